@@ -1191,6 +1191,47 @@ unsigned int Logic::unit_size() const
 	return _structure->unitsize;
 }
 
+shared_ptr<LogicEdgeFinder> LogicEdgeFinder::create()
+{
+	return shared_ptr<LogicEdgeFinder>{new LogicEdgeFinder{},
+		default_delete<LogicEdgeFinder>{}};
+}
+
+LogicEdgeFinder::LogicEdgeFinder() :
+	_structure(sr_logic_edges_new())
+{
+}
+
+LogicEdgeFinder::~LogicEdgeFinder()
+{
+	sr_logic_edges_free(_structure);
+}
+
+void LogicEdgeFinder::reset()
+{
+	sr_logic_edges_reset(_structure);
+}
+
+vector<LogicEdge> LogicEdgeFinder::find(shared_ptr<Logic> logic)
+{
+	const struct sr_logic_edge *edges;
+	size_t num_edges;
+
+	check(sr_logic_edges_find(_structure, logic->_structure,
+		&edges, &num_edges));
+
+	const size_t unitsize = logic->_structure->unitsize;
+	vector<LogicEdge> result;
+	result.reserve(num_edges);
+	for (size_t i = 0; i < num_edges; i++) {
+		result.push_back(LogicEdge{edges[i].sample,
+			vector<uint8_t>(edges[i].changed, edges[i].changed + unitsize),
+			vector<uint8_t>(edges[i].value, edges[i].value + unitsize)});
+	}
+
+	return result;
+}
+
 Analog::Analog(const struct sr_datafeed_analog *structure) :
 	PacketPayload(),
 	_structure(structure)
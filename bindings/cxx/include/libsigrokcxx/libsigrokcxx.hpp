@@ -112,6 +112,7 @@ class SR_API ChannelType;
 class SR_API Packet;
 class SR_API PacketPayload;
 class SR_API PacketType;
+class SR_API LogicEdgeFinder;
 class SR_API Quantity;
 class SR_API Unit;
 class SR_API QuantityFlag;
@@ -757,6 +758,36 @@ private:
 	const struct sr_datafeed_logic *_structure;
 
 	friend class Packet;
+	friend class LogicEdgeFinder;
+};
+
+/** A change on one or more logic channels */
+struct SR_API LogicEdge
+{
+	/** Number of the sample at which the change happened. */
+	uint64_t sample;
+	/** Channels that changed, one bit per channel, laid out like a sample. */
+	vector<uint8_t> changed;
+	/** Value of all channels from this sample on. */
+	vector<uint8_t> value;
+};
+
+/** Finds the edges in a stream of logic packets */
+class SR_API LogicEdgeFinder : public UserOwned<LogicEdgeFinder>
+{
+public:
+	/** Create a new edge finder. */
+	static shared_ptr<LogicEdgeFinder> create();
+	/** Start over, the next payload begins a new stream. */
+	void reset();
+	/** Find the edges in a logic payload.
+	 * @param logic Logic payload, following the one passed last. */
+	vector<LogicEdge> find(shared_ptr<Logic> logic);
+private:
+	LogicEdgeFinder();
+	~LogicEdgeFinder();
+	struct sr_logic_edges *_structure;
+	friend struct std::default_delete<LogicEdgeFinder>;
 };
 
 /** Payload of a datafeed packet with analog data */
@@ -65,6 +65,7 @@ template< class T > class enable_shared_from_this;
 %shared_ptr(sigrok::Meta);
 %shared_ptr(sigrok::Analog);
 %shared_ptr(sigrok::Logic);
+%shared_ptr(sigrok::LogicEdgeFinder);
 %shared_ptr(sigrok::InputFormat);
 %shared_ptr(sigrok::Input);
 %shared_ptr(sigrok::InputDevice);
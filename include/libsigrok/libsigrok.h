@@ -496,6 +496,25 @@ struct sr_datafeed_logic {
 	void *data;
 };
 
+/**
+ * A change on one or more logic channels, as found by sr_logic_edges_find().
+ *
+ * @since 0.5.0
+ */
+struct sr_logic_edge {
+	/** Number of the sample at which the change happened, counted from
+	 *  the first sample passed to sr_logic_edges_find(). */
+	uint64_t sample;
+	/** The channels that changed, one bit per channel, laid out like a
+	 *  sample in SR_DF_LOGIC (unitsize bytes). */
+	const uint8_t *changed;
+	/** The value of all channels from this sample on (unitsize bytes). */
+	const uint8_t *value;
+};
+
+/** Opaque state for extracting edges from a stream of logic packets. */
+struct sr_logic_edges;
+
 /** Analog datafeed payload for type SR_DF_ANALOG_OLD. */
 struct sr_datafeed_analog_old {
 	/** The channels for which data is included in this packet. */
@@ -1020,6 +1039,38 @@ enum sr_configkey {
 	/** Number of powerline cycles for ADC integration time. */
 	SR_CONF_ADC_POWERLINE_CYCLES,
 
+	/**
+	 * Range of samples to replay from a session file, as the first
+	 * sample and the sample to stop at. A stop sample of 0 replays
+	 * up to the end of the file.
+	 */
+	SR_CONF_REPLAY_SAMPLES,
+
+	/**
+	 * Range of time to replay from a session file, in seconds since
+	 * the start of the capture. A stop time of 0 replays up to the
+	 * end of the file.
+	 */
+	SR_CONF_REPLAY_TIME,
+
+	/** Number of USB transfers kept in flight during acquisition. */
+	SR_CONF_NUM_TRANSFERS,
+
+	/**
+	 * Service USB events on a dedicated thread, instead of from the
+	 * session's main loop.
+	 */
+	SR_CONF_EVENT_THREAD,
+
+	/**
+	 * Generate data as fast as possible, instead of at the pace of
+	 * the samplerate.
+	 */
+	SR_CONF_MAX_THROUGHPUT,
+
+	/** Size of each USB transfer during acquisition, in bytes. */
+	SR_CONF_TRANSFER_SIZE,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Acquisition modes, sample limiting ----------------------------*/
@@ -1163,6 +1214,13 @@ struct sr_dev_driver {
 	/* Dynamic */
 	/** Device driver context, considered private. Initialized by init(). */
 	void *context;
+
+	/* Hotplug */
+	/** Tell whether a USB device with these IDs may be handled by the
+	 *  driver, so it can be probed when it's plugged in.
+	 *  NULL if the driver doesn't take part in USB hotplug.
+	 *  @see sr_hotplug_start(). */
+	gboolean (*usb_match) (uint16_t vendor_id, uint16_t product_id);
 };
 
 /** Serial port descriptor. */
@@ -33,12 +33,23 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 SR_API int sr_analog_unit_to_string(const struct sr_datafeed_analog *analog,
 		char **result);
 SR_API void sr_rational_set(struct sr_rational *r, int64_t p, uint64_t q);
+SR_API int sr_rational_mult(struct sr_rational *res, const struct sr_rational *a,
+		const struct sr_rational *b);
 
 /*--- backend.c -------------------------------------------------------------*/
 
 SR_API int sr_init(struct sr_context **ctx);
 SR_API int sr_exit(struct sr_context *ctx);
 
+/*--- logic.c ---------------------------------------------------------------*/
+
+SR_API struct sr_logic_edges *sr_logic_edges_new(void);
+SR_API void sr_logic_edges_free(struct sr_logic_edges *edges);
+SR_API void sr_logic_edges_reset(struct sr_logic_edges *edges);
+SR_API int sr_logic_edges_find(struct sr_logic_edges *edges,
+		const struct sr_datafeed_logic *logic,
+		const struct sr_logic_edge **result, size_t *num_edges);
+
 /*--- log.c -----------------------------------------------------------------*/
 
 typedef int (*sr_log_callback)(void *cb_data, int loglevel,
@@ -100,6 +111,24 @@ SR_API int sr_config_list(const struct sr_dev_driver *driver,
 SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key);
 SR_API const struct sr_key_info *sr_key_info_name_get(int keytype, const char *keyid);
 
+/*--- hotplug.c -------------------------------------------------------------*/
+
+typedef void (*sr_hotplug_callback)(struct sr_context *ctx, gboolean arrived,
+		GSList *devices, void *cb_data);
+
+SR_API int sr_hotplug_start(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, sr_hotplug_callback cb,
+		void *cb_data);
+SR_API int sr_hotplug_stop(struct sr_context *ctx);
+SR_API GSList *sr_hotplug_dev_list(struct sr_context *ctx);
+
+/*--- scan.c ----------------------------------------------------------------*/
+
+SR_API GSList *sr_driver_scan_parallel(struct sr_dev_driver **drivers,
+		GSList *options, int max_threads, unsigned int timeout_ms);
+SR_API int sr_scan_cache_set_file(struct sr_context *ctx,
+		const char *filename);
+
 /*--- session.c -------------------------------------------------------------*/
 
 typedef void (*sr_session_stopped_callback)(void *data);
@@ -134,6 +163,12 @@ SR_API int sr_session_is_running(struct sr_session *session);
 SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 		sr_session_stopped_callback cb, void *cb_data);
 
+/*--- session_record.c ------------------------------------------------------*/
+
+SR_API int sr_session_record_start(struct sr_session *session,
+		const char *filename, uint64_t limit_samples);
+SR_API int sr_session_record_stop(struct sr_session *session);
+
 /*--- input/input.c ---------------------------------------------------------*/
 
 SR_API const struct sr_input_module **sr_input_list(void);
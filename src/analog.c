@@ -173,7 +173,7 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *outbuf)
 {
 	float offset;
-	unsigned int b, i, count;
+	unsigned int i, count;
 	gboolean bigendian;
 
 	if (!analog || !(analog->data) || !(analog->meaning)
@@ -272,20 +272,35 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		/* The data is already in the right format. */
 		memcpy(outbuf, analog->data, count * sizeof(float));
 	} else {
-		for (i = 0; i < count; i += analog->encoding->unitsize) {
-			for (b = 0; b < analog->encoding->unitsize; b++) {
-				if (analog->encoding->is_bigendian == bigendian)
-					((uint8_t *)outbuf)[i + b] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
+		const uint8_t *data = analog->data;
+		gboolean is_bigendian = analog->encoding->is_bigendian;
+		float scale = analog->encoding->scale.p / (float)analog->encoding->scale.q;
+		union { uint64_t u; double d; } d;
+
+		offset = analog->encoding->offset.p / (float)analog->encoding->offset.q;
+		switch (analog->encoding->unitsize) {
+		case sizeof(float):
+			for (i = 0; i < count; i++) {
+				if (is_bigendian)
+					outbuf[i] = RBFL(data + i * sizeof(float));
 				else
-					((uint8_t *)outbuf)[i + (analog->encoding->unitsize - b)] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
+					outbuf[i] = RLFL(data + i * sizeof(float));
+				outbuf[i] = scale * outbuf[i] + offset;
 			}
-			if (analog->encoding->scale.p != 1
-					|| analog->encoding->scale.q != 1)
-				outbuf[i] = (outbuf[i] * analog->encoding->scale.p) / analog->encoding->scale.q;
-			offset = ((float)analog->encoding->offset.p / (float)analog->encoding->offset.q);
-			outbuf[i] += offset;
+			break;
+		case sizeof(double):
+			for (i = 0; i < count; i++) {
+				if (is_bigendian)
+					d.u = RB64(data + i * sizeof(double));
+				else
+					d.u = RL64(data + i * sizeof(double));
+				outbuf[i] = scale * d.d + offset;
+			}
+			break;
+		default:
+			sr_err("Unsupported unit size '%d' for analog-to-float conversion.",
+				analog->encoding->unitsize);
+			return SR_ERR;
 		}
 	}
 
@@ -354,4 +369,75 @@ SR_API void sr_rational_set(struct sr_rational *r, int64_t p, uint64_t q)
 	r->q = q;
 }
 
+static uint64_t gcd_u64(uint64_t a, uint64_t b)
+{
+	uint64_t t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * Multiply two sr_rational values.
+ *
+ * The factors are reduced by their common divisors first, so the result
+ * only overflows when it can not be represented at all.
+ *
+ * @param[out] res Result. Must not be NULL. May be the same as @a a or @a b.
+ * @param[in] a First factor. Must not be NULL.
+ * @param[in] b Second factor. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the result would overflow.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_rational_mult(struct sr_rational *res, const struct sr_rational *a,
+		const struct sr_rational *b)
+{
+	uint64_t ap, bp, aq, bq, g, p, q;
+	gboolean negative;
+
+	if (!res || !a || !b || !a->q || !b->q)
+		return SR_ERR_ARG;
+
+	/* Avoid negating INT64_MIN. */
+	if (a->p == INT64_MIN || b->p == INT64_MIN)
+		return SR_ERR_ARG;
+
+	negative = (a->p < 0) != (b->p < 0);
+	ap = (a->p < 0) ? -a->p : a->p;
+	bp = (b->p < 0) ? -b->p : b->p;
+	aq = a->q;
+	bq = b->q;
+
+	if (!ap || !bp) {
+		res->p = 0;
+		res->q = 1;
+		return SR_OK;
+	}
+
+	g = gcd_u64(ap, bq);
+	ap /= g;
+	bq /= g;
+	g = gcd_u64(bp, aq);
+	bp /= g;
+	aq /= g;
+
+	if (ap > INT64_MAX / bp || aq > UINT64_MAX / bq)
+		return SR_ERR_ARG;
+	p = ap * bp;
+	q = aq * bq;
+
+	res->p = negative ? -(int64_t)p : (int64_t)p;
+	res->q = q;
+
+	return SR_OK;
+}
+
 /** @} */
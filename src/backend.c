@@ -526,6 +526,7 @@ SR_API int sr_init(struct sr_context **ctx)
 		ret = SR_ERR;
 		goto done;
 	}
+	sr_usb_shim_init();
 #endif
 	sr_resource_set_hooks(context, NULL, NULL, NULL, NULL);
 
@@ -557,13 +558,16 @@ SR_API int sr_exit(struct sr_context *ctx)
 		return SR_ERR;
 	}
 
+	sr_hotplug_stop(ctx);
 	sr_hw_cleanup_all(ctx);
+	sr_scan_cache_free(ctx);
 
 #ifdef _WIN32
 	WSACleanup();
 #endif
 
 #ifdef HAVE_LIBUSB_1_0
+	sr_usb_shim_exit();
 	libusb_exit(ctx->libusb_ctx);
 #endif
 
@@ -36,3 +36,33 @@ SR_API void sr_serial_free(struct sr_serial_port *serial)
 }
 
 #endif
+
+#ifndef HAVE_LIBUSB_1_0
+
+SR_API int sr_hotplug_start(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, sr_hotplug_callback cb,
+		void *cb_data)
+{
+	(void)ctx;
+	(void)drivers;
+	(void)cb;
+	(void)cb_data;
+
+	return SR_ERR_NA;
+}
+
+SR_API int sr_hotplug_stop(struct sr_context *ctx)
+{
+	(void)ctx;
+
+	return SR_OK;
+}
+
+SR_API GSList *sr_hotplug_dev_list(struct sr_context *ctx)
+{
+	(void)ctx;
+
+	return NULL;
+}
+
+#endif
@@ -35,6 +35,10 @@
 
 /* The size in bytes of chunks to send through the session bus. */
 #define LOGIC_BUFSIZE        4096
+/* Upper bound for the configurable chunk size. */
+#define MAX_LOGIC_BUFSIZE    (16 * 1024 * 1024)
+/* Number of chunks to send per round in maximum throughput mode. */
+#define MAX_THROUGHPUT_CHUNKS 16
 /* Size of the analog pattern space per channel. */
 #define ANALOG_BUFSIZE       4096
 
@@ -117,7 +121,18 @@ struct dev_context {
 	unsigned int logic_unitsize;
 	/* There is only ever one logic channel group, so its pattern goes here. */
 	uint8_t logic_pattern;
-	unsigned char logic_data[LOGIC_BUFSIZE];
+	uint64_t logic_bufsize;
+	uint64_t logic_chunk_samples;
+	uint8_t *logic_data;
+	/* One period of the pattern, plus a chunk to copy from its end. */
+	uint8_t *logic_table;
+	uint64_t logic_period;
+	uint64_t random_state;
+	gboolean max_throughput;
+	/* Soft trigger, samples before it are held back until it fires. */
+	uint64_t capture_ratio;
+	struct soft_trigger_logic *stl;
+	gboolean trigger_fired;
 	/* Analog */
 	int32_t num_analog_channels;
 	GHashTable *ch_ag;
@@ -143,6 +158,18 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_AVERAGING | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_AVG_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_BUFFERSIZE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_MAX_THROUGHPUT | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
+	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+};
+
+static const int32_t trigger_matches[] = {
+	SR_TRIGGER_ZERO,
+	SR_TRIGGER_ONE,
+	SR_TRIGGER_RISING,
+	SR_TRIGGER_FALLING,
+	SR_TRIGGER_EDGE,
 };
 
 static const uint32_t devopts_cg_logic[] = {
@@ -293,6 +320,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devc->num_logic_channels = num_logic_channels;
 	devc->logic_unitsize = (devc->num_logic_channels + 7) / 8;
 	devc->logic_pattern = PATTERN_SIGROK;
+	devc->logic_bufsize = LOGIC_BUFSIZE;
 	devc->num_analog_channels = num_analog_channels;
 
 	if (num_logic_channels > 0) {
@@ -308,6 +336,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	}
 
 	/* Analog channels, channel groups and pattern generators. */
+	devc->ch_ag = g_hash_table_new(g_direct_hash, g_direct_equal);
 	if (num_analog_channels > 0) {
 		pattern = 0;
 		/* An "Analog" channel group with all analog channels in it. */
@@ -315,7 +344,6 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		acg->name = g_strdup("Analog");
 		sdi->channel_groups = g_slist_append(sdi->channel_groups, acg);
 
-		devc->ch_ag = g_hash_table_new(g_direct_hash, g_direct_equal);
 		for (i = 0; i < num_analog_channels; i++) {
 			snprintf(channel_name, 16, "A%d", i);
 			ch = sr_channel_new(sdi, i + num_logic_channels, SR_CHANNEL_ANALOG,
@@ -380,6 +408,8 @@ static void clear_helper(void *priv)
 	while (g_hash_table_iter_next(&iter, NULL, &value))
 		g_free(value);
 	g_hash_table_unref(devc->ch_ag);
+	g_free(devc->logic_data);
+	g_free(devc->logic_table);
 	g_free(devc);
 }
 
@@ -416,6 +446,15 @@ static int config_get(uint32_t key, GVariant **data, const struct sr_dev_inst *s
 	case SR_CONF_AVG_SAMPLES:
 		*data = g_variant_new_uint64(devc->avg_samples);
 		break;
+	case SR_CONF_BUFFERSIZE:
+		*data = g_variant_new_uint64(devc->logic_bufsize);
+		break;
+	case SR_CONF_MAX_THROUGHPUT:
+		*data = g_variant_new_boolean(devc->max_throughput);
+		break;
+	case SR_CONF_CAPTURE_RATIO:
+		*data = g_variant_new_uint64(devc->capture_ratio);
+		break;
 	case SR_CONF_PATTERN_MODE:
 		if (!cg)
 			return SR_ERR_CHANNEL_GROUP;
@@ -485,6 +524,22 @@ static int config_set(uint32_t key, GVariant *data, const struct sr_dev_inst *sd
 		devc->avg_samples = g_variant_get_uint64(data);
 		sr_dbg("Setting averaging rate to %" PRIu64, devc->avg_samples);
 		break;
+	case SR_CONF_BUFFERSIZE:
+		if (g_variant_get_uint64(data) < 1
+				|| g_variant_get_uint64(data) > MAX_LOGIC_BUFSIZE)
+			return SR_ERR_ARG;
+		devc->logic_bufsize = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_MAX_THROUGHPUT:
+		devc->max_throughput = g_variant_get_boolean(data);
+		sr_dbg("%s maximum throughput", devc->max_throughput ?
+				"Enabling" : "Disabling");
+		break;
+	case SR_CONF_CAPTURE_RATIO:
+		if (g_variant_get_uint64(data) > 100)
+			return SR_ERR_ARG;
+		devc->capture_ratio = g_variant_get_uint64(data);
+		break;
 	case SR_CONF_PATTERN_MODE:
 		if (!cg)
 			return SR_ERR_CHANNEL_GROUP;
@@ -512,11 +567,6 @@ static int config_set(uint32_t key, GVariant *data, const struct sr_dev_inst *sd
 				sr_dbg("Setting logic pattern to %s",
 						logic_pattern_str[logic_pattern]);
 				devc->logic_pattern = logic_pattern;
-				/* Might as well do this now, these are static. */
-				if (logic_pattern == PATTERN_ALL_LOW)
-					memset(devc->logic_data, 0x00, LOGIC_BUFSIZE);
-				else if (logic_pattern == PATTERN_ALL_HIGH)
-					memset(devc->logic_data, 0xff, LOGIC_BUFSIZE);
 			} else if (ch->type == SR_CHANNEL_ANALOG) {
 				if (analog_pattern == -1)
 					return SR_ERR_ARG;
@@ -581,6 +631,11 @@ static int config_list(uint32_t key, GVariant **data, const struct sr_dev_inst *
 			g_variant_builder_add(&gvb, "{sv}", "samplerate-steps", gvar);
 			*data = g_variant_builder_end(&gvb);
 			break;
+		case SR_CONF_TRIGGER_MATCH:
+			*data = g_variant_new_fixed_array(G_VARIANT_TYPE_INT32,
+					trigger_matches, ARRAY_SIZE(trigger_matches),
+					sizeof(int32_t));
+			break;
 		default:
 			return SR_ERR_NA;
 		}
@@ -627,47 +682,149 @@ static int config_list(uint32_t key, GVariant **data, const struct sr_dev_inst *
 	return SR_OK;
 }
 
-static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
+/*
+ * All patterns except the random one repeat after a few samples. One
+ * period of them is computed up front, followed by the start of the next
+ * periods, so that a chunk starting anywhere in the period can be copied
+ * out in one go.
+ */
+static void logic_table_init(struct dev_context *devc)
 {
-	struct dev_context *devc;
-	uint64_t i, j;
-	uint8_t pat;
+	uint64_t num_samples, i;
+	unsigned int j;
+	uint8_t *p;
 
-	devc = sdi->priv;
+	g_free(devc->logic_data);
+	g_free(devc->logic_table);
+	devc->logic_table = NULL;
+
+	devc->logic_chunk_samples = MAX(devc->logic_bufsize
+			/ MAX(devc->logic_unitsize, 1), 1);
+	devc->logic_data = g_malloc(devc->logic_chunk_samples
+			* devc->logic_unitsize);
+	devc->random_state = 0x2545f4914f6cdd1dULL;
 
 	switch (devc->logic_pattern) {
 	case PATTERN_SIGROK:
-		memset(devc->logic_data, 0x00, size);
-		for (i = 0; i < size; i += devc->logic_unitsize) {
-			for (j = 0; j < devc->logic_unitsize; j++) {
-				pat = pattern_sigrok[(devc->step + j) % sizeof(pattern_sigrok)] >> 1;
-				devc->logic_data[i + j] = ~pat;
-			}
-			devc->step++;
-		}
-		break;
-	case PATTERN_RANDOM:
-		for (i = 0; i < size; i++)
-			devc->logic_data[i] = (uint8_t)(rand() & 0xff);
+		devc->logic_period = sizeof(pattern_sigrok);
 		break;
 	case PATTERN_INC:
-		for (i = 0; i < size; i++) {
-			for (j = 0; j < devc->logic_unitsize; j++) {
-				devc->logic_data[i + j] = devc->step;
-			}
-			devc->step++;
-		}
+		devc->logic_period = 256;
 		break;
 	case PATTERN_ALL_LOW:
 	case PATTERN_ALL_HIGH:
-		/* These were set when the pattern mode was selected. */
+		devc->logic_period = 1;
 		break;
 	default:
-		sr_err("Unknown pattern: %d.", devc->logic_pattern);
-		break;
+		devc->logic_period = 0;
+		return;
+	}
+
+	num_samples = devc->logic_period + devc->logic_chunk_samples;
+	devc->logic_table = g_malloc(num_samples * devc->logic_unitsize);
+	for (i = 0; i < num_samples; i++) {
+		p = devc->logic_table + i * devc->logic_unitsize;
+		for (j = 0; j < devc->logic_unitsize; j++) {
+			switch (devc->logic_pattern) {
+			case PATTERN_SIGROK:
+				p[j] = ~(pattern_sigrok[(i + j) % sizeof(pattern_sigrok)] >> 1);
+				break;
+			case PATTERN_INC:
+				p[j] = i;
+				break;
+			case PATTERN_ALL_LOW:
+				p[j] = 0x00;
+				break;
+			case PATTERN_ALL_HIGH:
+				p[j] = 0xff;
+				break;
+			}
+		}
 	}
 }
 
+/* Marsaglia's xorshift64, eight random bytes per step. */
+static inline uint64_t xorshift64(uint64_t *state)
+{
+	uint64_t x;
+
+	x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+
+	return x;
+}
+
+static void logic_generator(struct sr_dev_inst *sdi, uint64_t size)
+{
+	struct dev_context *devc;
+	uint64_t i, r;
+
+	devc = sdi->priv;
+
+	if (devc->logic_pattern == PATTERN_RANDOM) {
+		for (i = 0; i + sizeof(r) <= size; i += sizeof(r)) {
+			r = xorshift64(&devc->random_state);
+			memcpy(devc->logic_data + i, &r, sizeof(r));
+		}
+		if (i < size) {
+			r = xorshift64(&devc->random_state);
+			memcpy(devc->logic_data + i, &r, size - i);
+		}
+		return;
+	}
+
+	memcpy(devc->logic_data, devc->logic_table
+			+ devc->step % devc->logic_period * devc->logic_unitsize, size);
+	devc->step += size / devc->logic_unitsize;
+}
+
+/*
+ * Send the generated logic samples. With a trigger, they go to the soft
+ * trigger until it fires, which sends the samples it held back first.
+ * Returns the number of samples sent, those held back don't count.
+ */
+static uint64_t send_logic_packet(struct sr_dev_inst *sdi,
+		uint64_t num_samples)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t sent;
+	int offset, pre_trigger_samples;
+
+	devc = sdi->priv;
+
+	sent = 0;
+	offset = 0;
+	if (!devc->trigger_fired) {
+		offset = soft_trigger_logic_check(devc->stl, devc->logic_data,
+				num_samples * devc->logic_unitsize,
+				&pre_trigger_samples);
+		if (offset < 0)
+			return 0;
+		devc->trigger_fired = TRUE;
+		sent = pre_trigger_samples;
+		num_samples -= offset;
+	}
+
+	if (devc->limit_samples > 0)
+		num_samples = MIN(num_samples, devc->limit_samples
+				- MIN(devc->limit_samples, devc->sent_samples + sent));
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = num_samples * devc->logic_unitsize;
+	logic.unitsize = devc->logic_unitsize;
+	logic.data = devc->logic_data + offset * devc->logic_unitsize;
+	if (num_samples > 0)
+		sr_session_send(sdi, &packet);
+
+	return sent + num_samples;
+}
+
 static void send_analog_packet(struct analog_gen *ag,
 			       struct sr_dev_inst *sdi,
 			       uint64_t *analog_sent,
@@ -734,11 +891,11 @@ static int prepare_data(int fd, int revents, void *cb_data)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 	struct analog_gen *ag;
 	GHashTableIter iter;
 	void *value;
-	uint64_t samples_todo, logic_done, analog_done, analog_sent, sending_now;
+	uint64_t samples_todo, logic_done, logic_sent, analog_done, analog_sent;
+	uint64_t sending_now;
 	int64_t elapsed_us, limit_us, todo_us;
 
 	(void)fd;
@@ -763,9 +920,14 @@ static int prepare_data(int fd, int revents, void *cb_data)
 	else
 		todo_us = MAX(0, elapsed_us - devc->spent_us);
 
-	/* How many samples are outstanding since the last round? */
-	samples_todo = (todo_us * devc->cur_samplerate + G_USEC_PER_SEC - 1)
-			/ G_USEC_PER_SEC;
+	if (devc->max_throughput) {
+		/* As much as the session takes, time is only a limit. */
+		samples_todo = MAX_THROUGHPUT_CHUNKS * devc->logic_chunk_samples;
+	} else {
+		/* How many samples are outstanding since the last round? */
+		samples_todo = (todo_us * devc->cur_samplerate + G_USEC_PER_SEC - 1)
+				/ G_USEC_PER_SEC;
+	}
 	if (devc->limit_samples > 0) {
 		if (devc->limit_samples < devc->sent_samples)
 			samples_todo = 0;
@@ -776,23 +938,20 @@ static int prepare_data(int fd, int revents, void *cb_data)
 	 * count, rounded towards zero. This avoids getting stuck on a too-low
 	 * time delta with no samples being sent due to round-off.
 	 */
-	todo_us = samples_todo * G_USEC_PER_SEC / devc->cur_samplerate;
+	if (!devc->max_throughput)
+		todo_us = samples_todo * G_USEC_PER_SEC / devc->cur_samplerate;
 
 	logic_done  = devc->num_logic_channels  > 0 ? 0 : samples_todo;
+	logic_sent = 0;
 	analog_done = devc->num_analog_channels > 0 ? 0 : samples_todo;
 
 	while (logic_done < samples_todo || analog_done < samples_todo) {
 		/* Logic */
 		if (logic_done < samples_todo) {
 			sending_now = MIN(samples_todo - logic_done,
-					LOGIC_BUFSIZE / devc->logic_unitsize);
+					devc->logic_chunk_samples);
 			logic_generator(sdi, sending_now * devc->logic_unitsize);
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = sending_now * devc->logic_unitsize;
-			logic.unitsize = devc->logic_unitsize;
-			logic.data = devc->logic_data;
-			sr_session_send(sdi, &packet);
+			logic_sent += send_logic_packet(sdi, sending_now);
 			logic_done += sending_now;
 		}
 
@@ -816,7 +975,8 @@ static int prepare_data(int fd, int revents, void *cb_data)
 		sr_err("BUG: Sample count mismatch.");
 		return G_SOURCE_REMOVE;
 	}
-	devc->sent_samples += samples_todo;
+	/* Samples held back for the trigger don't count towards the limit. */
+	devc->sent_samples += devc->stl ? logic_sent : samples_todo;
 	devc->spent_us += todo_us;
 
 	if ((devc->limit_samples > 0 && devc->sent_samples >= devc->limit_samples)
@@ -844,8 +1004,10 @@ static int prepare_data(int fd, int revents, void *cb_data)
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	struct sr_trigger *trigger;
 	GHashTableIter iter;
 	void *value;
+	int pre_trigger_samples;
 
 	if (sdi->status != SR_ST_ACTIVE)
 		return SR_ERR_DEV_CLOSED;
@@ -853,11 +1015,37 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 	devc->sent_samples = 0;
 
+	logic_table_init(devc);
+
+	devc->trigger_fired = TRUE;
+	if ((trigger = sr_session_trigger_get(sdi->session))) {
+		pre_trigger_samples = 0;
+		if (devc->limit_samples > 0)
+			pre_trigger_samples = devc->capture_ratio
+					* devc->limit_samples / 100;
+		devc->stl = soft_trigger_logic_new(sdi, trigger,
+				pre_trigger_samples);
+		if (!devc->stl)
+			return SR_ERR_MALLOC;
+		/*
+		 * The soft trigger counts the analog channels into its
+		 * unit size, the logic samples generated here don't.
+		 */
+		if (devc->stl->unitsize != devc->logic_unitsize) {
+			sr_err("Triggers need a device without analog channels.");
+			soft_trigger_logic_free(devc->stl);
+			devc->stl = NULL;
+			return SR_ERR_NA;
+		}
+		devc->trigger_fired = FALSE;
+	}
+
 	g_hash_table_iter_init(&iter, devc->ch_ag);
 	while (g_hash_table_iter_next(&iter, NULL, &value))
 		generate_analog_pattern(value, devc->cur_samplerate);
 
-	sr_session_source_add(sdi->session, -1, 0, 100,
+	sr_session_source_add(sdi->session, -1, 0,
+			devc->max_throughput ? 0 : 100,
 			prepare_data, (struct sr_dev_inst *)sdi);
 
 	std_session_send_df_header(sdi, LOG_PREFIX);
@@ -871,10 +1059,19 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
 	sr_dbg("Stopping acquisition.");
 	sr_session_source_remove(sdi->session, -1);
 	std_session_send_df_end(sdi, LOG_PREFIX);
 
+	if (devc->stl) {
+		soft_trigger_logic_free(devc->stl);
+		devc->stl = NULL;
+	}
+
 	return SR_OK;
 }
 
@@ -132,6 +132,9 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_NUM_TRANSFERS | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_EVENT_THREAD | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const uint32_t dslogic_devopts[] = {
@@ -423,6 +426,19 @@ static int dev_clear(const struct sr_dev_driver *di)
 	return std_dev_clear(di, clear_dev_context);
 }
 
+static gboolean usb_match(uint16_t vendor_id, uint16_t product_id)
+{
+	int i;
+
+	for (i = 0; supported_fx2[i].vid; i++) {
+		if (vendor_id == supported_fx2[i].vid
+				&& product_id == supported_fx2[i].pid)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 static int dev_open(struct sr_dev_inst *sdi)
 {
 	struct sr_dev_driver *di = sdi->driver;
@@ -576,6 +592,15 @@ static int config_get(uint32_t key, GVariant **data, const struct sr_dev_inst *s
 	case SR_CONF_CAPTURE_RATIO:
 		*data = g_variant_new_uint64(devc->capture_ratio);
 		break;
+	case SR_CONF_NUM_TRANSFERS:
+		*data = g_variant_new_uint64(devc->cfg_num_transfers);
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		*data = g_variant_new_uint64(devc->cfg_transfer_size);
+		break;
+	case SR_CONF_EVENT_THREAD:
+		*data = g_variant_new_boolean(devc->event_thread);
+		break;
 	case SR_CONF_EXTERNAL_CLOCK:
 		*data = g_variant_new_boolean(devc->dslogic_external_clock);
 		break;
@@ -656,6 +681,23 @@ static int config_set(uint32_t key, GVariant *data, const struct sr_dev_inst *sd
 		devc->capture_ratio = g_variant_get_uint64(data);
 		ret = (devc->capture_ratio > 100) ? SR_ERR : SR_OK;
 		break;
+	case SR_CONF_NUM_TRANSFERS:
+		/* 0 keeps about 500ms of data in flight. */
+		arg = g_variant_get_uint64(data);
+		if (arg > MAX_NUM_TRANSFERS)
+			return SR_ERR_ARG;
+		devc->cfg_num_transfers = arg;
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		/* In bytes, 0 sizes it for 10ms of data. */
+		arg = g_variant_get_uint64(data);
+		if (arg > MAX_TRANSFER_SIZE)
+			return SR_ERR_ARG;
+		devc->cfg_transfer_size = arg;
+		break;
+	case SR_CONF_EVENT_THREAD:
+		devc->event_thread = g_variant_get_boolean(data);
+		break;
 	case SR_CONF_VOLTAGE_THRESHOLD:
 		g_variant_get(data, "(dd)", &low, &high);
 		ret = SR_ERR_ARG;
@@ -774,7 +816,7 @@ static int receive_data(int fd, int revents, void *cb_data)
 	drvc = (struct drv_context *)cb_data;
 
 	tv.tv_sec = tv.tv_usec = 0;
-	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
+	sr_usb_handle_events(drvc->sr_ctx->libusb_ctx, &tv, NULL);
 
 	return TRUE;
 }
@@ -789,6 +831,7 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	int endpoint, timeout, ret;
 	unsigned char *buf;
 	size_t size;
+	gboolean threaded;
 
 	devc = sdi->priv;
 	usb = sdi->conn;
@@ -831,29 +874,53 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		return SR_ERR_MALLOC;
 	}
 
+	threaded = devc->event_thread && !devc->dslogic;
+	if (threaded) {
+		if (fx2lafw_blocks_new(devc, num_transfers, size) != SR_OK) {
+			sr_err("USB transfer buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		for (i = 0; i < devc->num_blocks; i++)
+			devc->blocks[i].sdi = sdi;
+		if ((ret = fx2lafw_event_thread_start(sdi)) != SR_OK)
+			return ret;
+	}
+
 	timeout = fx2lafw_get_timeout(devc);
 	endpoint = devc->dslogic ? 6 : 2;
 	devc->num_transfers = num_transfers;
 	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
 		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				endpoint | LIBUSB_ENDPOINT_IN, buf, size,
-				fx2lafw_receive_transfer, (void *)sdi, timeout);
+		if (threaded) {
+			/* The buffer is owned by the block, not the transfer. */
+			buf = devc->blocks[i].data;
+			libusb_fill_bulk_transfer(transfer, usb->devhdl,
+					endpoint | LIBUSB_ENDPOINT_IN, buf, size,
+					fx2lafw_receive_transfer_threaded,
+					&devc->blocks[i], timeout);
+		} else {
+			if (!(buf = g_try_malloc(size))) {
+				sr_err("USB transfer buffer malloc failed.");
+				libusb_free_transfer(transfer);
+				return SR_ERR_MALLOC;
+			}
+			libusb_fill_bulk_transfer(transfer, usb->devhdl,
+					endpoint | LIBUSB_ENDPOINT_IN, buf, size,
+					fx2lafw_receive_transfer, (void *)sdi, timeout);
+		}
 		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_submit_transfer(transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
-			g_free(buf);
+			if (!threaded)
+				g_free(buf);
 			fx2lafw_abort_acquisition(devc);
 			return SR_ERR;
 		}
 		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
+		/* The USB event thread may already be retiring transfers. */
+		g_atomic_int_inc(&devc->submitted_transfers);
 	}
 
 	if (devc->profile->dev_caps & DEV_CAPS_AX_ANALOG)
@@ -931,7 +998,7 @@ static int dslogic_trigger_request(const struct sr_dev_inst *sdi)
 	libusb_fill_bulk_transfer(transfer, usb->devhdl, 6 | LIBUSB_ENDPOINT_IN,
 			(unsigned char *)tpos, sizeof(struct dslogic_trigger_pos),
 			dslogic_trigger_receive, (void *)sdi, 0);
-	if ((ret = libusb_submit_transfer(transfer)) < 0) {
+	if ((ret = sr_usb_submit_transfer(transfer)) < 0) {
 		sr_err("Failed to request trigger: %s.", libusb_error_name(ret));
 		libusb_free_transfer(transfer);
 		g_free(tpos);
@@ -1000,8 +1067,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	/* With the USB event thread the session source is added later on. */
 	timeout = fx2lafw_get_timeout(devc);
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
+	if (!devc->event_thread || devc->dslogic)
+		usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
 
 	if (devc->dslogic) {
 		dslogic_trigger_request(sdi);
@@ -1011,8 +1080,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		if (devc->profile->dev_caps & DEV_CAPS_AX_ANALOG) {
 			/* We need a buffer half the size of a transfer. */
 			devc->logic_buffer = g_try_malloc(size / 2);
-			devc->analog_buffer = g_try_malloc(
-				sizeof(float) * size / 2);
+			devc->analog_buffer = g_try_malloc(size / 2);
 		}
 		start_transfers(sdi);
 		if ((ret = fx2lafw_command_start_acquisition(sdi)) != SR_OK) {
@@ -1055,4 +1123,5 @@ SR_PRIV struct sr_dev_driver fx2lafw_driver_info = {
 	.dev_acquisition_start = dev_acquisition_start,
 	.dev_acquisition_stop = dev_acquisition_stop,
 	.context = NULL,
+	.usb_match = usb_match,
 };
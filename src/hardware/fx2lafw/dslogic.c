@@ -45,7 +45,7 @@ SR_PRIV int dslogic_set_vth(const struct sr_dev_inst *sdi, double vth)
 
 	cmd = vth/5.0 * 255;
 	/* Send the control command. */
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 	LIBUSB_ENDPOINT_OUT, DS_CMD_VTH, 0x0000, 0x0000,
 		(unsigned char *)&cmd, sizeof(cmd), 3000);
 	if (ret < 0) {
@@ -82,7 +82,7 @@ SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi,
 
 	/* Tell the device firmware is coming. */
 	memset(cmd, 0, sizeof(cmd));
-	if ((ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	if ((ret = sr_usb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_FPGA_FW, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), USB_TIMEOUT)) < 0) {
 		sr_err("Failed to upload FPGA firmware: %s.", libusb_error_name(ret));
@@ -104,7 +104,7 @@ SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi,
 		if (chunksize <= 0)
 			break;
 
-		if ((ret = libusb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
+		if ((ret = sr_usb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
 				buf, chunksize, &transferred, USB_TIMEOUT)) < 0) {
 			sr_err("Unable to configure FPGA firmware: %s.",
 					libusb_error_name(ret));
@@ -144,7 +144,7 @@ SR_PRIV int dslogic_start_acquisition(const struct sr_dev_inst *sdi)
 		mode.flags |= DS_START_FLAGS_SAMPLE_WIDE;
 
 	usb = sdi->conn;
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&mode, sizeof(mode), USB_TIMEOUT);
 	if (ret < 0) {
@@ -165,7 +165,7 @@ SR_PRIV int dslogic_stop_acquisition(const struct sr_dev_inst *sdi)
 	mode.sample_delay_h = mode.sample_delay_l = 0;
 
 	usb = sdi->conn;
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&mode, sizeof(struct dslogic_mode), USB_TIMEOUT);
 	if (ret < 0) {
@@ -318,7 +318,7 @@ SR_PRIV int dslogic_fpga_configure(const struct sr_dev_inst *sdi)
 	c[1] = (len >> 8) & 0xff;
 	c[2] = (len >> 16) & 0xff;
 
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_CONFIG, 0x0000, 0x0000,
 			c, 3, USB_TIMEOUT);
 	if (ret < 0) {
@@ -373,7 +373,7 @@ SR_PRIV int dslogic_fpga_configure(const struct sr_dev_inst *sdi)
 	dslogic_set_trigger(sdi, &cfg);
 
 	len = sizeof(struct dslogic_fpga_config);
-	ret = libusb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
+	ret = sr_usb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
 			(unsigned char *)&cfg, len, &transferred, USB_TIMEOUT);
 	if (ret < 0 || transferred != len) {
 		sr_err("Failed to send FPGA configuration: %s.", libusb_error_name(ret));
@@ -21,6 +21,11 @@
 #include <config.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <unistd.h>
+#if defined(_POSIX_THREAD_PRIORITY_SCHEDULING) && _POSIX_THREAD_PRIORITY_SCHEDULING > 0
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "protocol.h"
 #include "dslogic.h"
 
@@ -46,7 +51,7 @@ static int command_get_fw_version(libusb_device_handle *devhdl,
 {
 	int ret;
 
-	ret = libusb_control_transfer(devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 		LIBUSB_ENDPOINT_IN, CMD_GET_FW_VERSION, 0x0000, 0x0000,
 		(unsigned char *)vi, sizeof(struct version_info), USB_TIMEOUT);
 
@@ -67,7 +72,7 @@ static int command_get_revid_version(struct sr_dev_inst *sdi, uint8_t *revid)
 	int cmd, ret;
 
 	cmd = devc->dslogic ? DS_CMD_GET_REVID_VERSION : CMD_GET_REVID_VERSION;
-	ret = libusb_control_transfer(devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 		LIBUSB_ENDPOINT_IN, cmd, 0x0000, 0x0000, revid, 1, USB_TIMEOUT);
 
 	if (ret < 0) {
@@ -129,7 +134,7 @@ SR_PRIV int fx2lafw_command_start_acquisition(const struct sr_dev_inst *sdi)
 	cmd.flags |= (devc->profile->dev_caps & DEV_CAPS_AX_ANALOG) ? CMD_START_FLAGS_CLK_CTL2 : 0;
 
 	/* Send the control message. */
-	ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
+	ret = sr_usb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, CMD_START, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), USB_TIMEOUT);
 	if (ret < 0) {
@@ -317,14 +322,17 @@ SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc)
 {
 	int i;
 
-	devc->acq_aborted = TRUE;
+	/* The USB event thread may be checking this as well. */
+	g_atomic_int_set(&devc->acq_aborted, TRUE);
 
 	for (i = devc->num_transfers - 1; i >= 0; i--) {
 		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
+			sr_usb_cancel_transfer(devc->transfers[i]);
 	}
 }
 
+static void event_thread_stop(struct sr_dev_inst *sdi);
+
 static void finish_acquisition(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
@@ -333,7 +341,10 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	std_session_send_df_end(sdi, LOG_PREFIX);
 
-	usb_source_remove(sdi->session, devc->ctx);
+	if (devc->blocks)
+		event_thread_stop(sdi);
+	else
+		usb_source_remove(sdi->session, devc->ctx);
 
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
@@ -377,7 +388,7 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 {
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	if ((ret = sr_usb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
@@ -385,11 +396,26 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 
 }
 
+/* Gather the even bytes of a little-endian word into 32 bits. */
+static inline uint32_t even_bytes(uint64_t w)
+{
+	w &= 0x00ff00ff00ff00ffULL;
+	w = (w | (w >> 8)) & 0x0000ffff0000ffffULL;
+	w = (w | (w >> 16)) & 0x00000000ffffffffULL;
+
+	return w;
+}
+
 SR_PRIV void mso_send_data_proc(struct sr_dev_inst *sdi,
 	uint8_t *data, size_t length, size_t sample_width)
 {
 	size_t i;
+	uint64_t lo, hi;
 	struct dev_context *devc;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
 
 	(void)sample_width;
 
@@ -397,12 +423,22 @@ SR_PRIV void mso_send_data_proc(struct sr_dev_inst *sdi,
 
 	length /= 2;
 
-	/* Send the logic */
-	for (i = 0; i < length; i++) {
-		devc->logic_buffer[i]  = data[i * 2];
-		/* Rescale to -10V - +10V from 0-255. */
-		devc->analog_buffer[i] = data[i * 2 + 1] - 128.0f / 12.8f;
-	};
+	/*
+	 * Logic and ADC bytes alternate. Split them eight samples at a
+	 * time, the rest one by one.
+	 */
+	for (i = 0; i + 8 <= length; i += 8) {
+		lo = RL64(data + i * 2);
+		hi = RL64(data + i * 2 + 8);
+		WL32(devc->logic_buffer + i, even_bytes(lo));
+		WL32(devc->logic_buffer + i + 4, even_bytes(hi));
+		WL32(devc->analog_buffer + i, even_bytes(lo >> 8));
+		WL32(devc->analog_buffer + i + 4, even_bytes(hi >> 8));
+	}
+	for (; i < length; i++) {
+		devc->logic_buffer[i] = data[i * 2];
+		devc->analog_buffer[i] = data[i * 2 + 1];
+	}
 
 	const struct sr_datafeed_logic logic = {
 		.length = length,
@@ -417,17 +453,24 @@ SR_PRIV void mso_send_data_proc(struct sr_dev_inst *sdi,
 
 	sr_session_send(sdi, &logic_packet);
 
-	const struct sr_datafeed_analog_old analog = {
-		.channels = devc->enabled_analog_channels,
-		.num_samples = length,
-		.mq = SR_MQ_VOLTAGE,
-		.unit = SR_UNIT_VOLT,
-		.mqflags = 0 /*SR_MQFLAG_DC*/,
-		.data = devc->analog_buffer
-	};
+	/* The ADC samples are sent as they are, 0-255 maps to -10V - +10V. */
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+	encoding.unitsize = 1;
+	encoding.is_signed = FALSE;
+	encoding.is_float = FALSE;
+	encoding.scale.p = 5;
+	encoding.scale.q = 64;
+	encoding.offset.p = -10;
+	encoding.offset.q = 1;
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	meaning.mqflags = 0 /*SR_MQFLAG_DC*/;
+	meaning.channels = devc->enabled_analog_channels;
+	analog.num_samples = length;
+	analog.data = devc->analog_buffer;
 
 	const struct sr_datafeed_packet analog_packet = {
-		.type = SR_DF_ANALOG_OLD,
+		.type = SR_DF_ANALOG,
 		.payload = &analog
 	};
 
@@ -451,61 +494,34 @@ SR_PRIV void la_send_data_proc(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
-SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transfer)
+/*
+ * Handle the data of a completed transfer. Returns FALSE once the
+ * acquisition is over, because the device gave up or the sample limit
+ * was reached.
+ */
+static gboolean process_data(struct sr_dev_inst *sdi, uint8_t *buf,
+		int actual_length, gboolean packet_has_error)
 {
-	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	gboolean packet_has_error = FALSE;
 	struct sr_datafeed_packet packet;
 	unsigned int num_samples;
 	int trigger_offset, cur_sample_count, unitsize;
 	int pre_trigger_samples;
 
-	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	/*
-	 * If acquisition has already ended, just free any queued up
-	 * transfer that come in.
-	 */
-	if (devc->acq_aborted) {
-		free_transfer(transfer);
-		return;
-	}
-
-	sr_dbg("receive_transfer(): status %s received %d bytes.",
-		libusb_error_name(transfer->status), transfer->actual_length);
-
-	/* Save incoming transfer before reusing the transfer struct. */
 	unitsize = devc->sample_wide ? 2 : 1;
-	cur_sample_count = transfer->actual_length / unitsize;
+	cur_sample_count = actual_length / unitsize;
 
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		fx2lafw_abort_acquisition(devc);
-		free_transfer(transfer);
-		return;
-	case LIBUSB_TRANSFER_COMPLETED:
-	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
-		break;
-	default:
-		packet_has_error = TRUE;
-		break;
-	}
-
-	if (transfer->actual_length == 0 || packet_has_error) {
+	if (actual_length == 0 || packet_has_error) {
 		devc->empty_transfer_count++;
-		if (devc->empty_transfer_count > MAX_EMPTY_TRANSFERS) {
-			/*
-			 * The FX2 gave up. End the acquisition, the frontend
-			 * will work out that the samplecount is short.
-			 */
-			fx2lafw_abort_acquisition(devc);
-			free_transfer(transfer);
-		} else {
-			resubmit_transfer(transfer);
-		}
-		return;
+		/*
+		 * Once every transfer in flight came back empty twice, the
+		 * FX2 gave up. End the acquisition, the frontend will work
+		 * out that the samplecount is short.
+		 */
+		return devc->empty_transfer_count
+			<= 2 * (int)devc->num_transfers;
 	} else {
 		devc->empty_transfer_count = 0;
 	}
@@ -522,7 +538,7 @@ SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transf
 					/* dslogic trigger in this block. Send trigger position */
 					trigger_offset = devc->trigger_pos - devc->sent_samples;
 					/* pre-trigger samples */
-					devc->send_data_proc(sdi, (uint8_t *)transfer->buffer,
+					devc->send_data_proc(sdi, buf,
 						trigger_offset * unitsize, unitsize);
 					devc->sent_samples += trigger_offset;
 					/* trigger position */
@@ -532,18 +548,18 @@ SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transf
 					sr_session_send(sdi, &packet);
 					/* post trigger samples */
 					num_samples -= trigger_offset;
-					devc->send_data_proc(sdi, (uint8_t *)transfer->buffer
+					devc->send_data_proc(sdi, buf
 							+ trigger_offset * unitsize,	num_samples * unitsize, unitsize);
 					devc->sent_samples += num_samples;
 			}else{
-				devc->send_data_proc(sdi, (uint8_t *)transfer->buffer,
+				devc->send_data_proc(sdi, buf,
 					num_samples * unitsize, unitsize);
 				devc->sent_samples += num_samples;
 			}
 		}
 	} else {
 		trigger_offset = soft_trigger_logic_check(devc->stl,
-			transfer->buffer, transfer->actual_length, &pre_trigger_samples);
+			buf, actual_length, &pre_trigger_samples);
 		if (trigger_offset > -1) {
 			devc->sent_samples += pre_trigger_samples;
 			num_samples = cur_sample_count - trigger_offset;
@@ -551,7 +567,7 @@ SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transf
 					num_samples > devc->limit_samples - devc->sent_samples)
 				num_samples = devc->limit_samples - devc->sent_samples;
 
-			devc->send_data_proc(sdi, (uint8_t *)transfer->buffer
+			devc->send_data_proc(sdi, buf
 					+ trigger_offset * unitsize,
 					num_samples * unitsize, unitsize);
 			devc->sent_samples += num_samples;
@@ -560,11 +576,315 @@ SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transf
 		}
 	}
 
-	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
+	return !devc->limit_samples || devc->sent_samples < devc->limit_samples;
+}
+
+SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	gboolean packet_has_error = FALSE;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	/*
+	 * If acquisition has already ended, just free any queued up
+	 * transfer that come in.
+	 */
+	if (devc->acq_aborted) {
+		free_transfer(transfer);
+		return;
+	}
+
+	sr_dbg("receive_transfer(): status %s received %d bytes.",
+		libusb_error_name(transfer->status), transfer->actual_length);
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_NO_DEVICE:
 		fx2lafw_abort_acquisition(devc);
 		free_transfer(transfer);
-	} else
+		return;
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
+		break;
+	default:
+		packet_has_error = TRUE;
+		break;
+	}
+
+	if (process_data(sdi, transfer->buffer, transfer->actual_length,
+			packet_has_error)) {
 		resubmit_transfer(transfer);
+	} else {
+		fx2lafw_abort_acquisition(devc);
+		free_transfer(transfer);
+	}
+}
+
+static gboolean ring_init(struct fx2lafw_ring *ring, int size)
+{
+	/* One slot stays empty. */
+	ring->size = size + 1;
+	ring->head = ring->tail = 0;
+	ring->slots = g_try_malloc0(sizeof(*ring->slots) * ring->size);
+
+	return ring->slots != NULL;
+}
+
+/* Only ever called by the producer. */
+static gboolean ring_push(struct fx2lafw_ring *ring, struct fx2lafw_block *block)
+{
+	int tail, next;
+
+	tail = g_atomic_int_get(&ring->tail);
+	next = (tail + 1) % ring->size;
+	if (next == g_atomic_int_get(&ring->head))
+		return FALSE;
+	ring->slots[tail] = block;
+	g_atomic_int_set(&ring->tail, next);
+
+	return TRUE;
+}
+
+/* Only ever called by the consumer. */
+static struct fx2lafw_block *ring_pop(struct fx2lafw_ring *ring)
+{
+	struct fx2lafw_block *block;
+	int head;
+
+	head = g_atomic_int_get(&ring->head);
+	if (head == g_atomic_int_get(&ring->tail))
+		return NULL;
+	block = ring->slots[head];
+	g_atomic_int_set(&ring->head, (head + 1) % ring->size);
+
+	return block;
+}
+
+static void blocks_free(struct dev_context *devc)
+{
+	unsigned int i;
+
+	for (i = 0; i < devc->num_blocks; i++)
+		g_free(devc->blocks[i].data);
+	g_free(devc->blocks);
+	devc->blocks = NULL;
+	devc->num_blocks = 0;
+	g_free(devc->full_blocks.slots);
+	g_free(devc->free_blocks.slots);
+	devc->full_blocks.slots = devc->free_blocks.slots = NULL;
+}
+
+/*
+ * Allocate the buffers for event thread mode: one per transfer, and as
+ * many spares for the thread to swap in while the main loop catches up.
+ */
+SR_PRIV int fx2lafw_blocks_new(struct dev_context *devc,
+		unsigned int num_transfers, size_t size)
+{
+	unsigned int i;
+
+	devc->num_blocks = 2 * num_transfers;
+	devc->blocks = g_try_malloc0(sizeof(*devc->blocks) * devc->num_blocks);
+	if (!devc->blocks || !ring_init(&devc->full_blocks, devc->num_blocks)
+			|| !ring_init(&devc->free_blocks, devc->num_blocks)) {
+		blocks_free(devc);
+		return SR_ERR_MALLOC;
+	}
+
+	for (i = 0; i < devc->num_blocks; i++) {
+		if (!(devc->blocks[i].data = g_try_malloc(size))) {
+			blocks_free(devc);
+			return SR_ERR_MALLOC;
+		}
+	}
+
+	/* The transfers take the first half. */
+	for (i = num_transfers; i < devc->num_blocks; i++)
+		ring_push(&devc->free_blocks, &devc->blocks[i]);
+
+	return SR_OK;
+}
+
+/* A transfer is done for good, the main loop ends the acquisition. */
+static void retire_transfer(struct dev_context *devc)
+{
+	g_atomic_int_add(&devc->submitted_transfers, -1);
+}
+
+static void submit_block(struct dev_context *devc,
+		struct libusb_transfer *transfer, struct fx2lafw_block *block)
+{
+	int ret;
+
+	transfer->buffer = block->data;
+	transfer->user_data = block;
+	block->transfer = NULL;
+	if ((ret = sr_usb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+		return;
+
+	sr_err("%s: %s", __func__, libusb_error_name(ret));
+	fx2lafw_abort_acquisition(devc);
+	retire_transfer(devc);
+}
+
+/*
+ * Runs on the USB event thread in event thread mode. The data is left to
+ * the main loop, the transfer goes straight back to the device with a
+ * spare buffer so the FX2 never runs out of places to put its samples.
+ */
+SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer_threaded(struct libusb_transfer *transfer)
+{
+	struct fx2lafw_block *block, *spare;
+	struct dev_context *devc;
+
+	block = transfer->user_data;
+	devc = block->sdi->priv;
+
+	if (g_atomic_int_get(&devc->acq_aborted)) {
+		retire_transfer(devc);
+		return;
+	}
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		fx2lafw_abort_acquisition(devc);
+		retire_transfer(devc);
+		return;
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
+		block->error = FALSE;
+		break;
+	default:
+		block->error = TRUE;
+		break;
+	}
+	block->length = transfer->actual_length;
+
+	if ((spare = ring_pop(&devc->free_blocks))) {
+		block->transfer = NULL;
+		ring_push(&devc->full_blocks, block);
+		submit_block(devc, transfer, spare);
+	} else {
+		/* Out of spares, the transfer waits for the main loop. */
+		sr_dbg("No spare buffer, main loop is falling behind.");
+		block->transfer = transfer;
+		ring_push(&devc->full_blocks, block);
+	}
+}
+
+/* Main loop side of event thread mode. */
+SR_PRIV int fx2lafw_receive_blocks(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct fx2lafw_block *block;
+	struct libusb_transfer *transfer;
+	unsigned int i;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+
+	/* Don't hog the main loop if the device keeps up with us. */
+	for (i = 0; i < devc->num_blocks; i++) {
+		if (!(block = ring_pop(&devc->full_blocks)))
+			break;
+		if (!g_atomic_int_get(&devc->acq_aborted)
+				&& !process_data(sdi, block->data, block->length,
+					block->error))
+			fx2lafw_abort_acquisition(devc);
+
+		if ((transfer = block->transfer)) {
+			if (g_atomic_int_get(&devc->acq_aborted))
+				retire_transfer(devc);
+			else
+				submit_block(devc, transfer, block);
+		} else {
+			ring_push(&devc->free_blocks, block);
+		}
+	}
+
+	if (g_atomic_int_get(&devc->acq_aborted)
+			&& g_atomic_int_get(&devc->submitted_transfers) == 0)
+		finish_acquisition(sdi);
+
+	return TRUE;
+}
+
+static void raise_thread_priority(void)
+{
+#if defined(_POSIX_THREAD_PRIORITY_SCHEDULING) && _POSIX_THREAD_PRIORITY_SCHEDULING > 0
+	struct sched_param param;
+	int ret;
+
+	/* Usually needs privileges, the thread works fine without. */
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	if ((ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)))
+		sr_dbg("Unable to raise USB event thread priority: %s.",
+			g_strerror(ret));
+#endif
+}
+
+static gpointer usb_event_thread(gpointer data)
+{
+	struct dev_context *devc;
+	struct timeval tv;
+
+	devc = data;
+
+	raise_thread_priority();
+
+	while (!g_atomic_int_get(&devc->usb_thread_stop)) {
+		tv.tv_sec = 0;
+		tv.tv_usec = EVENT_THREAD_POLL_MS * 1000;
+		sr_usb_handle_events(devc->ctx->libusb_ctx, &tv, NULL);
+	}
+
+	return NULL;
+}
+
+SR_PRIV int fx2lafw_event_thread_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	ret = sr_session_fd_source_add(sdi->session, devc, -1, 0,
+			EVENT_THREAD_POLL_MS, fx2lafw_receive_blocks, (void *)sdi);
+	if (ret != SR_OK)
+		return ret;
+
+	g_atomic_int_set(&devc->usb_thread_stop, FALSE);
+	devc->usb_thread = g_thread_new("fx2lafw-usb", usb_event_thread, devc);
+
+	return SR_OK;
+}
+
+static void event_thread_stop(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	unsigned int i;
+
+	devc = sdi->priv;
+
+	if (devc->usb_thread) {
+		g_atomic_int_set(&devc->usb_thread_stop, TRUE);
+		g_thread_join(devc->usb_thread);
+		devc->usb_thread = NULL;
+	}
+	sr_session_source_remove_internal(sdi->session, devc);
+
+	/* All transfers are retired, none of them is in use anymore. */
+	for (i = 0; i < devc->num_transfers; i++) {
+		if (devc->transfers[i])
+			libusb_free_transfer(devc->transfers[i]);
+	}
+	blocks_free(devc);
 }
 
 static unsigned int to_bytes_per_ms(unsigned int samplerate)
@@ -576,6 +896,9 @@ SR_PRIV size_t fx2lafw_get_buffer_size(struct dev_context *devc)
 {
 	size_t s;
 
+	if (devc->cfg_transfer_size)
+		return (devc->cfg_transfer_size + 511) & ~511;
+
 	/*
 	 * The buffer should be large enough to hold 10ms of data and
 	 * a multiple of 512.
@@ -588,6 +911,9 @@ SR_PRIV unsigned int fx2lafw_get_number_of_transfers(struct dev_context *devc)
 {
 	unsigned int n;
 
+	if (devc->cfg_num_transfers)
+		return devc->cfg_num_transfers;
+
 	/* Total buffer size should be able to hold about 500ms of data. */
 	n = (500 * to_bytes_per_ms(devc->cur_samplerate) /
 		fx2lafw_get_buffer_size(devc));
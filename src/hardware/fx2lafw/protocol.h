@@ -37,7 +37,13 @@
 
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
-#define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
+
+/* Limits for a user-configured transfer count and size. */
+#define MAX_NUM_TRANSFERS	1024
+#define MAX_TRANSFER_SIZE	(16 * 1024 * 1024)
+
+/* How often the main loop checks for data from the USB event thread. */
+#define EVENT_THREAD_POLL_MS	10
 
 #define NUM_CHANNELS		16
 
@@ -92,6 +98,31 @@ struct fx2lafw_profile {
 	const char *usb_product;
 };
 
+/*
+ * A buffer for a transfer. In event thread mode the thread resubmits a
+ * transfer with a spare buffer as soon as it completes, and passes the
+ * filled one to the main loop.
+ */
+struct fx2lafw_block {
+	const struct sr_dev_inst *sdi;
+	uint8_t *data;
+	int length;
+	gboolean error;
+	/* Set if no spare buffer was left: the main loop resubmits. */
+	struct libusb_transfer *transfer;
+};
+
+/*
+ * Lock-free ring of blocks, for a single producer and a single consumer.
+ * One slot always stays empty to tell a full ring from an empty one.
+ */
+struct fx2lafw_ring {
+	struct fx2lafw_block **slots;
+	int size;
+	int head;
+	int tail;
+};
+
 struct dev_context {
 	const struct fx2lafw_profile *profile;
 	GSList *enabled_analog_channels;
@@ -129,7 +160,20 @@ struct dev_context {
 	void (*send_data_proc)(struct sr_dev_inst *sdi,
 		uint8_t *data, size_t length, size_t sample_width);
 	uint8_t *logic_buffer;
-	float *analog_buffer;
+	uint8_t *analog_buffer;
+
+	/* Transfer settings, 0 picks them from the samplerate. */
+	uint64_t cfg_num_transfers;
+	uint64_t cfg_transfer_size;
+
+	/* USB event thread mode. */
+	gboolean event_thread;
+	GThread *usb_thread;
+	int usb_thread_stop;
+	struct fx2lafw_block *blocks;
+	unsigned int num_blocks;
+	struct fx2lafw_ring full_blocks;
+	struct fx2lafw_ring free_blocks;
 
 	/* Is this a DSLogic? */
 	gboolean dslogic;
@@ -148,6 +192,11 @@ SR_PRIV int fx2lafw_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di);
 SR_PRIV struct dev_context *fx2lafw_dev_new(void);
 SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc);
 SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer(struct libusb_transfer *transfer);
+SR_PRIV int fx2lafw_blocks_new(struct dev_context *devc,
+		unsigned int num_transfers, size_t size);
+SR_PRIV void LIBUSB_CALL fx2lafw_receive_transfer_threaded(struct libusb_transfer *transfer);
+SR_PRIV int fx2lafw_receive_blocks(int fd, int revents, void *cb_data);
+SR_PRIV int fx2lafw_event_thread_start(const struct sr_dev_inst *sdi);
 SR_PRIV size_t fx2lafw_get_buffer_size(struct dev_context *devc);
 SR_PRIV unsigned int fx2lafw_get_number_of_transfers(struct dev_context *devc);
 SR_PRIV unsigned int fx2lafw_get_timeout(struct dev_context *devc);
@@ -119,6 +119,7 @@ static void clear_helper(void *priv)
 	devc = priv;
 
 	hmo_scope_state_free(devc->model_state);
+	sr_scpi_cache_free(devc->state_cache);
 
 	g_free(devc->analog_groups);
 	g_free(devc->digital_groups);
@@ -180,6 +181,21 @@ static int check_channel_group(struct dev_context *devc,
 	return CG_INVALID;
 }
 
+static int analog_channel_index(struct dev_context *devc,
+				const struct sr_channel_group *cg)
+{
+	unsigned int i;
+	const struct scope_config *model;
+
+	model = devc->model_config;
+
+	for (i = 0; i < model->analog_channels; i++)
+		if (cg == devc->analog_groups[i])
+			return i;
+
+	return -1;
+}
+
 static int config_get(uint32_t key, GVariant **data, const struct sr_dev_inst *sdi,
 		      const struct sr_channel_group *cg)
 {
@@ -195,6 +211,16 @@ static int config_get(uint32_t key, GVariant **data, const struct sr_dev_inst *s
 	if ((cg_type = check_channel_group(devc, cg)) == CG_INVALID)
 		return SR_ERR;
 
+	/*
+	 * Only settings that were changed since they were read cause traffic.
+	 * During an acquisition the connection carries waveform data, so the
+	 * cached values are reported as they are.
+	 */
+	if (sdi->status == SR_ST_ACTIVE && !devc->current_channel
+			&& hmo_scope_state_fetch(sdi, key,
+			analog_channel_index(devc, cg)) != SR_OK)
+		return SR_ERR;
+
 	ret = SR_ERR_NA;
 	model = devc->model_config;
 	state = devc->model_state;
@@ -470,6 +496,13 @@ static int config_set(uint32_t key, GVariant *data, const struct sr_dev_inst *sd
 	if (ret == SR_OK)
 		ret = sr_scpi_get_opc(sdi->conn);
 
+	/* Read back what the device made of the new setting when it's needed. */
+	sr_scpi_cache_invalidate(devc->state_cache, key,
+			analog_channel_index(devc, cg));
+	if (key == SR_CONF_TIMEBASE)
+		sr_scpi_cache_invalidate(devc->state_cache,
+				SR_CONF_HORIZ_TRIGGERPOS, -1);
+
 	if (ret == SR_OK && update_sample_rate)
 		ret = hmo_update_sample_rate(sdi);
 
@@ -762,6 +795,7 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	devc->num_frames = 0;
 	g_slist_free(devc->enabled_channels);
 	devc->enabled_channels = NULL;
+	devc->current_channel = NULL;
 	scpi = sdi->conn;
 	sr_scpi_source_remove(sdi->session, scpi);
 
@@ -308,32 +308,19 @@ static void scope_state_dump(const struct scope_config *config,
 		state->horiz_triggerpos);
 }
 
-static int scope_state_get_array_option(struct sr_scpi_dev_inst *scpi,
-		const char *command, const char *(*array)[], int *result)
+static int array_option_get(const char *value, const char *(*array)[],
+		int *result)
 {
-	char *tmp;
 	unsigned int i;
 
-	if (sr_scpi_get_string(scpi, command, &tmp) != SR_OK) {
-		g_free(tmp);
-		return SR_ERR;
-	}
-
 	for (i = 0; (*array)[i]; i++) {
-		if (!g_strcmp0(tmp, (*array)[i])) {
+		if (!g_strcmp0(value, (*array)[i])) {
 			*result = i;
-			g_free(tmp);
-			tmp = NULL;
-			break;
+			return SR_OK;
 		}
 	}
 
-	if (tmp) {
-		g_free(tmp);
-		return SR_ERR;
-	}
-
-	return SR_OK;
+	return SR_ERR;
 }
 
 /**
@@ -353,7 +340,7 @@ static int scope_state_get_array_option(struct sr_scpi_dev_inst *scpi,
  *
  * @return SR_ERR on any parsing error, SR_OK otherwise.
  */
-static int array_float_get(gchar *value, const uint64_t array[][2],
+static int array_float_get(const gchar *value, const uint64_t array[][2],
 		int array_len, unsigned int *result)
 {
 	int i, e;
@@ -406,88 +393,138 @@ static int array_float_get(gchar *value, const uint64_t array[][2],
 	return SR_ERR;
 }
 
-static int analog_channel_state_get(struct sr_scpi_dev_inst *scpi,
-				    const struct scope_config *config,
-				    struct scope_state *state)
+static int state_parse(const char *response, uint32_t key, int channel,
+		void *cb_data)
 {
-	unsigned int i, j;
-	char command[MAX_COMMAND_SIZE];
-	char *tmp_str;
-
-	for (i = 0; i < config->analog_channels; i++) {
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_ANALOG_CHAN_STATE],
-			   i + 1);
-
-		if (sr_scpi_get_bool(scpi, command,
-				     &state->analog_channels[i].state) != SR_OK)
-			return SR_ERR;
-
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_DIV],
-			   i + 1);
+	struct dev_context *devc;
+	struct scope_state *state;
+	const struct scope_config *config;
+	unsigned int i;
+	float tmp_float;
 
-		if (sr_scpi_get_string(scpi, command, &tmp_str) != SR_OK)
-			return SR_ERR;
+	devc = cb_data;
+	config = devc->model_config;
+	state = devc->model_state;
 
-		if (array_float_get(tmp_str, hmo_vdivs, ARRAY_SIZE(hmo_vdivs),
-				&j) != SR_OK) {
-			g_free(tmp_str);
+	switch (key) {
+	case HMO_STATE_ANALOG_CHAN:
+		return sr_scpi_parse_response(SCPI_QUERY_BOOL, response,
+				&state->analog_channels[channel].state);
+	case SR_CONF_VDIV:
+		if (array_float_get(response, hmo_vdivs, ARRAY_SIZE(hmo_vdivs),
+				&i) != SR_OK) {
 			sr_err("Could not determine array index for vertical div scale.");
 			return SR_ERR;
 		}
-
-		g_free(tmp_str);
-		state->analog_channels[i].vdiv = j;
-
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_OFFSET],
-			   i + 1);
-
-		if (sr_scpi_get_float(scpi, command,
-				     &state->analog_channels[i].vertical_offset) != SR_OK)
+		state->analog_channels[channel].vdiv = i;
+		return SR_OK;
+	case HMO_STATE_VERTICAL_OFFSET:
+		return sr_scpi_parse_response(SCPI_QUERY_FLOAT, response,
+				&state->analog_channels[channel].vertical_offset);
+	case SR_CONF_COUPLING:
+		return array_option_get(response, config->coupling_options,
+				&state->analog_channels[channel].coupling);
+	case HMO_STATE_DIG_CHAN:
+		return sr_scpi_parse_response(SCPI_QUERY_BOOL, response,
+				&state->digital_channels[channel]);
+	case HMO_STATE_DIG_POD:
+		return sr_scpi_parse_response(SCPI_QUERY_BOOL, response,
+				&state->digital_pods[channel]);
+	case SR_CONF_TIMEBASE:
+		if (array_float_get(response, hmo_timebases,
+				ARRAY_SIZE(hmo_timebases), &i) != SR_OK) {
+			sr_err("Could not determine array index for time base.");
 			return SR_ERR;
-
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_COUPLING],
-			   i + 1);
-
-		if (scope_state_get_array_option(scpi, command, config->coupling_options,
-					 &state->analog_channels[i].coupling) != SR_OK)
+		}
+		state->timebase = i;
+		return SR_OK;
+	case SR_CONF_HORIZ_TRIGGERPOS:
+		if (sr_atof_ascii(response, &tmp_float) != SR_OK)
 			return SR_ERR;
+		state->horiz_triggerpos = tmp_float /
+			(((double) (*config->timebases)[state->timebase][0] /
+			  (*config->timebases)[state->timebase][1]) * config->num_xdivs);
+		state->horiz_triggerpos -= 0.5;
+		state->horiz_triggerpos *= -1;
+		return SR_OK;
+	case SR_CONF_TRIGGER_SOURCE:
+		return array_option_get(response, config->trigger_sources,
+				&state->trigger_source);
+	case SR_CONF_TRIGGER_SLOPE:
+		return array_option_get(response, config->trigger_slopes,
+				&state->trigger_slope);
 	}
 
-	return SR_OK;
+	return SR_ERR_BUG;
 }
 
-static int digital_channel_state_get(struct sr_scpi_dev_inst *scpi,
-				     const struct scope_config *config,
-				     struct scope_state *state)
+static struct sr_scpi_cache *state_cache_new(struct dev_context *devc)
 {
+	const struct scope_config *config;
+	struct sr_scpi_cache *cache;
 	unsigned int i;
-	char command[MAX_COMMAND_SIZE];
 
-	for (i = 0; i < config->digital_channels; i++) {
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_DIG_CHAN_STATE],
-			   i);
+	config = devc->model_config;
+	cache = sr_scpi_cache_new(state_parse, devc);
 
-		if (sr_scpi_get_bool(scpi, command,
-				     &state->digital_channels[i]) != SR_OK)
-			return SR_ERR;
+	for (i = 0; i < config->analog_channels; i++) {
+		sr_scpi_cache_add(cache, HMO_STATE_ANALOG_CHAN, i,
+			(*config->scpi_dialect)[SCPI_CMD_GET_ANALOG_CHAN_STATE],
+			i + 1);
+		sr_scpi_cache_add(cache, SR_CONF_VDIV, i,
+			(*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_DIV],
+			i + 1);
+		sr_scpi_cache_add(cache, HMO_STATE_VERTICAL_OFFSET, i,
+			(*config->scpi_dialect)[SCPI_CMD_GET_VERTICAL_OFFSET],
+			i + 1);
+		sr_scpi_cache_add(cache, SR_CONF_COUPLING, i,
+			(*config->scpi_dialect)[SCPI_CMD_GET_COUPLING],
+			i + 1);
 	}
 
-	for (i = 0; i < config->digital_pods; i++) {
-		g_snprintf(command, sizeof(command),
-			   (*config->scpi_dialect)[SCPI_CMD_GET_DIG_POD_STATE],
-			   i + 1);
+	for (i = 0; i < config->digital_channels; i++) {
+		sr_scpi_cache_add(cache, HMO_STATE_DIG_CHAN, i,
+			(*config->scpi_dialect)[SCPI_CMD_GET_DIG_CHAN_STATE],
+			i);
+	}
 
-		if (sr_scpi_get_bool(scpi, command,
-				     &state->digital_pods[i]) != SR_OK)
-			return SR_ERR;
+	for (i = 0; i < config->digital_pods; i++) {
+		sr_scpi_cache_add(cache, HMO_STATE_DIG_POD, i,
+			(*config->scpi_dialect)[SCPI_CMD_GET_DIG_POD_STATE],
+			i + 1);
 	}
 
-	return SR_OK;
+	/* The trigger position is parsed in units of the time base. */
+	sr_scpi_cache_add(cache, SR_CONF_TIMEBASE, -1, "%s",
+		(*config->scpi_dialect)[SCPI_CMD_GET_TIMEBASE]);
+	sr_scpi_cache_add(cache, SR_CONF_HORIZ_TRIGGERPOS, -1, "%s",
+		(*config->scpi_dialect)[SCPI_CMD_GET_HORIZ_TRIGGERPOS]);
+	sr_scpi_cache_add(cache, SR_CONF_TRIGGER_SOURCE, -1, "%s",
+		(*config->scpi_dialect)[SCPI_CMD_GET_TRIGGER_SOURCE]);
+	sr_scpi_cache_add(cache, SR_CONF_TRIGGER_SLOPE, -1, "%s",
+		(*config->scpi_dialect)[SCPI_CMD_GET_TRIGGER_SLOPE]);
+
+	return cache;
+}
+
+/**
+ * Make sure cached settings are up to date, reading the ones that aren't
+ * (and any others that went stale) from the device.
+ *
+ * @param sdi The device instance.
+ * @param key The key of the settings, or 0 for all of them.
+ * @param channel The analog channel, or -1 for all channels.
+ *
+ * @return SR_OK upon success, SR_ERR* otherwise.
+ */
+SR_PRIV int hmo_scope_state_fetch(const struct sr_dev_inst *sdi,
+		uint32_t key, int channel)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	return sr_scpi_cache_fetch(sdi->conn, devc->state_cache, key, channel);
 }
 
 SR_PRIV int hmo_update_sample_rate(const struct sr_dev_inst *sdi)
@@ -557,9 +594,6 @@ SR_PRIV int hmo_scope_state_get(struct sr_dev_inst *sdi)
 	struct dev_context *devc;
 	struct scope_state *state;
 	const struct scope_config *config;
-	float tmp_float;
-	unsigned int i;
-	char *tmp_str;
 
 	devc = sdi->priv;
 	config = devc->model_config;
@@ -567,49 +601,10 @@ SR_PRIV int hmo_scope_state_get(struct sr_dev_inst *sdi)
 
 	sr_info("Fetching scope state");
 
-	if (analog_channel_state_get(sdi->conn, config, state) != SR_OK)
-		return SR_ERR;
-
-	if (digital_channel_state_get(sdi->conn, config, state) != SR_OK)
-		return SR_ERR;
+	/* The settings may have been changed on the device meanwhile. */
+	sr_scpi_cache_invalidate(devc->state_cache, 0, -1);
 
-	if (sr_scpi_get_float(sdi->conn,
-			(*config->scpi_dialect)[SCPI_CMD_GET_TIMEBASE],
-			&tmp_float) != SR_OK)
-		return SR_ERR;
-
-	if (sr_scpi_get_string(sdi->conn,
-			(*config->scpi_dialect)[SCPI_CMD_GET_TIMEBASE],
-			&tmp_str) != SR_OK)
-		return SR_ERR;
-
-	if (array_float_get(tmp_str, hmo_timebases, ARRAY_SIZE(hmo_timebases),
-			&i) != SR_OK) {
-		g_free(tmp_str);
-		sr_err("Could not determine array index for time base.");
-		return SR_ERR;
-	}
-
-	state->timebase = i;
-
-	if (sr_scpi_get_float(sdi->conn,
-			(*config->scpi_dialect)[SCPI_CMD_GET_HORIZ_TRIGGERPOS],
-			&tmp_float) != SR_OK)
-		return SR_ERR;
-	state->horiz_triggerpos = tmp_float /
-		(((double) (*config->timebases)[state->timebase][0] /
-		  (*config->timebases)[state->timebase][1]) * config->num_xdivs);
-	state->horiz_triggerpos -= 0.5;
-	state->horiz_triggerpos *= -1;
-
-	if (scope_state_get_array_option(sdi->conn,
-			(*config->scpi_dialect)[SCPI_CMD_GET_TRIGGER_SOURCE],
-			config->trigger_sources, &state->trigger_source) != SR_OK)
-		return SR_ERR;
-
-	if (scope_state_get_array_option(sdi->conn,
-		(*config->scpi_dialect)[SCPI_CMD_GET_TRIGGER_SLOPE],
-		config->trigger_slopes, &state->trigger_slope) != SR_OK)
+	if (hmo_scope_state_fetch(sdi, 0, -1) != SR_OK)
 		return SR_ERR;
 
 	if (hmo_update_sample_rate(sdi) != SR_OK)
@@ -720,6 +715,8 @@ SR_PRIV int hmo_init_device(struct sr_dev_inst *sdi)
 	if (!(devc->model_state = scope_state_new(devc->model_config)))
 		return SR_ERR_MALLOC;
 
+	devc->state_cache = state_cache_new(devc);
+
 	return SR_OK;
 }
 
@@ -66,6 +66,14 @@ struct scope_config {
 	const char *(*scpi_dialect)[];
 };
 
+/* Cached settings without an SR_CONF key, see state_cache_new(). */
+enum {
+	HMO_STATE_ANALOG_CHAN = 1,
+	HMO_STATE_VERTICAL_OFFSET,
+	HMO_STATE_DIG_CHAN,
+	HMO_STATE_DIG_POD,
+};
+
 struct analog_channel_state {
 	int coupling;
 
@@ -92,6 +100,7 @@ struct scope_state {
 struct dev_context {
 	const void *model_config;
 	void *model_state;
+	struct sr_scpi_cache *state_cache;
 
 	struct sr_channel_group **analog_groups;
 	struct sr_channel_group **digital_groups;
@@ -110,6 +119,8 @@ SR_PRIV int hmo_receive_data(int fd, int revents, void *cb_data);
 SR_PRIV struct scope_state *hmo_scope_state_new(struct scope_config *config);
 SR_PRIV void hmo_scope_state_free(struct scope_state *state);
 SR_PRIV int hmo_scope_state_get(struct sr_dev_inst *sdi);
+SR_PRIV int hmo_scope_state_fetch(const struct sr_dev_inst *sdi,
+		uint32_t key, int channel);
 SR_PRIV int hmo_update_sample_rate(const struct sr_dev_inst *sdi);
 
 #endif
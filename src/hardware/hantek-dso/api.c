@@ -254,6 +254,23 @@ static int dev_clear(const struct sr_dev_driver *di)
 	return std_dev_clear(di, clear_dev_context);
 }
 
+static gboolean usb_match(uint16_t vendor_id, uint16_t product_id)
+{
+	int i;
+
+	/* Both before and after the firmware upload. */
+	for (i = 0; dev_profiles[i].orig_vid; i++) {
+		if (vendor_id == dev_profiles[i].orig_vid
+				&& product_id == dev_profiles[i].orig_pid)
+			return TRUE;
+		if (vendor_id == dev_profiles[i].fw_vid
+				&& product_id == dev_profiles[i].fw_pid)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
@@ -1012,4 +1029,5 @@ SR_PRIV struct sr_dev_driver hantek_dso_driver_info = {
 	.dev_acquisition_start = dev_acquisition_start,
 	.dev_acquisition_stop = dev_acquisition_stop,
 	.context = NULL,
+	.usb_match = usb_match,
 };
@@ -429,7 +429,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	tmp = GUINT16_TO_LE(devc->after_trigger_delay);
 	memcpy(devc->xfer_data_out + 10, &tmp, sizeof(tmp));
 
-	if ((ret = libusb_submit_transfer(devc->xfer_out)) != 0) {
+	if ((ret = sr_usb_submit_transfer(devc->xfer_out)) != 0) {
 		sr_err("Submit transfer failed: %s.", libusb_error_name(ret));
 		return SR_ERR;
 	}
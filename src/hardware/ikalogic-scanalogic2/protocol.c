@@ -220,11 +220,11 @@ SR_PRIV int ikalogic_scanalogic2_receive_data(int fd, int revents, void *cb_data
 			if (!devc->stopping_in_progress) {
 				devc->next_state = STATE_RESET_AND_IDLE;
 				devc->stopping_in_progress = TRUE;
-				ret = libusb_submit_transfer(devc->xfer_in);
+				ret = sr_usb_submit_transfer(devc->xfer_in);
 			}
 		} else if (time_elapsed >= WAIT_DATA_READY_INTERVAL) {
 			devc->wait_data_ready_locked = TRUE;
-			ret = libusb_submit_transfer(devc->xfer_in);
+			ret = sr_usb_submit_transfer(devc->xfer_in);
 		}
 	}
 
@@ -237,8 +237,7 @@ SR_PRIV int ikalogic_scanalogic2_receive_data(int fd, int revents, void *cb_data
 	tv.tv_sec = 0;
 	tv.tv_usec = 0;
 
-	libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx, &tv,
-		NULL);
+	sr_usb_handle_events(drvc->sr_ctx->libusb_ctx, &tv, NULL);
 
 	/* Check if an error occurred on a transfer. */
 	if (devc->transfer_error)
@@ -268,7 +267,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 		devc->next_state = STATE_RESET_AND_IDLE;
 		devc->stopping_in_progress = TRUE;
 
-		if (libusb_submit_transfer(devc->xfer_in) != 0) {
+		if (sr_usb_submit_transfer(devc->xfer_in) != 0) {
 			sr_err("Submit transfer failed: %s.",
 				libusb_error_name(ret));
 			devc->transfer_error = TRUE;
@@ -298,7 +297,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 		if (devc->xfer_data_in[0] == 0x05 &&
 				devc->xfer_data_in[1] == STATUS_DATA_READY) {
 			devc->next_state = STATE_RECEIVE_DATA;
-			ret = libusb_submit_transfer(transfer);
+			ret = sr_usb_submit_transfer(transfer);
 		} else {
 			devc->wait_data_ready_locked = FALSE;
 			devc->wait_data_ready_time = g_get_monotonic_time();
@@ -324,7 +323,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 		if (devc->sample_packet == 0)
 			devc->channel++;
 
-		ret = libusb_submit_transfer(transfer);
+		ret = sr_usb_submit_transfer(transfer);
 	} else if (devc->state == STATE_RESET_AND_IDLE) {
 		/* Check if the received data are a valid device status. */
 		if (devc->xfer_data_in[0] == 0x05) {
@@ -336,7 +335,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 				devc->xfer_data_out[0] = CMD_RESET;
 			}
 
-			ret = libusb_submit_transfer(devc->xfer_out);
+			ret = sr_usb_submit_transfer(devc->xfer_out);
 		} else {
 			/*
 			 * The received device status is invalid which
@@ -344,7 +343,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 			 * commands. Request a new device status until a valid
 			 * device status is received.
 			 */
-			ret = libusb_submit_transfer(transfer);
+			ret = sr_usb_submit_transfer(transfer);
 		}
 	} else if (devc->state == STATE_WAIT_DEVICE_READY) {
 		/* Check if the received data are a valid device status. */
@@ -362,14 +361,14 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_in( struct libusb_transfer *transf
 				devc->xfer_data_out[0] = CMD_RESET;
 			}
 
-			ret = libusb_submit_transfer(devc->xfer_out);
+			ret = sr_usb_submit_transfer(devc->xfer_out);
 		} else {
 			/*
 			 * The device is not ready and therefore not able to
 			 * change to the idle state. Request a new device
 			 * status until the device is ready.
 			 */
-			ret = libusb_submit_transfer(transfer);
+			ret = sr_usb_submit_transfer(transfer);
 		}
 	}
 
@@ -399,7 +398,7 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_out( struct libusb_transfer *trans
 		devc->next_state = STATE_RESET_AND_IDLE;
 		devc->stopping_in_progress = TRUE;
 
-		if (libusb_submit_transfer(devc->xfer_in) != 0) {
+		if (sr_usb_submit_transfer(devc->xfer_in) != 0) {
 			sr_err("Submit transfer failed: %s.",
 				libusb_error_name(ret));
 
@@ -418,9 +417,9 @@ SR_PRIV void LIBUSB_CALL sl2_receive_transfer_out( struct libusb_transfer *trans
 		stop_acquisition(sdi);
 	} else if (devc->state == STATE_SAMPLE) {
 		devc->next_state = STATE_WAIT_DATA_READY;
-		ret = libusb_submit_transfer(devc->xfer_in);
+		ret = sr_usb_submit_transfer(devc->xfer_in);
 	} else if (devc->state == STATE_WAIT_DEVICE_READY) {
-		ret = libusb_submit_transfer(devc->xfer_in);
+		ret = sr_usb_submit_transfer(devc->xfer_in);
 	}
 
 	if (ret != 0) {
@@ -743,14 +742,14 @@ SR_PRIV int sl2_get_device_info(struct sr_usb_dev_inst usb,
 
 SR_PRIV int sl2_transfer_in(libusb_device_handle *dev_handle, uint8_t *data)
 {
-	return libusb_control_transfer(dev_handle, USB_REQUEST_TYPE_IN,
+	return sr_usb_control_transfer(dev_handle, USB_REQUEST_TYPE_IN,
 		USB_HID_GET_REPORT, USB_HID_REPORT_TYPE_FEATURE, USB_INTERFACE,
 		(unsigned char *)data, PACKET_LENGTH, USB_TIMEOUT_MS);
 }
 
 SR_PRIV int sl2_transfer_out(libusb_device_handle *dev_handle, uint8_t *data)
 {
-	return libusb_control_transfer(dev_handle, USB_REQUEST_TYPE_OUT,
+	return sr_usb_control_transfer(dev_handle, USB_REQUEST_TYPE_OUT,
 		USB_HID_SET_REPORT, USB_HID_REPORT_TYPE_FEATURE, USB_INTERFACE,
 		(unsigned char *)data, PACKET_LENGTH, USB_TIMEOUT_MS);
 }
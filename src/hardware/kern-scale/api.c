@@ -155,15 +155,26 @@ static int config_list(uint32_t key, GVariant **data, const struct sr_dev_inst *
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	struct scale_info *scale;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
+	int ret;
 
 	if (sdi->status != SR_ST_ACTIVE)
 		return SR_ERR_DEV_CLOSED;
 
+	scale = (struct scale_info *)sdi->driver;
 	devc = sdi->priv;
 	serial = sdi->conn;
 
+	/* Packets are variable length, so there is no sync byte. */
+	ret = serial_packet_scanner_init(&devc->scanner, scale->packet_size,
+			scale->packet_valid, -1, 0);
+	if (ret != SR_OK)
+		return ret;
+	g_free(devc->info);
+	devc->info = g_malloc0(scale->info_size);
+
 	sr_spew("Set O1 mode (continuous values, stable and unstable ones).");
 	if (serial_write_nonblocking(serial, "O1\r\n", 4) != 4)
 		return SR_ERR;
@@ -181,8 +192,18 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	return std_serial_dev_acquisition_stop(sdi, std_serial_dev_close,
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	ret = std_serial_dev_acquisition_stop(sdi, std_serial_dev_close,
 			sdi->conn, LOG_PREFIX);
+
+	g_free(devc->info);
+	devc->info = NULL;
+
+	return ret;
 }
 
 #define SCALE(ID, CHIPSET, VENDOR, MODEL, CONN, BAUDRATE, PACKETSIZE, \
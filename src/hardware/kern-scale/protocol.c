@@ -58,51 +58,27 @@ static void handle_packet(const uint8_t *buf, struct sr_dev_inst *sdi,
 	}
 }
 
-static void handle_new_data(struct sr_dev_inst *sdi, void *info)
+static gboolean packet_found(const uint8_t *buf, void *cb_data)
 {
+	struct sr_dev_inst *sdi;
 	struct scale_info *scale;
 	struct dev_context *devc;
-	int len, i, offset = 0;
-	struct sr_serial_dev_inst *serial;
 
+	sdi = cb_data;
 	scale = (struct scale_info *)sdi->driver;
-
 	devc = sdi->priv;
-	serial = sdi->conn;
-
-	/* Try to get as much data as the buffer can hold. */
-	len = SCALE_BUFSIZE - devc->buflen;
-	len = serial_read_nonblocking(serial, devc->buf + devc->buflen, len);
-	if (len == 0)
-		return; /* No new bytes, nothing to do. */
-	if (len < 0) {
-		sr_err("Serial port read error: %d.", len);
-		return;
-	}
-	devc->buflen += len;
-
-	/* Now look for packets in that data. */
-	while ((devc->buflen - offset) >= scale->packet_size) {
-		if (scale->packet_valid(devc->buf + offset)) {
-			handle_packet(devc->buf + offset, sdi, info);
-			offset += scale->packet_size;
-		} else {
-			offset++;
-		}
-	}
 
-	/* If we have any data left, move it to the beginning of our buffer. */
-	for (i = 0; i < devc->buflen - offset; i++)
-		devc->buf[i] = devc->buf[offset + i];
-	devc->buflen -= offset;
+	memset(devc->info, 0, scale->info_size);
+	handle_packet(buf, sdi, devc->info);
+
+	return TRUE;
 }
 
 SR_PRIV int kern_scale_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	struct scale_info *scale;
-	void *info;
+	int ret;
 
 	(void)fd;
 
@@ -112,13 +88,12 @@ SR_PRIV int kern_scale_receive_data(int fd, int revents, void *cb_data)
 	if (!(devc = sdi->priv))
 		return TRUE;
 
-	scale = (struct scale_info *)sdi->driver;
-
 	if (revents == G_IO_IN) {
 		/* Serial data arrived. */
-		info = g_malloc(scale->info_size);
-		handle_new_data(sdi, info);
-		g_free(info);
+		ret = serial_packet_scan(sdi->conn, &devc->scanner,
+				packet_found, sdi);
+		if (ret < 0)
+			sr_err("Serial port read error: %d.", ret);
 	}
 
 	if (sr_sw_limits_check(&devc->limits))
@@ -45,15 +45,13 @@ struct scale_info {
 	gsize info_size;
 };
 
-#define SCALE_BUFSIZE 256
-
 /** Private, per-device-instance driver context. */
 struct dev_context {
 	struct sr_sw_limits limits;
 
-	uint8_t buf[SCALE_BUFSIZE];
-	int bufoffset;
-	int buflen;
+	struct serial_packet_scanner scanner;
+	/** Chipset info struct, scale_info.info_size bytes. */
+	void *info;
 };
 
 SR_PRIV int kern_scale_receive_data(int fd, int revents, void *cb_data);
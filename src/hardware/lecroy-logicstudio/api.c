@@ -467,8 +467,7 @@ static int receive_usb_data(int fd, int revents, void *cb_data)
 	tv.tv_sec = 0;
 	tv.tv_usec = 0;
 
-	libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx,
-		&tv, NULL);
+	sr_usb_handle_events(drvc->sr_ctx->libusb_ctx, &tv, NULL);
 
 	return TRUE;
 }
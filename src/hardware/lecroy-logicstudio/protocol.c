@@ -148,7 +148,7 @@ static int read_register(const struct sr_dev_inst *sdi,
 
 	usb = sdi->conn;
 
-	r = libusb_control_transfer(usb->devhdl, CTRL_IN,
+	r = sr_usb_control_transfer(usb->devhdl, CTRL_IN,
 		USB_COMMAND_READ_WRITE_REGS, reg, 5444,
 		data, sizeof(data), USB_TIMEOUT_MS);
 
@@ -185,7 +185,7 @@ static int write_registers_sync(const struct sr_dev_inst *sdi,
 		WB16(&buf[i * 3 + 1], regs[i].val);
 	}
 
-	r = libusb_control_transfer(usb->devhdl, CTRL_OUT,
+	r = sr_usb_control_transfer(usb->devhdl, CTRL_OUT,
 			USB_COMMAND_READ_WRITE_REGS, wValue, wIndex,
 			buf, bufsiz, USB_TIMEOUT_MS);
 
@@ -225,7 +225,7 @@ static int write_registers_async(const struct sr_dev_inst *sdi,
 	libusb_fill_control_transfer(xfer, usb->devhdl,
 		xfer_buf, callback, (void *) sdi, USB_TIMEOUT_MS);
 
-	if (libusb_submit_transfer(xfer) < 0) {
+	if (sr_usb_submit_transfer(xfer) < 0) {
 		g_free(xfer->buffer);
 		xfer->buffer = NULL;
 		libusb_free_transfer(xfer);
@@ -260,7 +260,7 @@ static void LIBUSB_CALL handle_fetch_samples_done(struct libusb_transfer *xfer)
 		devc->fetched_samples, 17 << 10,
 		recv_bulk_transfer, (void *)sdi, USB_TIMEOUT_MS);
 
-	libusb_submit_transfer(devc->bulk_xfer);
+	sr_usb_submit_transfer(devc->bulk_xfer);
 }
 
 static void calc_unk0(uint32_t *a, uint32_t *b)
@@ -445,7 +445,7 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 	}
 
 	/* Initiate upload. */
-	r = libusb_control_transfer(usb->devhdl, CTRL_OUT,
+	r = sr_usb_control_transfer(usb->devhdl, CTRL_OUT,
 		USB_COMMAND_START_UPLOAD, 0x07, 5444,
 		NULL, 0, USB_TIMEOUT_MS);
 
@@ -467,7 +467,7 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 
 		actual_length = chunk_size;
 
-		r = libusb_bulk_transfer(usb->devhdl, EP_BITSTREAM,
+		r = sr_usb_bulk_transfer(usb->devhdl, EP_BITSTREAM,
 			firmware_chunk, chunk_size, &actual_length, USB_TIMEOUT_MS);
 
 		if (r != 0 || (ssize_t)actual_length != chunk_size) {
@@ -482,7 +482,7 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 
 		upload_succeeded = 0x00;
 
-		r = libusb_control_transfer(usb->devhdl, CTRL_IN,
+		r = sr_usb_control_transfer(usb->devhdl, CTRL_IN,
 			USB_COMMAND_VERIFY_UPLOAD, 0x07, 5444,
 			&upload_succeeded, sizeof(upload_succeeded),
 			USB_TIMEOUT_MS);
@@ -890,7 +890,7 @@ SR_PRIV int lls_setup_acquisition(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 
 	if (upload_bitstream) {
-		r = libusb_control_transfer(usb->devhdl, CTRL_OUT,
+		r = sr_usb_control_transfer(usb->devhdl, CTRL_OUT,
 			USB_COMMAND_WRITE_STATUS_REG, 0x12, 5444,
 			status_reg_value, sizeof(status_reg_value), USB_TIMEOUT_MS);
 
@@ -928,7 +928,7 @@ static void LIBUSB_CALL recv_intr_transfer(struct libusb_transfer *xfer)
 			sr_err("Invalid size of interrupt transfer: %u.",
 				xfer->actual_length);
 		else if (handle_intr_data(sdi, xfer->buffer)) {
-			if (libusb_submit_transfer(xfer) < 0)
+			if (sr_usb_submit_transfer(xfer) < 0)
 				sr_err("Failed to submit interrupt transfer.");
 		}
 	}
@@ -1024,7 +1024,7 @@ static void LIBUSB_CALL recv_bulk_transfer(struct libusb_transfer *xfer)
 		xfer->length = MIN(16 << 10,
 			SAMPLE_BUF_SIZE - devc->total_received_sample_bytes);
 
-		libusb_submit_transfer(xfer);
+		sr_usb_submit_transfer(xfer);
 		return;
 	}
 
@@ -1118,7 +1118,7 @@ SR_PRIV int lls_start_acquisition(const struct sr_dev_inst *sdi)
 		devc->intr_buf, INTR_BUF_SIZE,
 		recv_intr_transfer, (void *) sdi, USB_TIMEOUT_MS);
 
-	libusb_submit_transfer(devc->intr_xfer);
+	sr_usb_submit_transfer(devc->intr_xfer);
 
 	if (devc->want_trigger == FALSE)
 		return SR_OK;
@@ -230,6 +230,11 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	return devices;
 }
 
+static gboolean usb_match(uint16_t vendor_id, uint16_t product_id)
+{
+	return vendor_id == LOGIC16_VID && product_id == LOGIC16_PID;
+}
+
 static int logic16_dev_open(struct sr_dev_inst *sdi)
 {
 	struct sr_dev_driver *di;
@@ -557,7 +562,7 @@ static void abort_acquisition(struct dev_context *devc)
 
 	for (i = devc->num_transfers - 1; i >= 0; i--) {
 		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
+			sr_usb_cancel_transfer(devc->transfers[i]);
 	}
 }
 
@@ -653,7 +658,7 @@ static int receive_data(int fd, int revents, void *cb_data)
 	devc = sdi->priv;
 
 	tv.tv_sec = tv.tv_usec = 0;
-	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
+	sr_usb_handle_events(drvc->sr_ctx->libusb_ctx, &tv, NULL);
 
 	if (devc->sent_samples == -2) {
 		logic16_abort_acquisition(sdi);
@@ -747,7 +752,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
 				2 | LIBUSB_ENDPOINT_IN, buf, size,
 				logic16_receive_transfer, (void *)sdi, timeout);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_submit_transfer(transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
@@ -804,4 +809,5 @@ SR_PRIV struct sr_dev_driver saleae_logic16_driver_info = {
 	.dev_acquisition_start = dev_acquisition_start,
 	.dev_acquisition_stop = dev_acquisition_stop,
 	.context = NULL,
+	.usb_match = usb_match,
 };
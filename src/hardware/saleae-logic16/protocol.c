@@ -207,7 +207,7 @@ static int do_ep1_command(const struct sr_dev_inst *sdi,
 
 	encrypt(buf, command, cmd_len);
 
-	ret = libusb_bulk_transfer(usb->devhdl, 1, buf, cmd_len, &xfer, 1000);
+	ret = sr_usb_bulk_transfer(usb->devhdl, 1, buf, cmd_len, &xfer, 1000);
 	if (ret != 0) {
 		sr_dbg("Failed to send EP1 command 0x%02x: %s.",
 		       command[0], libusb_error_name(ret));
@@ -222,7 +222,7 @@ static int do_ep1_command(const struct sr_dev_inst *sdi,
 	if (reply_len == 0)
 		return SR_OK;
 
-	ret = libusb_bulk_transfer(usb->devhdl, 0x80 | 1, buf, reply_len,
+	ret = sr_usb_bulk_transfer(usb->devhdl, 0x80 | 1, buf, reply_len,
 				   &xfer, 1000);
 	if (ret != 0) {
 		sr_dbg("Failed to receive reply to EP1 command 0x%02x: %s.",
@@ -803,7 +803,7 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 {
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	if ((ret = sr_usb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	free_transfer(transfer);
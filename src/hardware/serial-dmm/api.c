@@ -183,14 +183,22 @@ static int config_list(uint32_t key, GVariant **data, const struct sr_dev_inst *
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	struct dmm_info *dmm;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
+	int ret;
 
 	if (sdi->status != SR_ST_ACTIVE)
 		return SR_ERR_DEV_CLOSED;
 
+	dmm = (struct dmm_info *)sdi->driver;
 	devc = sdi->priv;
 
+	if ((ret = packet_scanner_init(dmm, &devc->scanner)) != SR_OK)
+		return ret;
+	g_free(devc->info);
+	devc->info = g_malloc0(dmm->info_size);
+
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi, LOG_PREFIX);
 
@@ -204,8 +212,18 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	return std_serial_dev_acquisition_stop(sdi, std_serial_dev_close,
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	ret = std_serial_dev_acquisition_stop(sdi, std_serial_dev_close,
 			sdi->conn, LOG_PREFIX);
+
+	g_free(devc->info);
+	devc->info = NULL;
+
+	return ret;
 }
 
 #define DMM(ID, CHIPSET, VENDOR, MODEL, CONN, BAUDRATE, PACKETSIZE, TIMEOUT, \
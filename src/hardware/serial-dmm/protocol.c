@@ -108,51 +108,64 @@ SR_PRIV int req_packet(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static void handle_new_data(struct sr_dev_inst *sdi, void *info)
+/*
+ * Where packets of a chipset have a fixed byte, so the scanner can skip
+ * to the offsets where the validator has a chance.
+ */
+static const struct {
+	gboolean (*packet_valid)(const uint8_t *);
+	int sync_offset;
+	uint8_t sync_byte;
+} packet_syncs[] = {
+	{ sr_es519xx_19200_11b_packet_valid, 10, '\n' },
+	{ sr_es519xx_19200_14b_packet_valid, 13, '\n' },
+	{ sr_es519xx_2400_11b_packet_valid, 10, '\n' },
+	{ sr_fs9922_packet_valid, 13, '\n' },
+	{ sr_m2110_packet_valid, 8, '\n' },
+	{ sr_metex14_packet_valid, 13, '\r' },
+	{ sr_ut71x_packet_valid, 10, '\n' },
+	{ sr_vc870_packet_valid, 22, '\n' },
+};
+
+SR_PRIV int packet_scanner_init(const struct dmm_info *dmm,
+		struct serial_packet_scanner *scanner)
 {
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(packet_syncs); i++) {
+		if (packet_syncs[i].packet_valid == dmm->packet_valid)
+			return serial_packet_scanner_init(scanner,
+				dmm->packet_size, dmm->packet_valid,
+				packet_syncs[i].sync_offset,
+				packet_syncs[i].sync_byte);
+	}
+
+	return serial_packet_scanner_init(scanner, dmm->packet_size,
+			dmm->packet_valid, -1, 0);
+}
+
+static gboolean packet_found(const uint8_t *buf, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
 	struct dmm_info *dmm;
 	struct dev_context *devc;
-	int len, i, offset = 0;
-	struct sr_serial_dev_inst *serial;
 
+	sdi = cb_data;
 	dmm = (struct dmm_info *)sdi->driver;
-
 	devc = sdi->priv;
-	serial = sdi->conn;
 
-	/* Try to get as much data as the buffer can hold. */
-	len = DMM_BUFSIZE - devc->buflen;
-	len = serial_read_nonblocking(serial, devc->buf + devc->buflen, len);
-	if (len == 0)
-		return; /* No new bytes, nothing to do. */
-	if (len < 0) {
-		sr_err("Serial port read error: %d.", len);
-		return;
-	}
-	devc->buflen += len;
-
-	/* Now look for packets in that data. */
-	while ((devc->buflen - offset) >= dmm->packet_size) {
-		if (dmm->packet_valid(devc->buf + offset)) {
-			handle_packet(devc->buf + offset, sdi, info);
-			offset += dmm->packet_size;
-
-			/* Request next packet, if required. */
-			if (!dmm->packet_request)
-				break;
-			if (dmm->req_timeout_ms || dmm->req_delay_ms)
-				devc->req_next_at = g_get_monotonic_time() +
-					dmm->req_delay_ms * 1000;
-			req_packet(sdi);
-		} else {
-			offset++;
-		}
-	}
+	memset(devc->info, 0, dmm->info_size);
+	handle_packet(buf, sdi, devc->info);
 
-	/* If we have any data left, move it to the beginning of our buffer. */
-	for (i = 0; i < devc->buflen - offset; i++)
-		devc->buf[i] = devc->buf[offset + i];
-	devc->buflen -= offset;
+	/* Request next packet, if required. */
+	if (!dmm->packet_request)
+		return FALSE;
+	if (dmm->req_timeout_ms || dmm->req_delay_ms)
+		devc->req_next_at = g_get_monotonic_time() +
+			dmm->req_delay_ms * 1000;
+	req_packet(sdi);
+
+	return TRUE;
 }
 
 int receive_data(int fd, int revents, void *cb_data)
@@ -160,7 +173,7 @@ int receive_data(int fd, int revents, void *cb_data)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct dmm_info *dmm;
-	void *info;
+	int ret;
 
 	(void)fd;
 
@@ -174,9 +187,10 @@ int receive_data(int fd, int revents, void *cb_data)
 
 	if (revents == G_IO_IN) {
 		/* Serial data arrived. */
-		info = g_malloc(dmm->info_size);
-		handle_new_data(sdi, info);
-		g_free(info);
+		ret = serial_packet_scan(sdi->conn, &devc->scanner,
+				packet_found, sdi);
+		if (ret < 0)
+			sr_err("Serial port read error: %d.", ret);
 	} else {
 		/* Timeout; send another packet request if DMM needs it. */
 		if (dmm->packet_request && (req_packet(sdi) < 0))
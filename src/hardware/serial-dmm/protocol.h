@@ -54,15 +54,13 @@ struct dmm_info {
 	gsize info_size;
 };
 
-#define DMM_BUFSIZE 256
-
 /** Private, per-device-instance driver context. */
 struct dev_context {
 	struct sr_sw_limits limits;
 
-	uint8_t buf[DMM_BUFSIZE];
-	int bufoffset;
-	int buflen;
+	struct serial_packet_scanner scanner;
+	/** Chipset info struct, dmm_info.info_size bytes. */
+	void *info;
 
 	/** The timestamp [µs] to send the next request.
 	 *  Used only if device needs polling. */
@@ -70,6 +68,8 @@ struct dev_context {
 };
 
 SR_PRIV int req_packet(struct sr_dev_inst *sdi);
+SR_PRIV int packet_scanner_init(const struct dmm_info *dmm,
+		struct serial_packet_scanner *scanner);
 SR_PRIV int receive_data(int fd, int revents, void *cb_data);
 
 #endif
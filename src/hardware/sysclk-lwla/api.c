@@ -229,6 +229,14 @@ static int dev_clear(const struct sr_dev_driver *di)
 	return std_dev_clear(di, &clear_dev_context);
 }
 
+/* Tell whether a USB device is one of the supported models.
+ */
+static gboolean usb_match(uint16_t vendor_id, uint16_t product_id)
+{
+	return vendor_id == USB_VID_SYSCLK && (product_id == USB_PID_LWLA1016
+			|| product_id == USB_PID_LWLA1034);
+}
+
 /* Drain any pending data from the USB transfer buffers on the device.
  * This may be necessary e.g. after a crash or generally to clean up after
  * an abnormal condition.
@@ -242,7 +250,7 @@ static int drain_usb(struct sr_usb_dev_inst *usb, unsigned int endpoint)
 	drained = 0;
 	do {
 		xfer_len = 0;
-		ret = libusb_bulk_transfer(usb->devhdl, endpoint,
+		ret = sr_usb_bulk_transfer(usb->devhdl, endpoint,
 					   buf, sizeof(buf), &xfer_len,
 					   drain_timeout_ms);
 		drained += xfer_len;
@@ -793,4 +801,5 @@ SR_PRIV struct sr_dev_driver sysclk_lwla_driver_info = {
 	.dev_acquisition_start = dev_acquisition_start,
 	.dev_acquisition_stop = dev_acquisition_stop,
 	.context = NULL,
+	.usb_match = usb_match,
 };
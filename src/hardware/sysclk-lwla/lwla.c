@@ -93,7 +93,7 @@ SR_PRIV int lwla_send_bitstream(struct sr_context *ctx,
 	sr_info("Downloading FPGA bitstream '%s'.", name);
 
 	/* Transfer the entire bitstream in one URB. */
-	ret = libusb_bulk_transfer(usb->devhdl, EP_CONFIG,
+	ret = sr_usb_bulk_transfer(usb->devhdl, EP_CONFIG,
 				   stream, length, &xfer_len, USB_TIMEOUT_MS);
 	g_free(stream);
 
@@ -124,7 +124,7 @@ SR_PRIV int lwla_send_command(const struct sr_usb_dev_inst *usb,
 		return SR_ERR_BUG;
 
 	xfer_len = 0;
-	ret = libusb_bulk_transfer(usb->devhdl, EP_COMMAND,
+	ret = sr_usb_bulk_transfer(usb->devhdl, EP_COMMAND,
 				   (unsigned char *)command, cmd_len * 2,
 				   &xfer_len, USB_TIMEOUT_MS);
 	if (ret != 0) {
@@ -149,7 +149,7 @@ SR_PRIV int lwla_receive_reply(const struct sr_usb_dev_inst *usb,
 	if (!usb || !reply || buf_size <= 0)
 		return SR_ERR_BUG;
 
-	ret = libusb_bulk_transfer(usb->devhdl, EP_REPLY, reply, buf_size,
+	ret = sr_usb_bulk_transfer(usb->devhdl, EP_REPLY, reply, buf_size,
 				   xfer_len, USB_TIMEOUT_MS);
 	if (ret != 0) {
 		sr_dbg("Failed to receive reply: %s.", libusb_error_name(ret));
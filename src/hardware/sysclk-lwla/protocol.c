@@ -29,7 +29,7 @@ static int submit_transfer(struct dev_context *devc,
 {
 	int ret;
 
-	ret = libusb_submit_transfer(xfer);
+	ret = sr_usb_submit_transfer(xfer);
 
 	if (ret != 0) {
 		sr_err("Submit transfer failed: %s.", libusb_error_name(ret));
@@ -291,8 +291,7 @@ static int transfer_event(int fd, int revents, void *cb_data)
 	/* Handle pending USB events without blocking. */
 	tv.tv_sec  = 0;
 	tv.tv_usec = 0;
-	ret = libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx,
-						     &tv, NULL);
+	ret = sr_usb_handle_events(drvc->sr_ctx->libusb_ctx, &tv, NULL);
 	if (ret != 0) {
 		sr_err("Event handling failed: %s.", libusb_error_name(ret));
 		devc->transfer_error = TRUE;
@@ -0,0 +1,598 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libusb.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "hotplug"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Tracking USB devices as they are plugged in and out.
+ */
+
+/**
+ * @addtogroup grp_driver
+ *
+ * @{
+ */
+
+/*
+ * Firmware uploads make a device disconnect and come back on the same
+ * port, possibly with other IDs. For this long after a port was probed,
+ * a departure only counts if the device doesn't come back, and arrivals
+ * are ignored, so that doesn't look like a new device.
+ */
+#define HOTPLUG_SETTLE_MS 3000
+
+/* How often the hotplug thread checks whether it should stop. */
+#define HOTPLUG_POLL_MS 100
+
+/** @cond PRIVATE */
+struct hotplug_source {
+	GSource base;
+	struct sr_hotplug *hp;
+};
+
+struct hotplug_event {
+	libusb_device *dev;
+	gboolean arrived;
+	gint64 time;
+};
+
+struct sr_hotplug {
+	struct sr_context *ctx;
+	struct sr_dev_driver **drivers;
+	sr_hotplug_callback cb;
+	void *cb_data;
+	/*
+	 * Notifications come from a libusb context of their own, so the
+	 * hotplug thread never runs the transfer callbacks of drivers.
+	 */
+	libusb_context *usb_ctx;
+	libusb_hotplug_callback_handle handle;
+	GThread *thread;
+	gint running;
+	/* Events from the libusb callback, handled in main_context. */
+	GAsyncQueue *events;
+	GMainContext *main_context;
+	GSource *source;
+	/* Port path -> GSList of the devices found on it. */
+	GHashTable *inventory;
+	/* Port path -> time of the last probe, in gint64 *. */
+	GHashTable *probed;
+	/* Port path -> end of its settle time, for departures put off. */
+	GHashTable *departures;
+	/* Protects inventory. */
+	GMutex mutex;
+};
+/** @endcond */
+
+/*
+ * Called by libusb while handling events. No I/O is allowed here, so
+ * the device is just queued for the main context.
+ */
+static int LIBUSB_CALL hotplug_cb(libusb_context *usb_ctx,
+		libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	struct sr_hotplug *hp;
+	struct hotplug_event *ev;
+
+	(void)usb_ctx;
+
+	hp = user_data;
+
+	ev = g_malloc(sizeof(struct hotplug_event));
+	ev->dev = libusb_ref_device(dev);
+	ev->arrived = (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+	ev->time = g_get_monotonic_time();
+	g_async_queue_push(hp->events, ev);
+
+	return 0;
+}
+
+static gboolean driver_takes_conn(const struct sr_dev_driver *driver)
+{
+	GArray *opts;
+	gboolean ret;
+	unsigned int i;
+
+	if (!(opts = sr_driver_scan_options_list(driver)))
+		return FALSE;
+
+	ret = FALSE;
+	for (i = 0; i < opts->len; i++) {
+		if (g_array_index(opts, uint32_t, i) == SR_CONF_CONN)
+			ret = TRUE;
+	}
+	g_array_free(opts, TRUE);
+
+	return ret;
+}
+
+static GSList *probe(struct sr_hotplug *hp, const char *path,
+		const struct libusb_device_descriptor *des)
+{
+	struct sr_dev_driver *driver;
+	struct sr_config *src;
+	GSList *options, *devices;
+	int i;
+
+	src = sr_config_new(SR_CONF_CONN, g_variant_new_string(path));
+	options = g_slist_append(NULL, src);
+
+	devices = NULL;
+	for (i = 0; (driver = hp->drivers[i]); i++) {
+		if (!driver->usb_match
+				|| !driver->usb_match(des->idVendor, des->idProduct))
+			continue;
+		if (!driver_takes_conn(driver)) {
+			sr_dbg("%s can't probe a single device.", driver->name);
+			continue;
+		}
+		sr_dbg("Probing %04x:%04x at %s with %s.", des->idVendor,
+			des->idProduct, path, driver->name);
+		/* Don't run drivers alongside sr_driver_scan_parallel(). */
+		sr_scan_lock();
+		devices = g_slist_concat(devices, sr_driver_scan(driver, options));
+		sr_scan_unlock();
+	}
+
+	g_slist_free(options);
+	sr_config_free(src);
+
+	return devices;
+}
+
+static void depart(struct sr_hotplug *hp, const char *path)
+{
+	GSList *devices;
+
+	g_hash_table_remove(hp->probed, path);
+	g_hash_table_remove(hp->departures, path);
+	g_mutex_lock(&hp->mutex);
+	devices = g_slist_copy(g_hash_table_lookup(hp->inventory, path));
+	g_hash_table_remove(hp->inventory, path);
+	g_mutex_unlock(&hp->mutex);
+	if (!devices)
+		return;
+
+	sr_info("%d device(s) gone from %s.", g_slist_length(devices), path);
+	hp->cb(hp->ctx, FALSE, devices, hp->cb_data);
+	g_slist_free(devices);
+}
+
+static void handle_event(struct sr_hotplug *hp, struct hotplug_event *ev)
+{
+	struct libusb_device_descriptor des;
+	GSList *devices;
+	gint64 *probed, *due;
+	char path[64];
+
+	if (usb_get_port_path(ev->dev, path, sizeof(path)) != SR_OK)
+		return;
+
+	/* An event after the settle time comes after the departure. */
+	due = g_hash_table_lookup(hp->departures, path);
+	if (due && ev->time >= *due)
+		depart(hp, path);
+
+	probed = g_hash_table_lookup(hp->probed, path);
+	if (probed && ev->time < *probed + HOTPLUG_SETTLE_MS * 1000) {
+		if (ev->arrived) {
+			sr_spew("Ignoring arrival on %s, still settling.", path);
+			g_hash_table_remove(hp->departures, path);
+		} else {
+			sr_spew("Putting off departure from %s, still "
+				"settling.", path);
+			due = g_malloc(sizeof(gint64));
+			*due = *probed + HOTPLUG_SETTLE_MS * 1000;
+			g_hash_table_replace(hp->departures, g_strdup(path),
+				due);
+		}
+		return;
+	}
+
+	if (!ev->arrived) {
+		depart(hp, path);
+		return;
+	}
+
+	g_mutex_lock(&hp->mutex);
+	devices = g_hash_table_lookup(hp->inventory, path);
+	g_mutex_unlock(&hp->mutex);
+	if (devices)
+		return;
+
+	if (libusb_get_device_descriptor(ev->dev, &des) != 0)
+		return;
+
+	devices = probe(hp, path, &des);
+
+	probed = g_malloc(sizeof(gint64));
+	*probed = g_get_monotonic_time();
+	g_hash_table_replace(hp->probed, g_strdup(path), probed);
+
+	if (!devices)
+		return;
+
+	sr_info("%d device(s) found on %s.", g_slist_length(devices), path);
+	g_mutex_lock(&hp->mutex);
+	g_hash_table_insert(hp->inventory, g_strdup(path), devices);
+	g_mutex_unlock(&hp->mutex);
+	hp->cb(hp->ctx, TRUE, devices, hp->cb_data);
+}
+
+static void free_event(struct hotplug_event *ev)
+{
+	libusb_unref_device(ev->dev);
+	g_free(ev);
+}
+
+/* The device on the port now, if there is one. */
+static libusb_device *port_device(struct sr_hotplug *hp, const char *path)
+{
+	libusb_device **devlist, *dev;
+	char dev_path[64];
+	ssize_t num_devs, i;
+
+	if ((num_devs = libusb_get_device_list(hp->usb_ctx, &devlist)) < 0)
+		return NULL;
+
+	dev = NULL;
+	for (i = 0; i < num_devs && !dev; i++) {
+		if (usb_get_port_path(devlist[i], dev_path,
+				sizeof(dev_path)) == SR_OK
+				&& !strcmp(dev_path, path))
+			dev = libusb_ref_device(devlist[i]);
+	}
+	libusb_free_device_list(devlist, 1);
+
+	return dev;
+}
+
+/*
+ * The device didn't come back while its port settled, so it's gone.
+ * If a device is on the port anyway, the arrival went unnoticed; it is
+ * probed again, now that the devices found before are gone.
+ */
+static void handle_departures(struct sr_hotplug *hp, gint64 now)
+{
+	struct hotplug_event ev;
+	GHashTableIter iter;
+	gpointer path, due;
+	GSList *expired, *l;
+
+	expired = NULL;
+	g_hash_table_iter_init(&iter, hp->departures);
+	while (g_hash_table_iter_next(&iter, &path, &due)) {
+		if (*(gint64 *)due <= now)
+			expired = g_slist_append(expired, g_strdup(path));
+	}
+
+	for (l = expired; l; l = l->next) {
+		depart(hp, l->data);
+		if (!(ev.dev = port_device(hp, l->data)))
+			continue;
+		ev.arrived = TRUE;
+		ev.time = now;
+		handle_event(hp, &ev);
+		libusb_unref_device(ev.dev);
+	}
+	g_slist_free_full(expired, g_free);
+}
+
+/* The end of the earliest settle time with a departure put off. */
+static gint64 next_departure(struct sr_hotplug *hp)
+{
+	GHashTableIter iter;
+	gpointer due;
+	gint64 next;
+
+	next = G_MAXINT64;
+	g_hash_table_iter_init(&iter, hp->departures);
+	while (g_hash_table_iter_next(&iter, NULL, &due))
+		next = MIN(next, *(gint64 *)due);
+
+	return next;
+}
+
+static gboolean hotplug_source_prepare(GSource *source, int *timeout)
+{
+	struct hotplug_source *hsource;
+	gint64 now, next;
+
+	hsource = (struct hotplug_source *)source;
+	*timeout = -1;
+
+	if (g_async_queue_length(hsource->hp->events) > 0)
+		return TRUE;
+
+	if ((next = next_departure(hsource->hp)) == G_MAXINT64)
+		return FALSE;
+	now = g_source_get_time(source);
+	*timeout = (MAX(0, next - now) + 999) / 1000;
+
+	return *timeout == 0;
+}
+
+static gboolean hotplug_source_check(GSource *source)
+{
+	struct hotplug_source *hsource;
+
+	hsource = (struct hotplug_source *)source;
+
+	return g_async_queue_length(hsource->hp->events) > 0
+		|| next_departure(hsource->hp) <= g_source_get_time(source);
+}
+
+/* Probe in the application's thread, like any other driver call. */
+static gboolean hotplug_source_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	struct hotplug_source *hsource;
+	struct hotplug_event *ev;
+
+	(void)callback;
+	(void)user_data;
+
+	hsource = (struct hotplug_source *)source;
+
+	while ((ev = g_async_queue_try_pop(hsource->hp->events))) {
+		handle_event(hsource->hp, ev);
+		free_event(ev);
+	}
+	handle_departures(hsource->hp, g_get_monotonic_time());
+
+	return G_SOURCE_CONTINUE;
+}
+
+static GSource *hotplug_source_new(struct sr_hotplug *hp)
+{
+	static GSourceFuncs hotplug_source_funcs = {
+		.prepare  = &hotplug_source_prepare,
+		.check    = &hotplug_source_check,
+		.dispatch = &hotplug_source_dispatch,
+	};
+	GSource *source;
+
+	source = g_source_new(&hotplug_source_funcs,
+			sizeof(struct hotplug_source));
+	((struct hotplug_source *)source)->hp = hp;
+	g_source_set_name(source, "usb-hotplug");
+
+	return source;
+}
+
+/* Only waits for notifications; they are handled in the main context. */
+static gpointer hotplug_thread(gpointer data)
+{
+	struct sr_hotplug *hp;
+	struct timeval tv;
+
+	hp = data;
+
+	while (g_atomic_int_get(&hp->running)) {
+		tv.tv_sec = 0;
+		tv.tv_usec = HOTPLUG_POLL_MS * 1000;
+		libusb_handle_events_timeout_completed(hp->usb_ctx, &tv, NULL);
+		if (g_async_queue_length(hp->events) > 0)
+			g_main_context_wakeup(hp->main_context);
+	}
+
+	return NULL;
+}
+
+/**
+ * Start tracking USB devices.
+ *
+ * When a USB device is plugged in, the drivers whose usb_match() accepts
+ * its IDs probe it on its port (as an SR_CONF_CONN scan option), and the
+ * devices they find are passed to @a cb. When it is unplugged, @a cb gets
+ * the devices that were found on that port again. The devices that are
+ * connected already are reported as if they were just plugged in.
+ *
+ * Devices are probed, and @a cb is called, from the GLib main context
+ * that is the thread default one when this is called. The application
+ * must run a main loop on it, as sr_session_run() does, and won't see
+ * probes happen during its own driver calls in that thread. The devices
+ * belong to their drivers, as with sr_driver_scan(); the list passed to
+ * the callback is freed when it returns.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param drivers NULL-terminated array of drivers to probe with. They must
+ *                have been initialized with sr_driver_init().
+ * @param cb Called with TRUE and the new devices when devices are plugged
+ *           in, and with FALSE and the devices that are gone when they are
+ *           unplugged. Must not be NULL.
+ * @param cb_data Data passed to @a cb.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or tracking was started already.
+ * @retval SR_ERR_NA libusb doesn't support hotplug on this platform.
+ * @retval SR_ERR Other error.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_hotplug_start(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, sr_hotplug_callback cb,
+		void *cb_data)
+{
+	struct sr_hotplug *hp;
+	GError *error;
+	int num_drivers, ret;
+
+	if (!ctx || !drivers || !cb || ctx->hotplug)
+		return SR_ERR_ARG;
+
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		sr_err("libusb doesn't support hotplug on this platform.");
+		return SR_ERR_NA;
+	}
+
+	for (num_drivers = 0; drivers[num_drivers]; num_drivers++);
+
+	hp = g_malloc0(sizeof(struct sr_hotplug));
+	hp->ctx = ctx;
+	hp->drivers = g_memdup(drivers,
+			(num_drivers + 1) * sizeof(struct sr_dev_driver *));
+	hp->cb = cb;
+	hp->cb_data = cb_data;
+	hp->events = g_async_queue_new();
+	hp->inventory = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)g_slist_free);
+	hp->probed = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, g_free);
+	hp->departures = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, g_free);
+	g_mutex_init(&hp->mutex);
+	hp->main_context = g_main_context_ref_thread_default();
+	hp->source = hotplug_source_new(hp);
+	g_source_attach(hp->source, hp->main_context);
+
+	ret = libusb_init(&hp->usb_ctx);
+	if (ret != LIBUSB_SUCCESS) {
+		sr_err("libusb_init() returned %s.", libusb_error_name(ret));
+		hp->usb_ctx = NULL;
+		ctx->hotplug = hp;
+		sr_hotplug_stop(ctx);
+		return SR_ERR;
+	}
+
+	/* Existing devices show up as arrivals. */
+	ret = libusb_hotplug_register_callback(hp->usb_ctx,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+			| LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+			LIBUSB_HOTPLUG_ENUMERATE, LIBUSB_HOTPLUG_MATCH_ANY,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			hotplug_cb, hp, &hp->handle);
+	if (ret != LIBUSB_SUCCESS) {
+		sr_err("Failed to register hotplug callback: %s.",
+			libusb_error_name(ret));
+		ctx->hotplug = hp;
+		sr_hotplug_stop(ctx);
+		return SR_ERR;
+	}
+
+	ctx->hotplug = hp;
+	g_atomic_int_set(&hp->running, 1);
+	error = NULL;
+	if (!(hp->thread = g_thread_try_new("sr-hotplug", hotplug_thread,
+			hp, &error))) {
+		sr_err("Failed to start hotplug thread: %s.", error->message);
+		g_error_free(error);
+		libusb_hotplug_deregister_callback(hp->usb_ctx, hp->handle);
+		sr_hotplug_stop(ctx);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Stop tracking USB devices.
+ *
+ * When this returns, the callback passed to sr_hotplug_start() won't be
+ * called anymore. This must not be called from that callback.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK Success, or tracking wasn't started.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_hotplug_stop(struct sr_context *ctx)
+{
+	struct sr_hotplug *hp;
+	struct hotplug_event *ev;
+
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	if (!(hp = ctx->hotplug))
+		return SR_OK;
+
+	if (hp->thread) {
+		g_atomic_int_set(&hp->running, 0);
+		/* This also wakes up the thread. */
+		libusb_hotplug_deregister_callback(hp->usb_ctx, hp->handle);
+		g_thread_join(hp->thread);
+	}
+
+	g_source_destroy(hp->source);
+	g_source_unref(hp->source);
+	g_main_context_unref(hp->main_context);
+
+	while ((ev = g_async_queue_try_pop(hp->events)))
+		free_event(ev);
+	g_async_queue_unref(hp->events);
+	if (hp->usb_ctx)
+		libusb_exit(hp->usb_ctx);
+	g_hash_table_destroy(hp->inventory);
+	g_hash_table_destroy(hp->probed);
+	g_hash_table_destroy(hp->departures);
+	g_mutex_clear(&hp->mutex);
+	g_free(hp->drivers);
+	g_free(hp);
+	ctx->hotplug = NULL;
+
+	return SR_OK;
+}
+
+/**
+ * List the devices found by USB hotplug tracking.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @return A GSList * of struct sr_dev_inst, or NULL if there are none or
+ *         tracking isn't started. The list must be freed by the caller
+ *         using g_slist_free(), but without freeing the data pointed to
+ *         in the list.
+ *
+ * @since 0.5.0
+ */
+SR_API GSList *sr_hotplug_dev_list(struct sr_context *ctx)
+{
+	struct sr_hotplug *hp;
+	GHashTableIter iter;
+	gpointer devices;
+	GSList *l;
+
+	if (!ctx || !(hp = ctx->hotplug))
+		return NULL;
+
+	l = NULL;
+	g_mutex_lock(&hp->mutex);
+	g_hash_table_iter_init(&iter, hp->inventory);
+	while (g_hash_table_iter_next(&iter, NULL, &devices))
+		l = g_slist_concat(l, g_slist_copy(devices));
+	g_mutex_unlock(&hp->mutex);
+
+	return l;
+}
+
+/** @} */
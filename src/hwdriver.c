@@ -191,6 +191,18 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Probe factor", NULL},
 	{SR_CONF_ADC_POWERLINE_CYCLES, SR_T_FLOAT, "nplc",
 		"Number of ADC powerline cycles", NULL},
+	{SR_CONF_REPLAY_SAMPLES, SR_T_UINT64_RANGE, "replay_samples",
+		"Replay sample range", NULL},
+	{SR_CONF_REPLAY_TIME, SR_T_DOUBLE_RANGE, "replay_time",
+		"Replay time range", NULL},
+	{SR_CONF_NUM_TRANSFERS, SR_T_UINT64, "num_transfers",
+		"Number of USB transfers", NULL},
+	{SR_CONF_EVENT_THREAD, SR_T_BOOL, "event_thread",
+		"USB event thread", NULL},
+	{SR_CONF_MAX_THROUGHPUT, SR_T_BOOL, "max_throughput",
+		"Maximum throughput", NULL},
+	{SR_CONF_TRANSFER_SIZE, SR_T_UINT64, "transfer_size",
+		"USB transfer size", NULL},
 
 	/* Acquisition modes, sample limiting */
 	{SR_CONF_LIMIT_MSEC, SR_T_UINT64, "limit_time",
@@ -489,6 +501,10 @@ static int check_options(struct sr_dev_driver *driver, GSList *options,
  * Before calling sr_driver_scan(), the user must have previously initialized
  * the driver by calling sr_driver_init().
  *
+ * If a scan cache is set up (see sr_scan_cache_set_file()), the devices this
+ * driver found last time are probed first, and the full scan is skipped if
+ * they are all still there.
+ *
  * @param driver The driver that should scan. This must be a pointer to one of
  *               the entries returned by sr_driver_list(). Must not be NULL.
  * @param options A list of 'struct sr_hwopt' options to pass to the driver's
@@ -520,11 +536,16 @@ SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
 			return NULL;
 	}
 
+	if ((l = sr_scan_cache_lookup(driver, options)))
+		return l;
+
 	l = driver->scan(driver, options);
 
 	sr_spew("Scan of '%s' found %d devices.", driver->name,
 		g_slist_length(l));
 
+	sr_scan_cache_update(driver, options, l);
+
 	return l;
 }
 
@@ -259,10 +259,6 @@ static void cleanup(struct sr_input *in)
 	struct context *inc;
 
 	inc = in->priv;
-	g_variant_unref(options[0].def);
-	g_variant_unref(options[1].def);
-	g_variant_unref(options[2].def);
-	g_slist_free_full(options[2].values, (GDestroyNotify)g_variant_unref);
 	g_free(inc);
 	in->priv = NULL;
 }
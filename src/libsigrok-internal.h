@@ -36,6 +36,7 @@
 
 struct zip;
 struct zip_stat;
+struct sr_scpi_dev_inst;
 
 /**
  * @file
@@ -271,11 +272,16 @@ struct sr_context {
 	struct sr_dev_driver **driver_list;
 #ifdef HAVE_LIBUSB_1_0
 	libusb_context *libusb_ctx;
+	/* USB hotplug tracking, NULL if it isn't running. */
+	struct sr_hotplug *hotplug;
 #endif
 	sr_resource_open_callback resource_open_cb;
 	sr_resource_close_callback resource_close_cb;
 	sr_resource_read_callback resource_read_cb;
 	void *resource_cb_data;
+	/* Where the scan cache is kept, NULL if it isn't used. */
+	char *scan_cache_file;
+	GKeyFile *scan_cache;
 };
 
 /** Input module metadata keys. */
@@ -619,6 +625,31 @@ struct sr_transform_module {
 			struct sr_datafeed_packet *packet_in,
 			struct sr_datafeed_packet **packet_out);
 
+	/**
+	 * Optional per-block kernel for SR_DF_LOGIC packets.
+	 *
+	 * If set, the session may call this instead of receive() for logic
+	 * packets, once for every block of the packet's data, in order.
+	 * Consecutive transforms with a kernel are fused this way: all of
+	 * them run on one cache-sized block before the next block is
+	 * touched. All other packet types still go through receive().
+	 *
+	 * The kernel must work in place and must not change the length
+	 * of the data.
+	 *
+	 * @param t Pointer to the respective 'struct sr_transform'.
+	 * @param logic The logic payload the block is part of.
+	 * @param data Start of the block within logic->data.
+	 * @param length Length of the block in bytes, a multiple of the
+	 *               unit size.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_logic_block) (const struct sr_transform *t,
+			const struct sr_datafeed_logic *logic,
+			uint8_t *data, uint64_t length);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the transform module, and can be used to free any internal
@@ -643,6 +674,9 @@ struct sr_usb_dev_inst {
 #endif
 
 #ifdef HAVE_LIBSERIALPORT
+/** Size of the per-port read-ahead buffer. */
+#define SERIAL_RXBUF_SIZE 1024
+
 struct sr_serial_dev_inst {
 	/** Port name, e.g. '/dev/tty42'. */
 	char *port;
@@ -650,6 +684,14 @@ struct sr_serial_dev_inst {
 	char *serialcomm;
 	/** libserialport port handle */
 	struct sp_port *data;
+	/** Bytes received from the port but not consumed yet. */
+	uint8_t rxbuf[SERIAL_RXBUF_SIZE];
+	/** Offset of the first unconsumed byte in rxbuf. */
+	size_t rxbuf_pos;
+	/** Number of unconsumed bytes in rxbuf. */
+	size_t rxbuf_len;
+	/** Event set to wait for incoming data, created on first use. */
+	struct sp_event_set *rx_events;
 };
 #endif
 
@@ -800,6 +842,10 @@ struct sr_session {
 	unsigned int stop_check_id;
 	/** Whether the session has been started. */
 	gboolean running;
+	/** Recorder writing the logic data to disk, or NULL. */
+	struct sr_session_recorder *recorder;
+	/** Whether consecutive transforms with a block kernel are fused. */
+	gboolean fuse_transforms;
 };
 
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
@@ -828,6 +874,10 @@ SR_PRIV int sr_session_source_remove_channel(struct sr_session *session,
 
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_send_downstream(const struct sr_transform *t,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_fuse_transforms_set(struct sr_session *session,
+		gboolean fuse);
 SR_PRIV int sr_sessionfile_check(const char *filename);
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 		struct sr_session **session);
@@ -835,6 +885,11 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		struct sr_datafeed_packet **copy);
 SR_PRIV void sr_packet_free(struct sr_datafeed_packet *packet);
 
+/*--- session_record.c ------------------------------------------------------*/
+
+SR_PRIV int sr_session_record_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, gboolean *consumed);
+
 /*--- session_file.c --------------------------------------------------------*/
 
 #if !HAVE_ZIP_DISCARD
@@ -922,6 +977,22 @@ SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *st);
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *st, uint8_t *buf,
 		int len, int *pre_trigger_samples);
 
+/*--- scan.c ----------------------------------------------------------------*/
+
+SR_PRIV void sr_scan_io_begin(void);
+SR_PRIV void sr_scan_io_end(void);
+SR_PRIV unsigned int sr_scan_io_timeout(unsigned int timeout_ms);
+SR_PRIV GSList *sr_driver_scan_ports(struct sr_dev_driver **drivers,
+		GSList *options, GSList *ports, int max_threads,
+		unsigned int timeout_ms);
+SR_PRIV void sr_scan_lock(void);
+SR_PRIV void sr_scan_unlock(void);
+SR_PRIV GSList *sr_scan_cache_lookup(struct sr_dev_driver *driver,
+		GSList *options);
+SR_PRIV void sr_scan_cache_update(struct sr_dev_driver *driver,
+		GSList *options, GSList *devices);
+SR_PRIV void sr_scan_cache_free(struct sr_context *ctx);
+
 /*--- hardware/serial.c -----------------------------------------------------*/
 
 #ifdef HAVE_LIBSERIALPORT
@@ -931,6 +1002,24 @@ enum {
 };
 
 typedef gboolean (*packet_valid_callback)(const uint8_t *buf);
+typedef gboolean (*packet_found_callback)(const uint8_t *buf, void *cb_data);
+
+#define SERIAL_SCANNER_BUFSIZE 256
+
+/** Finds fixed size packets in a serial data stream. */
+struct serial_packet_scanner {
+	/** Size of a packet, in bytes. */
+	size_t packet_size;
+	/** Offset of a byte every packet has, or -1 if there is none. */
+	int sync_offset;
+	/** The byte every packet has at @a sync_offset. */
+	uint8_t sync_byte;
+	/** Packet validation function. */
+	packet_valid_callback is_valid;
+	/** Received data that doesn't make a packet yet. */
+	uint8_t buf[SERIAL_SCANNER_BUFSIZE];
+	size_t buflen;
+};
 
 SR_PRIV int serial_open(struct sr_serial_dev_inst *serial, int flags);
 SR_PRIV int serial_close(struct sr_serial_dev_inst *serial);
@@ -955,6 +1044,15 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 				 size_t packet_size,
 				 packet_valid_callback is_valid,
 				 uint64_t timeout_ms, int baudrate);
+SR_PRIV int serial_packet_scanner_init(struct serial_packet_scanner *scanner,
+		size_t packet_size, packet_valid_callback is_valid,
+		int sync_offset, uint8_t sync_byte);
+SR_PRIV int serial_packet_scanner_feed(struct serial_packet_scanner *scanner,
+		const uint8_t *buf, size_t len,
+		packet_found_callback cb, void *cb_data);
+SR_PRIV int serial_packet_scan(struct sr_serial_dev_inst *serial,
+		struct serial_packet_scanner *scanner,
+		packet_found_callback cb, void *cb_data);
 SR_PRIV int sr_serial_extract_options(GSList *options, const char **serial_device,
 				      const char **serial_options);
 SR_PRIV int serial_source_add(struct sr_session *session,
@@ -986,6 +1084,19 @@ SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data);
 SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx);
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len);
+SR_PRIV void sr_usb_shim_init(void);
+SR_PRIV void sr_usb_shim_exit(void);
+SR_PRIV int sr_usb_submit_transfer(struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_cancel_transfer(struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_handle_events(libusb_context *usb_ctx, struct timeval *tv,
+		int *completed);
+SR_PRIV int sr_usb_control_transfer(libusb_device_handle *devhdl,
+		uint8_t request_type, uint8_t request, uint16_t value,
+		uint16_t index, unsigned char *data, uint16_t length,
+		unsigned int timeout);
+SR_PRIV int sr_usb_bulk_transfer(libusb_device_handle *devhdl,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout);
 #endif
 
 
@@ -1288,4 +1399,71 @@ SR_PRIV void sr_sw_limits_update_samples_read(struct sr_sw_limits *limits,
 	uint64_t samples_read);
 SR_PRIV void sr_sw_limits_init(struct sr_sw_limits *limits);
 
+/*--- test_hooks.c ----------------------------------------------------------*/
+
+/*
+ * Private functions the unit tests call. They link the shared library,
+ * which doesn't export SR_PRIV symbols.
+ */
+struct sr_test_hooks {
+	int (*std_init)(struct sr_dev_driver *di, struct sr_context *sr_ctx);
+	int (*std_cleanup)(const struct sr_dev_driver *di);
+	int (*std_dev_clear)(const struct sr_dev_driver *driver,
+			std_dev_clear_callback clear_private);
+	GSList *(*std_dev_list)(const struct sr_dev_driver *di);
+	void (*dev_inst_free)(struct sr_dev_inst *sdi);
+	int (*session_fuse_transforms_set)(struct sr_session *session,
+			gboolean fuse);
+	struct soft_trigger_logic *(*soft_trigger_logic_new)(
+			const struct sr_dev_inst *sdi,
+			struct sr_trigger *trigger, int pre_trigger_samples);
+	void (*soft_trigger_logic_free)(struct soft_trigger_logic *st);
+	int (*soft_trigger_logic_check)(struct soft_trigger_logic *st,
+			uint8_t *buf, int len, int *pre_trigger_samples);
+	struct sr_scpi_dev_inst *(*scpi_dev_inst_new)(struct drv_context *drvc,
+			const char *resource, const char *serialcomm);
+	int (*scpi_open)(struct sr_scpi_dev_inst *scpi);
+	int (*scpi_close)(struct sr_scpi_dev_inst *scpi);
+	void (*scpi_free)(struct sr_scpi_dev_inst *scpi);
+	int (*scpi_get_floatv)(struct sr_scpi_dev_inst *scpi,
+			const char *command, GArray **scpi_response);
+	int (*scpi_get_block)(struct sr_scpi_dev_inst *scpi,
+			const char *command, uint8_t *buf, size_t maxlen);
+	void (*scan_io_begin)(void);
+	void (*scan_io_end)(void);
+	GSList *(*driver_scan_ports)(struct sr_dev_driver **drivers,
+			GSList *options, GSList *ports, int max_threads,
+			unsigned int timeout_ms);
+#ifdef HAVE_LIBSERIALPORT
+	int (*serial_packet_scanner_init)(
+			struct serial_packet_scanner *scanner,
+			size_t packet_size, packet_valid_callback is_valid,
+			int sync_offset, uint8_t sync_byte);
+	int (*serial_packet_scanner_feed)(
+			struct serial_packet_scanner *scanner,
+			const uint8_t *buf, size_t len,
+			packet_found_callback cb, void *cb_data);
+#endif
+#ifdef HAVE_LIBUSB_1_0
+	int (*usb_source_add)(struct sr_session *session,
+			struct sr_context *ctx, int timeout,
+			sr_receive_data_callback cb, void *cb_data);
+	int (*usb_source_remove)(struct sr_session *session,
+			struct sr_context *ctx);
+	int (*usb_submit_transfer)(struct libusb_transfer *transfer);
+	int (*usb_cancel_transfer)(struct libusb_transfer *transfer);
+	int (*usb_handle_events)(libusb_context *usb_ctx, struct timeval *tv,
+			int *completed);
+	int (*usb_control_transfer)(libusb_device_handle *devhdl,
+			uint8_t request_type, uint8_t request, uint16_t value,
+			uint16_t index, unsigned char *data, uint16_t length,
+			unsigned int timeout);
+	int (*usb_bulk_transfer)(libusb_device_handle *devhdl,
+			unsigned char endpoint, unsigned char *data, int length,
+			int *transferred, unsigned int timeout);
+#endif
+};
+
+SR_API const struct sr_test_hooks *sr_test_hooks_get(void);
+
 #endif
@@ -0,0 +1,298 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "logic"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Handling logic data.
+ */
+
+/**
+ * @defgroup grp_logic Logic data handling
+ *
+ * Handling logic data.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+struct sr_logic_edges {
+	uint16_t unitsize;
+	/* Number of samples seen so far. */
+	uint64_t samplenum;
+	/* The last sample seen, NULL at the start of a stream. */
+	uint8_t *last;
+	uint8_t *changed;
+	/* Found edges, and the changed/value bytes they point to. */
+	GArray *edges;
+	GByteArray *bits;
+};
+/** @endcond */
+
+static inline unsigned int lowest_bit(uint64_t x)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(x);
+#else
+	unsigned int i;
+
+	for (i = 0; !(x & 1); i++)
+		x >>= 1;
+
+	return i;
+#endif
+}
+
+static void add_edge(struct sr_logic_edges *e, uint64_t samplenum,
+		const uint8_t *changed, const uint8_t *value)
+{
+	struct sr_logic_edge edge;
+
+	/* The pointers are filled in once all edges are found. */
+	edge.sample = samplenum;
+	edge.changed = edge.value = NULL;
+	g_array_append_val(e->edges, edge);
+	g_byte_array_append(e->bits, changed, e->unitsize);
+	g_byte_array_append(e->bits, value, e->unitsize);
+}
+
+static void add_edge_word(struct sr_logic_edges *e, uint64_t samplenum,
+		uint64_t changed, uint64_t value)
+{
+	uint8_t c[sizeof(uint64_t)], v[sizeof(uint64_t)];
+	unsigned int i;
+
+	for (i = 0; i < e->unitsize; i++) {
+		c[i] = changed >> (8 * i);
+		v[i] = value >> (8 * i);
+	}
+	add_edge(e, samplenum, c, v);
+}
+
+/* Compare every sample against the previous one. */
+static void find_edges_bytes(struct sr_logic_edges *e, const uint8_t *data,
+		uint64_t num_samples, uint64_t samplenum)
+{
+	const uint8_t *p;
+	uint64_t i;
+	unsigned int j;
+
+	for (i = 0; i < num_samples; i++) {
+		p = data + i * e->unitsize;
+		if (memcmp(p, e->last, e->unitsize)) {
+			for (j = 0; j < e->unitsize; j++)
+				e->changed[j] = p[j] ^ e->last[j];
+			add_edge(e, samplenum + i, e->changed, p);
+			memcpy(e->last, p, e->unitsize);
+		}
+	}
+}
+
+/*
+ * Samples of 1, 2, 4 or 8 bytes are handled 64 bits at a time: each word
+ * is XORed with itself shifted by one sample, so the set bits are exactly
+ * the changes. Runs without changes cost one compare per word, and the
+ * changes in a word are located with a bit scan.
+ */
+static uint64_t find_edges_words(struct sr_logic_edges *e, const uint8_t *data,
+		uint64_t num_words, uint64_t samplenum)
+{
+	uint64_t w, d, prev, smask, i;
+	unsigned int bits, shift, per_word;
+
+	bits = e->unitsize * 8;
+	per_word = sizeof(uint64_t) / e->unitsize;
+	smask = bits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+
+	prev = 0;
+	for (shift = 0; shift < bits; shift += 8)
+		prev |= (uint64_t)e->last[shift / 8] << shift;
+
+	for (i = 0; i < num_words; i++) {
+		w = RL64(data + i * sizeof(uint64_t));
+		if (bits == 64) {
+			d = w ^ prev;
+			prev = w;
+		} else {
+			d = w ^ ((w << bits) | prev);
+			prev = w >> (64 - bits);
+		}
+		while (d) {
+			shift = lowest_bit(d) / bits * bits;
+			add_edge_word(e, samplenum + i * per_word + shift / bits,
+				(d >> shift) & smask, (w >> shift) & smask);
+			d &= ~(smask << shift);
+		}
+	}
+
+	for (shift = 0; shift < bits; shift += 8)
+		e->last[shift / 8] = prev >> shift;
+
+	return num_words * per_word;
+}
+
+/**
+ * Create a new edge finder.
+ *
+ * The edge finder extracts the changes from a stream of SR_DF_LOGIC
+ * payloads, so a consumer that is only interested in transitions can
+ * work through them instead of through every sample.
+ *
+ * @return A newly allocated edge finder. Must be freed with
+ *         sr_logic_edges_free().
+ *
+ * @since 0.5.0
+ */
+SR_API struct sr_logic_edges *sr_logic_edges_new(void)
+{
+	struct sr_logic_edges *e;
+
+	e = g_malloc0(sizeof(struct sr_logic_edges));
+	e->edges = g_array_new(FALSE, FALSE, sizeof(struct sr_logic_edge));
+	e->bits = g_byte_array_new();
+
+	return e;
+}
+
+/**
+ * Free an edge finder.
+ *
+ * @param edges The edge finder to free. Must not be NULL.
+ *
+ * @since 0.5.0
+ */
+SR_API void sr_logic_edges_free(struct sr_logic_edges *edges)
+{
+	if (!edges)
+		return;
+
+	g_free(edges->last);
+	g_free(edges->changed);
+	g_array_free(edges->edges, TRUE);
+	g_byte_array_free(edges->bits, TRUE);
+	g_free(edges);
+}
+
+/**
+ * Reset an edge finder for a new stream.
+ *
+ * The next sample will be reported as sample 0, with all channels changed.
+ *
+ * @param edges The edge finder to reset. Must not be NULL.
+ *
+ * @since 0.5.0
+ */
+SR_API void sr_logic_edges_reset(struct sr_logic_edges *edges)
+{
+	if (!edges)
+		return;
+
+	g_free(edges->last);
+	g_free(edges->changed);
+	edges->last = edges->changed = NULL;
+	edges->unitsize = 0;
+	edges->samplenum = 0;
+}
+
+/**
+ * Find the edges in a logic payload.
+ *
+ * The first sample of a stream is reported as an edge on all channels,
+ * after that an edge is reported for every sample that differs from the
+ * one before it, also across payloads. If the unitsize changes, the
+ * stream starts over (but keeps counting samples).
+ *
+ * @param[in] edges The edge finder. Must not be NULL.
+ * @param[in] logic The logic payload. Must not be NULL.
+ * @param[out] result The edges found in this payload, in sample order.
+ *                    Valid until the next call with the same edge finder.
+ * @param[out] num_edges The number of edges in @a result.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_logic_edges_find(struct sr_logic_edges *edges,
+		const struct sr_datafeed_logic *logic,
+		const struct sr_logic_edge **result, size_t *num_edges)
+{
+	struct sr_logic_edge *edge;
+	const uint8_t *data;
+	uint64_t num_samples, done;
+	unsigned int i;
+
+	if (!edges || !logic || !result || !num_edges)
+		return SR_ERR_ARG;
+	if (logic->unitsize == 0 || (logic->length && !logic->data))
+		return SR_ERR_ARG;
+
+	g_array_set_size(edges->edges, 0);
+	g_byte_array_set_size(edges->bits, 0);
+
+	data = logic->data;
+	num_samples = logic->length / logic->unitsize;
+
+	if (num_samples > 0) {
+		if (!edges->last || edges->unitsize != logic->unitsize) {
+			/* Start of a stream: everything changed. */
+			g_free(edges->last);
+			g_free(edges->changed);
+			edges->unitsize = logic->unitsize;
+			edges->last = g_malloc(edges->unitsize);
+			edges->changed = g_malloc(edges->unitsize);
+			memset(edges->last, 0xff, edges->unitsize);
+			add_edge(edges, edges->samplenum, edges->last, data);
+			memcpy(edges->last, data, edges->unitsize);
+		}
+
+		done = 0;
+		if (edges->unitsize <= sizeof(uint64_t)
+				&& sizeof(uint64_t) % edges->unitsize == 0) {
+			done = find_edges_words(edges, data,
+				logic->length / sizeof(uint64_t), edges->samplenum);
+		}
+		find_edges_bytes(edges, data + done * edges->unitsize,
+			num_samples - done, edges->samplenum + done);
+		edges->samplenum += num_samples;
+	}
+
+	/* All edges are in, the bits won't move anymore. */
+	for (i = 0; i < edges->edges->len; i++) {
+		edge = &g_array_index(edges->edges, struct sr_logic_edge, i);
+		edge->changed = edges->bits->data + 2 * i * edges->unitsize;
+		edge->value = edge->changed + edges->unitsize;
+	}
+
+	*result = (const struct sr_logic_edge *)edges->edges->data;
+	*num_edges = edges->edges->len;
+
+	return SR_OK;
+}
+
+/** @} */
@@ -35,6 +35,8 @@ struct out_context {
 	char *filename;
 	gint first_analog_index;
 	gint *analog_index_map;
+	/* Sample ranges of the chunks written so far, see index_add(). */
+	GKeyFile *index;
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -50,6 +52,7 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	outc = g_malloc0(sizeof(struct out_context));
 	outc->filename = g_strdup(o->filename);
+	outc->index = g_key_file_new();
 	o->priv = outc;
 
 	return SR_OK;
@@ -188,6 +191,70 @@ static int zip_create(const struct sr_output *o)
 	return SR_OK;
 }
 
+/*
+ * The "index" entry has a group for every capture file, which lists the
+ * first sample of each of its chunks and the total number of samples.
+ * Readers can use it to find the chunks covering a range of samples
+ * without inflating everything before them:
+ *
+ * [logic-1]
+ * samples=3145728
+ * logic-1-1=0
+ * logic-1-2=1048576
+ * ...
+ */
+static void index_add(struct out_context *outc, const char *capturefile,
+		const char *chunkname, uint64_t num_samples)
+{
+	uint64_t start;
+
+	start = 0;
+	if (g_key_file_has_key(outc->index, capturefile, "samples", NULL))
+		start = g_key_file_get_uint64(outc->index, capturefile,
+				"samples", NULL);
+	g_key_file_set_uint64(outc->index, capturefile, chunkname, start);
+	g_key_file_set_uint64(outc->index, capturefile, "samples",
+			start + num_samples);
+}
+
+static int zip_write_index(const struct sr_output *o)
+{
+	struct out_context *outc;
+	struct zip *archive;
+	struct zip_source *indexsrc;
+	struct zip_stat zs;
+	char *indexbuf;
+	gsize indexlen;
+	int ret;
+
+	outc = o->priv;
+	if (!(archive = zip_open(outc->filename, 0, NULL)))
+		return SR_ERR;
+
+	indexbuf = g_key_file_to_data(outc->index, &indexlen, NULL);
+	indexsrc = zip_source_buffer(archive, indexbuf, indexlen, FALSE);
+	if (zip_stat(archive, "index", 0, &zs) < 0)
+		ret = zip_add(archive, "index", indexsrc) < 0 ? -1 : 0;
+	else
+		ret = zip_replace(archive, zs.index, indexsrc);
+	if (ret < 0) {
+		sr_err("Failed to save index: %s", zip_strerror(archive));
+		zip_source_free(indexsrc);
+		zip_discard(archive);
+		g_free(indexbuf);
+		return SR_ERR;
+	}
+	if (zip_close(archive) < 0) {
+		sr_err("Error saving session file: %s", zip_strerror(archive));
+		zip_discard(archive);
+		g_free(indexbuf);
+		return SR_ERR;
+	}
+	g_free(indexbuf);
+
+	return SR_OK;
+}
+
 static int zip_append(const struct sr_output *o, unsigned char *buf,
 		int unitsize, int length)
 {
@@ -284,11 +351,10 @@ static int zip_append(const struct sr_output *o, unsigned char *buf,
 	}
 	logicsrc = zip_source_buffer(archive, buf, length, FALSE);
 	chunkname = g_strdup_printf("logic-1-%u", next_chunk_num);
-	i = zip_add(archive, chunkname, logicsrc);
-	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk 'logic-1-%u': %s",
-			next_chunk_num, zip_strerror(archive));
+	if (zip_add(archive, chunkname, logicsrc) < 0) {
+		sr_err("Failed to add chunk '%s': %s", chunkname,
+			zip_strerror(archive));
+		g_free(chunkname);
 		zip_source_free(logicsrc);
 		zip_discard(archive);
 		g_free(metabuf);
@@ -296,10 +362,14 @@ static int zip_append(const struct sr_output *o, unsigned char *buf,
 	}
 	if (zip_close(archive) < 0) {
 		sr_err("Error saving session file: %s", zip_strerror(archive));
+		g_free(chunkname);
 		zip_discard(archive);
 		g_free(metabuf);
 		return SR_ERR;
 	}
+	/* Only chunks that made it into the file are indexed. */
+	index_add(outc, "logic-1", chunkname, length / unitsize);
+	g_free(chunkname);
 	g_free(metabuf);
 
 	return SR_OK;
@@ -376,16 +446,19 @@ static int zip_append_analog(const struct sr_output *o,
 	analogsrc = zip_source_buffer(archive, chunkbuf, chunksize, FALSE);
 	chunkname = g_strdup_printf("%s-%u", basename, next_chunk_num);
 	i = zip_add(archive, chunkname, analogsrc);
-	g_free(chunkname);
 	if (i < 0) {
 		sr_err("Failed to add chunk '%s': %s", chunkname, zip_strerror(archive));
+		g_free(chunkname);
 		zip_source_free(analogsrc);
 		goto err_free_chunkbuf;
 	}
 	if (zip_close(archive) < 0) {
 		sr_err("Error saving session file: %s", zip_strerror(archive));
+		g_free(chunkname);
 		goto err_free_chunkbuf;
 	}
+	index_add(outc, basename, chunkname, analog->num_samples);
+	g_free(chunkname);
 
 	g_free(basename);
 	g_free(chunkbuf);
@@ -450,6 +523,13 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		if (ret != SR_OK)
 			return ret;
 		break;
+	case SR_DF_END:
+		if (outc->zip_created) {
+			ret = zip_write_index(o);
+			if (ret != SR_OK)
+				return ret;
+		}
+		break;
 	}
 
 	return SR_OK;
@@ -473,7 +553,9 @@ static int cleanup(struct sr_output *o)
 
 	outc = o->priv;
 	g_variant_unref(options[0].def);
+	options[0].def = NULL;
 	g_free(outc->analog_index_map);
+	g_key_file_free(outc->index);
 	g_free(outc->filename);
 	g_free(outc);
 	o->priv = NULL;
@@ -31,7 +31,7 @@
 struct context {
 	int num_enabled_channels;
 	GArray *channelindices;
-	uint8_t *prevsample;
+	struct sr_logic_edges *edges;
 	gboolean header_done;
 	int period;
 	int *channel_index;
@@ -77,6 +77,8 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->channel_index[i++] = ch->index;
 	}
 
+	ctx->edges = sr_logic_edges_new();
+
 	return SR_OK;
 }
 
@@ -159,11 +161,11 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
+	const struct sr_logic_edge *edges;
 	GSList *l;
 	struct context *ctx;
-	unsigned int i;
-	int p, curbit, prevbit, index;
-	uint8_t *sample;
+	size_t num_edges, i;
+	int p, curbit, index, ret;
 	gboolean timestamp_written;
 
 	*out = NULL;
@@ -191,31 +193,26 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			*out = g_string_sized_new(512);
 		}
 
-		if (!ctx->prevsample) {
-			/* Can't allocate this until we know the stream's unitsize. */
-			ctx->prevsample = g_malloc0(logic->unitsize);
-		}
+		ret = sr_logic_edges_find(ctx->edges, logic, &edges, &num_edges);
+		if (ret != SR_OK)
+			return ret;
 
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			sample = logic->data + i;
+		/* VCD only contains deltas/changes of signals. */
+		for (i = 0; i < num_edges; i++) {
 			timestamp_written = FALSE;
 
 			for (p = 0; p < ctx->num_enabled_channels; p++) {
 				index = ctx->channel_index[p];
 
-				curbit = ((unsigned)sample[index / 8]
-						>> (index % 8)) & 1;
-				prevbit = ((unsigned)ctx->prevsample[index / 8]
-						>> (index % 8)) & 1;
-
-				/* VCD only contains deltas/changes of signals. */
-				if (prevbit == curbit && ctx->samplecount > 0)
+				if (!((edges[i].changed[index / 8] >> (index % 8)) & 1))
 					continue;
+				curbit = ((unsigned)edges[i].value[index / 8]
+						>> (index % 8)) & 1;
 
 				/* Output timestamp of subsequent signal changes. */
 				if (!timestamp_written)
 					g_string_append_printf(*out, "#%.0f",
-						(double)ctx->samplecount /
+						(double)edges[i].sample /
 							ctx->samplerate * ctx->period);
 
 				/* Output which signal changed to which value. */
@@ -228,10 +225,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 			if (timestamp_written)
 				g_string_append_c(*out, '\n');
-
-			ctx->samplecount++;
-			memcpy(ctx->prevsample, sample, logic->unitsize);
 		}
+
+		ctx->samplecount += logic->length / logic->unitsize;
 		break;
 	case SR_DF_END:
 		/* Write final timestamp as length indicator. */
@@ -252,7 +248,7 @@ static int cleanup(struct sr_output *o)
 		return SR_ERR_ARG;
 
 	ctx = o->priv;
-	g_free(ctx->prevsample);
+	sr_logic_edges_free(ctx->edges);
 	g_free(ctx->channel_index);
 	g_free(ctx);
 
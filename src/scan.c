@@ -0,0 +1,726 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "scan"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Scanning for devices on several ports at once, and caching scan results.
+ */
+
+/**
+ * @addtogroup grp_driver
+ *
+ * @{
+ */
+
+/*
+ * Driver scan() functions were not written to run concurrently: they
+ * update their driver context without any locking. So the workers all
+ * take scan_lock to run driver code, and only drop it while waiting
+ * for serial port I/O (see sr_scan_io_begin()). That's where a probe
+ * spends nearly all of its time, so the waits overlap, but the
+ * drivers never run at the same time.
+ */
+
+/** @cond PRIVATE */
+struct scan_job {
+	/* Port to probe, or NULL to let the drivers enumerate. */
+	const char *port;
+	/* Drivers to run, in order. */
+	GSList *drivers;
+	/* Devices found, one list per driver. */
+	GSList **results;
+};
+
+struct scan_state {
+	GSList *options;
+	gint64 deadline;
+};
+/** @endcond */
+
+static GMutex scan_lock;
+static GPrivate scan_worker;
+
+static void scan_job_run(gpointer data, gpointer user_data)
+{
+	struct scan_job *job;
+	struct scan_state *state;
+	struct sr_config *src;
+	GSList *l, *options;
+	int i;
+
+	job = data;
+	state = user_data;
+
+	options = state->options;
+	src = NULL;
+	if (job->port) {
+		src = sr_config_new(SR_CONF_CONN, g_variant_new_string(job->port));
+		options = g_slist_prepend(g_slist_copy(options), src);
+	}
+
+	g_mutex_lock(&scan_lock);
+	g_private_set(&scan_worker, state);
+
+	for (i = 0, l = job->drivers; l; i++, l = l->next) {
+		if (g_get_monotonic_time() >= state->deadline) {
+			sr_dbg("Deadline passed, not probing %s with %s.",
+				job->port ? job->port : "(all)",
+				((struct sr_dev_driver *)l->data)->name);
+			continue;
+		}
+		job->results[i] = sr_driver_scan(l->data, options);
+	}
+
+	g_private_set(&scan_worker, NULL);
+	g_mutex_unlock(&scan_lock);
+
+	if (src) {
+		g_slist_free(options);
+		sr_config_free(src);
+	}
+}
+
+static gboolean device_conn(const struct sr_dev_inst *sdi, char **conn,
+		char **serialcomm);
+
+static gboolean has_scan_option(const struct sr_dev_driver *driver,
+		uint32_t key)
+{
+	GArray *opts;
+	gboolean found;
+	unsigned int i;
+
+	if (!(opts = sr_driver_scan_options_list(driver)))
+		return FALSE;
+
+	found = FALSE;
+	for (i = 0; i < opts->len && !found; i++)
+		found = g_array_index(opts, uint32_t, i) == key;
+	g_array_free(opts, TRUE);
+
+	return found;
+}
+
+static gboolean is_serial_driver(const struct sr_dev_driver *driver)
+{
+	return has_scan_option(driver, SR_CONF_CONN)
+		&& has_scan_option(driver, SR_CONF_SERIALCOMM);
+}
+
+static gboolean has_conn(GSList *options)
+{
+	GSList *l;
+
+	for (l = options; l; l = l->next) {
+		if (((struct sr_config *)l->data)->key == SR_CONF_CONN)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void scan_job_init(struct scan_job *job, const char *port,
+		GSList *drivers)
+{
+	job->port = port;
+	job->drivers = drivers;
+	job->results = g_malloc0(g_slist_length(drivers) * sizeof(GSList *));
+}
+
+/* Run the jobs on up to max_threads workers, and wait for them. */
+static void scan_jobs_run(struct scan_job *jobs, unsigned int num_jobs,
+		struct scan_state *state, int max_threads)
+{
+	GThreadPool *pool;
+	GError *error;
+	unsigned int j;
+
+	if (num_jobs == 0)
+		return;
+
+	error = NULL;
+	pool = g_thread_pool_new(scan_job_run, state,
+			max_threads > 0 ? max_threads : (int)num_jobs,
+			FALSE, &error);
+	if (!pool) {
+		sr_err("Failed to create scan workers: %s.", error->message);
+		g_error_free(error);
+		/* Scan in this thread instead. */
+		for (j = 0; j < num_jobs; j++)
+			scan_job_run(&jobs[j], state);
+		return;
+	}
+
+	for (j = 0; j < num_jobs; j++)
+		g_thread_pool_push(pool, &jobs[j], NULL);
+	/* Wait for all jobs to finish. */
+	g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+/**
+ * Scan for devices with several drivers, on the given serial ports.
+ *
+ * This does the work of sr_driver_scan_parallel(), which passes the
+ * ports from sr_serial_list().
+ *
+ * @param ports GSList of port names (char *) to probe with the serial
+ *              drivers.
+ *
+ * @private
+ */
+SR_PRIV GSList *sr_driver_scan_ports(struct sr_dev_driver **drivers,
+		GSList *options, GSList *ports, int max_threads,
+		unsigned int timeout_ms)
+{
+	struct scan_state state;
+	struct scan_job *jobs;
+	GHashTable *claimed;
+	GSList *serial_drivers, *devices, *l;
+	unsigned int num_jobs, num_enum, num_ports, num_drivers, d, j;
+	char *conn, *serialcomm;
+	int i;
+
+	if (!drivers) {
+		sr_err("Invalid driver list, can't scan for devices.");
+		return NULL;
+	}
+
+	for (num_drivers = 0; drivers[num_drivers]; num_drivers++) {
+		if (!drivers[num_drivers]->context) {
+			sr_err("Driver %s not initialized, can't scan for devices.",
+				drivers[num_drivers]->name);
+			return NULL;
+		}
+	}
+
+	serial_drivers = NULL;
+	if (!has_conn(options)) {
+		for (d = 0; d < num_drivers; d++) {
+			if (is_serial_driver(drivers[d]))
+				serial_drivers = g_slist_append(serial_drivers,
+						drivers[d]);
+		}
+	}
+
+	state.options = options;
+	state.deadline = g_get_monotonic_time() + (gint64)timeout_ms * 1000;
+
+	/*
+	 * Some serial drivers also find devices without a port, e.g. SCPI
+	 * drivers on USBTMC, or on serial ports with known USB IDs. So the
+	 * serial drivers first scan without SR_CONF_CONN, each in a job of
+	 * its own. Then all of them probe the ports no device was found
+	 * on, one job per port, while the other drivers each run a job.
+	 */
+	jobs = g_malloc0((num_drivers + g_slist_length(ports))
+			* sizeof(struct scan_job));
+	num_jobs = 0;
+	for (l = serial_drivers; l; l = l->next)
+		scan_job_init(&jobs[num_jobs++], NULL,
+			g_slist_append(NULL, l->data));
+	num_enum = num_jobs;
+	scan_jobs_run(jobs, num_enum, &state, max_threads);
+
+	claimed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	for (j = 0; j < num_enum; j++) {
+		for (l = jobs[j].results[0]; l; l = l->next) {
+			if (!device_conn(l->data, &conn, &serialcomm))
+				continue;
+			g_hash_table_insert(claimed, conn, NULL);
+			g_free(serialcomm);
+		}
+	}
+	for (l = ports; l && serial_drivers; l = l->next) {
+		if (g_hash_table_contains(claimed, l->data)) {
+			sr_dbg("Found a device on %s already, not probing it.",
+				(const char *)l->data);
+			continue;
+		}
+		scan_job_init(&jobs[num_jobs++], l->data, serial_drivers);
+	}
+	g_hash_table_destroy(claimed);
+	num_ports = num_jobs - num_enum;
+	for (d = 0; d < num_drivers; d++) {
+		if (!g_slist_find(serial_drivers, drivers[d]))
+			scan_job_init(&jobs[num_jobs++], NULL,
+				g_slist_append(NULL, drivers[d]));
+	}
+
+	sr_dbg("Scanning with %u drivers on %u ports, %u jobs.", num_drivers,
+		num_ports, num_jobs);
+	scan_jobs_run(jobs + num_enum, num_jobs - num_enum, &state,
+		max_threads);
+
+	/*
+	 * Merge in driver order. Within a serial driver, what it found on
+	 * its own comes first, then the ports in order.
+	 */
+	devices = NULL;
+	for (d = 0; d < num_drivers; d++) {
+		for (j = 0; j < num_jobs; j++) {
+			i = g_slist_index(jobs[j].drivers, drivers[d]);
+			if (i < 0)
+				continue;
+			devices = g_slist_concat(devices, jobs[j].results[i]);
+		}
+	}
+
+	for (j = 0; j < num_jobs; j++) {
+		if (!jobs[j].port)
+			g_slist_free(jobs[j].drivers);
+		g_free(jobs[j].results);
+	}
+	g_free(jobs);
+	g_slist_free(serial_drivers);
+
+	sr_dbg("Parallel scan found %u devices.", g_slist_length(devices));
+
+	return devices;
+}
+
+/**
+ * Scan for devices with several drivers, on all serial ports at once.
+ *
+ * Serial drivers (drivers that take SR_CONF_CONN and SR_CONF_SERIALCOMM
+ * scan options) first scan without a port, like sr_driver_scan() would,
+ * each in a worker of its own; SCPI drivers find USBTMC devices that
+ * way, for instance. They are then run on every port returned by
+ * sr_serial_list() on which they found nothing, one worker per port.
+ * The drivers probe a port one after the other, while the ports are
+ * probed concurrently. All other drivers enumerate their devices (e.g.
+ * with sr_usb_find()) themselves, and each of them gets a worker of its
+ * own. If @a options contains SR_CONF_CONN, nothing is enumerated and
+ * every driver gets a worker for that connection.
+ *
+ * Once @a timeout_ms has passed, pending probes are skipped, and serial
+ * port I/O of the ones in progress times out.
+ *
+ * The devices are returned in the order of @a drivers, and for serial
+ * drivers in the order of the ports, after the devices they found
+ * without one. So the result doesn't depend on which probes complete
+ * first.
+ *
+ * @param drivers NULL-terminated array of drivers to scan with. They
+ *                must have been initialized with sr_driver_init().
+ * @param options Scan options passed to every driver, as with
+ *                sr_driver_scan(). Can be NULL.
+ * @param max_threads Maximum number of workers, or 0 for one per port
+ *                    and non-serial driver.
+ * @param timeout_ms The deadline for the whole scan, in milliseconds.
+ *
+ * @return A GSList * of struct sr_dev_inst, or NULL if no devices were
+ *         found. This list must be freed by the caller using
+ *         g_slist_free(), but without freeing the data pointed to in
+ *         the list.
+ *
+ * @since 0.5.0
+ */
+SR_API GSList *sr_driver_scan_parallel(struct sr_dev_driver **drivers,
+		GSList *options, int max_threads, unsigned int timeout_ms)
+{
+	struct sr_serial_port *port;
+	GSList *ports, *names, *devices, *l;
+	unsigned int d;
+
+	ports = names = NULL;
+	for (d = 0; drivers && drivers[d] && !has_conn(options); d++) {
+		if (is_serial_driver(drivers[d])) {
+			ports = sr_serial_list(NULL);
+			break;
+		}
+	}
+	for (l = ports; l; l = l->next) {
+		port = l->data;
+		names = g_slist_append(names, port->name);
+	}
+
+	devices = sr_driver_scan_ports(drivers, options, names, max_threads,
+			timeout_ms);
+
+	g_slist_free(names);
+	g_slist_free_full(ports, (GDestroyNotify)sr_serial_free);
+
+	return devices;
+}
+
+/**
+ * Set up a cache of scan results.
+ *
+ * Once set up, sr_driver_scan() records which devices a driver found on
+ * which connection (USB port path, serial port, SCPI resource) in this
+ * file. The next time that driver scans without SR_CONF_CONN, it only
+ * probes those connections, and does the full scan (which may involve
+ * baud rate sweeps, firmware uploads and the like) only if none of the
+ * devices answer.
+ *
+ * Devices that were connected since the cache was written are not found
+ * as long as the cached ones still answer. Remove the file, or scan with
+ * SR_CONF_CONN, to pick them up.
+ *
+ * Only drivers that take SR_CONF_CONN as a scan option use the cache; the
+ * others always do a full scan.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param filename The cache file. It is created if it doesn't exist. NULL
+ *                 to stop using a cache.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_scan_cache_set_file(struct sr_context *ctx, const char *filename)
+{
+	GError *error;
+
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	sr_scan_cache_free(ctx);
+	if (!filename)
+		return SR_OK;
+
+	ctx->scan_cache_file = g_strdup(filename);
+	ctx->scan_cache = g_key_file_new();
+
+	error = NULL;
+	if (!g_key_file_load_from_file(ctx->scan_cache, filename,
+			G_KEY_FILE_NONE, &error)) {
+		/* A missing or broken cache just means a full scan. */
+		sr_dbg("Starting new scan cache %s: %s.", filename,
+			error->message);
+		g_error_free(error);
+	}
+
+	return SR_OK;
+}
+
+/** @} */
+
+/**
+ * Keep driver code from running in sr_driver_scan_parallel() workers.
+ *
+ * For callers that scan outside of a parallel scan, from a thread of
+ * their own. Must be paired with sr_scan_unlock().
+ *
+ * @private
+ */
+SR_PRIV void sr_scan_lock(void)
+{
+	g_mutex_lock(&scan_lock);
+}
+
+/** @private */
+SR_PRIV void sr_scan_unlock(void)
+{
+	g_mutex_unlock(&scan_lock);
+}
+
+/**
+ * Let other scan workers run while this one waits for I/O.
+ *
+ * Must be paired with sr_scan_io_end(). Does nothing outside of
+ * sr_driver_scan_parallel().
+ *
+ * @private
+ */
+SR_PRIV void sr_scan_io_begin(void)
+{
+	if (g_private_get(&scan_worker))
+		g_mutex_unlock(&scan_lock);
+}
+
+/** @private */
+SR_PRIV void sr_scan_io_end(void)
+{
+	if (g_private_get(&scan_worker))
+		g_mutex_lock(&scan_lock);
+}
+
+/**
+ * Limit an I/O timeout to the deadline of the scan in progress.
+ *
+ * @param timeout_ms The timeout in ms, or 0 for no timeout.
+ *
+ * @return The timeout to use, at least 1ms if a deadline applies. Outside
+ *         of sr_driver_scan_parallel() that is @a timeout_ms.
+ *
+ * @private
+ */
+SR_PRIV unsigned int sr_scan_io_timeout(unsigned int timeout_ms)
+{
+	struct scan_state *state;
+	gint64 remaining;
+
+	if (!(state = g_private_get(&scan_worker)))
+		return timeout_ms;
+
+	remaining = (state->deadline - g_get_monotonic_time()) / 1000;
+	remaining = MAX(remaining, 1);
+	if (timeout_ms == 0 || remaining < timeout_ms)
+		return remaining;
+
+	return timeout_ms;
+}
+
+/*
+ * The scan cache has a group per driver, with an entry per device found:
+ *
+ *   [fx2lafw]
+ *   usb/2-1.4=;Saleae Logic;
+ *   [serial-dmm]
+ *   /dev/ttyUSB0=2400/8n1;Digitek DT4000ZC;
+ *
+ * The key is the connection to probe, the value its serial parameters
+ * (empty if there are none) and the vendor and model that answered.
+ */
+
+static struct sr_context *driver_ctx(const struct sr_dev_driver *driver)
+{
+	struct drv_context *drvc;
+
+	drvc = driver->context;
+
+	return drvc ? drvc->sr_ctx : NULL;
+}
+
+/* Get the connection to probe a device on, if there is a stable one. */
+static gboolean device_conn(const struct sr_dev_inst *sdi, char **conn,
+		char **serialcomm)
+{
+#ifdef HAVE_LIBSERIALPORT
+	struct sr_serial_dev_inst *serial;
+#endif
+	char *sep;
+
+	*conn = *serialcomm = NULL;
+
+	switch (sdi->inst_type) {
+#ifdef HAVE_LIBSERIALPORT
+	case SR_INST_SERIAL:
+		serial = sdi->conn;
+		*conn = g_strdup(serial->port);
+		*serialcomm = g_strdup(serial->serialcomm);
+		break;
+#endif
+	case SR_INST_USB:
+		/* The bus.address changes on every reconnect, the path doesn't. */
+		if (sdi->connection_id && g_str_has_prefix(sdi->connection_id, "usb/"))
+			*conn = g_strdup(sdi->connection_id);
+		break;
+	case SR_INST_SCPI:
+		if (!sdi->connection_id)
+			break;
+		*conn = g_strdup(sdi->connection_id);
+		if ((sep = strchr(*conn, ':'))) {
+			*sep = '\0';
+			*serialcomm = g_strdup(sep + 1);
+		}
+		break;
+	}
+
+	return *conn != NULL;
+}
+
+static char *device_model(const struct sr_dev_inst *sdi)
+{
+	return g_strjoin(" ", sdi->vendor ? sdi->vendor : "",
+			sdi->model ? sdi->model : "", NULL);
+}
+
+static void cache_save(struct sr_context *ctx)
+{
+	GError *error;
+	char *data;
+	gsize len;
+
+	error = NULL;
+	if (!(data = g_key_file_to_data(ctx->scan_cache, &len, &error))
+			|| !g_file_set_contents(ctx->scan_cache_file, data, len,
+				&error)) {
+		sr_warn("Failed to write scan cache %s: %s.",
+			ctx->scan_cache_file, error->message);
+		g_error_free(error);
+	}
+	g_free(data);
+}
+
+static void cache_add(struct sr_context *ctx,
+		const struct sr_dev_driver *driver, GSList *devices)
+{
+	GSList *l;
+	const char *value[2];
+	char *conn, *serialcomm, *model;
+
+	for (l = devices; l; l = l->next) {
+		if (!device_conn(l->data, &conn, &serialcomm))
+			continue;
+		model = device_model(l->data);
+		value[0] = serialcomm ? serialcomm : "";
+		value[1] = model;
+		g_key_file_set_string_list(ctx->scan_cache, driver->name,
+			conn, value, 2);
+		g_free(conn);
+		g_free(serialcomm);
+		g_free(model);
+	}
+}
+
+static gboolean has_option(GSList *options, uint32_t key)
+{
+	GSList *l;
+
+	for (l = options; l; l = l->next) {
+		if (((struct sr_config *)l->data)->key == key)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Probe the connections a driver found devices on last time.
+ *
+ * @return The devices found, or NULL if a full scan is needed.
+ *
+ * @private
+ */
+SR_PRIV GSList *sr_scan_cache_lookup(struct sr_dev_driver *driver,
+		GSList *options)
+{
+	struct sr_context *ctx;
+	struct sr_config *conn_src, *serialcomm_src;
+	GSList *devices, *found, *opts;
+	char **conns, **value, *model;
+	gboolean changed;
+	gsize num_conns, i;
+
+	ctx = driver_ctx(driver);
+	if (!ctx || !ctx->scan_cache || has_option(options, SR_CONF_CONN))
+		return NULL;
+
+	/* Without SR_CONF_CONN, the driver can't probe a single device. */
+	if (!has_scan_option(driver, SR_CONF_CONN))
+		return NULL;
+
+	if (!(conns = g_key_file_get_keys(ctx->scan_cache, driver->name,
+			&num_conns, NULL)))
+		return NULL;
+
+	devices = NULL;
+	changed = FALSE;
+	for (i = 0; i < num_conns; i++) {
+		value = g_key_file_get_string_list(ctx->scan_cache,
+				driver->name, conns[i], NULL, NULL);
+		if (!value || g_strv_length(value) != 2) {
+			g_strfreev(value);
+			continue;
+		}
+
+		conn_src = sr_config_new(SR_CONF_CONN,
+				g_variant_new_string(conns[i]));
+		opts = g_slist_prepend(g_slist_copy(options), conn_src);
+		serialcomm_src = NULL;
+		if (value[0][0] && !has_option(options, SR_CONF_SERIALCOMM)
+				&& has_scan_option(driver, SR_CONF_SERIALCOMM)) {
+			serialcomm_src = sr_config_new(SR_CONF_SERIALCOMM,
+					g_variant_new_string(value[0]));
+			opts = g_slist_prepend(opts, serialcomm_src);
+		}
+
+		sr_dbg("Probing cached %s device '%s' at %s.", driver->name,
+			value[1], conns[i]);
+		if ((found = driver->scan(driver, opts))) {
+			model = device_model(found->data);
+			if (strcmp(model, value[1]))
+				sr_info("Found %s instead of cached %s at %s.",
+					model, value[1], conns[i]);
+			g_free(model);
+			devices = g_slist_concat(devices, found);
+		} else {
+			sr_dbg("Cached device at %s is gone.", conns[i]);
+			g_key_file_remove_key(ctx->scan_cache, driver->name,
+				conns[i], NULL);
+			changed = TRUE;
+		}
+
+		g_slist_free(opts);
+		sr_config_free(conn_src);
+		if (serialcomm_src)
+			sr_config_free(serialcomm_src);
+		g_strfreev(value);
+	}
+	g_strfreev(conns);
+
+	if (devices) {
+		sr_info("Found %d cached %s devices, skipping full scan.",
+			g_slist_length(devices), driver->name);
+		/* The models may have changed. */
+		cache_add(ctx, driver, devices);
+		changed = TRUE;
+	}
+	if (changed)
+		cache_save(ctx);
+
+	return devices;
+}
+
+/**
+ * Record the devices a driver found in the scan cache.
+ *
+ * A scan without SR_CONF_CONN replaces all entries of the driver, a scan
+ * with SR_CONF_CONN adds to them.
+ *
+ * @private
+ */
+SR_PRIV void sr_scan_cache_update(struct sr_dev_driver *driver,
+		GSList *options, GSList *devices)
+{
+	struct sr_context *ctx;
+
+	ctx = driver_ctx(driver);
+	if (!ctx || !ctx->scan_cache || !has_scan_option(driver, SR_CONF_CONN))
+		return;
+
+	if (!has_option(options, SR_CONF_CONN))
+		g_key_file_remove_group(ctx->scan_cache, driver->name, NULL);
+	cache_add(ctx, driver, devices);
+	cache_save(ctx);
+}
+
+/** @private */
+SR_PRIV void sr_scan_cache_free(struct sr_context *ctx)
+{
+	if (ctx->scan_cache)
+		g_key_file_free(ctx->scan_cache);
+	g_free(ctx->scan_cache_file);
+	ctx->scan_cache = NULL;
+	ctx->scan_cache_file = NULL;
+}
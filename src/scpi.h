@@ -70,6 +70,31 @@ struct sr_scpi_hw_info {
 	char *firmware_version;
 };
 
+/** Types of responses to queries in a batch. */
+enum sr_scpi_query_type {
+	SCPI_QUERY_STRING,	/**< char *, freed by the caller */
+	SCPI_QUERY_BOOL,	/**< gboolean */
+	SCPI_QUERY_INT,		/**< int */
+	SCPI_QUERY_FLOAT,	/**< float */
+	SCPI_QUERY_DOUBLE,	/**< double */
+};
+
+struct sr_scpi_batch;
+struct sr_scpi_cache;
+
+/**
+ * Parse the response to a cached query into the driver's state.
+ *
+ * @param response The response.
+ * @param key The key the query was added with.
+ * @param channel The channel the query was added with.
+ * @param cb_data The data passed to sr_scpi_cache_new().
+ *
+ * @return SR_OK upon success, SR_ERR* if the response is invalid.
+ */
+typedef int (*sr_scpi_cache_parse_callback)(const char *response,
+		uint32_t key, int channel, void *cb_data);
+
 struct sr_scpi_dev_inst {
 	const char *name;
 	const char *prefix;
@@ -91,6 +116,8 @@ struct sr_scpi_dev_inst {
 	void *priv;
 	/* Only used for quirk workarounds, notably the Rigol DS1000 series. */
 	uint64_t firmware_version;
+	/* Set once the device got a batch of queries wrong. */
+	gboolean no_compound_queries;
 };
 
 SR_PRIV GSList *sr_scpi_scan(struct drv_context *drvc, GSList *options,
@@ -128,6 +155,26 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 			const char *command, GArray **scpi_response);
 SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 			const char *command, GArray **scpi_response);
+SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
+			const char *command, uint8_t *buf, size_t maxlen);
+SR_PRIV int sr_scpi_parse_response(enum sr_scpi_query_type type,
+			const char *response, void *result);
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(void);
+SR_PRIV void sr_scpi_batch_add(struct sr_scpi_batch *batch,
+			enum sr_scpi_query_type type, void *result,
+			const char *format, ...) G_GNUC_PRINTF(4, 5);
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+			struct sr_scpi_batch *batch);
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch);
+SR_PRIV struct sr_scpi_cache *sr_scpi_cache_new(
+			sr_scpi_cache_parse_callback parse, void *cb_data);
+SR_PRIV void sr_scpi_cache_add(struct sr_scpi_cache *cache, uint32_t key,
+			int channel, const char *format, ...) G_GNUC_PRINTF(4, 5);
+SR_PRIV int sr_scpi_cache_fetch(struct sr_scpi_dev_inst *scpi,
+			struct sr_scpi_cache *cache, uint32_t key, int channel);
+SR_PRIV void sr_scpi_cache_invalidate(struct sr_scpi_cache *cache,
+			uint32_t key, int channel);
+SR_PRIV void sr_scpi_cache_free(struct sr_scpi_cache *cache);
 SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 			struct sr_scpi_hw_info **scpi_response);
 SR_PRIV void sr_scpi_hw_info_free(struct sr_scpi_hw_info *hw_info);
@@ -18,7 +18,9 @@
  */
 
 #include <config.h>
+#include <errno.h>
 #include <glib.h>
+#include <stdlib.h>
 #include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -29,6 +31,12 @@
 #define SCPI_READ_RETRIES 100
 #define SCPI_READ_RETRY_TIMEOUT_US (10 * 1000)
 
+/* Longest message sent for a batch of queries. */
+#define SCPI_BATCH_MAX_LEN 256
+
+/* Longest length field of a definite length block, '#9<9 digits>'. */
+#define SCPI_BLOCK_LEN_DIGITS 9
+
 /**
  * Parse a string representation of a boolean-like value into a gboolean.
  * Similar to sr_parse_boolstring but rejects strings which do not represent
@@ -74,6 +82,32 @@ SR_PRIV extern const struct sr_scpi_dev_inst scpi_vxi_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_visa_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_libgpib_dev;
 
+/** @cond PRIVATE */
+struct scpi_query {
+	char *command;
+	enum sr_scpi_query_type type;
+	void *result;
+};
+
+struct sr_scpi_batch {
+	GArray *queries;
+};
+
+struct scpi_cache_entry {
+	uint32_t key;
+	int channel;
+	char *command;
+	gboolean valid;
+	char *response;
+};
+
+struct sr_scpi_cache {
+	GArray *entries;
+	sr_scpi_cache_parse_callback parse;
+	void *cb_data;
+};
+/** @endcond */
+
 static const struct sr_scpi_dev_inst *scpi_devs[] = {
 	&scpi_tcp_raw_dev,
 	&scpi_tcp_rigol_dev,
@@ -164,8 +198,12 @@ SR_PRIV GSList *sr_scpi_scan(struct drv_context *drvc, GSList *options,
 
 	if (!devices && resource) {
 		sdi = sr_scpi_scan_resource(drvc, resource, serialcomm, probe_device);
-		if (sdi)
+		if (sdi) {
 			devices = g_slist_append(NULL, sdi);
+			sdi->connection_id = serialcomm
+				? g_strdup_printf("%s:%s", resource, serialcomm)
+				: g_strdup(resource);
+		}
 	}
 
 	/* Tack a copy of the newly found devices onto the driver list. */
@@ -591,6 +629,93 @@ SR_PRIV int sr_scpi_get_opc(struct sr_scpi_dev_inst *scpi)
 	return SR_ERR;
 }
 
+/*
+ * Find the end of a value parsed from a list element starting at tok,
+ * the parser having stopped at end. The element is valid if the value
+ * took all of it, apart from trailing whitespace.
+ *
+ * Returns the start of the next element, or NULL after the last one.
+ */
+static const char *list_next(const char *tok, const char *end,
+		gboolean *valid)
+{
+	while (g_ascii_isspace(*end))
+		end++;
+
+	*valid = (end != tok && (*end == ',' || *end == '\0'));
+
+	if (*end != ',' && !(end = strchr(end, ',')))
+		return NULL;
+
+	return end + 1;
+}
+
+/* Upper bound of the number of elements in a comma separated list. */
+static unsigned int list_count(const char *str)
+{
+	unsigned int count;
+
+	for (count = 1; (str = strchr(str, ',')); str++)
+		count++;
+
+	return count;
+}
+
+/*
+ * Parse a comma separated list of floats into an array, without
+ * splitting or copying the string. Invalid elements are skipped.
+ */
+static int parse_floatv(const char *str, GArray *array)
+{
+	const char *tok;
+	char *end;
+	double tmp;
+	float value;
+	gboolean valid;
+	int ret;
+
+	ret = SR_OK;
+	for (tok = str; tok; ) {
+		errno = 0;
+		tmp = g_ascii_strtod(tok, &end);
+		tok = list_next(tok, end, &valid);
+		if (!valid || errno) {
+			ret = SR_ERR_DATA;
+			continue;
+		}
+		value = tmp;
+		g_array_append_val(array, value);
+	}
+
+	return ret;
+}
+
+/* As parse_floatv(), for unsigned 8 bit integers. */
+static int parse_uint8v(const char *str, GArray *array)
+{
+	const char *tok;
+	char *end;
+	long tmp;
+	uint8_t value;
+	gboolean valid;
+	int ret;
+
+	ret = SR_OK;
+	for (tok = str; tok; ) {
+		errno = 0;
+		tmp = strtol(tok, &end, 10);
+		tok = list_next(tok, end, &valid);
+		if (!valid || errno || tmp < 0 || tmp > UINT8_MAX) {
+			ret = SR_ERR_DATA;
+			continue;
+		}
+		value = tmp;
+		g_array_append_val(array, value);
+	}
+
+	return ret;
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as comma separated list of
  * floats and store the as an result in scpi_response.
@@ -608,33 +733,20 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GArray **scpi_response)
 {
 	int ret;
-	float tmp;
 	char *response;
-	gchar **ptr, **tokens;
 	GArray *response_array;
 
 	response = NULL;
-	tokens = NULL;
 
 	ret = sr_scpi_get_string(scpi, command, &response);
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	ptr = tokens;
+	response_array = g_array_sized_new(TRUE, FALSE, sizeof(float),
+			list_count(response));
 
-	response_array = g_array_sized_new(TRUE, FALSE, sizeof(float), 256);
-
-	while (*ptr) {
-		if (sr_atof_ascii(*ptr, &tmp) == SR_OK)
-			response_array = g_array_append_val(response_array,
-							    tmp);
-		else
-			ret = SR_ERR_DATA;
-
-		ptr++;
-	}
-	g_strfreev(tokens);
+	if (parse_floatv(response, response_array) != SR_OK)
+		ret = SR_ERR_DATA;
 	g_free(response);
 
 	if (ret != SR_OK && response_array->len == 0) {
@@ -664,33 +776,21 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GArray **scpi_response)
 {
-	int tmp, ret;
+	int ret;
 	char *response;
-	gchar **ptr, **tokens;
 	GArray *response_array;
 
 	response = NULL;
-	tokens = NULL;
 
 	ret = sr_scpi_get_string(scpi, command, &response);
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	ptr = tokens;
-
-	response_array = g_array_sized_new(TRUE, FALSE, sizeof(uint8_t), 256);
+	response_array = g_array_sized_new(TRUE, FALSE, sizeof(uint8_t),
+			list_count(response));
 
-	while (*ptr) {
-		if (sr_atoi(*ptr, &tmp) == SR_OK)
-			response_array = g_array_append_val(response_array,
-							    tmp);
-		else
-			ret = SR_ERR_DATA;
-
-		ptr++;
-	}
-	g_strfreev(tokens);
+	if (parse_uint8v(response, response_array) != SR_OK)
+		ret = SR_ERR_DATA;
 	g_free(response);
 
 	if (response_array->len == 0) {
@@ -704,6 +804,625 @@ SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 	return ret;
 }
 
+/*
+ * Read exactly len bytes of a response. Unlike sr_scpi_get_string(), this
+ * doesn't stop at read_complete(), as binary data may contain newlines.
+ */
+static int scpi_read_exact(struct sr_scpi_dev_inst *scpi, char *buf,
+		int len, gint64 *laststart)
+{
+	int ret;
+	unsigned int elapsed_ms;
+
+	while (len > 0) {
+		ret = sr_scpi_read_data(scpi, buf, len);
+		if (ret < 0) {
+			sr_err("Incompletely read SCPI response.");
+			return SR_ERR;
+		} else if (ret > 0) {
+			*laststart = g_get_monotonic_time();
+			buf += ret;
+			len -= ret;
+			continue;
+		}
+		elapsed_ms = (g_get_monotonic_time() - *laststart) / 1000;
+		if (elapsed_ms >= scpi->read_timeout_ms) {
+			sr_err("Timed out waiting for SCPI response.");
+			return SR_ERR;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Read and discard what is left of a response. */
+static int scpi_read_flush(struct sr_scpi_dev_inst *scpi, gint64 *laststart)
+{
+	char buf[256];
+	int len;
+	unsigned int elapsed_ms;
+
+	while (!sr_scpi_read_complete(scpi)) {
+		len = sr_scpi_read_data(scpi, buf, sizeof(buf));
+		if (len < 0) {
+			sr_err("Incompletely read SCPI response.");
+			return SR_ERR;
+		} else if (len > 0) {
+			*laststart = g_get_monotonic_time();
+		}
+		elapsed_ms = (g_get_monotonic_time() - *laststart) / 1000;
+		if (elapsed_ms >= scpi->read_timeout_ms) {
+			sr_err("Timed out waiting for SCPI response.");
+			return SR_ERR;
+		}
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Read an indefinite length block ('#0'), which lasts until the end of
+ * the response.
+ */
+static int scpi_read_indefinite_block(struct sr_scpi_dev_inst *scpi,
+		uint8_t *buf, size_t maxlen, gint64 *laststart)
+{
+	size_t pos;
+	int len;
+	unsigned int elapsed_ms;
+
+	pos = 0;
+	while (!sr_scpi_read_complete(scpi)) {
+		if (pos == maxlen) {
+			sr_err("SCPI block larger than %" G_GSIZE_FORMAT
+				" bytes.", maxlen);
+			scpi_read_flush(scpi, laststart);
+			return SR_ERR_DATA;
+		}
+		len = sr_scpi_read_data(scpi, (char *)buf + pos,
+				MIN(maxlen - pos, G_MAXINT));
+		if (len < 0) {
+			sr_err("Incompletely read SCPI response.");
+			return SR_ERR;
+		} else if (len > 0) {
+			*laststart = g_get_monotonic_time();
+			pos += len;
+		}
+		elapsed_ms = (g_get_monotonic_time() - *laststart) / 1000;
+		if (elapsed_ms >= scpi->read_timeout_ms) {
+			sr_err("Timed out waiting for SCPI response.");
+			return SR_ERR;
+		}
+	}
+
+	/* The terminating linefeed isn't part of the data. */
+	if (pos > 0 && buf[pos - 1] == '\n')
+		pos--;
+
+	return pos;
+}
+
+/**
+ * Send a SCPI command and read the reply as an IEEE 488.2 arbitrary block.
+ *
+ * Definite length blocks ('#<n><length><data>') are read straight into
+ * @a buf, without parsing or copying the data. The response must hold a
+ * single block, optionally followed by a linefeed. Indefinite length blocks
+ * ('#0<data>') are read up to the end of the response.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param command The SCPI command to send to the device (can be NULL).
+ * @param buf Buffer to store the data of the block.
+ * @param maxlen Size of the buffer.
+ *
+ * @return The number of data bytes read, or SR_ERR* upon failure. If the
+ *         block doesn't fit into @a buf, the rest of the response is
+ *         discarded and SR_ERR_DATA is returned.
+ */
+SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
+			      const char *command, uint8_t *buf, size_t maxlen)
+{
+	char header[SCPI_BLOCK_LEN_DIGITS + 1];
+	gint64 laststart;
+	unsigned long len;
+	int digits;
+
+	if (maxlen > G_MAXINT)
+		maxlen = G_MAXINT;
+
+	if (command)
+		if (sr_scpi_send(scpi, command) != SR_OK)
+			return SR_ERR;
+
+	if (sr_scpi_read_begin(scpi) != SR_OK)
+		return SR_ERR;
+
+	laststart = g_get_monotonic_time();
+
+	/* Skip what may be left of a previous response's terminator. */
+	do {
+		if (scpi_read_exact(scpi, header, 1, &laststart) != SR_OK)
+			return SR_ERR;
+	} while (g_ascii_isspace(header[0]));
+
+	if (header[0] != '#') {
+		sr_err("Expected SCPI block, got '%c'.", header[0]);
+		scpi_read_flush(scpi, &laststart);
+		return SR_ERR_DATA;
+	}
+
+	if (scpi_read_exact(scpi, header, 1, &laststart) != SR_OK)
+		return SR_ERR;
+	if (!g_ascii_isdigit(header[0])) {
+		sr_err("Invalid SCPI block header.");
+		scpi_read_flush(scpi, &laststart);
+		return SR_ERR_DATA;
+	}
+	digits = header[0] - '0';
+
+	if (digits == 0)
+		return scpi_read_indefinite_block(scpi, buf, maxlen, &laststart);
+
+	if (scpi_read_exact(scpi, header, digits, &laststart) != SR_OK)
+		return SR_ERR;
+	header[digits] = '\0';
+	if (strspn(header, "0123456789") != (size_t)digits) {
+		sr_err("Invalid SCPI block length '%s'.", header);
+		scpi_read_flush(scpi, &laststart);
+		return SR_ERR_DATA;
+	}
+	len = strtoul(header, NULL, 10);
+
+	if (len > maxlen) {
+		sr_err("SCPI block of %lu bytes doesn't fit into %"
+			G_GSIZE_FORMAT " bytes.", len, maxlen);
+		scpi_read_flush(scpi, &laststart);
+		return SR_ERR_DATA;
+	}
+
+	if (scpi_read_exact(scpi, (char *)buf, len, &laststart) != SR_OK)
+		return SR_ERR;
+
+	/* Consume the terminator, if any. */
+	if (scpi_read_flush(scpi, &laststart) != SR_OK)
+		return SR_ERR;
+
+	sr_spew("Got SCPI block of %lu bytes.", len);
+
+	return len;
+}
+
+/**
+ * Create a batch of queries.
+ *
+ * Queries are added with sr_scpi_batch_add() and sent with
+ * sr_scpi_batch_run(), several of them per message. That saves a round
+ * trip per query, which adds up on network transports.
+ *
+ * @return The new batch, to be freed with sr_scpi_batch_free().
+ */
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(void)
+{
+	struct sr_scpi_batch *batch;
+
+	batch = g_malloc(sizeof(struct sr_scpi_batch));
+	batch->queries = g_array_new(FALSE, FALSE, sizeof(struct scpi_query));
+
+	return batch;
+}
+
+/**
+ * Add a query to a batch.
+ *
+ * Queries must have a single response which is not a block, and should
+ * start with a colon, since they are sent as one compound command.
+ *
+ * @param batch The batch.
+ * @param type How to parse the response.
+ * @param result Where to store the parsed response, with a type that
+ *               matches @a type. Left alone if the query fails.
+ * @param format Format string of the query, to be followed by any
+ *               necessary arguments.
+ */
+SR_PRIV void sr_scpi_batch_add(struct sr_scpi_batch *batch,
+			       enum sr_scpi_query_type type, void *result,
+			       const char *format, ...)
+{
+	struct scpi_query query;
+	va_list args;
+
+	va_start(args, format);
+	query.command = g_strdup_vprintf(format, args);
+	va_end(args);
+	query.type = type;
+	query.result = result;
+
+	g_array_append_val(batch->queries, query);
+}
+
+/**
+ * Free a batch of queries.
+ *
+ * @param batch The batch. May be NULL.
+ */
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch)
+{
+	unsigned int i;
+
+	if (!batch)
+		return;
+
+	for (i = 0; i < batch->queries->len; i++)
+		g_free(g_array_index(batch->queries, struct scpi_query, i).command);
+	g_array_free(batch->queries, TRUE);
+	g_free(batch);
+}
+
+/**
+ * Parse a response the way sr_scpi_get_bool() and friends do.
+ *
+ * @param type How to parse the response.
+ * @param response The response.
+ * @param result Where to store the parsed response, with a type that
+ *               matches @a type. Strings are copied, and must be freed
+ *               by the caller.
+ *
+ * @return SR_OK upon success, SR_ERR_DATA if the response is invalid.
+ */
+SR_PRIV int sr_scpi_parse_response(enum sr_scpi_query_type type,
+				   const char *response, void *result)
+{
+	switch (type) {
+	case SCPI_QUERY_STRING:
+		*(char **)result = g_strdup(response);
+		return SR_OK;
+	case SCPI_QUERY_BOOL:
+		return parse_strict_bool(response, result) == SR_OK
+			? SR_OK : SR_ERR_DATA;
+	case SCPI_QUERY_INT:
+		return sr_atoi(response, result) == SR_OK
+			? SR_OK : SR_ERR_DATA;
+	case SCPI_QUERY_FLOAT:
+		return sr_atof_ascii(response, result) == SR_OK
+			? SR_OK : SR_ERR_DATA;
+	case SCPI_QUERY_DOUBLE:
+		return sr_atod(response, result) == SR_OK
+			? SR_OK : SR_ERR_DATA;
+	}
+
+	return SR_ERR_BUG;
+}
+
+static int query_run(struct sr_scpi_dev_inst *scpi,
+		const struct scpi_query *query)
+{
+	char *response;
+	int ret;
+
+	response = NULL;
+	ret = sr_scpi_get_string(scpi, query->command, &response);
+	if (ret == SR_OK)
+		ret = sr_scpi_parse_response(query->type, response,
+				query->result);
+	g_free(response);
+
+	return ret;
+}
+
+/*
+ * Split the response to a compound query at the semicolons between the
+ * responses to each query, but not at semicolons within quoted strings.
+ * The response is modified in place.
+ */
+static unsigned int compound_response_split(char *response, char **parts,
+		unsigned int max_parts)
+{
+	unsigned int num_parts;
+	char *p, quote;
+
+	num_parts = 0;
+	parts[num_parts++] = response;
+	for (p = response, quote = 0; *p; p++) {
+		if (quote) {
+			if (*p == quote)
+				quote = 0;
+		} else if (*p == '"' || *p == '\'') {
+			quote = *p;
+		} else if (*p == ';') {
+			if (num_parts == max_parts)
+				return max_parts + 1;
+			*p = '\0';
+			parts[num_parts++] = p + 1;
+		}
+	}
+
+	return num_parts;
+}
+
+/* Run queries first to first + count - 1 of a batch as one message. */
+static int batch_run_compound(struct sr_scpi_dev_inst *scpi,
+		struct sr_scpi_batch *batch, unsigned int first,
+		unsigned int count)
+{
+	struct scpi_query *query;
+	GString *command;
+	char *response, **parts;
+	unsigned int i, num_parts;
+	int ret, query_ret;
+
+	command = g_string_sized_new(SCPI_BATCH_MAX_LEN);
+	for (i = first; i < first + count; i++) {
+		query = &g_array_index(batch->queries, struct scpi_query, i);
+		if (i > first)
+			g_string_append_c(command, ';');
+		g_string_append(command, query->command);
+	}
+
+	response = NULL;
+	ret = sr_scpi_send(scpi, "%s", command->str);
+	g_string_free(command, TRUE);
+	if (ret != SR_OK)
+		return SR_ERR;
+	ret = sr_scpi_get_string(scpi, NULL, &response);
+	if (ret != SR_OK) {
+		g_free(response);
+		return SR_ERR_NA;
+	}
+
+	parts = g_malloc(count * sizeof(char *));
+	num_parts = compound_response_split(response, parts, count);
+	if (num_parts != count) {
+		sr_dbg("Expected %u responses, got %u.", count, num_parts);
+		ret = SR_ERR_NA;
+	} else {
+		for (i = 0; i < count; i++) {
+			query = &g_array_index(batch->queries,
+					struct scpi_query, first + i);
+			query_ret = sr_scpi_parse_response(query->type,
+					parts[i], query->result);
+			if (query_ret != SR_OK && ret == SR_OK)
+				ret = query_ret;
+		}
+	}
+	g_free(parts);
+	g_free(response);
+
+	return ret;
+}
+
+/**
+ * Send the queries of a batch and parse their responses.
+ *
+ * The queries are sent as compound commands of several queries each,
+ * and their responses are stored in the order they were added. If the
+ * device doesn't answer a compound command as expected, its queries are
+ * sent one by one instead, and so are all queries to that device from
+ * then on.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param batch The batch. Can be run again.
+ *
+ * @return SR_OK upon success, SR_ERR* if any query failed. The results of
+ *         the other queries are stored anyway.
+ */
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+			      struct sr_scpi_batch *batch)
+{
+	struct scpi_query *query;
+	unsigned int first, count, i;
+	size_t len;
+	int ret, run_ret;
+
+	ret = SR_OK;
+	for (first = 0; first < batch->queries->len; first += count) {
+		/* Gather as many queries as fit into a message. */
+		len = 0;
+		for (count = 0; first + count < batch->queries->len; count++) {
+			query = &g_array_index(batch->queries,
+					struct scpi_query, first + count);
+			len += strlen(query->command) + 1;
+			if (count > 0 && len > SCPI_BATCH_MAX_LEN)
+				break;
+		}
+
+		run_ret = SR_ERR_NA;
+		if (count > 1 && !scpi->no_compound_queries) {
+			run_ret = batch_run_compound(scpi, batch, first, count);
+			if (run_ret == SR_ERR_NA) {
+				sr_warn("Device doesn't handle compound queries, "
+					"sending them one by one.");
+				scpi->no_compound_queries = TRUE;
+			}
+		}
+		if (run_ret == SR_ERR_NA) {
+			run_ret = SR_OK;
+			for (i = first; i < first + count; i++) {
+				query = &g_array_index(batch->queries,
+						struct scpi_query, i);
+				if (query_run(scpi, query) != SR_OK)
+					run_ret = SR_ERR;
+			}
+		}
+		if (run_ret != SR_OK && ret == SR_OK)
+			ret = run_ret;
+	}
+
+	return ret;
+}
+
+/**
+ * Create a cache of instrument settings.
+ *
+ * Each setting is read by a query, added with sr_scpi_cache_add(), and
+ * parsed into the driver's state by @a parse. Settings are only read
+ * when sr_scpi_cache_fetch() asks for one that isn't known, and then
+ * all settings that aren't known are read in one batch. Drivers
+ * invalidate settings when they change them, so polling the
+ * configuration doesn't cost any SCPI traffic.
+ *
+ * @param parse Called to parse the response to each query.
+ * @param cb_data Data passed to @a parse.
+ *
+ * @return The new cache, to be freed with sr_scpi_cache_free(). All
+ *         settings start out invalid.
+ */
+SR_PRIV struct sr_scpi_cache *sr_scpi_cache_new(
+			sr_scpi_cache_parse_callback parse, void *cb_data)
+{
+	struct sr_scpi_cache *cache;
+
+	cache = g_malloc(sizeof(struct sr_scpi_cache));
+	cache->entries = g_array_new(FALSE, FALSE,
+			sizeof(struct scpi_cache_entry));
+	cache->parse = parse;
+	cache->cb_data = cb_data;
+
+	return cache;
+}
+
+/**
+ * Add a setting to a cache.
+ *
+ * Settings are fetched and parsed in the order they were added, so
+ * settings which are parsed based on others should be added after them.
+ *
+ * @param cache The cache.
+ * @param key The key of the setting, usually an SR_CONF key.
+ * @param channel The channel the setting belongs to, or -1.
+ * @param format Format string of the query that reads the setting, to be
+ *               followed by any necessary arguments.
+ */
+SR_PRIV void sr_scpi_cache_add(struct sr_scpi_cache *cache, uint32_t key,
+			       int channel, const char *format, ...)
+{
+	struct scpi_cache_entry entry;
+	va_list args;
+
+	va_start(args, format);
+	entry.command = g_strdup_vprintf(format, args);
+	va_end(args);
+	entry.key = key;
+	entry.channel = channel;
+	entry.valid = FALSE;
+	entry.response = NULL;
+
+	g_array_append_val(cache->entries, entry);
+}
+
+static gboolean cache_entry_match(const struct scpi_cache_entry *entry,
+		uint32_t key, int channel)
+{
+	return (key == 0 || entry->key == key)
+		&& (channel < 0 || entry->channel == channel);
+}
+
+/**
+ * Make sure settings in a cache are known.
+ *
+ * If any of the requested settings is invalid, all invalid settings are
+ * read from the device in one batch.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param cache The cache.
+ * @param key The key of the settings, or 0 for all settings.
+ * @param channel The channel of the settings, or -1 for all channels.
+ *
+ * @return SR_OK upon success, also if no settings match, SR_ERR* if any
+ *         setting couldn't be read. Those stay invalid.
+ */
+SR_PRIV int sr_scpi_cache_fetch(struct sr_scpi_dev_inst *scpi,
+				struct sr_scpi_cache *cache, uint32_t key,
+				int channel)
+{
+	struct scpi_cache_entry *entry;
+	struct sr_scpi_batch *batch;
+	gboolean needed;
+	unsigned int i;
+	int ret;
+
+	needed = FALSE;
+	for (i = 0; i < cache->entries->len && !needed; i++) {
+		entry = &g_array_index(cache->entries,
+				struct scpi_cache_entry, i);
+		needed = !entry->valid && cache_entry_match(entry, key, channel);
+	}
+	if (!needed)
+		return SR_OK;
+
+	batch = sr_scpi_batch_new();
+	for (i = 0; i < cache->entries->len; i++) {
+		entry = &g_array_index(cache->entries,
+				struct scpi_cache_entry, i);
+		if (!entry->valid)
+			sr_scpi_batch_add(batch, SCPI_QUERY_STRING,
+				&entry->response, "%s", entry->command);
+	}
+	ret = sr_scpi_batch_run(scpi, batch);
+	sr_scpi_batch_free(batch);
+
+	for (i = 0; i < cache->entries->len; i++) {
+		entry = &g_array_index(cache->entries,
+				struct scpi_cache_entry, i);
+		if (!entry->response)
+			continue;
+		if (cache->parse(entry->response, entry->key, entry->channel,
+				cache->cb_data) == SR_OK) {
+			entry->valid = TRUE;
+		} else {
+			sr_err("Invalid response '%s' to '%s'.",
+				entry->response, entry->command);
+			ret = SR_ERR_DATA;
+		}
+		g_free(entry->response);
+		entry->response = NULL;
+	}
+
+	return ret;
+}
+
+/**
+ * Invalidate settings in a cache, so they are read again when needed.
+ *
+ * @param cache The cache. May be NULL.
+ * @param key The key of the settings, or 0 for all settings.
+ * @param channel The channel of the settings, or -1 for all channels.
+ */
+SR_PRIV void sr_scpi_cache_invalidate(struct sr_scpi_cache *cache,
+				      uint32_t key, int channel)
+{
+	struct scpi_cache_entry *entry;
+	unsigned int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < cache->entries->len; i++) {
+		entry = &g_array_index(cache->entries,
+				struct scpi_cache_entry, i);
+		if (cache_entry_match(entry, key, channel))
+			entry->valid = FALSE;
+	}
+}
+
+/**
+ * Free a cache of instrument settings.
+ *
+ * @param cache The cache. May be NULL.
+ */
+SR_PRIV void sr_scpi_cache_free(struct sr_scpi_cache *cache)
+{
+	unsigned int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < cache->entries->len; i++)
+		g_free(g_array_index(cache->entries,
+				struct scpi_cache_entry, i).command);
+	g_array_free(cache->entries, TRUE);
+	g_free(cache);
+}
+
 /**
  * Send the *IDN? SCPI command, receive the reply, parse it and store the
  * reply as a sr_scpi_hw_info structure in the supplied scpi_response pointer.
@@ -27,8 +27,11 @@
 #include <string.h>
 #include <unistd.h>
 #ifndef _WIN32
+#include <fcntl.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #endif
@@ -41,6 +44,15 @@
 
 #define LENGTH_BYTES 4
 
+/* Receive buffer asked for, so whole waveforms fit while we're busy. */
+#define RCVBUF_SIZE (4 * 1024 * 1024)
+
+/* How long a read waits for data before returning with nothing. */
+#define READ_WAIT_MS 10
+
+/* Longest header of a definite length block, '#9<9 digits>'. */
+#define BLOCK_HEADER_MAX 11
+
 struct scpi_tcp {
 	char *address;
 	char *port;
@@ -49,6 +61,13 @@ struct scpi_tcp {
 	int length_bytes_read;
 	int response_length;
 	int response_bytes_read;
+	/* Tracking of raw responses, which have no length prefix. */
+	gboolean response_started;
+	char block_header[BLOCK_HEADER_MAX + 1];
+	int block_header_len;
+	/* -2 until the header is known, -1 if it isn't a definite block. */
+	int64_t block_remaining;
+	char last_char;
 };
 
 static int scpi_tcp_dev_inst_new(void *priv, struct drv_context *drvc,
@@ -72,6 +91,92 @@ static int scpi_tcp_dev_inst_new(void *priv, struct drv_context *drvc,
 	return SR_OK;
 }
 
+/*
+ * Make the socket non-blocking, so reads from the session's event loop
+ * never stall it, and give it a large receive buffer, so the device can
+ * keep sending at link rate while waveforms are being processed.
+ */
+static void scpi_tcp_setup(struct scpi_tcp *tcp)
+{
+	int opt;
+#ifdef _WIN32
+	u_long nonblock;
+#endif
+
+	opt = RCVBUF_SIZE;
+	if (setsockopt(tcp->socket, SOL_SOCKET, SO_RCVBUF,
+			(const void *)&opt, sizeof(opt)) < 0)
+		sr_dbg("Failed to set receive buffer size: %s",
+			g_strerror(errno));
+
+	/* Commands are short, don't hold them back. */
+	opt = 1;
+	if (setsockopt(tcp->socket, IPPROTO_TCP, TCP_NODELAY,
+			(const void *)&opt, sizeof(opt)) < 0)
+		sr_dbg("Failed to set TCP_NODELAY: %s", g_strerror(errno));
+
+#ifdef _WIN32
+	nonblock = 1;
+	ioctlsocket(tcp->socket, FIONBIO, &nonblock);
+#else
+	fcntl(tcp->socket, F_SETFL, fcntl(tcp->socket, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+/* Wait until the socket is readable (or writable), at most timeout_ms. */
+static int scpi_tcp_wait(struct scpi_tcp *tcp, gboolean write, int timeout_ms)
+{
+	fd_set fds;
+	struct timeval tv;
+
+	FD_ZERO(&fds);
+	FD_SET(tcp->socket, &fds);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	return select(tcp->socket + 1, write ? NULL : &fds,
+			write ? &fds : NULL, NULL, &tv);
+}
+
+static gboolean scpi_tcp_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/*
+ * Receive whatever is there, straight into the caller's buffer. If there
+ * is nothing, wait for it a little, but return 0 rather than block.
+ */
+static int scpi_tcp_recv(struct scpi_tcp *tcp, char *buf, int maxlen)
+{
+	int len;
+
+	len = recv(tcp->socket, buf, maxlen, 0);
+	if (len < 0 && scpi_tcp_would_block()) {
+		if (scpi_tcp_wait(tcp, FALSE, READ_WAIT_MS) <= 0)
+			return 0;
+		len = recv(tcp->socket, buf, maxlen, 0);
+		if (len < 0 && scpi_tcp_would_block())
+			return 0;
+	}
+
+	if (len < 0) {
+		sr_err("Receive error: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+
+	if (len == 0 && maxlen > 0) {
+		sr_err("Connection closed by %s:%s.", tcp->address, tcp->port);
+		return SR_ERR;
+	}
+
+	return len;
+}
+
 static int scpi_tcp_open(struct sr_scpi_dev_inst *scpi)
 {
 	struct scpi_tcp *tcp = scpi->priv;
@@ -112,6 +217,8 @@ static int scpi_tcp_open(struct sr_scpi_dev_inst *scpi)
 		return SR_ERR;
 	}
 
+	scpi_tcp_setup(tcp);
+
 	return SR_OK;
 }
 
@@ -134,19 +241,23 @@ static int scpi_tcp_source_remove(struct sr_session *session, void *priv)
 static int scpi_tcp_send(void *priv, const char *command)
 {
 	struct scpi_tcp *tcp = priv;
-	int len, out;
+	int len, out, sent;
 
 	len = strlen(command);
-	out = send(tcp->socket, command, len, 0);
-
-	if (out < 0) {
-		sr_err("Send error: %s", g_strerror(errno));
-		return SR_ERR;
-	}
-
-	if (out < len) {
-		sr_dbg("Only sent %d/%d bytes of SCPI command: '%s'.", out,
-		       len, command);
+	for (sent = 0; sent < len; sent += out) {
+		out = send(tcp->socket, command + sent, len - sent, 0);
+		if (out < 0 && scpi_tcp_would_block()) {
+			/* The socket is non-blocking, wait for room. */
+			if (scpi_tcp_wait(tcp, TRUE, 1000) <= 0) {
+				sr_err("Timed out sending SCPI command: '%s'.",
+					command);
+				return SR_ERR;
+			}
+			out = 0;
+		} else if (out < 0) {
+			sr_err("Send error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
 	}
 
 	sr_spew("Successfully sent SCPI command: '%s'.", command);
@@ -160,41 +271,87 @@ static int scpi_tcp_read_begin(void *priv)
 
 	tcp->response_bytes_read = 0;
 	tcp->length_bytes_read = 0;
+	tcp->response_started = FALSE;
+	tcp->block_header_len = 0;
+	tcp->block_remaining = -2;
+	tcp->last_char = 0;
 
 	return SR_OK;
 }
 
+/*
+ * Follow a raw response to find its end. Text responses end at a
+ * linefeed. Definite length blocks may contain linefeeds, so their
+ * header is parsed and they end at the linefeed after their data.
+ */
+static void scpi_tcp_raw_track(struct scpi_tcp *tcp, const char *buf, int len)
+{
+	int i, digits;
+
+	for (i = 0; i < len && tcp->block_remaining == -2; i++) {
+		/* Skip what's left of a previous response's terminator. */
+		if (!tcp->response_started) {
+			if (g_ascii_isspace(buf[i]))
+				continue;
+			tcp->response_started = TRUE;
+		}
+		tcp->block_header[tcp->block_header_len++] = buf[i];
+		if (tcp->block_header[0] != '#') {
+			tcp->block_remaining = -1;
+		} else if (tcp->block_header_len >= 2) {
+			digits = tcp->block_header[1] - '0';
+			if (digits < 1 || digits > 9)
+				tcp->block_remaining = -1;
+			else if (tcp->block_header_len == 2 + digits) {
+				tcp->block_header[tcp->block_header_len] = '\0';
+				/* Include the terminating linefeed. */
+				tcp->block_remaining = g_ascii_strtoull(
+					tcp->block_header + 2, NULL, 10) + 1;
+			}
+		}
+	}
+
+	if (tcp->block_remaining > 0)
+		tcp->block_remaining -= MIN(len - i, tcp->block_remaining);
+
+	if (len > 0)
+		tcp->last_char = buf[len - 1];
+}
+
 static int scpi_tcp_raw_read_data(void *priv, char *buf, int maxlen)
 {
 	struct scpi_tcp *tcp = priv;
 	int len;
 
-	len = recv(tcp->socket, buf, maxlen, 0);
-
-	if (len < 0) {
-		sr_err("Receive error: %s", g_strerror(errno));
-		return SR_ERR;
-	}
+	if ((len = scpi_tcp_recv(tcp, buf, maxlen)) <= 0)
+		return len;
 
-	tcp->length_bytes_read = LENGTH_BYTES;
-	tcp->response_length = len < maxlen ? len : maxlen + 1;
-	tcp->response_bytes_read = len;
+	scpi_tcp_raw_track(tcp, buf, len);
+	tcp->response_bytes_read += len;
 
 	return len;
 }
 
+static int scpi_tcp_raw_read_complete(void *priv)
+{
+	struct scpi_tcp *tcp = priv;
+
+	if (!tcp->response_started || tcp->last_char != '\n')
+		return 0;
+
+	return tcp->block_remaining == -1 || tcp->block_remaining == 0;
+}
+
 static int scpi_tcp_rigol_read_data(void *priv, char *buf, int maxlen)
 {
 	struct scpi_tcp *tcp = priv;
 	int len;
 
 	if (tcp->length_bytes_read < LENGTH_BYTES) {
-		len = recv(tcp->socket, tcp->length_buf + tcp->length_bytes_read,
-				LENGTH_BYTES - tcp->length_bytes_read, 0);
-		if (len < 0) {
-			sr_err("Receive error: %s", g_strerror(errno));
+		len = scpi_tcp_recv(tcp, tcp->length_buf + tcp->length_bytes_read,
+				LENGTH_BYTES - tcp->length_bytes_read);
+		if (len < 0)
 			return SR_ERR;
-		}
 
 		tcp->length_bytes_read += len;
 
@@ -207,19 +364,18 @@ static int scpi_tcp_rigol_read_data(void *priv, char *buf, int maxlen)
 	if (tcp->response_bytes_read >= tcp->response_length)
 		return SR_ERR;
 
-	len = recv(tcp->socket, buf, maxlen, 0);
+	/* Don't read into the next response. */
+	maxlen = MIN(maxlen, tcp->response_length - tcp->response_bytes_read);
 
-	if (len < 0) {
-		sr_err("Receive error: %s", g_strerror(errno));
+	if ((len = scpi_tcp_recv(tcp, buf, maxlen)) < 0)
 		return SR_ERR;
-	}
 
 	tcp->response_bytes_read += len;
 
 	return len;
 }
 
-static int scpi_tcp_read_complete(void *priv)
+static int scpi_tcp_rigol_read_complete(void *priv)
 {
 	struct scpi_tcp *tcp = priv;
 
@@ -256,7 +412,7 @@ SR_PRIV const struct sr_scpi_dev_inst scpi_tcp_raw_dev = {
 	.send          = scpi_tcp_send,
 	.read_begin    = scpi_tcp_read_begin,
 	.read_data     = scpi_tcp_raw_read_data,
-	.read_complete = scpi_tcp_read_complete,
+	.read_complete = scpi_tcp_raw_read_complete,
 	.close         = scpi_tcp_close,
 	.free          = scpi_tcp_free,
 };
@@ -272,7 +428,7 @@ SR_PRIV const struct sr_scpi_dev_inst scpi_tcp_rigol_dev = {
 	.send          = scpi_tcp_send,
 	.read_begin    = scpi_tcp_read_begin,
 	.read_data     = scpi_tcp_rigol_read_data,
-	.read_complete = scpi_tcp_read_complete,
+	.read_complete = scpi_tcp_rigol_read_complete,
 	.close         = scpi_tcp_close,
 	.free          = scpi_tcp_free,
 };
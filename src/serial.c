@@ -85,6 +85,8 @@ SR_PRIV int serial_open(struct sr_serial_dev_inst *serial, int flags)
 	else if (flags & SERIAL_RDONLY)
 		sp_flags = SP_MODE_READ;
 
+	serial->rxbuf_pos = serial->rxbuf_len = 0;
+
 	ret = sp_open(serial->data, sp_flags);
 
 	switch (ret) {
@@ -149,6 +151,11 @@ SR_PRIV int serial_close(struct sr_serial_dev_inst *serial)
 	sp_free_port(serial->data);
 	serial->data = NULL;
 
+	if (serial->rx_events)
+		sp_free_event_set(serial->rx_events);
+	serial->rx_events = NULL;
+	serial->rxbuf_pos = serial->rxbuf_len = 0;
+
 	return SR_OK;
 }
 
@@ -179,6 +186,8 @@ SR_PRIV int serial_flush(struct sr_serial_dev_inst *serial)
 
 	sr_spew("Flushing serial port %s.", serial->port);
 
+	serial->rxbuf_pos = serial->rxbuf_len = 0;
+
 	ret = sp_flush(serial->data, SP_BUF_BOTH);
 
 	switch (ret) {
@@ -252,10 +261,14 @@ static int _serial_write(struct sr_serial_dev_inst *serial,
 		return SR_ERR;
 	}
 
-	if (nonblocking)
+	if (nonblocking) {
 		ret = sp_nonblocking_write(serial->data, buf, count);
-	else
+	} else {
+		timeout_ms = sr_scan_io_timeout(timeout_ms);
+		sr_scan_io_begin();
 		ret = sp_blocking_write(serial->data, buf, count, timeout_ms);
+		sr_scan_io_end();
+	}
 
 	switch (ret) {
 	case SP_ERR_ARG:
@@ -313,10 +326,105 @@ SR_PRIV int serial_write_nonblocking(struct sr_serial_dev_inst *serial,
 	return _serial_write(serial, buf, count, 1, 0);
 }
 
+/*
+ * The read-ahead buffer holds bytes that were received in bulk but not
+ * consumed yet, e.g. the bytes following a line terminator found by
+ * serial_readline(). All read functions consume from it before they
+ * touch the port, so the byte order on the wire is always preserved.
+ *
+ * Note that buffered bytes don't make the port readable to the poll
+ * loop. They are returned by the next serial_read_*() call, which
+ * drivers do on the next incoming data or source timeout.
+ */
+static void rxbuf_drop(struct sr_serial_dev_inst *serial, size_t count)
+{
+	serial->rxbuf_pos += count;
+	serial->rxbuf_len -= count;
+	if (!serial->rxbuf_len)
+		serial->rxbuf_pos = 0;
+}
+
+static size_t rxbuf_take(struct sr_serial_dev_inst *serial, void *buf,
+		size_t count)
+{
+	count = MIN(count, serial->rxbuf_len);
+	if (count) {
+		memcpy(buf, serial->rxbuf + serial->rxbuf_pos, count);
+		rxbuf_drop(serial, count);
+	}
+
+	return count;
+}
+
+/*
+ * Wait up to timeout_ms for the port to become readable (0 to not wait
+ * at all), then read everything available into the read-ahead buffer.
+ * Returns the number of bytes added, or a negative error code.
+ */
+static int rxbuf_fill(struct sr_serial_dev_inst *serial,
+		unsigned int timeout_ms)
+{
+	ssize_t ret;
+	char *error;
+
+	if (serial->rxbuf_pos) {
+		memmove(serial->rxbuf, serial->rxbuf + serial->rxbuf_pos,
+			serial->rxbuf_len);
+		serial->rxbuf_pos = 0;
+	}
+	if (serial->rxbuf_len == SERIAL_RXBUF_SIZE)
+		return 0;
+
+	if (timeout_ms) {
+		if (!serial->rx_events) {
+			if (sp_new_event_set(&serial->rx_events) != SP_OK)
+				return SR_ERR;
+			if (sp_add_port_events(serial->rx_events, serial->data,
+					SP_EVENT_RX_READY) != SP_OK) {
+				sp_free_event_set(serial->rx_events);
+				serial->rx_events = NULL;
+				return SR_ERR;
+			}
+		}
+		/* A timeout is not an error, the read below returns 0. */
+		timeout_ms = sr_scan_io_timeout(timeout_ms);
+		sr_scan_io_begin();
+		ret = sp_wait(serial->rx_events, timeout_ms);
+		sr_scan_io_end();
+		if (ret != SP_OK) {
+			error = sp_last_error_message();
+			sr_err("Error waiting for data (%d): %s.",
+				sp_last_error_code(), error);
+			sp_free_error_message(error);
+			return SR_ERR;
+		}
+	}
+
+	ret = sp_nonblocking_read(serial->data,
+			serial->rxbuf + serial->rxbuf_len,
+			SERIAL_RXBUF_SIZE - serial->rxbuf_len);
+
+	switch (ret) {
+	case SP_ERR_ARG:
+		sr_err("Attempted serial port read with invalid arguments.");
+		return SR_ERR_ARG;
+	case SP_ERR_FAIL:
+		error = sp_last_error_message();
+		sr_err("Read error (%d): %s.", sp_last_error_code(), error);
+		sp_free_error_message(error);
+		return SR_ERR;
+	}
+
+	serial->rxbuf_len += ret;
+
+	return ret;
+}
+
 static int _serial_read(struct sr_serial_dev_inst *serial, void *buf,
 		size_t count, int nonblocking, unsigned int timeout_ms)
 {
 	ssize_t ret;
+	size_t buffered;
 	char *error;
 
 	if (!serial) {
@@ -329,10 +437,22 @@ static int _serial_read(struct sr_serial_dev_inst *serial, void *buf,
 		return SR_ERR;
 	}
 
-	if (nonblocking)
-		ret = sp_nonblocking_read(serial->data, buf, count);
-	else
-		ret = sp_blocking_read(serial->data, buf, count, timeout_ms);
+	buffered = rxbuf_take(serial, buf, count);
+	if (buffered == count) {
+		sr_spew("Read %zu/%zu bytes (buffered).", buffered, count);
+		return buffered;
+	}
+	buf = (uint8_t *)buf + buffered;
+
+	if (nonblocking) {
+		ret = sp_nonblocking_read(serial->data, buf, count - buffered);
+	} else {
+		timeout_ms = sr_scan_io_timeout(timeout_ms);
+		sr_scan_io_begin();
+		ret = sp_blocking_read(serial->data, buf, count - buffered,
+				timeout_ms);
+		sr_scan_io_end();
+	}
 
 	switch (ret) {
 	case SP_ERR_ARG:
@@ -345,6 +465,7 @@ static int _serial_read(struct sr_serial_dev_inst *serial, void *buf,
 		return SR_ERR;
 	}
 
+	ret += buffered;
 	if (ret > 0)
 		sr_spew("Read %zd/%zu bytes.", ret, count);
 
@@ -611,7 +732,9 @@ SR_PRIV int serial_readline(struct sr_serial_dev_inst *serial, char **buf,
 		int *buflen, gint64 timeout_ms)
 {
 	gint64 start, remaining;
-	int maxlen, len;
+	const uint8_t *p, *eol, *cr;
+	size_t n;
+	int maxlen, ret;
 
 	if (!serial) {
 		sr_dbg("Invalid serial port.");
@@ -623,34 +746,39 @@ SR_PRIV int serial_readline(struct sr_serial_dev_inst *serial, char **buf,
 		return -1;
 	}
 
+	timeout_ms = sr_scan_io_timeout(timeout_ms);
 	start = g_get_monotonic_time();
-	remaining = timeout_ms;
 
 	maxlen = *buflen;
-	*buflen = len = 0;
-	while (1) {
-		len = maxlen - *buflen - 1;
-		if (len < 1)
+	*buflen = 0;
+	while (*buflen < maxlen - 1) {
+		/* Look for CR or LF in what's buffered, up to the space left. */
+		p = serial->rxbuf + serial->rxbuf_pos;
+		n = MIN(serial->rxbuf_len, (size_t)(maxlen - 1 - *buflen));
+		eol = memchr(p, '\n', n);
+		cr = memchr(p, '\r', eol ? (size_t)(eol - p) : n);
+		if (cr)
+			eol = cr;
+		if (eol) {
+			/* Strip CR/LF and terminate. */
+			memcpy(*buf + *buflen, p, eol - p);
+			*buflen += eol - p;
+			rxbuf_drop(serial, eol - p + 1);
 			break;
-		len = sp_blocking_read(serial->data, *buf + *buflen, 1, remaining);
-		if (len > 0) {
-			*buflen += len;
-			*(*buf + *buflen) = '\0';
-			if (*buflen > 0 && (*(*buf + *buflen - 1) == '\r'
-					|| *(*buf + *buflen - 1) == '\n')) {
-				/* Strip CR/LF and terminate. */
-				*(*buf + --*buflen) = '\0';
-				break;
-			}
 		}
-		/* Reduce timeout by time elapsed. */
+		*buflen += rxbuf_take(serial, *buf + *buflen, n);
+
+		/* Wait for more data, for the time that's left. */
 		remaining = timeout_ms - ((g_get_monotonic_time() - start) / 1000);
-		if (remaining <= 0)
+		ret = rxbuf_fill(serial, MAX(remaining, 0));
+		if (ret < 0)
+			return ret;
+		if (ret == 0 && remaining <= 0)
 			/* Timeout */
 			break;
-		if (len < 1)
-			g_usleep(2000);
 	}
+	if (maxlen > 0)
+		*(*buf + *buflen) = '\0';
 	if (*buflen)
 		sr_dbg("Received %d: '%s'.", *buflen, *buf);
 
@@ -684,7 +812,7 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 {
 	uint64_t start, time, byte_delay_us;
 	size_t ibuf, i, maxlen;
-	ssize_t len;
+	int ret;
 
 	maxlen = *buflen;
 
@@ -698,32 +826,24 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 
 	/* Assume 8n1 transmission. That is 10 bits for every byte. */
 	byte_delay_us = 10 * ((1000 * 1000) / baudrate);
+	timeout_ms = sr_scan_io_timeout(timeout_ms);
 	start = g_get_monotonic_time();
 
-	i = ibuf = len = 0;
+	i = ibuf = 0;
 	while (ibuf < maxlen) {
-		len = serial_read_nonblocking(serial, &buf[ibuf], 1);
-		if (len > 0) {
-			ibuf += len;
-		} else if (len == 0) {
-			/* No logging, already done in serial_read(). */
-		} else {
-			/* Error reading byte, but continuing anyway. */
-		}
+		/* Take whatever arrived, then try all new packet offsets. */
+		ibuf += rxbuf_take(serial, &buf[ibuf], maxlen - ibuf);
 
 		time = g_get_monotonic_time() - start;
 		time /= 1000;
 
-		if ((ibuf - i) >= packet_size) {
+		while ((ibuf - i) >= packet_size) {
 			/* We have at least a packet's worth of data. */
 			if (is_valid(&buf[i])) {
 				sr_spew("Found valid %zu-byte packet after "
 					"%" PRIu64 "ms.", (ibuf - i), time);
 				*buflen = ibuf;
 				return SR_OK;
-			} else {
-				sr_spew("Got %zu bytes, but not a valid "
-					"packet.", (ibuf - i));
 			}
 			/* Not a valid packet. Continue searching. */
 			i++;
@@ -733,8 +853,12 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 			sr_dbg("Detection timed out after %" PRIu64 "ms.", time);
 			break;
 		}
-		if (len < 1)
+		/* Sleep until data comes in, rather than polling. */
+		ret = rxbuf_fill(serial, timeout_ms - time);
+		if (ret < 0) {
+			/* Error reading, but continuing anyway. */
 			g_usleep(byte_delay_us);
+		}
 	}
 
 	*buflen = ibuf;
@@ -744,6 +868,177 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 	return SR_ERR;
 }
 
+/**
+ * Set up a packet scanner.
+ *
+ * If all packets of a protocol have the same byte at a fixed offset
+ * (e.g. a sync byte, or the LF of a trailing CR/LF), pass it as
+ * @a sync_offset and @a sync_byte. Packet candidates are then found with
+ * memchr(), and @a is_valid only runs where that byte is in place.
+ *
+ * @param scanner The scanner to set up.
+ * @param[in] packet_size Size, in bytes, of a valid packet. At most
+ *                        SERIAL_SCANNER_BUFSIZE.
+ * @param is_valid Callback that assesses whether the packet is valid or not.
+ * @param[in] sync_offset Offset of the sync byte within a packet, or -1 if
+ *                        the protocol has none.
+ * @param[in] sync_byte The sync byte.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int serial_packet_scanner_init(struct serial_packet_scanner *scanner,
+		size_t packet_size, packet_valid_callback is_valid,
+		int sync_offset, uint8_t sync_byte)
+{
+	if (!scanner || !is_valid)
+		return SR_ERR_ARG;
+	if (packet_size == 0 || packet_size > SERIAL_SCANNER_BUFSIZE)
+		return SR_ERR_ARG;
+	if (sync_offset >= (int)packet_size)
+		return SR_ERR_ARG;
+
+	scanner->packet_size = packet_size;
+	scanner->is_valid = is_valid;
+	scanner->sync_offset = sync_offset;
+	scanner->sync_byte = sync_byte;
+	scanner->buflen = 0;
+
+	return SR_OK;
+}
+
+/* Pass the valid packets in the scanner's buffer to the callback. */
+static int scanner_find_packets(struct serial_packet_scanner *scanner,
+		packet_found_callback cb, void *cb_data, gboolean *scanning)
+{
+	const uint8_t *sync;
+	size_t offset, last;
+	int found;
+
+	found = 0;
+	offset = 0;
+	while (scanner->buflen - offset >= scanner->packet_size) {
+		/* Skip to the next offset with the sync byte in place. */
+		if (scanner->sync_offset >= 0) {
+			last = scanner->buflen - scanner->packet_size;
+			sync = memchr(scanner->buf + offset + scanner->sync_offset,
+				scanner->sync_byte, last - offset + 1);
+			if (!sync) {
+				offset = last + 1;
+				break;
+			}
+			offset = sync - scanner->buf - scanner->sync_offset;
+		}
+		if (!scanner->is_valid(scanner->buf + offset)) {
+			offset++;
+			continue;
+		}
+		found++;
+		offset += scanner->packet_size;
+		if (!cb(scanner->buf + offset - scanner->packet_size, cb_data)) {
+			*scanning = FALSE;
+			break;
+		}
+	}
+
+	/* Move whatever is left to the beginning of the buffer. */
+	if (offset) {
+		memmove(scanner->buf, scanner->buf + offset,
+			scanner->buflen - offset);
+		scanner->buflen -= offset;
+	}
+
+	return found;
+}
+
+/**
+ * Pass every valid packet in a block of received data to a callback.
+ *
+ * Data that may be the start of a packet is kept for the next call.
+ *
+ * @param scanner Scanner set up with serial_packet_scanner_init().
+ * @param[in] buf The received data.
+ * @param[in] len The number of bytes in @a buf.
+ * @param cb Called for every valid packet. Return FALSE to stop scanning,
+ *           the remaining data is then kept for the next call, as far as
+ *           it fits in the scanner's buffer.
+ * @param cb_data Data passed to @a cb.
+ *
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other The number of packets found.
+ *
+ * @private
+ */
+SR_PRIV int serial_packet_scanner_feed(struct serial_packet_scanner *scanner,
+		const uint8_t *buf, size_t len,
+		packet_found_callback cb, void *cb_data)
+{
+	size_t count;
+	gboolean scanning;
+	int found;
+
+	if (!scanner || (!buf && len) || !cb)
+		return SR_ERR_ARG;
+
+	found = 0;
+	scanning = TRUE;
+	do {
+		count = MIN(len, SERIAL_SCANNER_BUFSIZE - scanner->buflen);
+		if (count) {
+			memcpy(scanner->buf + scanner->buflen, buf, count);
+			scanner->buflen += count;
+			buf += count;
+			len -= count;
+		}
+		if (scanning)
+			found += scanner_find_packets(scanner, cb, cb_data,
+				&scanning);
+	} while (len > 0 && (scanning
+			|| scanner->buflen < SERIAL_SCANNER_BUFSIZE));
+
+	if (len > 0)
+		sr_warn("Packet scanner buffer full, dropping %zu bytes.", len);
+
+	return found;
+}
+
+/**
+ * Read the available data from a serial port, and pass every valid
+ * packet in it to a callback, see serial_packet_scanner_feed().
+ *
+ * @param serial Previously initialized serial port structure.
+ * @param scanner Scanner set up with serial_packet_scanner_init().
+ * @param cb Called for every valid packet. Return FALSE to stop scanning,
+ *           the remaining data is then kept for the next call.
+ * @param cb_data Data passed to @a cb.
+ *
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Read error.
+ * @retval other The number of packets found.
+ *
+ * @private
+ */
+SR_PRIV int serial_packet_scan(struct sr_serial_dev_inst *serial,
+		struct serial_packet_scanner *scanner,
+		packet_found_callback cb, void *cb_data)
+{
+	uint8_t buf[SERIAL_SCANNER_BUFSIZE];
+	int len;
+
+	if (!scanner || !cb)
+		return SR_ERR_ARG;
+
+	/* Read no more than the scanner's buffer can take. */
+	len = serial_read_nonblocking(serial, buf,
+			SERIAL_SCANNER_BUFSIZE - scanner->buflen);
+	if (len < 0)
+		return len;
+
+	return serial_packet_scanner_feed(scanner, buf, len, cb, cb_data);
+}
+
 /**
  * Extract the serial device and options from the options linked list.
  *
@@ -225,6 +225,8 @@ SR_API int sr_session_new(struct sr_context *ctx,
 
 	g_mutex_init(&session->main_mutex);
 
+	session->fuse_transforms = TRUE;
+
 	/* To maintain API compatibility, we need a lookup table
 	 * which maps poll_object IDs to GSource* pointers.
 	 */
@@ -258,6 +260,9 @@ SR_API int sr_session_destroy(struct sr_session *session)
 
 	sr_session_datafeed_callback_remove_all(session);
 
+	if (session->recorder)
+		sr_session_record_stop(session);
+
 	g_hash_table_unref(session->event_sources);
 
 	g_mutex_clear(&session->main_mutex);
@@ -1079,6 +1084,126 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 	}
 }
 
+/*
+ * Size of the blocks that fused transforms process in turn. This should
+ * comfortably fit into the L1 data cache.
+ */
+#define TRANSFORM_BLOCK_SIZE (16 * 1024)
+
+static gboolean has_block_kernel(GSList *l)
+{
+	const struct sr_transform *t;
+
+	if (!l)
+		return FALSE;
+	t = l->data;
+
+	return t->module->receive_logic_block != NULL;
+}
+
+/*
+ * Run the transforms from @a first on, as long as they have a block
+ * kernel, over the logic payload one block at a time. Returns the last
+ * transform that was run in @a last.
+ */
+static int run_fused_transforms(GSList *first, GSList **last,
+		const struct sr_datafeed_logic *logic)
+{
+	GSList *l, *end;
+	const struct sr_transform *t;
+	uint64_t block, offset, length;
+	uint8_t *data;
+	int ret;
+
+	for (end = first; has_block_kernel(end->next); end = end->next)
+		;
+	*last = end;
+
+	if (!logic->unitsize)
+		return SR_ERR_ARG;
+	block = MAX(TRANSFORM_BLOCK_SIZE / logic->unitsize, 1) * logic->unitsize;
+
+	data = logic->data;
+	for (offset = 0; offset < logic->length; offset += block) {
+		length = MIN(block, logic->length - offset);
+		for (l = first; ; l = l->next) {
+			t = l->data;
+			ret = t->module->receive_logic_block(t, logic,
+					data + offset, length);
+			if (ret < 0)
+				return ret;
+			if (l == end)
+				break;
+		}
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Pass the packet to the transform module at @a first. If that returns
+ * another packet (instead of NULL), pass that packet to the next
+ * transform module in the list, and so on. If the last transform did
+ * output a packet, pass it to all datafeed callbacks.
+ *
+ * Two or more consecutive transforms with a block kernel are fused into
+ * a single pass over the data of a logic packet.
+ */
+static int session_send_chain(const struct sr_dev_inst *sdi, GSList *first,
+		const struct sr_datafeed_packet *packet)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	struct sr_datafeed_packet *packet_in, *packet_out;
+	struct sr_transform *t;
+	int ret;
+
+	packet_in = (struct sr_datafeed_packet *)packet;
+	for (l = first; l; l = l->next) {
+		if (packet_in->type == SR_DF_LOGIC && sdi->session->fuse_transforms
+				&& has_block_kernel(l) && has_block_kernel(l->next)) {
+			sr_spew("Running fused transform modules.");
+			ret = run_fused_transforms(l, &l, packet_in->payload);
+			if (ret < 0) {
+				sr_err("Error while running transform module: %d.", ret);
+				return SR_ERR;
+			}
+			continue;
+		}
+		t = l->data;
+		sr_spew("Running transform module '%s'.", t->module->id);
+		ret = t->module->receive(t, packet_in, &packet_out);
+		if (ret < 0) {
+			sr_err("Error while running transform module: %d.", ret);
+			return SR_ERR;
+		}
+		if (!packet_out) {
+			/*
+			 * If any of the transforms don't return an output
+			 * packet, abort.
+			 */
+			sr_spew("Transform module didn't return a packet, aborting.");
+			return SR_OK;
+		} else {
+			/*
+			 * Use this transform module's output packet as input
+			 * for the next transform module.
+			 */
+			packet_in = packet_out;
+		}
+	}
+	packet = packet_in;
+
+	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
+		if (sr_log_loglevel_get() >= SR_LOG_DBG)
+			datafeed_dump(packet);
+		cb_struct = l->data;
+		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+	}
+
+	return SR_OK;
+}
+
 /**
  * Send a packet to whatever is listening on the datafeed bus.
  *
@@ -1095,10 +1220,7 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet)
 {
-	GSList *l;
-	struct datafeed_callback *cb_struct;
-	struct sr_datafeed_packet *packet_in, *packet_out;
-	struct sr_transform *t;
+	gboolean consumed;
 	int ret;
 
 	if (!sdi) {
@@ -1153,48 +1275,80 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		return sr_session_send(sdi, &new_packet);
 	}
 
-	/*
-	 * Pass the packet to the first transform module. If that returns
-	 * another packet (instead of NULL), pass that packet to the next
-	 * transform module in the list, and so on.
-	 */
-	packet_in = (struct sr_datafeed_packet *)packet;
-	for (l = sdi->session->transforms; l; l = l->next) {
-		t = l->data;
-		sr_spew("Running transform module '%s'.", t->module->id);
-		ret = t->module->receive(t, packet_in, &packet_out);
-		if (ret < 0) {
-			sr_err("Error while running transform module: %d.", ret);
-			return SR_ERR;
-		}
-		if (!packet_out) {
-			/*
-			 * If any of the transforms don't return an output
-			 * packet, abort.
-			 */
-			sr_spew("Transform module didn't return a packet, aborting.");
-			return SR_OK;
-		} else {
-			/*
-			 * Use this transform module's output packet as input
-			 * for the next transform module.
-			 */
-			packet_in = packet_out;
-		}
+	if (sdi->session->recorder) {
+		/* Recorded logic data doesn't go any further. */
+		ret = sr_session_record_packet(sdi, packet, &consumed);
+		if (consumed)
+			return ret;
+		if (ret != SR_OK)
+			sr_err("Failed to record packet: %d.", ret);
 	}
-	packet = packet_in;
 
-	/*
-	 * If the last transform did output a packet, pass it to all datafeed
-	 * callbacks.
-	 */
-	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
-		if (sr_log_loglevel_get() >= SR_LOG_DBG)
-			datafeed_dump(packet);
-		cb_struct = l->data;
-		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+	return session_send_chain(sdi, sdi->session->transforms, packet);
+}
+
+/**
+ * Send a packet that was generated by a transform module.
+ *
+ * The packet is passed to the transform modules following @a t in the
+ * session's transform chain, and then to all datafeed callbacks. This
+ * lets a transform emit packets in addition to the one it returns from
+ * its receive() callback, e.g. an SR_DF_META packet announcing the new
+ * samplerate of a decimated stream.
+ *
+ * @param t The transform instance emitting the packet. Must not be NULL.
+ * @param packet The datafeed packet to send. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_BUG The transform is not part of its session's chain.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_downstream(const struct sr_transform *t,
+		const struct sr_datafeed_packet *packet)
+{
+	GSList *l;
+
+	if (!t || !t->sdi || !packet)
+		return SR_ERR_ARG;
+
+	if (!t->sdi->session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
 	}
 
+	l = g_slist_find(t->sdi->session->transforms, t);
+	if (!l) {
+		sr_err("%s: transform is not part of the session", __func__);
+		return SR_ERR_BUG;
+	}
+
+	return session_send_chain(t->sdi, l->next, packet);
+}
+
+/**
+ * Set whether consecutive transforms with a block kernel are fused.
+ *
+ * Fusion is on by default. Turning it off runs every transform on its
+ * own, which the tests compare the fused chain against.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param fuse TRUE to fuse the transforms, FALSE to run them one by one.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_fuse_transforms_set(struct sr_session *session,
+		gboolean fuse)
+{
+	if (!session)
+		return SR_ERR_ARG;
+
+	session->fuse_transforms = fuse;
+
 	return SR_OK;
 }
 
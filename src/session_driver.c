@@ -23,6 +23,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <string.h>
+#include <math.h>
 #include <zip.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -34,22 +36,118 @@
 #define CHUNKSIZE (512 * 1024)
 /** @endcond */
 
+/*
+ * Threads inflating capture files, on top of the one every track needs.
+ * Only the spare ones are bounded by this and the number of processors,
+ * so a file with many analog channels can still use more threads.
+ */
+#define MAX_WORKERS 8
+
+/* Number of payloads each thread may prepare in advance. */
+#define NUM_BUFFERS 4
+
 SR_PRIV struct sr_dev_driver session_driver_info;
 
+/* A capture file (or chunk of one) in the session archive. */
+struct replay_chunk {
+	char *name;
+	/* Bytes to skip at the start, and bytes to replay after that. */
+	uint64_t skip;
+	uint64_t length;
+};
+
+/*
+ * A payload read by a worker. Buffers go round between the worker's free
+ * and ready queues, a buffer with no data marks the end of a chunk.
+ */
+struct replay_buffer {
+	uint8_t *data;
+	int length;
+	gboolean error;
+};
+
+/*
+ * The logic data and every analog channel form a track of their own.
+ * Tracks are replayed side by side, in blocks of the same samples, so a
+ * consumer sees all channels progress together.
+ */
+struct replay_track {
+	/* 0 for logic data, or the analog channel number starting at 1. */
+	int analog_channel;
+	unsigned int samplesize;
+	GSList *channels;
+	GSList *chunks;
+	unsigned int num_chunks;
+
+	/* The workers inflating this track's chunks. */
+	struct replay_worker *workers;
+	int num_workers;
+
+	/* Replay state, only used by the main loop. */
+	unsigned int cur_chunk;
+	uint64_t position;
+	struct replay_buffer *buf;
+	int offset;
+	gboolean done;
+};
+
+/*
+ * Chunks are independent zip entries, so they are inflated in parallel.
+ * Every track has at least one worker to itself, and worker n of a track
+ * takes its chunks n, n + num_workers, ... in order, each worker with its
+ * own handle on the archive and its own buffers. The main loop collects a
+ * track's chunks from its workers in turn, which keeps them in file order,
+ * and a worker that gets too far ahead simply runs out of buffers. The
+ * memory used therefore doesn't depend on the size of the capture.
+ */
+struct replay_worker {
+	struct session_vdev *vdev;
+	struct replay_track *track;
+	int id;
+	GThread *thread;
+	struct zip *archive;
+	struct replay_buffer buffers[NUM_BUFFERS];
+	GAsyncQueue *free_buffers;
+	GAsyncQueue *ready_buffers;
+};
+
 struct session_vdev {
 	char *sessionfile;
 	char *capturefile;
 	struct zip *archive;
-	struct zip_file *capfile;
-	int bytes_read;
+	uint64_t bytes_read;
 	uint64_t samplerate;
 	int unitsize;
 	int num_channels;
 	int num_analog_channels;
-	int cur_analog_channel;
 	GArray *analog_channels;
-	int cur_chunk;
 	gboolean finished;
+
+	/* Part of the file to replay, a stop of 0 means up to the end. */
+	uint64_t start_sample;
+	uint64_t stop_sample;
+	double start_time;
+	double stop_time;
+	gboolean replay_by_time;
+
+	/* Tracks are sent in blocks of this many samples. */
+	struct replay_track *tracks;
+	int num_tracks;
+	uint64_t block_samples;
+
+	/* Read-ahead state. */
+	struct replay_worker *workers;
+	int num_workers;
+	gint stop;
+	/* The workers wake the session's main loop up for their payloads. */
+	GMainContext *main_context;
+};
+
+/* Passes the workers' payloads on in the main loop, see replay_ready(). */
+struct replay_source {
+	GSource base;
+	struct sr_session *session;
+	struct session_vdev *vdev;
 };
 
 static const uint32_t devopts[] = {
@@ -59,125 +157,546 @@ static const uint32_t devopts[] = {
 	SR_CONF_NUM_ANALOG_CHANNELS | SR_CONF_SET,
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_SESSIONFILE | SR_CONF_SET,
+	SR_CONF_REPLAY_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_REPLAY_TIME | SR_CONF_GET | SR_CONF_SET,
 };
 
-static gboolean stream_session_data(struct sr_dev_inst *sdi)
+static void chunk_free(void *data)
 {
-	struct session_vdev *vdev;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-	struct sr_datafeed_analog_old analog;
-	struct zip_stat zs;
-	int ret, got_data;
-	char capturefile[16];
-	void *buf;
+	struct replay_chunk *chunk;
 
-	got_data = FALSE;
-	vdev = sdi->priv;
+	chunk = data;
+	g_free(chunk->name);
+	g_free(chunk);
+}
+
+static void tracks_free(struct session_vdev *vdev)
+{
+	int i;
+
+	for (i = 0; i < vdev->num_tracks; i++) {
+		g_slist_free(vdev->tracks[i].channels);
+		g_slist_free_full(vdev->tracks[i].chunks, chunk_free);
+	}
+	g_free(vdev->tracks);
+	vdev->tracks = NULL;
+	vdev->num_tracks = 0;
+}
+
+/*
+ * Queue a chunk for replay if it overlaps the requested range of samples.
+ * The chunk starts at sample 'first', and holds 'size' bytes.
+ */
+static void add_chunk(struct session_vdev *vdev, struct replay_track *track,
+		const char *name, uint64_t first, uint64_t size)
+{
+	struct replay_chunk *chunk;
+	uint64_t last, lo, hi;
+
+	last = first + size / track->samplesize;
+
+	lo = MAX(first, vdev->start_sample);
+	hi = vdev->stop_sample ? MIN(last, vdev->stop_sample) : last;
+	if (lo >= hi) {
+		sr_spew("Skipping %s.", name);
+		return;
+	}
+
+	chunk = g_malloc0(sizeof(struct replay_chunk));
+	chunk->name = g_strdup(name);
+	chunk->skip = (lo - first) * track->samplesize;
+	chunk->length = (hi - lo) * track->samplesize;
+	track->chunks = g_slist_append(track->chunks, chunk);
+	track->num_chunks++;
+}
+
+/*
+ * Find a capture file in the archive, either whole or in numbered chunks.
+ * If the file has an index, it gives the first sample and the length of
+ * each chunk, so a chunk that was cut short is reported as an error and
+ * doesn't shift the samples after it. Without one, the chunks follow each
+ * other and are as long as their entries in the archive.
+ */
+static int add_chunks(struct session_vdev *vdev, GKeyFile *index,
+		struct replay_track *track, const char *basename)
+{
+	struct zip_stat zs;
+	GError *error;
+	char *name, *next;
+	uint64_t first, start, end, size;
+	int i;
+
+	if (zip_stat(vdev->archive, basename, 0, &zs) != -1) {
+		add_chunk(vdev, track, basename, 0, zs.size);
+		return SR_OK;
+	}
 
-	if (!vdev->capfile) {
-		/* No capture file opened yet, or finished with the last
-		 * chunked one. */
-		if (vdev->capturefile && (vdev->cur_chunk == 0)) {
-			/* capturefile is always the unchunked base name. */
-			if (zip_stat(vdev->archive, vdev->capturefile, 0, &zs) != -1) {
-				/* No chunks, just a single capture file. */
-				vdev->cur_chunk = 0;
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						vdev->capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", vdev->capturefile);
+	first = 0;
+	for (i = 1; ; i++) {
+		name = g_strdup_printf("%s-%d", basename, i);
+		if (zip_stat(vdev->archive, name, 0, &zs) == -1) {
+			g_free(name);
+			break;
+		}
+		size = zs.size;
+		if (index) {
+			/* The chunk ends where the next one (or the file) starts. */
+			error = NULL;
+			end = 0;
+			next = g_strdup_printf("%s-%d", basename, i + 1);
+			start = g_key_file_get_uint64(index, basename, name, &error);
+			if (!error && g_key_file_has_key(index, basename, next, NULL))
+				end = g_key_file_get_uint64(index, basename, next, &error);
+			else if (!error)
+				end = g_key_file_get_uint64(index, basename, "samples", &error);
+			g_free(next);
+			if (error || end < start) {
+				sr_dbg("No index entry for %s.", name);
+				if (error)
+					g_error_free(error);
+				index = NULL;
 			} else {
-				/* Try as first chunk filename. */
-				snprintf(capturefile, 15, "%s-1", vdev->capturefile);
-				if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-					vdev->cur_chunk = 1;
-					if (!(vdev->capfile = zip_fopen(vdev->archive,
-							capturefile, 0)))
-						return FALSE;
-					sr_dbg("Opened %s.", capturefile);
-				} else {
-					sr_err("No capture file '%s' in " "session file '%s'.",
-							vdev->capturefile, vdev->sessionfile);
-					return FALSE;
-				}
+				first = start;
+				size = (end - start) * track->samplesize;
 			}
-		} else {
-			/* Capture data is chunked, advance to the next chunk. */
-			vdev->cur_chunk++;
-			snprintf(capturefile, 15, "%s-%d", vdev->capturefile,
-					vdev->cur_chunk);
-			if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", capturefile);
-			} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
-				vdev->capturefile = g_strdup_printf("analog-1-%d",
-						vdev->num_channels + vdev->cur_analog_channel + 1);
-				vdev->cur_analog_channel++;
-				vdev->cur_chunk = 0;
-				return TRUE;
-			} else {
-				/* We got all the chunks, finish up. */
-				return FALSE;
+		}
+		add_chunk(vdev, track, name, first, size);
+		first += size / track->samplesize;
+		g_free(name);
+	}
+
+	if (i == 1) {
+		sr_err("No capture file '%s' in session file '%s'.",
+			basename, vdev->sessionfile);
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+/* One track for the logic data, then one for each analog channel. */
+static int find_chunks(struct session_vdev *vdev)
+{
+	struct replay_track *track;
+	struct zip_stat zs;
+	GKeyFile *index;
+	char *basename;
+	int i, ret;
+
+	if (vdev->replay_by_time) {
+		if (!vdev->samplerate) {
+			sr_err("Cannot replay a time range without a samplerate.");
+			return SR_ERR;
+		}
+		vdev->start_sample = vdev->start_time * vdev->samplerate;
+		vdev->stop_sample = ceil(vdev->stop_time * vdev->samplerate);
+	}
+	if (vdev->start_sample || vdev->stop_sample)
+		sr_info("Replaying samples %" PRIu64 " to %" PRIu64 ".",
+			vdev->start_sample, vdev->stop_sample);
+
+	index = NULL;
+	if (zip_stat(vdev->archive, "index", 0, &zs) != -1)
+		index = sr_sessionfile_read_metadata(vdev->archive, &zs);
+
+	vdev->tracks = g_malloc0_n(vdev->num_analog_channels + 1,
+			sizeof(struct replay_track));
+	vdev->block_samples = 0;
+
+	ret = SR_OK;
+	if (vdev->capturefile) {
+		track = &vdev->tracks[vdev->num_tracks++];
+		/* unitsize is not defined for purely analog session files. */
+		track->samplesize = MAX(vdev->unitsize, 1);
+		ret = add_chunks(vdev, index, track, vdev->capturefile);
+	}
+
+	for (i = 1; ret == SR_OK && i <= vdev->num_analog_channels; i++) {
+		if ((unsigned int)i > vdev->analog_channels->len) {
+			sr_err("No channel for analog capture file %d.", i);
+			ret = SR_ERR_DATA;
+			break;
+		}
+		track = &vdev->tracks[vdev->num_tracks++];
+		track->analog_channel = i;
+		track->samplesize = sizeof(float);
+		track->channels = g_slist_append(NULL,
+			g_array_index(vdev->analog_channels, struct sr_channel *, i - 1));
+		basename = g_strdup_printf("analog-1-%d", vdev->num_channels + i);
+		ret = add_chunks(vdev, index, track, basename);
+		g_free(basename);
+	}
+
+	/* A block is as large as a payload of the widest track. */
+	for (i = 0; i < vdev->num_tracks; i++) {
+		track = &vdev->tracks[i];
+		track->done = track->num_chunks == 0;
+		if (!vdev->block_samples || CHUNKSIZE / track->samplesize < vdev->block_samples)
+			vdev->block_samples = CHUNKSIZE / track->samplesize;
+	}
+
+	if (index)
+		g_key_file_free(index);
+
+	return ret;
+}
+
+/* Hand a payload to the main loop, and wake it up for it. */
+static void buffer_ready(struct replay_worker *w, struct replay_buffer *buf)
+{
+	g_async_queue_push(w->ready_buffers, buf);
+	g_main_context_wakeup(w->vdev->main_context);
+}
+
+static gboolean inflate_chunk(struct replay_worker *w,
+		const struct replay_chunk *chunk)
+{
+	struct session_vdev *vdev;
+	struct replay_buffer *buf;
+	struct zip_file *capfile;
+	uint64_t skip, remaining, size;
+	int ret;
+
+	vdev = w->vdev;
+
+	if (!(capfile = zip_fopen(w->archive, chunk->name, 0))) {
+		sr_err("Failed to open %s: %s", chunk->name,
+			zip_strerror(w->archive));
+		return FALSE;
+	}
+	sr_dbg("Opened %s.", chunk->name);
+
+	/* Compressed entries can't seek, read up to the start. */
+	skip = chunk->skip;
+	ret = 0;
+	while (skip > 0 && !g_atomic_int_get(&vdev->stop)) {
+		buf = g_async_queue_pop(w->free_buffers);
+		ret = zip_fread(capfile, buf->data, MIN(skip, CHUNKSIZE));
+		g_async_queue_push(w->free_buffers, buf);
+		if (ret <= 0)
+			break;
+		skip -= ret;
+	}
+
+	size = CHUNKSIZE / w->track->samplesize * w->track->samplesize;
+	remaining = chunk->length;
+	while (skip == 0 && remaining > 0 && !g_atomic_int_get(&vdev->stop)) {
+		buf = g_async_queue_pop(w->free_buffers);
+		ret = zip_fread(capfile, buf->data, MIN(remaining, size));
+		if (ret <= 0) {
+			g_async_queue_push(w->free_buffers, buf);
+			break;
+		}
+		buf->length = ret;
+		remaining -= ret;
+		buffer_ready(w, buf);
+	}
+
+	/* A chunk shorter than expected would shift all samples after it. */
+	if ((skip > 0 || remaining > 0) && !g_atomic_int_get(&vdev->stop)) {
+		if (ret < 0)
+			sr_err("Failed to read %s: %s", chunk->name,
+				zip_file_strerror(capfile));
+		else
+			sr_err("%s ends %" PRIu64 " bytes early.", chunk->name,
+				skip + remaining);
+		zip_fclose(capfile);
+		return FALSE;
+	}
+	zip_fclose(capfile);
+
+	return TRUE;
+}
+
+/* Runs in its own thread, and inflates every num_workers'th chunk. */
+static gpointer inflate_chunks(gpointer data)
+{
+	struct replay_worker *w;
+	struct session_vdev *vdev;
+	struct replay_buffer *buf;
+	GSList *l;
+	gboolean ok;
+
+	w = data;
+	vdev = w->vdev;
+
+	l = g_slist_nth(w->track->chunks, w->id);
+	while (l && !g_atomic_int_get(&vdev->stop)) {
+		ok = inflate_chunk(w, l->data);
+
+		/* End of chunk. */
+		buf = g_async_queue_pop(w->free_buffers);
+		buf->length = 0;
+		buf->error = !ok;
+		buffer_ready(w, buf);
+		if (!ok)
+			break;
+
+		l = g_slist_nth(l, w->track->num_workers);
+	}
+
+	return NULL;
+}
+
+static void read_ahead_stop(struct session_vdev *vdev);
+
+/*
+ * Every track with data gets a worker of its own, whatever the limit.
+ * Below MAX_WORKERS and the number of processors, spare workers then go
+ * round the tracks that have more chunks than workers, one at a time.
+ * Memory use thus grows with the number of tracks, NUM_BUFFERS payloads
+ * per worker, but not with the length of the capture.
+ */
+static int assign_workers(struct session_vdev *vdev)
+{
+	struct replay_track *track;
+	int max_workers, num_workers, i;
+	gboolean added;
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+	max_workers = MIN((int)g_get_num_processors(), MAX_WORKERS);
+#else
+	max_workers = 1;
+#endif
+
+	num_workers = 0;
+	for (i = 0; i < vdev->num_tracks; i++) {
+		track = &vdev->tracks[i];
+		track->num_workers = track->done ? 0 : 1;
+		num_workers += track->num_workers;
+	}
+
+	added = TRUE;
+	while (num_workers < max_workers && added) {
+		added = FALSE;
+		for (i = 0; i < vdev->num_tracks && num_workers < max_workers; i++) {
+			track = &vdev->tracks[i];
+			if (track->done || (unsigned int)track->num_workers >= track->num_chunks)
+				continue;
+			track->num_workers++;
+			num_workers++;
+			added = TRUE;
+		}
+	}
+
+	return num_workers;
+}
+
+static int read_ahead_start(struct session_vdev *vdev)
+{
+	struct replay_track *track;
+	struct replay_worker *w;
+	int num_workers, ret, i, j, k;
+
+	num_workers = assign_workers(vdev);
+	sr_dbg("Inflating %d track(s) on %d thread(s).",
+		vdev->num_tracks, num_workers);
+
+	g_atomic_int_set(&vdev->stop, 0);
+	vdev->workers = g_malloc0_n(MAX(num_workers, 1),
+			sizeof(struct replay_worker));
+	vdev->num_workers = 0;
+	for (i = 0; i < vdev->num_tracks; i++) {
+		track = &vdev->tracks[i];
+		track->workers = vdev->workers + vdev->num_workers;
+		for (j = 0; j < track->num_workers; j++) {
+			w = &track->workers[j];
+			w->vdev = vdev;
+			w->track = track;
+			w->id = j;
+			if (!(w->archive = zip_open(vdev->sessionfile, 0, &ret))) {
+				sr_err("Failed to open session file '%s': "
+				       "zip error %d.", vdev->sessionfile, ret);
+				read_ahead_stop(vdev);
+				return SR_ERR;
 			}
+			w->free_buffers = g_async_queue_new();
+			w->ready_buffers = g_async_queue_new();
+			for (k = 0; k < NUM_BUFFERS; k++) {
+				w->buffers[k].data = g_malloc(CHUNKSIZE);
+				g_async_queue_push(w->free_buffers, &w->buffers[k]);
+			}
+			vdev->num_workers++;
 		}
 	}
 
-	buf = g_malloc(CHUNKSIZE);
+	for (i = 0; i < vdev->num_workers; i++) {
+		w = &vdev->workers[i];
+		w->thread = g_thread_new("session-replay", inflate_chunks, w);
+	}
+
+	return SR_OK;
+}
+
+static inline struct replay_worker *track_worker(struct replay_track *track)
+{
+	return &track->workers[track->cur_chunk % track->num_workers];
+}
+
+static void read_ahead_stop(struct session_vdev *vdev)
+{
+	struct replay_track *track;
+	struct replay_worker *w;
+	struct replay_buffer *buf;
+	int i, j;
+
+	/* Hand back everything the threads may be waiting for. */
+	g_atomic_int_set(&vdev->stop, 1);
+	for (i = 0; i < vdev->num_tracks; i++) {
+		track = &vdev->tracks[i];
+		if (track->buf) {
+			g_async_queue_push(track_worker(track)->free_buffers,
+				track->buf);
+			track->buf = NULL;
+		}
+	}
+	for (i = 0; i < vdev->num_workers; i++) {
+		w = &vdev->workers[i];
+		while ((buf = g_async_queue_try_pop(w->ready_buffers)))
+			g_async_queue_push(w->free_buffers, buf);
+	}
+
+	for (i = 0; i < vdev->num_workers; i++) {
+		w = &vdev->workers[i];
+		if (w->thread)
+			g_thread_join(w->thread);
+		zip_discard(w->archive);
+		g_async_queue_unref(w->free_buffers);
+		g_async_queue_unref(w->ready_buffers);
+		for (j = 0; j < NUM_BUFFERS; j++)
+			g_free(w->buffers[j].data);
+	}
+	g_free(vdev->workers);
+	vdev->workers = NULL;
+	vdev->num_workers = 0;
+}
+
+/* Send the track's samples up to the end of the current block. */
+static void send_block(const struct sr_dev_inst *sdi,
+		struct replay_track *track)
+{
+	struct session_vdev *vdev;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct replay_buffer *buf;
+	uint64_t num_samples, block_end;
+	uint8_t *data;
+
+	vdev = sdi->priv;
+	buf = track->buf;
 
-	/* unitsize is not defined for purely analog session files. */
-	if (vdev->unitsize)
-		ret = zip_fread(vdev->capfile, buf,
-				CHUNKSIZE / vdev->unitsize * vdev->unitsize);
-	else
-		ret = zip_fread(vdev->capfile, buf, CHUNKSIZE);
+	data = buf->data + track->offset;
+	num_samples = (buf->length - track->offset) / track->samplesize;
+	block_end = (track->position / vdev->block_samples + 1) * vdev->block_samples;
+	num_samples = MIN(num_samples, block_end - track->position);
 
-	if (ret > 0) {
-		got_data = TRUE;
-		if (vdev->cur_analog_channel != 0) {
-			packet.type = SR_DF_ANALOG_OLD;
+	if (num_samples > 0) {
+		if (track->analog_channel != 0) {
+			packet.type = SR_DF_ANALOG;
 			packet.payload = &analog;
-			analog.channels = g_slist_prepend(NULL,
-					g_array_index(vdev->analog_channels,
-						struct sr_channel *, vdev->cur_analog_channel - 1));
-			analog.num_samples = ret / sizeof(float);
-			analog.mq = SR_MQ_VOLTAGE;
-			analog.unit = SR_UNIT_VOLT;
-			analog.mqflags = SR_MQFLAG_DC;
-			analog.data = (float *) buf;
+			sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
+			encoding.is_signed = TRUE;
+			encoding.is_digits_decimal = FALSE;
+			meaning.mq = SR_MQ_VOLTAGE;
+			meaning.unit = SR_UNIT_VOLT;
+			meaning.mqflags = SR_MQFLAG_DC;
+			meaning.channels = track->channels;
+			analog.num_samples = num_samples;
+			analog.data = data;
 		} else {
-			if (ret % vdev->unitsize != 0)
-				sr_warn("Read size %d not a multiple of the"
-					" unit size %d.", ret, vdev->unitsize);
 			packet.type = SR_DF_LOGIC;
 			packet.payload = &logic;
-			logic.length = ret;
-			logic.unitsize = vdev->unitsize;
-			logic.data = buf;
+			logic.length = num_samples * track->samplesize;
+			logic.unitsize = track->samplesize;
+			logic.data = data;
 		}
-		vdev->bytes_read += ret;
 		sr_session_send(sdi, &packet);
-	} else {
-		/* done with this capture file */
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-		if (vdev->cur_chunk != 0) {
-			/* There might be more chunks, so don't fall through
-			 * to the SR_DF_END here. */
-			got_data = TRUE;
-		}
+		vdev->bytes_read += num_samples * track->samplesize;
+		track->offset += num_samples * track->samplesize;
+		track->position += num_samples;
+	}
+
+	if (buf->length - track->offset < (int)track->samplesize) {
+		if (buf->length != track->offset)
+			sr_warn("Read size %d not a multiple of the"
+				" sample size %u.", buf->length, track->samplesize);
+		g_async_queue_push(track_worker(track)->free_buffers, buf);
+		track->buf = NULL;
+	}
+}
+
+/*
+ * The track that is furthest behind goes next, logic before analog on a
+ * tie. That sends every block of samples on all tracks before the next.
+ */
+static struct replay_track *next_track(struct session_vdev *vdev)
+{
+	struct replay_track *track, *next;
+	int i;
+
+	next = NULL;
+	for (i = 0; i < vdev->num_tracks; i++) {
+		track = &vdev->tracks[i];
+		if (!track->done && (!next || track->position < next->position))
+			next = track;
 	}
-	g_free(buf);
 
-	return got_data;
+	return next;
+}
+
+/*
+ * Whether receive_data() has anything to do without waiting for the
+ * workers: the next track's payload is ready, or the replay ended.
+ */
+static gboolean replay_ready(struct session_vdev *vdev)
+{
+	struct replay_track *track;
+
+	if (vdev->finished || !(track = next_track(vdev)) || track->buf)
+		return TRUE;
+
+	return g_async_queue_length(track_worker(track)->ready_buffers) > 0;
+}
+
+static gboolean replay_source_prepare(GSource *source, int *timeout)
+{
+	*timeout = -1;
+
+	return replay_ready(((struct replay_source *)source)->vdev);
+}
+
+static gboolean replay_source_check(GSource *source)
+{
+	return replay_ready(((struct replay_source *)source)->vdev);
+}
+
+static gboolean replay_source_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	(void)source;
+
+	return (*(sr_receive_data_callback)callback)(-1, 0, user_data);
+}
+
+static void replay_source_finalize(GSource *source)
+{
+	struct replay_source *rsource;
+
+	rsource = (struct replay_source *)source;
+	sr_session_source_destroyed(rsource->session, rsource->vdev, source);
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct session_vdev *vdev;
+	struct replay_track *track;
+	struct replay_worker *w;
+	struct replay_buffer *buf;
 
 	(void)fd;
 	(void)revents;
@@ -185,20 +704,40 @@ static int receive_data(int fd, int revents, void *cb_data)
 	sdi = cb_data;
 	vdev = sdi->priv;
 
-	if (!vdev->finished && !stream_session_data(sdi))
-		vdev->finished = TRUE;
-	if (!vdev->finished)
-		return G_SOURCE_CONTINUE;
+	/* The workers did the work, just pass on the results in order. */
+	while (!vdev->finished) {
+		if (!(track = next_track(vdev))) {
+			vdev->finished = TRUE;
+			break;
+		}
+		if (track->buf) {
+			send_block(sdi, track);
+			return G_SOURCE_CONTINUE;
+		}
 
-	if (vdev->capfile) {
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-	}
-	if (vdev->archive) {
-		zip_discard(vdev->archive);
-		vdev->archive = NULL;
+		/* Not ready yet, the worker wakes the main loop up. */
+		w = track_worker(track);
+		if (!(buf = g_async_queue_try_pop(w->ready_buffers)))
+			return G_SOURCE_CONTINUE;
+		if (buf->length > 0) {
+			track->buf = buf;
+			track->offset = 0;
+			continue;
+		}
+
+		/* End of a chunk. */
+		if (buf->error) {
+			sr_err("Stopping the replay at sample %" PRIu64 ".",
+				track->position);
+			vdev->finished = TRUE;
+		} else if (++track->cur_chunk >= track->num_chunks)
+			track->done = TRUE;
+		g_async_queue_push(w->free_buffers, buf);
 	}
 
+	read_ahead_stop(vdev);
+	tracks_free(vdev);
+
 	std_session_send_df_end(sdi, LOG_PREFIX);
 
 	return G_SOURCE_REMOVE;
@@ -237,7 +776,12 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 static int dev_close(struct sr_dev_inst *sdi)
 {
-	const struct session_vdev *const vdev = sdi->priv;
+	struct session_vdev *vdev = sdi->priv;
+
+	read_ahead_stop(vdev);
+	tracks_free(vdev);
+	if (vdev->analog_channels)
+		g_array_free(vdev->analog_channels, TRUE);
 	g_free(vdev->sessionfile);
 	g_free(vdev->capturefile);
 
@@ -266,6 +810,12 @@ static int config_get(uint32_t key, GVariant **data, const struct sr_dev_inst *s
 	case SR_CONF_CAPTURE_UNITSIZE:
 		*data = g_variant_new_uint64(vdev->unitsize);
 		break;
+	case SR_CONF_REPLAY_SAMPLES:
+		*data = g_variant_new("(tt)", vdev->start_sample, vdev->stop_sample);
+		break;
+	case SR_CONF_REPLAY_TIME:
+		*data = g_variant_new("(dd)", vdev->start_time, vdev->stop_time);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -277,6 +827,8 @@ static int config_set(uint32_t key, GVariant *data, const struct sr_dev_inst *sd
 		const struct sr_channel_group *cg)
 {
 	struct session_vdev *vdev;
+	uint64_t start_sample, stop_sample;
+	double start_time, stop_time;
 
 	(void)cg;
 
@@ -306,6 +858,23 @@ static int config_set(uint32_t key, GVariant *data, const struct sr_dev_inst *sd
 	case SR_CONF_NUM_ANALOG_CHANNELS:
 		vdev->num_analog_channels = g_variant_get_int32(data);
 		break;
+	case SR_CONF_REPLAY_SAMPLES:
+		g_variant_get(data, "(tt)", &start_sample, &stop_sample);
+		if (stop_sample && stop_sample <= start_sample)
+			return SR_ERR_ARG;
+		vdev->start_sample = start_sample;
+		vdev->stop_sample = stop_sample;
+		vdev->start_time = vdev->stop_time = 0;
+		vdev->replay_by_time = FALSE;
+		break;
+	case SR_CONF_REPLAY_TIME:
+		g_variant_get(data, "(dd)", &start_time, &stop_time);
+		if (start_time < 0 || (stop_time && stop_time <= start_time))
+			return SR_ERR_ARG;
+		vdev->start_time = start_time;
+		vdev->stop_time = stop_time;
+		vdev->replay_by_time = TRUE;
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -333,14 +902,23 @@ static int config_list(uint32_t key, GVariant **data, const struct sr_dev_inst *
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	static GSourceFuncs replay_source_funcs = {
+		.prepare  = &replay_source_prepare,
+		.check    = &replay_source_check,
+		.dispatch = &replay_source_dispatch,
+		.finalize = &replay_source_finalize
+	};
 	struct session_vdev *vdev;
+	struct replay_source *rsource;
+	GSource *source;
 	int ret;
 	GSList *l;
 	struct sr_channel *ch;
 
 	vdev = sdi->priv;
 	vdev->bytes_read = 0;
-	vdev->cur_analog_channel = 0;
+	if (vdev->analog_channels)
+		g_array_free(vdev->analog_channels, TRUE);
 	vdev->analog_channels = g_array_sized_new(FALSE, FALSE,
 			sizeof(struct sr_channel *), vdev->num_analog_channels);
 	for (l = sdi->channels; l; l = l->next) {
@@ -348,8 +926,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		if (ch->type == SR_CHANNEL_ANALOG)
 			g_array_append_val(vdev->analog_channels, ch);
 	}
-	vdev->cur_chunk = 0;
 	vdev->finished = FALSE;
+	vdev->main_context = sdi->session->main_context;
 
 	sr_info("Opening archive %s file %s", vdev->sessionfile,
 		vdev->capturefile);
@@ -360,12 +938,34 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	/* The workers open the archive on their own. */
+	ret = find_chunks(vdev);
+	zip_discard(vdev->archive);
+	vdev->archive = NULL;
+	if (ret == SR_OK)
+		ret = read_ahead_start(vdev);
+	if (ret != SR_OK) {
+		tracks_free(vdev);
+		return ret;
+	}
+
 	std_session_send_df_header(sdi, LOG_PREFIX);
 
-	/* freewheeling source */
-	sr_session_source_add(sdi->session, -1, 0, 0, receive_data, (void *)sdi);
+	source = g_source_new(&replay_source_funcs, sizeof(struct replay_source));
+	g_source_set_name(source, "session-replay");
+	rsource = (struct replay_source *)source;
+	rsource->session = sdi->session;
+	rsource->vdev = vdev;
+	g_source_set_callback(source, (GSourceFunc)receive_data,
+			(void *)sdi, NULL);
+	ret = sr_session_source_add_internal(sdi->session, vdev, source);
+	g_source_unref(source);
+	if (ret != SR_OK) {
+		read_ahead_stop(vdev);
+		tracks_free(vdev);
+	}
 
-	return SR_OK;
+	return ret;
 }
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
@@ -0,0 +1,482 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* O_DIRECT is a GNU extension. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session-record"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Recording logic data straight to disk.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/* Writes are multiples of this, and start at addresses aligned to it. */
+#define RECORD_ALIGN (4 * 1024)
+
+/* Size of the staging buffer, and of most writes. */
+#define RECORD_BUFSIZE (4 * 1024 * 1024)
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/** @cond PRIVATE */
+struct sr_session_recorder {
+	char *filename;
+	int fd;
+	gboolean direct;
+	uint64_t limit_samples;
+
+	/* Samples waiting for a full aligned block. */
+	uint8_t *buf;
+	uint8_t *buf_mem;
+	size_t buf_len;
+
+	/* The acquisition being recorded. */
+	const struct sr_dev_inst *sdi;
+	uint64_t samplerate;
+	uint16_t unitsize;
+	uint64_t samples;
+	GArray *triggers;
+	gboolean limit_reached;
+	gboolean finished;
+	/* The recorded acquisition is over, and the next one started. */
+	gboolean released;
+	int error;
+};
+/** @endcond */
+
+static int write_all(struct sr_session_recorder *rec, const uint8_t *data,
+		size_t len)
+{
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = write(rec->fd, data, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			sr_err("Failed to write '%s': %s.", rec->filename,
+				g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		data += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Sample data is only ever copied into the staging buffer, never looked
+ * at. Data that is suitably aligned already bypasses the buffer when it
+ * is empty.
+ */
+static int record_data(struct sr_session_recorder *rec, const uint8_t *data,
+		size_t len)
+{
+	size_t n;
+	int ret;
+
+	while (len > 0) {
+		if (rec->buf_len == 0 && len >= RECORD_ALIGN
+				&& ((uintptr_t)data % RECORD_ALIGN) == 0) {
+			n = len - len % RECORD_ALIGN;
+			if ((ret = write_all(rec, data, n)) != SR_OK)
+				return ret;
+		} else {
+			n = MIN(len, RECORD_BUFSIZE - rec->buf_len);
+			memcpy(rec->buf + rec->buf_len, data, n);
+			rec->buf_len += n;
+			if (rec->buf_len == RECORD_BUFSIZE) {
+				if ((ret = write_all(rec, rec->buf, rec->buf_len)) != SR_OK)
+					return ret;
+				rec->buf_len = 0;
+			}
+		}
+		data += n;
+		len -= n;
+	}
+
+	return SR_OK;
+}
+
+static void preallocate(struct sr_session_recorder *rec)
+{
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+	int ret;
+
+	if (!rec->limit_samples)
+		return;
+
+	/* Not every filesystem can do this, it's only a hint anyway. */
+	ret = posix_fallocate(rec->fd, 0, rec->limit_samples * rec->unitsize);
+	if (ret)
+		sr_dbg("Failed to preallocate '%s': %s.", rec->filename,
+			g_strerror(ret));
+#else
+	(void)rec;
+#endif
+}
+
+/*
+ * The metadata follows the srzip format: together with the sample file
+ * as "logic-1" and a "version" file it forms a session file.
+ */
+static int write_metadata(struct sr_session_recorder *rec)
+{
+	struct sr_channel *ch;
+	GKeyFile *meta;
+	GSList *l;
+	GError *error;
+	char *metafile, *metabuf, *s, **triggers;
+	gsize metalen;
+	unsigned int i, num_logic;
+	int ret;
+
+	meta = g_key_file_new();
+	g_key_file_set_string(meta, "global", "sigrok version",
+			SR_PACKAGE_VERSION_STRING);
+
+	num_logic = 0;
+	for (l = rec->sdi ? rec->sdi->channels : NULL; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC)
+			continue;
+		num_logic++;
+		if (!ch->enabled)
+			continue;
+		s = g_strdup_printf("probe%d", ch->index + 1);
+		g_key_file_set_string(meta, "device 1", s, ch->name);
+		g_free(s);
+	}
+	g_key_file_set_string(meta, "device 1", "capturefile", "logic-1");
+	g_key_file_set_integer(meta, "device 1", "total probes", num_logic);
+	s = sr_samplerate_string(rec->samplerate);
+	g_key_file_set_string(meta, "device 1", "samplerate", s);
+	g_free(s);
+	g_key_file_set_integer(meta, "device 1", "total analog", 0);
+	g_key_file_set_integer(meta, "device 1", "unitsize", rec->unitsize);
+
+	g_key_file_set_uint64(meta, "record", "samples", rec->samples);
+	triggers = g_malloc0_n(rec->triggers->len + 1, sizeof(char *));
+	for (i = 0; i < rec->triggers->len; i++)
+		triggers[i] = g_strdup_printf("%" PRIu64,
+			g_array_index(rec->triggers, uint64_t, i));
+	g_key_file_set_string_list(meta, "record", "triggers",
+		(const char *const *)triggers, rec->triggers->len);
+	g_strfreev(triggers);
+
+	metabuf = g_key_file_to_data(meta, &metalen, NULL);
+	metafile = g_strconcat(rec->filename, ".metadata", NULL);
+	error = NULL;
+	ret = SR_OK;
+	if (!g_file_set_contents(metafile, metabuf, metalen, &error)) {
+		sr_err("Failed to write '%s': %s.", metafile, error->message);
+		g_error_free(error);
+		ret = SR_ERR_IO;
+	}
+	g_free(metafile);
+	g_free(metabuf);
+	g_key_file_free(meta);
+
+	return ret;
+}
+
+/* Write out the rest of the data, and trim the file to its real size. */
+static int record_finish(struct sr_session_recorder *rec)
+{
+	int ret;
+
+	if (rec->finished)
+		return rec->error;
+	rec->finished = TRUE;
+
+	ret = rec->error;
+	if (ret == SR_OK && rec->buf_len > 0) {
+#ifdef O_DIRECT
+		/* The tail isn't a full block, that needs a regular write. */
+		if (rec->direct)
+			fcntl(rec->fd, F_SETFL, fcntl(rec->fd, F_GETFL) & ~O_DIRECT);
+#endif
+		ret = write_all(rec, rec->buf, rec->buf_len);
+		rec->buf_len = 0;
+	}
+	if (ret == SR_OK && ftruncate(rec->fd, rec->samples * rec->unitsize) < 0) {
+		sr_err("Failed to truncate '%s': %s.", rec->filename,
+			g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+	if (ret == SR_OK)
+		ret = write_metadata(rec);
+
+	sr_info("Recorded %" PRIu64 " samples to '%s'.", rec->samples,
+		rec->filename);
+	rec->error = ret;
+
+	return ret;
+}
+
+static void recorder_free(struct sr_session_recorder *rec)
+{
+	if (rec->fd >= 0)
+		close(rec->fd);
+	g_array_free(rec->triggers, TRUE);
+	g_free(rec->buf_mem);
+	g_free(rec->filename);
+	g_free(rec);
+}
+
+/**
+ * Record the logic data of a session straight to a file.
+ *
+ * While the recorder is active, SR_DF_LOGIC payloads bypass the
+ * transforms, datafeed callbacks and outputs of the session: they are
+ * written to @a filename as they come from the driver, in large aligned
+ * writes (with O_DIRECT where the platform supports it). All other
+ * packets still reach the session as usual. Only one acquisition is
+ * recorded, from the next one on the logic data reaches the session
+ * again.
+ *
+ * At the end of the acquisition, the samples written, the trigger
+ * positions, samplerate and channel names are saved to a separate file
+ * named @a filename with ".metadata" appended. It follows the srzip
+ * format, so together with the samples (stored as "logic-1") and a
+ * "version" file containing "2" it can be zipped into a session file.
+ * The sample file can also be imported with the "binary" input module.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param filename The file to write the samples to. Must not be NULL.
+ *                 An existing file is overwritten.
+ * @param limit_samples The number of samples after which the recorder
+ *                      stops the session, or 0 for no limit. The file
+ *                      is preallocated to this size.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the session already records.
+ * @retval SR_ERR_IO The file could not be created.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_session_record_start(struct sr_session *session,
+		const char *filename, uint64_t limit_samples)
+{
+	struct sr_session_recorder *rec;
+	int flags;
+
+	if (!session || !filename) {
+		sr_err("%s: Invalid argument.", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->recorder) {
+		sr_err("%s: Session is already being recorded.", __func__);
+		return SR_ERR_ARG;
+	}
+
+	rec = g_malloc0(sizeof(struct sr_session_recorder));
+	rec->filename = g_strdup(filename);
+	rec->limit_samples = limit_samples;
+	rec->triggers = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	rec->buf_mem = g_malloc(RECORD_BUFSIZE + RECORD_ALIGN);
+	rec->buf = rec->buf_mem + (RECORD_ALIGN
+		- (uintptr_t)rec->buf_mem % RECORD_ALIGN) % RECORD_ALIGN;
+
+	flags = O_WRONLY | O_CREAT | O_TRUNC | O_BINARY;
+	rec->fd = -1;
+#ifdef O_DIRECT
+	/* Not every filesystem supports it. */
+	rec->fd = g_open(filename, flags | O_DIRECT, 0644);
+	rec->direct = rec->fd >= 0;
+#endif
+	if (rec->fd < 0)
+		rec->fd = g_open(filename, flags, 0644);
+	if (rec->fd < 0) {
+		sr_err("Failed to create '%s': %s.", filename, g_strerror(errno));
+		recorder_free(rec);
+		return SR_ERR_IO;
+	}
+	sr_dbg("Recording to '%s'%s.", filename,
+		rec->direct ? " (direct I/O)" : "");
+
+	session->recorder = rec;
+
+	return SR_OK;
+}
+
+/**
+ * Stop recording a session.
+ *
+ * If the acquisition hasn't ended yet, the data received so far is
+ * written out as if it had.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session, or the session isn't recorded.
+ * @retval SR_ERR_IO The recording could not be completed.
+ *
+ * @since 0.5.0
+ */
+SR_API int sr_session_record_stop(struct sr_session *session)
+{
+	int ret;
+
+	if (!session || !session->recorder) {
+		sr_err("%s: Session isn't being recorded.", __func__);
+		return SR_ERR_ARG;
+	}
+
+	ret = record_finish(session->recorder);
+	recorder_free(session->recorder);
+	session->recorder = NULL;
+
+	return ret;
+}
+
+static int record_logic(struct sr_session_recorder *rec,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_logic *logic)
+{
+	uint64_t num_samples;
+	int ret;
+
+	/* Past the limit or the end, the rest of the acquisition is dropped. */
+	if (rec->finished || rec->limit_reached || rec->error)
+		return rec->error;
+
+	if (!rec->unitsize) {
+		rec->unitsize = logic->unitsize;
+		preallocate(rec);
+	} else if (logic->unitsize != rec->unitsize) {
+		sr_err("Unitsize changed from %d to %d.", rec->unitsize,
+			logic->unitsize);
+		return rec->error = SR_ERR_DATA;
+	}
+
+	/* The limit is applied to the length, the data isn't touched. */
+	num_samples = logic->length / logic->unitsize;
+	if (rec->limit_samples)
+		num_samples = MIN(num_samples, rec->limit_samples - rec->samples);
+
+	ret = record_data(rec, logic->data, num_samples * logic->unitsize);
+	if (ret != SR_OK) {
+		/* Nothing more can be recorded. */
+		rec->error = ret;
+		sr_session_stop(sdi->session);
+		return ret;
+	}
+	rec->samples += num_samples;
+
+	if (rec->limit_samples && rec->samples >= rec->limit_samples) {
+		rec->limit_reached = TRUE;
+		sr_session_stop(sdi->session);
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Pass a packet to the session's recorder.
+ *
+ * @param[in] sdi The device instance the packet comes from.
+ * @param[in] packet The packet.
+ * @param[out] consumed Set to TRUE if the packet was recorded, and must
+ *                      not be sent on to the session.
+ *
+ * @return SR_OK upon success, SR_ERR_* upon failure.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_record_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, gboolean *consumed)
+{
+	struct sr_session_recorder *rec;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GVariant *gvar;
+	GSList *l;
+
+	rec = sdi->session->recorder;
+	*consumed = FALSE;
+
+	/*
+	 * Only one acquisition is recorded, later ones are left alone. A
+	 * driver may still send data after the end of its acquisition,
+	 * that is dropped until the next one starts.
+	 */
+	if (rec->finished && packet->type == SR_DF_HEADER)
+		rec->released = TRUE;
+	if (rec->released)
+		return SR_OK;
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		rec->sdi = sdi;
+		if (sr_config_get(sdi->driver, sdi, NULL, SR_CONF_SAMPLERATE,
+				&gvar) == SR_OK) {
+			rec->samplerate = g_variant_get_uint64(gvar);
+			g_variant_unref(gvar);
+		}
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				rec->samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_TRIGGER:
+		g_array_append_val(rec->triggers, rec->samples);
+		break;
+	case SR_DF_LOGIC:
+		*consumed = TRUE;
+		return record_logic(rec, sdi, packet->payload);
+	case SR_DF_END:
+		return record_finish(rec);
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+/** @} */
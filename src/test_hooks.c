@@ -0,0 +1,70 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "scpi.h"
+
+static const struct sr_test_hooks test_hooks = {
+	.std_init = std_init,
+	.std_cleanup = std_cleanup,
+	.std_dev_clear = std_dev_clear,
+	.std_dev_list = std_dev_list,
+	.dev_inst_free = sr_dev_inst_free,
+	.session_fuse_transforms_set = sr_session_fuse_transforms_set,
+	.soft_trigger_logic_new = soft_trigger_logic_new,
+	.soft_trigger_logic_free = soft_trigger_logic_free,
+	.soft_trigger_logic_check = soft_trigger_logic_check,
+	.scpi_dev_inst_new = scpi_dev_inst_new,
+	.scpi_open = sr_scpi_open,
+	.scpi_close = sr_scpi_close,
+	.scpi_free = sr_scpi_free,
+	.scpi_get_floatv = sr_scpi_get_floatv,
+	.scpi_get_block = sr_scpi_get_block,
+	.scan_io_begin = sr_scan_io_begin,
+	.scan_io_end = sr_scan_io_end,
+	.driver_scan_ports = sr_driver_scan_ports,
+#ifdef HAVE_LIBSERIALPORT
+	.serial_packet_scanner_init = serial_packet_scanner_init,
+	.serial_packet_scanner_feed = serial_packet_scanner_feed,
+#endif
+#ifdef HAVE_LIBUSB_1_0
+	.usb_source_add = usb_source_add,
+	.usb_source_remove = usb_source_remove,
+	.usb_submit_transfer = sr_usb_submit_transfer,
+	.usb_cancel_transfer = sr_usb_cancel_transfer,
+	.usb_handle_events = sr_usb_handle_events,
+	.usb_control_transfer = sr_usb_control_transfer,
+	.usb_bulk_transfer = sr_usb_bulk_transfer,
+#endif
+};
+
+/**
+ * Get the private functions the unit tests call.
+ *
+ * Not part of the API, only for libsigrok's own tests.
+ *
+ * @private
+ */
+SR_API const struct sr_test_hooks *sr_test_hooks_get(void)
+{
+	return &test_hooks;
+}
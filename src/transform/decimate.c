@@ -0,0 +1,709 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/decimate"
+
+/* Upper bound for the length of the anti-alias filter. */
+#define MAX_FIR_TAPS 255
+
+enum logic_mode {
+	/* Keep the first sample of every window. */
+	LOGIC_SAMPLE,
+	/* OR all samples of a window, a high pulse is never lost. */
+	LOGIC_OR,
+	/* AND all samples of a window, a low pulse is never lost. */
+	LOGIC_AND,
+};
+
+enum analog_mode {
+	ANALOG_SAMPLE,
+	ANALOG_MEAN,
+	ANALOG_MIN,
+	ANALOG_MAX,
+	ANALOG_FIR,
+};
+
+static const char *logic_modes[] = {
+	[LOGIC_SAMPLE] = "sample",
+	[LOGIC_OR] = "or",
+	[LOGIC_AND] = "and",
+};
+
+static const char *analog_modes[] = {
+	[ANALOG_SAMPLE] = "sample",
+	[ANALOG_MEAN] = "mean",
+	[ANALOG_MIN] = "min",
+	[ANALOG_MAX] = "max",
+	[ANALOG_FIR] = "fir",
+};
+
+/*
+ * Analog packets usually carry a single channel each, and consecutive
+ * packets can belong to different channels. The window position is
+ * therefore kept per group of channels, keyed by the first channel.
+ */
+struct analog_state {
+	unsigned int num_channels;
+	uint64_t phase;
+	/* Of the last packet, to flush a partial window at the end. */
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	/* Running mean/min/max, one value per channel. */
+	float *acc;
+	/* FIR history, 2 * num_taps values per channel (mirrored). */
+	float *history;
+	unsigned int hist_pos;
+};
+
+struct context {
+	uint64_t factor;
+	enum logic_mode logic_mode;
+	enum analog_mode analog_mode;
+
+	uint64_t samplerate;
+	gboolean meta_sent;
+
+	/* Logic state. */
+	uint16_t unitsize;
+	uint64_t logic_phase;
+	uint8_t *logic_acc;
+	uint8_t *logic_buf;
+	uint64_t logic_buf_size;
+
+	/* Analog state. */
+	GHashTable *analog_states;
+	float *taps;
+	unsigned int num_taps;
+	float *fbuf;
+	uint64_t fbuf_size;
+	float *abuf;
+	uint64_t abuf_size;
+
+	/* Outgoing packets, only valid until the next call. */
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_datafeed_meta meta;
+	struct sr_config *meta_src;
+};
+
+static int find_mode(const char *name, const char **modes, int num_modes)
+{
+	int i;
+
+	for (i = 0; i < num_modes; i++) {
+		if (!strcmp(name, modes[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Windowed-sinc low-pass with its cutoff at the new Nyquist frequency. */
+static void fir_design(struct context *ctx)
+{
+	double fc, x, w, sum;
+	unsigned int i, m;
+
+	ctx->num_taps = MIN(4 * ctx->factor + 1, MAX_FIR_TAPS);
+	ctx->taps = g_malloc(ctx->num_taps * sizeof(float));
+
+	fc = 0.5 / ctx->factor;
+	m = ctx->num_taps / 2;
+	sum = 0;
+	for (i = 0; i < ctx->num_taps; i++) {
+		x = (double)i - m;
+		w = 0.54 - 0.46 * cos(2 * G_PI * i / (ctx->num_taps - 1));
+		if (i == m)
+			ctx->taps[i] = 2 * fc;
+		else
+			ctx->taps[i] = sin(2 * G_PI * fc * x) / (G_PI * x) * w;
+		sum += ctx->taps[i];
+	}
+
+	/* Unity gain at DC. */
+	for (i = 0; i < ctx->num_taps; i++)
+		ctx->taps[i] /= sum;
+}
+
+static void analog_state_free(void *data)
+{
+	struct analog_state *state;
+
+	state = data;
+	g_slist_free(state->meaning.channels);
+	g_free(state->acc);
+	g_free(state->history);
+	g_free(state);
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const char *mode;
+	int m;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+
+	ctx->factor = g_variant_get_uint64(g_hash_table_lookup(options, "factor"));
+	if (ctx->factor == 0) {
+		sr_err("Decimation factor must be at least 1.");
+		goto err;
+	}
+
+	mode = g_variant_get_string(g_hash_table_lookup(options, "logic"), NULL);
+	if ((m = find_mode(mode, logic_modes, ARRAY_SIZE(logic_modes))) < 0) {
+		sr_err("Unknown logic decimation mode '%s'.", mode);
+		goto err;
+	}
+	ctx->logic_mode = m;
+
+	mode = g_variant_get_string(g_hash_table_lookup(options, "analog"), NULL);
+	if ((m = find_mode(mode, analog_modes, ARRAY_SIZE(analog_modes))) < 0) {
+		sr_err("Unknown analog decimation mode '%s'.", mode);
+		goto err;
+	}
+	ctx->analog_mode = m;
+
+	if (ctx->analog_mode == ANALOG_FIR)
+		fir_design(ctx);
+
+	ctx->analog_states = g_hash_table_new_full(g_direct_hash,
+			g_direct_equal, NULL, analog_state_free);
+
+	return SR_OK;
+
+err:
+	g_free(ctx);
+	t->priv = NULL;
+	return SR_ERR_ARG;
+}
+
+/* Reset all per-acquisition state when a new stream starts. */
+static void reset(const struct sr_transform *t)
+{
+	struct context *ctx;
+	GVariant *gvar;
+
+	ctx = t->priv;
+	ctx->logic_phase = 0;
+	ctx->meta_sent = FALSE;
+	g_hash_table_remove_all(ctx->analog_states);
+
+	ctx->samplerate = 0;
+	if (sr_config_get(t->sdi->driver, t->sdi, NULL, SR_CONF_SAMPLERATE,
+			&gvar) == SR_OK) {
+		ctx->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+}
+
+static void meta_free(struct context *ctx)
+{
+	g_slist_free(ctx->meta.config);
+	ctx->meta.config = NULL;
+	if (ctx->meta_src)
+		sr_config_free(ctx->meta_src);
+	ctx->meta_src = NULL;
+}
+
+/*
+ * Build an SR_DF_META packet in ctx->packet which is a copy of 'meta_in'
+ * (if any), with the samplerate replaced by the decimated one.
+ */
+static void meta_rewrite(struct context *ctx,
+		const struct sr_datafeed_meta *meta_in)
+{
+	struct sr_config *src;
+	GSList *l;
+
+	meta_free(ctx);
+	ctx->meta_src = sr_config_new(SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(ctx->samplerate / ctx->factor));
+
+	for (l = meta_in ? meta_in->config : NULL; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_SAMPLERATE)
+			continue;
+		ctx->meta.config = g_slist_append(ctx->meta.config, src);
+	}
+	ctx->meta.config = g_slist_append(ctx->meta.config, ctx->meta_src);
+
+	ctx->packet.type = SR_DF_META;
+	ctx->packet.payload = &ctx->meta;
+	ctx->meta_sent = TRUE;
+}
+
+/* Announce the decimated samplerate before the first sample goes out. */
+static int send_meta(const struct sr_transform *t)
+{
+	struct context *ctx;
+
+	ctx = t->priv;
+	if (ctx->meta_sent || !ctx->samplerate)
+		return SR_OK;
+
+	meta_rewrite(ctx, NULL);
+
+	return sr_session_send_downstream(t, &ctx->packet);
+}
+
+static uint64_t decimate_logic(struct context *ctx,
+		const struct sr_datafeed_logic *logic)
+{
+	const uint8_t *in, *end;
+	uint8_t *out, *acc;
+	uint64_t num_samples, first, phase, n, i;
+	uint16_t unitsize;
+
+	unitsize = logic->unitsize;
+	num_samples = logic->length / unitsize;
+	if (unitsize != ctx->unitsize) {
+		ctx->unitsize = unitsize;
+		ctx->logic_acc = g_realloc(ctx->logic_acc, unitsize);
+		ctx->logic_phase = 0;
+	}
+
+	/* Worst case: one output sample per started window. */
+	n = (num_samples / ctx->factor + 1) * unitsize;
+	if (n > ctx->logic_buf_size) {
+		ctx->logic_buf = g_realloc(ctx->logic_buf, n);
+		ctx->logic_buf_size = n;
+	}
+
+	in = logic->data;
+	out = ctx->logic_buf;
+	acc = ctx->logic_acc;
+	phase = ctx->logic_phase;
+	n = 0;
+
+	if (ctx->logic_mode == LOGIC_SAMPLE) {
+		first = phase ? ctx->factor - phase : 0;
+		for (i = first; i < num_samples; i += ctx->factor)
+			memcpy(out + n++ * unitsize, in + i * unitsize, unitsize);
+		ctx->logic_phase = (phase + num_samples) % ctx->factor;
+		return n;
+	}
+
+	end = in + num_samples * unitsize;
+	for (; in < end; in += unitsize) {
+		if (phase == 0) {
+			memcpy(acc, in, unitsize);
+		} else if (ctx->logic_mode == LOGIC_OR) {
+			for (i = 0; i < unitsize; i++)
+				acc[i] |= in[i];
+		} else {
+			for (i = 0; i < unitsize; i++)
+				acc[i] &= in[i];
+		}
+		if (++phase == ctx->factor) {
+			memcpy(out + n++ * unitsize, acc, unitsize);
+			phase = 0;
+		}
+	}
+	ctx->logic_phase = phase;
+
+	return n;
+}
+
+static struct analog_state *analog_state_get(struct context *ctx,
+		GSList *channels, unsigned int num_channels)
+{
+	struct analog_state *state;
+
+	state = g_hash_table_lookup(ctx->analog_states, channels->data);
+	if (state && state->num_channels == num_channels)
+		return state;
+
+	state = g_malloc0(sizeof(struct analog_state));
+	state->num_channels = num_channels;
+	state->meaning.channels = g_slist_copy(channels);
+	state->acc = g_malloc0(num_channels * sizeof(float));
+	if (ctx->analog_mode == ANALOG_FIR)
+		state->history = g_malloc0(num_channels * 2 * ctx->num_taps
+				* sizeof(float));
+	g_hash_table_replace(ctx->analog_states, channels->data, state);
+
+	return state;
+}
+
+static uint64_t decimate_analog(struct context *ctx,
+		struct analog_state *state, const float *in, uint64_t num_samples)
+{
+	const float *src, *win;
+	float *out, *acc, *h, v;
+	uint64_t phase, n, s;
+	unsigned int nch, c, k, ntaps;
+
+	nch = state->num_channels;
+	ntaps = ctx->num_taps;
+	acc = state->acc;
+	phase = state->phase;
+	n = 0;
+
+	for (s = 0; s < num_samples; s++) {
+		src = in + s * nch;
+		out = ctx->abuf + n * nch;
+		switch (ctx->analog_mode) {
+		case ANALOG_SAMPLE:
+			if (phase == 0) {
+				memcpy(out, src, nch * sizeof(float));
+				n++;
+			}
+			break;
+		case ANALOG_MEAN:
+			for (c = 0; c < nch; c++)
+				acc[c] = phase ? acc[c] + src[c] : src[c];
+			if (phase == ctx->factor - 1) {
+				for (c = 0; c < nch; c++)
+					out[c] = acc[c] / ctx->factor;
+				n++;
+			}
+			break;
+		case ANALOG_MIN:
+			for (c = 0; c < nch; c++)
+				acc[c] = (phase && acc[c] < src[c]) ? acc[c] : src[c];
+			if (phase == ctx->factor - 1) {
+				memcpy(out, acc, nch * sizeof(float));
+				n++;
+			}
+			break;
+		case ANALOG_MAX:
+			for (c = 0; c < nch; c++)
+				acc[c] = (phase && acc[c] > src[c]) ? acc[c] : src[c];
+			if (phase == ctx->factor - 1) {
+				memcpy(out, acc, nch * sizeof(float));
+				n++;
+			}
+			break;
+		case ANALOG_FIR:
+			/*
+			 * The history is stored twice in a row, so the last
+			 * 'ntaps' values are always contiguous in memory.
+			 */
+			for (c = 0; c < nch; c++) {
+				h = state->history + c * 2 * ntaps;
+				h[state->hist_pos] = h[state->hist_pos + ntaps] = src[c];
+			}
+			if (phase == 0) {
+				for (c = 0; c < nch; c++) {
+					win = state->history + c * 2 * ntaps
+						+ state->hist_pos + 1;
+					v = 0;
+					for (k = 0; k < ntaps; k++)
+						v += ctx->taps[k] * win[k];
+					out[c] = v;
+				}
+				n++;
+			}
+			if (++state->hist_pos == ntaps)
+				state->hist_pos = 0;
+			break;
+		}
+		if (++phase == ctx->factor)
+			phase = 0;
+	}
+	state->phase = phase;
+
+	return n;
+}
+
+static int receive_logic(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	uint64_t n;
+
+	ctx = t->priv;
+	logic = packet_in->payload;
+	if (!logic->unitsize)
+		return SR_ERR_ARG;
+
+	n = decimate_logic(ctx, logic);
+	if (n == 0) {
+		*packet_out = NULL;
+		return SR_OK;
+	}
+
+	ctx->logic.length = n * logic->unitsize;
+	ctx->logic.unitsize = logic->unitsize;
+	ctx->logic.data = ctx->logic_buf;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int receive_analog(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_analog *analog;
+	struct analog_state *state;
+	GSList *channels;
+	unsigned int num_channels;
+	uint64_t count, n;
+	int ret;
+
+	ctx = t->priv;
+	analog = packet_in->payload;
+	num_channels = g_slist_length(analog->meaning->channels);
+	if (!num_channels) {
+		/* Nothing to go by, pass the packet on unmodified. */
+		*packet_out = packet_in;
+		return SR_OK;
+	}
+
+	count = (uint64_t)analog->num_samples * num_channels;
+	if (count > ctx->fbuf_size) {
+		ctx->fbuf = g_realloc(ctx->fbuf, count * sizeof(float));
+		ctx->fbuf_size = count;
+	}
+	if ((ret = sr_analog_to_float(analog, ctx->fbuf)) != SR_OK)
+		return ret;
+
+	n = (analog->num_samples / ctx->factor + 1) * num_channels;
+	if (n > ctx->abuf_size) {
+		ctx->abuf = g_realloc(ctx->abuf, n * sizeof(float));
+		ctx->abuf_size = n;
+	}
+
+	state = analog_state_get(ctx, analog->meaning->channels, num_channels);
+	n = decimate_analog(ctx, state, ctx->fbuf, analog->num_samples);
+
+	/* The samples are floats now, everything else stays the same. */
+	state->encoding = *analog->encoding;
+	state->encoding.unitsize = sizeof(float);
+	state->encoding.is_signed = TRUE;
+	state->encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	state->encoding.is_bigendian = TRUE;
+#else
+	state->encoding.is_bigendian = FALSE;
+#endif
+	state->encoding.scale.p = 1;
+	state->encoding.scale.q = 1;
+	state->encoding.offset.p = 0;
+	state->encoding.offset.q = 1;
+	channels = state->meaning.channels;
+	state->meaning = *analog->meaning;
+	state->meaning.channels = channels;
+	if (analog->spec)
+		state->spec = *analog->spec;
+
+	if (n == 0) {
+		*packet_out = NULL;
+		return SR_OK;
+	}
+
+	ctx->encoding = state->encoding;
+	ctx->analog = *analog;
+	ctx->analog.data = ctx->abuf;
+	ctx->analog.num_samples = n;
+	ctx->analog.encoding = &ctx->encoding;
+	ctx->packet.type = SR_DF_ANALOG;
+	ctx->packet.payload = &ctx->analog;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+/*
+ * Send the last partial window of every group of analog channels. Its
+ * mean is over the samples it got, like its minimum and maximum.
+ */
+static int flush_analog(const struct sr_transform *t)
+{
+	struct context *ctx;
+	struct analog_state *state;
+	GHashTableIter iter;
+	void *value;
+	unsigned int c;
+	int ret;
+
+	ctx = t->priv;
+	if (ctx->analog_mode != ANALOG_MEAN && ctx->analog_mode != ANALOG_MIN
+			&& ctx->analog_mode != ANALOG_MAX)
+		return SR_OK;
+
+	g_hash_table_iter_init(&iter, ctx->analog_states);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		state = value;
+		if (!state->phase)
+			continue;
+		for (c = 0; c < state->num_channels; c++) {
+			ctx->abuf[c] = state->acc[c];
+			if (ctx->analog_mode == ANALOG_MEAN)
+				ctx->abuf[c] /= state->phase;
+		}
+		state->phase = 0;
+
+		ctx->encoding = state->encoding;
+		ctx->analog.data = ctx->abuf;
+		ctx->analog.num_samples = 1;
+		ctx->analog.encoding = &ctx->encoding;
+		ctx->analog.meaning = &state->meaning;
+		ctx->analog.spec = &state->spec;
+		ctx->packet.type = SR_DF_ANALOG;
+		ctx->packet.payload = &ctx->analog;
+		if ((ret = sr_session_send_downstream(t, &ctx->packet)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_meta *meta;
+	struct sr_config *src;
+	GSList *l;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	if (ctx->factor == 1)
+		return SR_OK;
+
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+		reset(t);
+		break;
+	case SR_DF_META:
+		meta = packet_in->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			ctx->samplerate = g_variant_get_uint64(src->data);
+			meta_rewrite(ctx, meta);
+			*packet_out = &ctx->packet;
+			break;
+		}
+		break;
+	case SR_DF_LOGIC:
+		if ((ret = send_meta(t)) != SR_OK)
+			return ret;
+		return receive_logic(t, packet_in, packet_out);
+	case SR_DF_ANALOG:
+		if ((ret = send_meta(t)) != SR_OK)
+			return ret;
+		return receive_analog(t, packet_in, packet_out);
+	case SR_DF_END:
+		/* Flush the last partial windows, they may contain a glitch. */
+		if (ctx->logic_mode != LOGIC_SAMPLE && ctx->logic_phase) {
+			ctx->logic.length = ctx->unitsize;
+			ctx->logic.unitsize = ctx->unitsize;
+			ctx->logic.data = ctx->logic_acc;
+			ctx->packet.type = SR_DF_LOGIC;
+			ctx->packet.payload = &ctx->logic;
+			ctx->logic_phase = 0;
+			if ((ret = sr_session_send_downstream(t, &ctx->packet)) != SR_OK)
+				return ret;
+		}
+		if ((ret = flush_analog(t)) != SR_OK)
+			return ret;
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	meta_free(ctx);
+	g_hash_table_destroy(ctx->analog_states);
+	g_free(ctx->logic_acc);
+	g_free(ctx->logic_buf);
+	g_free(ctx->taps);
+	g_free(ctx->fbuf);
+	g_free(ctx->abuf);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "factor", "Factor", "Keep one out of this many samples", NULL, NULL },
+	{ "logic", "Logic mode", "How to reduce a window of logic samples", NULL, NULL },
+	{ "analog", "Analog mode", "How to reduce a window of analog samples", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(1));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(logic_modes[LOGIC_SAMPLE]));
+		for (i = 0; i < ARRAY_SIZE(logic_modes); i++) {
+			options[1].values = g_slist_append(options[1].values,
+				g_variant_ref_sink(g_variant_new_string(logic_modes[i])));
+		}
+		options[2].def = g_variant_ref_sink(g_variant_new_string(analog_modes[ANALOG_SAMPLE]));
+		for (i = 0; i < ARRAY_SIZE(analog_modes); i++) {
+			options[2].values = g_slist_append(options[2].values,
+				g_variant_ref_sink(g_variant_new_string(analog_modes[i])));
+		}
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_decimate = {
+	.id = "decimate",
+	.name = "Decimate",
+	.desc = "Reduce the samplerate by an integer factor",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,356 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/deglitch"
+
+/* The run length counters are bit-sliced, this bounds their depth. */
+#define MAX_PLANES 16
+#define MAX_WIDTH ((1 << MAX_PLANES) - 1)
+
+/*
+ * A channel only follows its input once the input has been at the same
+ * level for 'width' consecutive samples. Shorter pulses never show up
+ * in the output, longer ones come out 'width - 1' samples late but with
+ * their original length.
+ *
+ * All channels of a sample are filtered at once: the samples are
+ * processed as 64-bit words, and every channel keeps its run length in
+ * a bit-sliced counter, i.e. plane j holds bit j of the run length of
+ * all 64 channels of a word. The filter needs no look-ahead, so it works
+ * in place and doesn't hold back any data.
+ */
+struct context {
+	uint64_t width;
+	unsigned int num_planes;
+	/* Bitmask of the selected channels (same layout as a sample). */
+	uint8_t *selected;
+	unsigned int selected_size;
+
+	/* Filter state, kept across packets. */
+	uint16_t unitsize;
+	unsigned int num_words;
+	uint64_t *mask;
+	uint64_t *last;
+	uint64_t *out;
+	uint64_t *stable;
+	uint64_t *count;
+};
+
+static int select_channels(struct context *ctx, const struct sr_dev_inst *sdi,
+		const char *names)
+{
+	struct sr_channel *ch;
+	GSList *l;
+	char **tokens;
+	int i, ret;
+
+	ret = SR_OK;
+	tokens = g_strsplit(names, ",", 0);
+	for (i = 0; tokens[i]; i++) {
+		g_strstrip(tokens[i]);
+		if (!tokens[i][0])
+			continue;
+		for (l = sdi->channels; l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_LOGIC && !strcmp(ch->name, tokens[i]))
+				break;
+		}
+		if (!l) {
+			sr_err("Unknown logic channel '%s'.", tokens[i]);
+			ret = SR_ERR_ARG;
+			break;
+		}
+		if ((unsigned int)ch->index / 8 >= ctx->selected_size) {
+			ctx->selected = g_realloc(ctx->selected, ch->index / 8 + 1);
+			memset(ctx->selected + ctx->selected_size, 0,
+				ch->index / 8 + 1 - ctx->selected_size);
+			ctx->selected_size = ch->index / 8 + 1;
+		}
+		ctx->selected[ch->index / 8] |= 1 << (ch->index % 8);
+	}
+	g_strfreev(tokens);
+
+	return ret;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const char *names;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+
+	ctx->width = g_variant_get_uint64(g_hash_table_lookup(options, "width"));
+	if (ctx->width < 1 || ctx->width > MAX_WIDTH) {
+		sr_err("Pulse width must be between 1 and %d samples.", MAX_WIDTH);
+		goto err;
+	}
+	ctx->num_planes = g_bit_storage(ctx->width);
+
+	names = g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL);
+	if (select_channels(ctx, t->sdi, names) != SR_OK)
+		goto err;
+
+	return SR_OK;
+
+err:
+	g_free(ctx->selected);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_ERR_ARG;
+}
+
+static void state_free(struct context *ctx)
+{
+	g_free(ctx->mask);
+	g_free(ctx->last);
+	g_free(ctx->out);
+	g_free(ctx->stable);
+	g_free(ctx->count);
+	ctx->mask = ctx->last = ctx->out = ctx->stable = ctx->count = NULL;
+	ctx->unitsize = 0;
+}
+
+/*
+ * Samples are copied into words byte by byte, so a word's bit n is the
+ * same channel on every host, as long as the mask is loaded the same way.
+ */
+static inline uint64_t load_word(const uint8_t *p, unsigned int size)
+{
+	uint64_t w;
+
+	w = 0;
+	memcpy(&w, p, size);
+
+	return w;
+}
+
+static inline void store_word(uint8_t *p, unsigned int size, uint64_t w)
+{
+	memcpy(p, &w, size);
+}
+
+static inline unsigned int word_size(const struct context *ctx, unsigned int w)
+{
+	return MIN(sizeof(uint64_t), ctx->unitsize - w * sizeof(uint64_t));
+}
+
+/* Start out as if the first sample had been there forever. */
+static void state_init(struct context *ctx, uint16_t unitsize,
+		const uint8_t *first)
+{
+	uint8_t *selected;
+	unsigned int w, j, size;
+
+	state_free(ctx);
+	ctx->unitsize = unitsize;
+	ctx->num_words = (unitsize + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	ctx->mask = g_malloc0(ctx->num_words * sizeof(uint64_t));
+	ctx->last = g_malloc0(ctx->num_words * sizeof(uint64_t));
+	ctx->out = g_malloc0(ctx->num_words * sizeof(uint64_t));
+	ctx->stable = g_malloc0(ctx->num_words * sizeof(uint64_t));
+	ctx->count = g_malloc0(ctx->num_words * ctx->num_planes * sizeof(uint64_t));
+
+	selected = g_malloc0(ctx->num_words * sizeof(uint64_t));
+	if (ctx->selected)
+		memcpy(selected, ctx->selected, MIN(ctx->selected_size, unitsize));
+	else
+		memset(selected, 0xff, unitsize);
+
+	for (w = 0; w < ctx->num_words; w++) {
+		size = word_size(ctx, w);
+		ctx->mask[w] = load_word(selected + w * sizeof(uint64_t), size);
+		ctx->last[w] = load_word(first + w * sizeof(uint64_t), size);
+		ctx->out[w] = ctx->last[w];
+		ctx->stable[w] = ~(uint64_t)0;
+		for (j = 0; j < ctx->num_planes; j++) {
+			if (ctx->width & (1 << j))
+				ctx->count[j * ctx->num_words + w] = ~(uint64_t)0;
+		}
+	}
+	g_free(selected);
+}
+
+/*
+ * Filter one 64-bit word of a sample. The run length of every channel
+ * counts up while the input stays the same, restarts at 1 when it changes
+ * and saturates at 'width', which is when the output may follow.
+ */
+static inline uint64_t deglitch_word(struct context *ctx, unsigned int w,
+		uint64_t in)
+{
+	uint64_t *count, same, carry, c, stable;
+	unsigned int j, stride;
+
+	count = ctx->count + w;
+	stride = ctx->num_words;
+
+	same = ~(in ^ ctx->last[w]);
+	carry = same & ~ctx->stable[w];
+	stable = ~(uint64_t)0;
+	for (j = 0; j < ctx->num_planes; j++) {
+		c = count[j * stride];
+		/* Increment... */
+		c ^= carry;
+		carry &= ~c;
+		/* ...or restart at 1. */
+		if (j == 0)
+			c |= ~same;
+		else
+			c &= same;
+		count[j * stride] = c;
+		/* The counter never passes 'width', equality will do. */
+		stable &= (ctx->width & (1 << j)) ? c : ~c;
+	}
+	ctx->stable[w] = stable;
+	ctx->last[w] = in;
+
+	/* Unselected channels always follow their input. */
+	stable |= ~ctx->mask[w];
+	ctx->out[w] = (in & stable) | (ctx->out[w] & ~stable);
+
+	return ctx->out[w];
+}
+
+static void deglitch_logic(struct context *ctx, uint16_t unitsize,
+		uint8_t *data, uint64_t length)
+{
+	uint64_t i, num_samples;
+	unsigned int w, size;
+	uint8_t *p;
+
+	if (ctx->width == 1 || unitsize == 0 || length < unitsize)
+		return;
+
+	if (ctx->unitsize != unitsize)
+		state_init(ctx, unitsize, data);
+
+	num_samples = length / unitsize;
+	if (ctx->num_words == 1) {
+		for (i = 0; i < num_samples; i++) {
+			p = data + i * unitsize;
+			store_word(p, unitsize,
+				deglitch_word(ctx, 0, load_word(p, unitsize)));
+		}
+		return;
+	}
+
+	for (i = 0; i < num_samples; i++) {
+		for (w = 0; w < ctx->num_words; w++) {
+			p = data + i * unitsize + w * sizeof(uint64_t);
+			size = word_size(ctx, w);
+			store_word(p, size, deglitch_word(ctx, w, load_word(p, size)));
+		}
+	}
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+		/* A new acquisition starts from scratch. */
+		state_free(ctx);
+		break;
+	case SR_DF_LOGIC:
+		logic = packet_in->payload;
+		deglitch_logic(ctx, logic->unitsize, logic->data, logic->length);
+		break;
+	default:
+		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
+		break;
+	}
+
+	*packet_out = packet_in;
+
+	return SR_OK;
+}
+
+static int receive_logic_block(const struct sr_transform *t,
+		const struct sr_datafeed_logic *logic,
+		uint8_t *data, uint64_t length)
+{
+	if (!t || !t->priv || !logic || !data)
+		return SR_ERR_ARG;
+
+	deglitch_logic(t->priv, logic->unitsize, data, length);
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	state_free(ctx);
+	g_free(ctx->selected);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "width", "Width", "Suppress pulses shorter than this many samples", NULL, NULL },
+	{ "channels", "Channels", "Comma-separated list of channels to filter (default: all)", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(2));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(""));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_deglitch = {
+	.id = "deglitch",
+	.name = "Deglitch",
+	.desc = "Suppress short pulses on logic channels",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.receive_logic_block = receive_logic_block,
+	.cleanup = cleanup,
+};
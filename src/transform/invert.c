@@ -25,65 +25,195 @@
 
 #define LOG_PREFIX "transform/invert"
 
+struct context {
+	/* Reciprocals of integer-encoded analog samples. */
+	float *fbuf;
+	uint64_t fbuf_size;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	t->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+/*
+ * Invert every bit in every byte. This works on 64-bit words, and the
+ * loop is simple enough for the compiler to vectorize.
+ */
+static void invert_logic(uint8_t *data, uint64_t length)
+{
+	uint64_t i, n, w;
+
+	n = length / sizeof(uint64_t);
+	for (i = 0; i < n; i++) {
+		memcpy(&w, data + i * sizeof(uint64_t), sizeof(uint64_t));
+		w = ~w;
+		memcpy(data + i * sizeof(uint64_t), &w, sizeof(uint64_t));
+	}
+	for (i = n * sizeof(uint64_t); i < length; i++)
+		data[i] = ~data[i];
+}
+
+static void reciprocal(float *f, uint64_t count)
+{
+	uint64_t i;
+
+	for (i = 0; i < count; i++)
+		f[i] = 1.0f / f[i];
+}
+
+static void set_native_float(struct sr_analog_encoding *encoding)
+{
+	encoding->unitsize = sizeof(float);
+	encoding->is_signed = TRUE;
+	encoding->is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding->is_bigendian = TRUE;
+#else
+	encoding->is_bigendian = FALSE;
+#endif
+	encoding->scale.p = 1;
+	encoding->scale.q = 1;
+	encoding->offset.p = 0;
+	encoding->offset.q = 1;
+}
+
+static int invert_analog(struct context *ctx,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	const struct sr_datafeed_analog *analog;
+	const struct sr_analog_encoding *encoding;
+	uint64_t count, i;
+	float *f, scale, offset;
+	uint8_t *b;
+	gboolean bigendian;
+	int ret;
+
+	analog = packet_in->payload;
+	encoding = analog->encoding;
+	count = (uint64_t)analog->num_samples
+		* g_slist_length(analog->meaning->channels);
+
+#ifdef WORDS_BIGENDIAN
+	bigendian = TRUE;
+#else
+	bigendian = FALSE;
+#endif
+
+	if (encoding->is_float && encoding->unitsize == sizeof(float)) {
+		/* Float samples are replaced in place by their reciprocal. */
+		f = analog->data;
+		if (encoding->is_bigendian != bigendian) {
+			b = analog->data;
+			for (i = 0; i < count; i++) {
+				if (encoding->is_bigendian)
+					f[i] = RBFL(b + i * sizeof(float));
+				else
+					f[i] = RLFL(b + i * sizeof(float));
+			}
+		}
+		if (encoding->scale.p != 1 || encoding->scale.q != 1
+				|| encoding->offset.p != 0) {
+			scale = encoding->scale.p / (float)encoding->scale.q;
+			offset = encoding->offset.p / (float)encoding->offset.q;
+			for (i = 0; i < count; i++)
+				f[i] = f[i] * scale + offset;
+		}
+		reciprocal(f, count);
+	} else {
+		/* The reciprocal of an integer needs a float to go into. */
+		if (count > ctx->fbuf_size) {
+			ctx->fbuf = g_realloc(ctx->fbuf, count * sizeof(float));
+			ctx->fbuf_size = count;
+		}
+		if ((ret = sr_analog_to_float(analog, ctx->fbuf)) != SR_OK)
+			return ret;
+		reciprocal(ctx->fbuf, count);
+	}
+
+	/* The source's encoding may be reused, describe the result in a copy. */
+	ctx->encoding = *encoding;
+	set_native_float(&ctx->encoding);
+	ctx->analog = *analog;
+	if (!encoding->is_float || encoding->unitsize != sizeof(float))
+		ctx->analog.data = ctx->fbuf;
+	ctx->analog.encoding = &ctx->encoding;
+	ctx->packet.type = SR_DF_ANALOG;
+	ctx->packet.payload = &ctx->analog;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
 static int receive(const struct sr_transform *t,
 		struct sr_datafeed_packet *packet_in,
 		struct sr_datafeed_packet **packet_out)
 {
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_analog_old *analog_old;
-	const struct sr_datafeed_analog *analog;
-	struct sr_channel *ch;
-	GSList *l;
-	float *fdata, *f;
-	int si, num_channels, c;
-	uint8_t *b;
-	int64_t p;
-	uint64_t i, j, q;
 
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
 
+	/* Unless noted otherwise, return the in-place-modified packet. */
+	*packet_out = packet_in;
+
 	switch (packet_in->type) {
 	case SR_DF_LOGIC:
 		logic = packet_in->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* For now invert every bit in every byte. */
-				b = (uint8_t *)logic->data + i + logic->unitsize - 1 - j;
-				*b = ~(*b);
-			}
-		}
+		/* For now invert every bit in every byte. */
+		invert_logic(logic->data, logic->length);
 		break;
 	case SR_DF_ANALOG_OLD:
 		analog_old = packet_in->payload;
-		fdata = (float *)analog_old->data;
-		num_channels = g_slist_length(analog_old->channels);
-		for (si = 0; si < analog_old->num_samples; si++) {
-			/* For now invert all values in all channels. */
-			for (l = analog_old->channels, c = 0; l; l = l->next, c++) {
-				ch = l->data;
-				(void)ch;
-				f = &fdata[si * num_channels + c];
-				*f = 1.0 / *f;
-			}
-		}
+		/* For now invert all values in all channels. */
+		reciprocal(analog_old->data, (uint64_t)analog_old->num_samples
+				* g_slist_length(analog_old->channels));
 		break;
 	case SR_DF_ANALOG:
-		analog = packet_in->payload;
-		p = analog->encoding->scale.p;
-		q = analog->encoding->scale.q;
-		if (q > INT64_MAX)
-			return SR_ERR;
-		analog->encoding->scale.p = (p < 0) ? -q : q;
-		analog->encoding->scale.q = (p < 0) ? -p : p;
-		break;
+		return invert_analog(t->priv, packet_in, packet_out);
 	default:
 		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
 		break;
 	}
 
-	/* Return the in-place-modified packet. */
-	*packet_out = packet_in;
+	return SR_OK;
+}
+
+static int receive_logic_block(const struct sr_transform *t,
+		const struct sr_datafeed_logic *logic,
+		uint8_t *data, uint64_t length)
+{
+	(void)t;
+	(void)logic;
+
+	invert_logic(data, length);
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_free(ctx->fbuf);
+	g_free(ctx);
+	t->priv = NULL;
 
 	return SR_OK;
 }
@@ -93,7 +223,8 @@ SR_PRIV struct sr_transform_module transform_invert = {
 	.name = "Invert",
 	.desc = "Invert values",
 	.options = NULL,
-	.init = NULL,
+	.init = init,
 	.receive = receive,
-	.cleanup = NULL,
+	.receive_logic_block = receive_logic_block,
+	.cleanup = cleanup,
 };
@@ -39,6 +39,19 @@ static int receive(const struct sr_transform *t,
 	return SR_OK;
 }
 
+static int receive_logic_block(const struct sr_transform *t,
+		const struct sr_datafeed_logic *logic,
+		uint8_t *data, uint64_t length)
+{
+	(void)t;
+	(void)logic;
+	(void)data;
+	(void)length;
+
+	/* Do nothing, but don't keep other transforms from being fused. */
+	return SR_OK;
+}
+
 SR_PRIV struct sr_transform_module transform_nop = {
 	.id = "nop",
 	.name = "NOP",
@@ -46,5 +59,6 @@ SR_PRIV struct sr_transform_module transform_nop = {
 	.options = NULL,
 	.init = NULL,
 	.receive = receive,
+	.receive_logic_block = receive_logic_block,
 	.cleanup = NULL,
 };
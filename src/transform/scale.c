@@ -27,6 +27,10 @@
 
 struct context {
 	struct sr_rational factor;
+	/* Outgoing analog packet, with the scaled copy of the encoding. */
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
 };
 
 static int init(struct sr_transform *t, GHashTable *options)
@@ -44,6 +48,27 @@ static int init(struct sr_transform *t, GHashTable *options)
 	return SR_OK;
 }
 
+static void scale_float(float *f, uint64_t count, float factor)
+{
+	uint64_t i;
+
+	for (i = 0; i < count; i++)
+		f[i] *= factor;
+}
+
+static gboolean native_float(const struct sr_analog_encoding *encoding)
+{
+#ifdef WORDS_BIGENDIAN
+	if (!encoding->is_bigendian)
+		return FALSE;
+#else
+	if (encoding->is_bigendian)
+		return FALSE;
+#endif
+
+	return encoding->is_float && encoding->unitsize == sizeof(float);
+}
+
 static int receive(const struct sr_transform *t,
 		struct sr_datafeed_packet *packet_in,
 		struct sr_datafeed_packet **packet_out)
@@ -51,11 +76,10 @@ static int receive(const struct sr_transform *t,
 	struct context *ctx;
 	const struct sr_datafeed_analog_old *analog_old;
 	const struct sr_datafeed_analog *analog;
-	struct sr_channel *ch;
-	GSList *l;
-	float *fdata;
+	struct sr_analog_encoding *encoding;
+	struct sr_rational scale, offset;
+	uint64_t count;
 	float factor;
-	int i, num_channels, c;
 
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
@@ -64,23 +88,43 @@ static int receive(const struct sr_transform *t,
 	switch (packet_in->type) {
 	case SR_DF_ANALOG_OLD:
 		analog_old = packet_in->payload;
-		fdata = (float *)analog_old->data;
-		num_channels = g_slist_length(analog_old->channels);
 		factor = (float) ctx->factor.p / ctx->factor.q;
-		for (i = 0; i < analog_old->num_samples; i++) {
-			/* For now scale all values in all channels. */
-			for (l = analog_old->channels, c = 0; l; l = l->next, c++) {
-				ch = l->data;
-				(void)ch;
-				fdata[i * num_channels + c] *= factor;
-			}
-		}
+		/* For now scale all values in all channels. */
+		scale_float(analog_old->data, (uint64_t)analog_old->num_samples
+				* g_slist_length(analog_old->channels), factor);
 		break;
 	case SR_DF_ANALOG:
+		/*
+		 * Scaling only touches a copy of the encoding, whatever the
+		 * sample format is: both its scale and its offset are
+		 * multiplied by the factor. The source's encoding is left
+		 * alone, as it may be reused for the following packets.
+		 */
 		analog = packet_in->payload;
-		analog->encoding->scale.p *= ctx->factor.p;
-		analog->encoding->scale.q *= ctx->factor.q;
-		break;
+		ctx->analog = *analog;
+		ctx->encoding = *analog->encoding;
+		ctx->analog.encoding = &ctx->encoding;
+		ctx->packet.type = SR_DF_ANALOG;
+		ctx->packet.payload = &ctx->analog;
+		*packet_out = &ctx->packet;
+		encoding = &ctx->encoding;
+		if (sr_rational_mult(&scale, &encoding->scale, &ctx->factor) == SR_OK
+				&& sr_rational_mult(&offset, &encoding->offset,
+				&ctx->factor) == SR_OK) {
+			encoding->scale = scale;
+			encoding->offset = offset;
+			return SR_OK;
+		}
+		if (!native_float(encoding) || encoding->offset.p != 0) {
+			sr_err("Scale factor overflows the analog encoding.");
+			return SR_ERR;
+		}
+		/* Native floats can take the factor in place instead. */
+		count = (uint64_t)analog->num_samples
+			* g_slist_length(analog->meaning->channels);
+		factor = (float) ctx->factor.p / ctx->factor.q;
+		scale_float(analog->data, count, factor);
+		return SR_OK;
 	default:
 		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
 		break;
@@ -45,12 +45,16 @@
 extern SR_PRIV struct sr_transform_module transform_nop;
 extern SR_PRIV struct sr_transform_module transform_scale;
 extern SR_PRIV struct sr_transform_module transform_invert;
+extern SR_PRIV struct sr_transform_module transform_decimate;
+extern SR_PRIV struct sr_transform_module transform_deglitch;
 /* @endcond */
 
 static const struct sr_transform_module *transform_module_list[] = {
 	&transform_nop,
 	&transform_scale,
 	&transform_invert,
+	&transform_decimate,
+	&transform_deglitch,
 	NULL,
 };
 
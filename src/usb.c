@@ -20,9 +20,12 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <libusb.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -30,6 +33,7 @@
 /* SR_CONF_CONN takes one of these: */
 #define CONN_USB_VIDPID  "^([0-9a-fA-F]{4})\\.([0-9a-fA-F]{4})$"
 #define CONN_USB_BUSADDR "^(\\d+)\\.(\\d+)$"
+#define CONN_USB_PORTPATH "^usb/\\d+-\\d+(\\.\\d+)*$"
 
 #define LOG_PREFIX "usb"
 
@@ -53,11 +57,13 @@ struct usb_source {
 	GPtrArray *pollfds;
 };
 
+static int64_t shim_next_due(int64_t now_us);
+
 /** USB event source prepare() method.
  */
 static gboolean usb_source_prepare(GSource *source, int *timeout)
 {
-	int64_t now_us, usb_due_us;
+	int64_t now_us, usb_due_us, replay_due_us;
 	struct usb_source *usource;
 	struct timeval usb_timeout;
 	int remaining_ms;
@@ -82,6 +88,14 @@ static gboolean usb_source_prepare(GSource *source, int *timeout)
 		if (usb_due_us < usource->due_us)
 			usource->due_us = usb_due_us;
 	}
+	/*
+	 * Replayed transfers complete without any activity on the file
+	 * descriptors, so wake up when the next one is due. check() then
+	 * sees the source as ready from the expiration time.
+	 */
+	replay_due_us = shim_next_due(now_us);
+	if (replay_due_us < usource->due_us)
+		usource->due_us = replay_due_us;
 	if (usource->due_us != INT64_MAX)
 		remaining_ms = (MAX(0, usource->due_us - now_us) + 999) / 1000;
 	else
@@ -302,7 +316,8 @@ static GSource *usb_source_new(struct sr_session *session,
  *
  * @param usb_ctx libusb context to use while scanning.
  * @param conn Connection string specifying the device(s) to match. This
- * can be of the form "<bus>.<address>", or "<vendorid>.<productid>".
+ * can be of the form "<bus>.<address>", or "<vendorid>.<productid>", or
+ * a port path as returned by usb_get_port_path() ("usb/<bus>-<port>...").
  *
  * @return A GSList of struct sr_usb_dev_inst, with bus and address fields
  * matching the device that matched the connection string. The GSList and
@@ -317,11 +332,19 @@ SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn)
 	GRegex *reg;
 	GMatchInfo *match;
 	int vid, pid, bus, addr, b, a, ret, i;
-	char *mstr;
+	char *mstr, port_path[64];
+	const char *path;
 
 	vid = pid = bus = addr = 0;
+	path = NULL;
+	if (g_regex_match_simple(CONN_USB_PORTPATH, conn, 0, 0)) {
+		path = conn;
+		sr_dbg("Trying to find USB device at %s.", path);
+	}
 	reg = g_regex_new(CONN_USB_VIDPID, 0, 0, NULL);
-	if (g_regex_match(reg, conn, 0, &match)) {
+	if (path) {
+		match = NULL;
+	} else if (g_regex_match(reg, conn, 0, &match)) {
 		if ((mstr = g_match_info_fetch(match, 1)))
 			vid = strtoul(mstr, NULL, 16);
 		g_free(mstr);
@@ -347,10 +370,11 @@ SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn)
 			       "%d.%d.", bus, addr);
 		}
 	}
-	g_match_info_unref(match);
+	if (match)
+		g_match_info_unref(match);
 	g_regex_unref(reg);
 
-	if (vid + pid + bus + addr == 0) {
+	if (!path && vid + pid + bus + addr == 0) {
 		sr_err("Neither VID:PID nor bus.address was specified.");
 		return NULL;
 	}
@@ -383,6 +407,11 @@ SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn)
 		if (bus + addr && (b != bus || a != addr))
 			continue;
 
+		if (path && (usb_get_port_path(devlist[i], port_path,
+				sizeof(port_path)) != SR_OK
+				|| strcmp(path, port_path)))
+			continue;
+
 		sr_dbg("Found USB device (VID:PID = %04x:%04x, bus.address = "
 		       "%d.%d).", des.idVendor, des.idProduct, b, a);
 
@@ -510,3 +539,617 @@ SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len)
 
 	return SR_OK;
 }
+
+/*
+ * Recording and replaying USB transfers.
+ *
+ * When the SIGROK_USB_RECORD environment variable names a file, the
+ * results of all transfers that go through the sr_usb_*_transfer()
+ * wrappers below are written to it: the completions of asynchronous
+ * transfers in the order they happen, and synchronous control and bulk
+ * transfers as they return. Only the data of IN transfers is kept; for
+ * control transfers, that's the data after the setup packet, and their
+ * direction is that of bmRequestType.
+ *
+ * With SIGROK_USB_REPLAY instead, no transfer goes to the device: the
+ * asynchronous transfers are completed from the recording when the
+ * driver handles events, and synchronous transfers return the recorded
+ * results. SIGROK_USB_REPLAY_SPEED scales the original timing of the
+ * completions; 0 replays them as fast as the driver takes them.
+ *
+ * The file starts with the magic and a 32-bit version, followed by a
+ * 32-byte little-endian header per transfer and the data of IN transfers.
+ */
+
+#define SHIM_MAGIC     "SRUSBREC"
+#define SHIM_VERSION   1
+#define SHIM_HDRSIZE   32
+
+enum {
+	SHIM_TRANSFER = 1,
+	SHIM_CONTROL,
+	SHIM_BULK,
+	SHIM_CONTROL_TRANSFER,
+};
+
+struct shim_record {
+	uint8_t type;
+	/* Endpoint, or bmRequestType of control transfers. */
+	uint8_t endpoint;
+	uint8_t request;
+	uint16_t value;
+	uint16_t index;
+	/* Transfer status, or the return value of synchronous transfers. */
+	int32_t status;
+	uint32_t length;
+	uint64_t time_us;
+	uint8_t *data;
+};
+
+struct shim_callback {
+	libusb_transfer_cb_fn fn;
+};
+
+static struct {
+	GMutex mutex;
+	int refcount;
+	int64_t start_us;
+	FILE *record;
+	/* Original callbacks of transfers being recorded. */
+	GHashTable *callbacks;
+	FILE *replay;
+	double speed;
+	/* The replay clock, set when the first transfer completes. */
+	gboolean clock_set;
+	int64_t clock_us;
+	uint64_t clock_rec_us;
+	/* Records read so far, but not used yet. */
+	GQueue *async_ahead;
+	GQueue *sync_ahead;
+	/* Submitted transfers, in order. */
+	GSList *pending;
+	GSList *cancelled;
+} shim;
+
+static gboolean shim_has_data(const struct shim_record *rec)
+{
+	if (rec->type == SHIM_CONTROL && rec->status < 0)
+		return FALSE;
+
+	return (rec->endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN
+		&& rec->length > 0;
+}
+
+/* Must be called with the shim mutex held. */
+static void shim_write(struct shim_record *rec)
+{
+	uint8_t hdr[SHIM_HDRSIZE];
+
+	rec->time_us = g_get_monotonic_time() - shim.start_us;
+
+	memset(hdr, 0, sizeof(hdr));
+	W8(hdr, rec->type);
+	W8(hdr + 1, rec->endpoint);
+	W8(hdr + 2, rec->request);
+	WL16(hdr + 4, rec->value);
+	WL16(hdr + 6, rec->index);
+	WL32(hdr + 8, rec->status);
+	WL32(hdr + 12, rec->length);
+	WL32(hdr + 16, rec->time_us);
+	WL32(hdr + 20, rec->time_us >> 32);
+
+	if (fwrite(hdr, sizeof(hdr), 1, shim.record) != 1
+			|| (shim_has_data(rec) && fwrite(rec->data,
+			rec->length, 1, shim.record) != 1))
+		sr_err("Failed to write USB recording.");
+}
+
+static void shim_record_free(struct shim_record *rec)
+{
+	g_free(rec->data);
+	g_free(rec);
+}
+
+/* Read the next record, must be called with the shim mutex held. */
+static gboolean shim_read(void)
+{
+	struct shim_record *rec;
+	uint8_t hdr[SHIM_HDRSIZE];
+
+	if (fread(hdr, sizeof(hdr), 1, shim.replay) != 1)
+		return FALSE;
+
+	rec = g_malloc0(sizeof(struct shim_record));
+	rec->type = R8(hdr);
+	rec->endpoint = R8(hdr + 1);
+	rec->request = R8(hdr + 2);
+	rec->value = RL16(hdr + 4);
+	rec->index = RL16(hdr + 6);
+	rec->status = RL32S(hdr + 8);
+	rec->length = RL32(hdr + 12);
+	rec->time_us = RL32(hdr + 16) | (uint64_t)RL32(hdr + 20) << 32;
+	if (shim_has_data(rec)) {
+		rec->data = g_malloc(rec->length);
+		if (fread(rec->data, rec->length, 1, shim.replay) != 1) {
+			sr_err("USB recording is truncated.");
+			shim_record_free(rec);
+			return FALSE;
+		}
+	}
+
+	if (rec->type == SHIM_TRANSFER || rec->type == SHIM_CONTROL_TRANSFER)
+		g_queue_push_tail(shim.async_ahead, rec);
+	else
+		g_queue_push_tail(shim.sync_ahead, rec);
+
+	return TRUE;
+}
+
+static struct shim_record *shim_peek(GQueue *queue)
+{
+	while (g_queue_is_empty(queue)) {
+		if (!shim_read())
+			return NULL;
+	}
+
+	return g_queue_peek_head(queue);
+}
+
+/**
+ * Set up recording or replaying of USB transfers, as requested by the
+ * environment. Called from sr_init().
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_shim_init(void)
+{
+	const char *filename, *speed;
+	char magic[sizeof(SHIM_MAGIC) - 1];
+	uint8_t version[4];
+
+	g_mutex_lock(&shim.mutex);
+	if (shim.refcount++ > 0) {
+		g_mutex_unlock(&shim.mutex);
+		return;
+	}
+
+	shim.start_us = g_get_monotonic_time();
+	shim.callbacks = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, g_free);
+	shim.async_ahead = g_queue_new();
+	shim.sync_ahead = g_queue_new();
+
+	if ((filename = g_getenv("SIGROK_USB_RECORD"))) {
+		if (!(shim.record = g_fopen(filename, "wb"))) {
+			sr_err("Failed to create USB recording '%s'.", filename);
+		} else {
+			WL32(version, SHIM_VERSION);
+			fwrite(SHIM_MAGIC, sizeof(magic), 1, shim.record);
+			fwrite(version, sizeof(version), 1, shim.record);
+			sr_info("Recording USB transfers to '%s'.", filename);
+		}
+	} else if ((filename = g_getenv("SIGROK_USB_REPLAY"))) {
+		if (!(shim.replay = g_fopen(filename, "rb"))) {
+			sr_err("Failed to open USB recording '%s'.", filename);
+		} else if (fread(magic, sizeof(magic), 1, shim.replay) != 1
+				|| memcmp(magic, SHIM_MAGIC, sizeof(magic))
+				|| fread(version, sizeof(version), 1, shim.replay) != 1
+				|| RL32(version) != SHIM_VERSION) {
+			sr_err("'%s' is not a USB recording.", filename);
+			fclose(shim.replay);
+			shim.replay = NULL;
+		} else {
+			speed = g_getenv("SIGROK_USB_REPLAY_SPEED");
+			shim.speed = speed ? g_ascii_strtod(speed, NULL) : 1.0;
+			sr_info("Replaying USB transfers from '%s'.", filename);
+		}
+	}
+
+	g_mutex_unlock(&shim.mutex);
+}
+
+/**
+ * Finish recording or replaying USB transfers. Called from sr_exit().
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_shim_exit(void)
+{
+	g_mutex_lock(&shim.mutex);
+	if (--shim.refcount > 0) {
+		g_mutex_unlock(&shim.mutex);
+		return;
+	}
+
+	if (shim.record)
+		fclose(shim.record);
+	if (shim.replay)
+		fclose(shim.replay);
+	shim.record = shim.replay = NULL;
+	shim.clock_set = FALSE;
+	g_hash_table_destroy(shim.callbacks);
+	g_queue_free_full(shim.async_ahead, (GDestroyNotify)shim_record_free);
+	g_queue_free_full(shim.sync_ahead, (GDestroyNotify)shim_record_free);
+	g_slist_free(shim.pending);
+	g_slist_free(shim.cancelled);
+	shim.pending = shim.cancelled = NULL;
+
+	g_mutex_unlock(&shim.mutex);
+}
+
+/*
+ * Describe an asynchronous transfer the way it's recorded, and return
+ * where its data goes and how much of it fits. Control transfers all go
+ * to endpoint 0; their setup packet tells them apart.
+ */
+static unsigned char *shim_describe(struct libusb_transfer *transfer,
+		struct shim_record *rec, int *size)
+{
+	struct libusb_control_setup *setup;
+
+	memset(rec, 0, sizeof(*rec));
+	if (transfer->type != LIBUSB_TRANSFER_TYPE_CONTROL) {
+		rec->type = SHIM_TRANSFER;
+		rec->endpoint = transfer->endpoint;
+		*size = transfer->length;
+		return transfer->buffer;
+	}
+
+	setup = libusb_control_transfer_get_setup(transfer);
+	rec->type = SHIM_CONTROL_TRANSFER;
+	rec->endpoint = setup->bmRequestType;
+	rec->request = setup->bRequest;
+	rec->value = libusb_le16_to_cpu(setup->wValue);
+	rec->index = libusb_le16_to_cpu(setup->wIndex);
+	*size = MAX(transfer->length - LIBUSB_CONTROL_SETUP_SIZE, 0);
+
+	return libusb_control_transfer_get_data(transfer);
+}
+
+static void LIBUSB_CALL shim_record_callback(struct libusb_transfer *transfer)
+{
+	struct shim_record rec;
+	struct shim_callback *cb;
+	int size;
+
+	rec.data = shim_describe(transfer, &rec, &size);
+	rec.status = transfer->status;
+	rec.length = transfer->actual_length;
+
+	g_mutex_lock(&shim.mutex);
+	shim_write(&rec);
+	cb = g_hash_table_lookup(shim.callbacks, transfer);
+	transfer->callback = cb->fn;
+	g_hash_table_remove(shim.callbacks, transfer);
+	g_mutex_unlock(&shim.mutex);
+
+	/* The driver may submit it again right away. */
+	transfer->callback(transfer);
+}
+
+/**
+ * Submit an asynchronous transfer, like libusb_submit_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_submit_transfer(struct libusb_transfer *transfer)
+{
+	struct shim_callback *cb;
+	int ret;
+
+	if (shim.replay) {
+		g_mutex_lock(&shim.mutex);
+		shim.pending = g_slist_append(shim.pending, transfer);
+		g_mutex_unlock(&shim.mutex);
+		return LIBUSB_SUCCESS;
+	}
+
+	if (shim.record) {
+		cb = g_malloc(sizeof(struct shim_callback));
+		cb->fn = transfer->callback;
+		g_mutex_lock(&shim.mutex);
+		g_hash_table_insert(shim.callbacks, transfer, cb);
+		g_mutex_unlock(&shim.mutex);
+		transfer->callback = shim_record_callback;
+	}
+
+	if ((ret = libusb_submit_transfer(transfer)) < 0 && shim.record) {
+		g_mutex_lock(&shim.mutex);
+		cb = g_hash_table_lookup(shim.callbacks, transfer);
+		transfer->callback = cb->fn;
+		g_hash_table_remove(shim.callbacks, transfer);
+		g_mutex_unlock(&shim.mutex);
+	}
+
+	return ret;
+}
+
+/**
+ * Cancel an asynchronous transfer, like libusb_cancel_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_cancel_transfer(struct libusb_transfer *transfer)
+{
+	int ret;
+
+	if (!shim.replay)
+		return libusb_cancel_transfer(transfer);
+
+	/* Like libusb, the callback runs when events are handled. */
+	ret = LIBUSB_ERROR_NOT_FOUND;
+	g_mutex_lock(&shim.mutex);
+	if (g_slist_find(shim.pending, transfer)) {
+		shim.pending = g_slist_remove(shim.pending, transfer);
+		shim.cancelled = g_slist_append(shim.cancelled, transfer);
+		ret = LIBUSB_SUCCESS;
+	}
+	g_mutex_unlock(&shim.mutex);
+
+	return ret;
+}
+
+static void shim_complete(struct libusb_transfer *transfer, int status,
+		const struct shim_record *rec)
+{
+	struct shim_record desc;
+	unsigned char *data;
+	int size;
+
+	transfer->status = status;
+	transfer->actual_length = 0;
+	if (rec) {
+		data = shim_describe(transfer, &desc, &size);
+		transfer->actual_length = MIN(rec->length, (uint32_t)size);
+		if (rec->data)
+			memcpy(data, rec->data, transfer->actual_length);
+	}
+
+	g_mutex_unlock(&shim.mutex);
+	transfer->callback(transfer);
+	g_mutex_lock(&shim.mutex);
+}
+
+/* The first pending transfer the record can complete. */
+static struct libusb_transfer *shim_find_pending(const struct shim_record *rec)
+{
+	struct libusb_transfer *transfer;
+	struct shim_record desc;
+	GSList *l;
+	int size;
+
+	for (l = shim.pending; l; l = l->next) {
+		transfer = l->data;
+		shim_describe(transfer, &desc, &size);
+		if (desc.type == rec->type && desc.endpoint == rec->endpoint
+				&& desc.request == rec->request)
+			return transfer;
+	}
+
+	return NULL;
+}
+
+/* When a completion is due, must be called with the shim mutex held. */
+static int64_t shim_due(const struct shim_record *rec, int64_t now_us)
+{
+	if (shim.speed <= 0 || !shim.clock_set)
+		return now_us;
+
+	return shim.clock_us + (int64_t)((rec->time_us - shim.clock_rec_us)
+			/ shim.speed);
+}
+
+/*
+ * When shim_replay_events() has something to do next: 'now_us' if it
+ * can complete a transfer right away, INT64_MAX if it can't until more
+ * transfers are submitted, or when not replaying at all.
+ */
+static int64_t shim_next_due(int64_t now_us)
+{
+	struct shim_record *rec;
+	int64_t due_us;
+
+	if (!shim.replay)
+		return INT64_MAX;
+
+	g_mutex_lock(&shim.mutex);
+	if (shim.cancelled)
+		due_us = now_us;
+	else if (!shim.pending)
+		due_us = INT64_MAX;
+	else if (!(rec = shim_peek(shim.async_ahead)))
+		due_us = now_us;
+	else if (!shim_find_pending(rec))
+		due_us = INT64_MAX;
+	else
+		due_us = shim_due(rec, now_us);
+	g_mutex_unlock(&shim.mutex);
+
+	return due_us;
+}
+
+/*
+ * Complete the transfers that were pending on entry and are due, in the
+ * recorded order. Once the recording runs out, the device is gone.
+ */
+static int shim_replay_events(struct timeval *tv)
+{
+	struct libusb_transfer *transfer;
+	struct shim_record *rec;
+	int64_t timeout_us, wait_us, due_us, now_us;
+	unsigned int budget, done;
+
+	timeout_us = tv ? tv->tv_sec * G_USEC_PER_SEC + tv->tv_usec : 0;
+	wait_us = timeout_us;
+	done = 0;
+
+	g_mutex_lock(&shim.mutex);
+	budget = g_slist_length(shim.pending) + g_slist_length(shim.cancelled);
+	while (budget > 0) {
+		budget--;
+		if (shim.cancelled) {
+			transfer = shim.cancelled->data;
+			shim.cancelled = g_slist_delete_link(shim.cancelled,
+					shim.cancelled);
+			shim_complete(transfer, LIBUSB_TRANSFER_CANCELLED, NULL);
+			done++;
+			continue;
+		}
+
+		if (!(rec = shim_peek(shim.async_ahead))) {
+			if (!shim.pending)
+				break;
+			transfer = shim.pending->data;
+			shim.pending = g_slist_delete_link(shim.pending,
+					shim.pending);
+			shim_complete(transfer, LIBUSB_TRANSFER_NO_DEVICE, NULL);
+			done++;
+			continue;
+		}
+		if (!(transfer = shim_find_pending(rec)))
+			break;
+
+		now_us = g_get_monotonic_time();
+		if (!shim.clock_set) {
+			shim.clock_set = TRUE;
+			shim.clock_us = now_us;
+			shim.clock_rec_us = rec->time_us;
+		}
+		if ((due_us = shim_due(rec, now_us)) > now_us) {
+			wait_us = MIN(wait_us, due_us - now_us);
+			break;
+		}
+
+		g_queue_pop_head(shim.async_ahead);
+		shim.pending = g_slist_remove(shim.pending, transfer);
+		shim_complete(transfer, rec->status, rec);
+		shim_record_free(rec);
+		done++;
+	}
+	g_mutex_unlock(&shim.mutex);
+
+	/* Nothing to do, block like libusb would. */
+	if (!done && wait_us > 0)
+		g_usleep(wait_us);
+
+	return LIBUSB_SUCCESS;
+}
+
+/**
+ * Handle USB events, like libusb_handle_events_timeout_completed().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_handle_events(libusb_context *usb_ctx, struct timeval *tv,
+		int *completed)
+{
+	if (shim.replay)
+		return shim_replay_events(tv);
+
+	return libusb_handle_events_timeout_completed(usb_ctx, tv, completed);
+}
+
+/* Return the result of the next synchronous transfer in the recording. */
+static int shim_replay_sync(const struct shim_record *req, unsigned char *data,
+		int length, int *transferred)
+{
+	struct shim_record *rec;
+	int ret;
+
+	g_mutex_lock(&shim.mutex);
+	if (!(rec = shim_peek(shim.sync_ahead))) {
+		g_mutex_unlock(&shim.mutex);
+		sr_err("USB recording has no more synchronous transfers.");
+		return LIBUSB_ERROR_NO_DEVICE;
+	}
+	g_queue_pop_head(shim.sync_ahead);
+	g_mutex_unlock(&shim.mutex);
+
+	if (rec->type != req->type || rec->endpoint != req->endpoint
+			|| rec->request != req->request)
+		sr_warn("USB replay diverges: expected transfer type %d "
+			"(0x%02x/0x%02x), got %d (0x%02x/0x%02x).", req->type,
+			req->endpoint, req->request, rec->type,
+			rec->endpoint, rec->request);
+
+	ret = rec->status;
+	if (rec->data && data)
+		memcpy(data, rec->data, MIN(rec->length, (uint32_t)length));
+	if (transferred)
+		*transferred = MIN(rec->length, (uint32_t)length);
+	shim_record_free(rec);
+
+	return ret;
+}
+
+/**
+ * Perform a synchronous control transfer, like libusb_control_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_control_transfer(libusb_device_handle *devhdl,
+		uint8_t request_type, uint8_t request, uint16_t value,
+		uint16_t index, unsigned char *data, uint16_t length,
+		unsigned int timeout)
+{
+	struct shim_record rec;
+	int ret;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = SHIM_CONTROL;
+	rec.endpoint = request_type;
+	rec.request = request;
+	rec.value = value;
+	rec.index = index;
+
+	if (shim.replay)
+		return shim_replay_sync(&rec, data, length, NULL);
+
+	ret = libusb_control_transfer(devhdl, request_type, request, value,
+			index, data, length, timeout);
+
+	if (shim.record) {
+		rec.status = ret;
+		rec.length = MAX(ret, 0);
+		rec.data = data;
+		g_mutex_lock(&shim.mutex);
+		shim_write(&rec);
+		g_mutex_unlock(&shim.mutex);
+	}
+
+	return ret;
+}
+
+/**
+ * Perform a synchronous bulk transfer, like libusb_bulk_transfer().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_bulk_transfer(libusb_device_handle *devhdl,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout)
+{
+	struct shim_record rec;
+	int ret;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = SHIM_BULK;
+	rec.endpoint = endpoint;
+
+	if (shim.replay)
+		return shim_replay_sync(&rec, data, length, transferred);
+
+	ret = libusb_bulk_transfer(devhdl, endpoint, data, length,
+			transferred, timeout);
+
+	if (shim.record) {
+		rec.status = ret;
+		rec.length = transferred ? *transferred : 0;
+		rec.data = data;
+		g_mutex_lock(&shim.mutex);
+		shim_write(&rec);
+		g_mutex_unlock(&shim.mutex);
+	}
+
+	return ret;
+}
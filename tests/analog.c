@@ -86,6 +86,69 @@ START_TEST(test_analog_to_float)
 }
 END_TEST
 
+/* Check float and double samples with a scale, an offset and either byte order. */
+START_TEST(test_analog_to_float_scaled)
+{
+	int ret;
+	unsigned int i, b;
+	float f[4], fout[4];
+	double d[4];
+	uint8_t swapped[sizeof(d)];
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	const float v[] = {-12.5, 0, 3.25, 1000};
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = ARRAY_SIZE(v);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.scale.p = 3;
+	encoding.scale.q = 2;
+	encoding.offset.p = -1;
+	encoding.offset.q = 4;
+
+	for (i = 0; i < ARRAY_SIZE(v); i++) {
+		f[i] = v[i];
+		d[i] = v[i];
+	}
+
+	/* Native byte order. */
+	analog.data = f;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(v); i++)
+		fail_unless(fabs(fout[i] - (v[i] * 1.5 - 0.25)) <= 0.001,
+			"Sample %u: %f != %f", i, fout[i], v[i] * 1.5 - 0.25);
+
+	/* Foreign byte order. */
+	for (i = 0; i < ARRAY_SIZE(v); i++)
+		for (b = 0; b < sizeof(float); b++)
+			swapped[i * sizeof(float) + b] =
+				((uint8_t *)&f[i])[sizeof(float) - 1 - b];
+	encoding.is_bigendian = !encoding.is_bigendian;
+	analog.data = swapped;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(v); i++)
+		fail_unless(fabs(fout[i] - (v[i] * 1.5 - 0.25)) <= 0.001,
+			"Swapped sample %u: %f != %f", i, fout[i], v[i] * 1.5 - 0.25);
+	encoding.is_bigendian = !encoding.is_bigendian;
+
+	/* Doubles. */
+	encoding.unitsize = sizeof(double);
+	analog.data = d;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(v); i++)
+		fail_unless(fabs(fout[i] - (v[i] * 1.5 - 0.25)) <= 0.001,
+			"Double sample %u: %f != %f", i, fout[i], v[i] * 1.5 - 0.25);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
 START_TEST(test_analog_to_float_null)
 {
 	int ret;
@@ -196,6 +259,34 @@ START_TEST(test_set_rational_null)
 }
 END_TEST
 
+START_TEST(test_rational_mult)
+{
+	unsigned int i;
+	struct sr_rational r;
+	const struct sr_rational a[] = {{1, 32768}, {-4, 9}, {0, 5}, {INT64_MAX, 3}};
+	const struct sr_rational b[] = {{6, 4}, {3, 8}, {7, 3}, {3, INT64_MAX}};
+	const struct sr_rational res[] = {{3, 65536}, {-1, 6}, {0, 1}, {1, 1}};
+
+	for (i = 0; i < ARRAY_SIZE(a); i++) {
+		fail_unless(sr_rational_mult(&r, &a[i], &b[i]) == SR_OK);
+		fail_unless(r.p == res[i].p && r.q == res[i].q,
+			"Expected %" PRId64 "/%" PRIu64 ", got %" PRId64 "/%"
+			PRIu64 ".", res[i].p, res[i].q, r.p, r.q);
+	}
+}
+END_TEST
+
+START_TEST(test_rational_mult_overflow)
+{
+	struct sr_rational r;
+	const struct sr_rational a = {INT64_MAX, 1}, b = {2, 1}, z = {1, 0};
+
+	fail_unless(sr_rational_mult(&r, &a, &b) == SR_ERR_ARG);
+	fail_unless(sr_rational_mult(&r, &a, &z) == SR_ERR_ARG);
+	fail_unless(sr_rational_mult(NULL, &a, &b) == SR_ERR_ARG);
+}
+END_TEST
+
 Suite *suite_analog(void)
 {
 	Suite *s;
@@ -205,11 +296,14 @@ Suite *suite_analog(void)
 
 	tc = tcase_create("analog_to_float");
 	tcase_add_test(tc, test_analog_to_float);
+	tcase_add_test(tc, test_analog_to_float_scaled);
 	tcase_add_test(tc, test_analog_to_float_null);
 	tcase_add_test(tc, test_analog_unit_to_string);
 	tcase_add_test(tc, test_analog_unit_to_string_null);
 	tcase_add_test(tc, test_set_rational);
 	tcase_add_test(tc, test_set_rational_null);
+	tcase_add_test(tc, test_rational_mult);
+	tcase_add_test(tc, test_rational_mult_overflow);
 	suite_add_tcase(s, tc);
 
 	return s;
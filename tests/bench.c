@@ -0,0 +1,718 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Throughput benchmarks for the datafeed pipeline, run with "make bench".
+ * The SCPI stages fetch waveforms from a simulated instrument (see
+ * scpi_sim.h), the bytes counted being those of the parsed data.
+ *
+ * Every stage is fed the same synthetic data on every run, and is run a
+ * few times; the fastest run is reported. The output is one line per
+ * stage, with tab separated fields:
+ *
+ *   stage  bytes  seconds  MB/s  allocations
+ *
+ * The allocation count is that of the last run. Allocations are only
+ * counted with glibc, elsewhere the count is "-". Lines starting with
+ * '#' are comments.
+ *
+ * Stage names can be given on the command line to only run the stages
+ * starting with them, e.g. "bench output/ trigger".
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "scpi.h"
+#include "scpi_sim.h"
+
+#define BENCH_RUNS            3
+#define BENCH_CHUNKSIZE       (1024 * 1024)
+#define BENCH_SESSION_BYTES   (256 * 1024 * 1024)
+#define BENCH_OUTPUT_BYTES    (16 * 1024 * 1024)
+#define BENCH_INPUT_BYTES     (16 * 1024 * 1024)
+#define BENCH_ANALOG_SAMPLES  (16 * 1024 * 1024)
+#define BENCH_TRIGGER_BYTES   (64 * 1024 * 1024)
+#define BENCH_SCPI_POINTS     (128 * 1024)
+#define BENCH_SCPI_BYTES      (4 * 1024 * 1024)
+#define BENCH_CHANNELS        16
+#define BENCH_UNITSIZE        ((BENCH_CHANNELS + 7) / 8)
+
+/*
+ * glibc lets a program replace its allocator, and with it that of
+ * libsigrok and glib. Every entry point is replaced, the ones that
+ * aren't would still allocate without being counted.
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static volatile gint allocations;
+
+void *malloc(size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+	if (!(ptr = memalign(alignment, size)))
+		return ENOMEM;
+	*memptr = ptr;
+
+	return 0;
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+#define ALLOCATIONS() g_atomic_int_get(&allocations)
+#else
+#define ALLOCATIONS() -1
+#endif
+
+static const struct sr_test_hooks *hooks;
+static struct sr_context *ctx;
+static char **filters;
+/* BENCH_CHUNKSIZE bytes of random samples. */
+static uint8_t *logic_chunk;
+/* A device with BENCH_CHANNELS logic channels. */
+static struct sr_dev_inst *logic_sdi;
+
+static gboolean stage_selected(const char *name)
+{
+	int i;
+
+	if (!filters || !filters[0])
+		return TRUE;
+	for (i = 0; filters[i]; i++) {
+		if (g_str_has_prefix(name, filters[i]))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Run a stage a few times. The stage function returns the number of
+ * bytes it processed, or 0 if it failed.
+ */
+static void run_stage(const char *name, uint64_t (*fn)(void *), void *data)
+{
+	uint64_t bytes;
+	int64_t start, elapsed, best;
+	int i, allocs;
+	char count[16];
+
+	if (!stage_selected(name))
+		return;
+
+	bytes = 0;
+	best = G_MAXINT64;
+	allocs = -1;
+	for (i = 0; i < BENCH_RUNS; i++) {
+		allocs = ALLOCATIONS();
+		start = g_get_monotonic_time();
+		bytes = fn(data);
+		elapsed = g_get_monotonic_time() - start;
+		if (allocs >= 0)
+			allocs = ALLOCATIONS() - allocs;
+		if (!bytes) {
+			printf("# %s: failed\n", name);
+			return;
+		}
+		best = MIN(best, MAX(elapsed, 1));
+	}
+
+	if (allocs >= 0)
+		snprintf(count, sizeof(count), "%d", allocs);
+	else
+		strcpy(count, "-");
+	printf("%s\t%" PRIu64 "\t%.6f\t%.1f\t%s\n", name, bytes,
+		best / (double)G_USEC_PER_SEC, bytes / (double)best, count);
+	fflush(stdout);
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+
+	return *state;
+}
+
+static void fill_random(uint8_t *buf, size_t len)
+{
+	uint64_t state, r;
+	size_t i;
+
+	state = 0x2545f4914f6cdd1dULL;
+	r = 0;
+	for (i = 0; i < len; i++) {
+		if (i % sizeof(r) == 0)
+			r = xorshift64(&state);
+		buf[i] = r >> (8 * (i % sizeof(r)));
+	}
+}
+
+/*--- Session bus, fed by the demo driver ----------------------------------*/
+
+struct session_bench {
+	struct sr_dev_inst *sdi;
+	uint64_t bytes;
+};
+
+static void session_datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct session_bench *sb;
+	const struct sr_datafeed_logic *logic;
+
+	(void)sdi;
+
+	sb = cb_data;
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		sb->bytes += logic->length;
+	}
+}
+
+static uint64_t bench_session(void *data)
+{
+	struct session_bench *sb;
+	struct sr_session *session;
+
+	sb = data;
+	sb->bytes = 0;
+	sr_session_new(ctx, &session);
+	sr_session_dev_add(session, sb->sdi);
+	sr_session_datafeed_callback_add(session, session_datafeed_in, sb);
+	if (sr_session_start(session) == SR_OK)
+		sr_session_run(session);
+	sr_session_destroy(session);
+
+	return sb->bytes;
+}
+
+static void session_stages(void)
+{
+	struct sr_dev_driver **drivers, *driver;
+	struct session_bench sb;
+	struct sr_config *src;
+	GSList *devices, *options;
+	int i;
+
+	driver = NULL;
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers && drivers[i]; i++) {
+		if (!strcmp(drivers[i]->name, "demo"))
+			driver = drivers[i];
+	}
+	if (!driver || sr_driver_init(ctx, driver) != SR_OK) {
+		printf("# session/demo: no demo driver\n");
+		return;
+	}
+
+	options = NULL;
+	src = g_malloc(sizeof(struct sr_config));
+	src->key = SR_CONF_NUM_LOGIC_CHANNELS;
+	src->data = g_variant_new_int32(BENCH_CHANNELS);
+	options = g_slist_append(options, src);
+	src = g_malloc(sizeof(struct sr_config));
+	src->key = SR_CONF_NUM_ANALOG_CHANNELS;
+	src->data = g_variant_new_int32(0);
+	options = g_slist_append(options, src);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free_full(options, g_free);
+	if (!devices) {
+		printf("# session/demo: no demo device\n");
+		return;
+	}
+
+	sb.sdi = devices->data;
+	g_slist_free(devices);
+	sr_dev_open(sb.sdi);
+	sr_config_set(sb.sdi, NULL, SR_CONF_MAX_THROUGHPUT,
+		g_variant_new_boolean(TRUE));
+	sr_config_set(sb.sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(BENCH_SESSION_BYTES / BENCH_UNITSIZE));
+
+	sr_config_set(sb.sdi, NULL, SR_CONF_BUFFERSIZE,
+		g_variant_new_uint64(4096));
+	run_stage("session/demo-4k", bench_session, &sb);
+	sr_config_set(sb.sdi, NULL, SR_CONF_BUFFERSIZE,
+		g_variant_new_uint64(BENCH_CHUNKSIZE));
+	run_stage("session/demo-1m", bench_session, &sb);
+
+	sr_dev_close(sb.sdi);
+}
+
+/*--- Output modules --------------------------------------------------------*/
+
+static void output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	GString *out;
+
+	out = NULL;
+	sr_output_send(o, packet, &out);
+	if (out)
+		g_string_free(out, TRUE);
+}
+
+static uint64_t bench_output(void *data)
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_config src;
+	uint64_t bytes;
+
+	omod = data;
+	if (!(o = sr_output_new(omod, NULL, logic_sdi, NULL)))
+		return 0;
+
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	header.feed_version = 1;
+	gettimeofday(&header.starttime, NULL);
+	output_send(o, &packet);
+
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_new_uint64(SR_MHZ(1));
+	meta.config = g_slist_append(NULL, &src);
+	output_send(o, &packet);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = BENCH_UNITSIZE;
+	logic.length = BENCH_CHUNKSIZE;
+	for (bytes = 0; bytes < BENCH_OUTPUT_BYTES; bytes += logic.length) {
+		/* Some modules change the data. */
+		logic.data = g_memdup(logic_chunk, BENCH_CHUNKSIZE);
+		output_send(o, &packet);
+		g_free(logic.data);
+	}
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	output_send(o, &packet);
+	sr_output_free(o);
+
+	return bytes;
+}
+
+static void output_stages(void)
+{
+	const struct sr_output_module **omods;
+	char *name;
+	int i;
+
+	omods = sr_output_list();
+	for (i = 0; omods[i]; i++) {
+		/* Don't write files. */
+		if (sr_output_test_flag(omods[i], SR_OUTPUT_INTERNAL_IO_HANDLING))
+			continue;
+		name = g_strconcat("output/", sr_output_id_get(omods[i]), NULL);
+		run_stage(name, bench_output, (void *)omods[i]);
+		g_free(name);
+	}
+}
+
+/*--- Input modules ---------------------------------------------------------*/
+
+struct input_bench {
+	const char *id;
+	GString *data;
+};
+
+static void input_attach(const struct sr_input *in, struct sr_session *session,
+		gboolean *attached)
+{
+	struct sr_dev_inst *sdi;
+
+	if (*attached || !(sdi = sr_input_dev_inst_get(in)))
+		return;
+	sr_session_dev_add(session, sdi);
+	*attached = TRUE;
+}
+
+static uint64_t bench_input(void *data)
+{
+	struct input_bench *ib;
+	const struct sr_input_module *imod;
+	const struct sr_input *in;
+	struct sr_session *session;
+	GString *chunk;
+	gboolean attached;
+	gsize offset, len;
+	int ret;
+
+	ib = data;
+	if (!(imod = sr_input_find((char *)ib->id)))
+		return 0;
+	if (!(in = sr_input_new(imod, NULL)))
+		return 0;
+
+	sr_session_new(ctx, &session);
+	attached = FALSE;
+	ret = SR_OK;
+	chunk = g_string_sized_new(BENCH_CHUNKSIZE);
+	for (offset = 0; offset < ib->data->len && ret == SR_OK; offset += len) {
+		len = MIN(BENCH_CHUNKSIZE, ib->data->len - offset);
+		g_string_truncate(chunk, 0);
+		g_string_append_len(chunk, ib->data->str + offset, len);
+		input_attach(in, session, &attached);
+		ret = sr_input_send(in, chunk);
+		input_attach(in, session, &attached);
+	}
+	if (ret == SR_OK)
+		ret = sr_input_end(in);
+	g_string_free(chunk, TRUE);
+	sr_input_free(in);
+	sr_session_destroy(session);
+
+	return ret == SR_OK ? ib->data->len : 0;
+}
+
+static void input_stages(void)
+{
+	struct input_bench ib;
+	uint8_t *p;
+	int i;
+
+	ib.id = "binary";
+	ib.data = g_string_sized_new(BENCH_INPUT_BYTES);
+	for (i = 0; i < BENCH_INPUT_BYTES / BENCH_CHUNKSIZE; i++)
+		g_string_append_len(ib.data, (char *)logic_chunk, BENCH_CHUNKSIZE);
+	run_stage("input/binary", bench_input, &ib);
+	g_string_free(ib.data, TRUE);
+
+	/* One line per sample, a column per channel. */
+	ib.id = "csv";
+	ib.data = g_string_sized_new(BENCH_INPUT_BYTES);
+	for (p = logic_chunk; ib.data->len < BENCH_INPUT_BYTES; p++) {
+		if (p == logic_chunk + BENCH_CHUNKSIZE)
+			p = logic_chunk;
+		for (i = 0; i < 8; i++) {
+			g_string_append_c(ib.data, (*p & (1 << i)) ? '1' : '0');
+			g_string_append_c(ib.data, i < 7 ? ',' : '\n');
+		}
+	}
+	run_stage("input/csv", bench_input, &ib);
+	g_string_free(ib.data, TRUE);
+}
+
+/*--- Analog conversion -----------------------------------------------------*/
+
+struct analog_bench {
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	float *out;
+};
+
+static uint64_t bench_analog(void *data)
+{
+	struct analog_bench *ab;
+
+	ab = data;
+	if (sr_analog_to_float(&ab->analog, ab->out) != SR_OK)
+		return 0;
+
+	return ab->analog.num_samples * ab->encoding.unitsize;
+}
+
+static void analog_stages(void)
+{
+	struct analog_bench ab;
+	float *in;
+	int i;
+
+	memset(&ab, 0, sizeof(ab));
+	ab.analog.encoding = &ab.encoding;
+	ab.analog.meaning = &ab.meaning;
+	ab.analog.spec = &ab.spec;
+	ab.analog.num_samples = BENCH_ANALOG_SAMPLES;
+	ab.meaning.mq = SR_MQ_VOLTAGE;
+	ab.meaning.unit = SR_UNIT_VOLT;
+	ab.meaning.channels = g_slist_append(NULL,
+		sr_dev_inst_channels_get(logic_sdi)->data);
+	ab.encoding.scale.p = ab.encoding.scale.q = 1;
+	ab.encoding.offset.p = 0;
+	ab.encoding.offset.q = 1;
+	ab.out = g_malloc(BENCH_ANALOG_SAMPLES * sizeof(float));
+
+	in = g_malloc(BENCH_ANALOG_SAMPLES * sizeof(float));
+	for (i = 0; i < BENCH_ANALOG_SAMPLES; i++)
+		in[i] = logic_chunk[i % BENCH_CHUNKSIZE] / 25.6f - 5.0f;
+	ab.analog.data = in;
+	ab.encoding.unitsize = sizeof(float);
+	ab.encoding.is_signed = TRUE;
+	ab.encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	ab.encoding.is_bigendian = TRUE;
+#endif
+	run_stage("analog/float", bench_analog, &ab);
+	g_free(in);
+
+	/* 8-bit ADC samples, as sent by the fx2lafw MSO devices. */
+	in = g_malloc(BENCH_ANALOG_SAMPLES);
+	for (i = 0; i < BENCH_ANALOG_SAMPLES / BENCH_CHUNKSIZE; i++)
+		memcpy((uint8_t *)in + i * BENCH_CHUNKSIZE, logic_chunk,
+			BENCH_CHUNKSIZE);
+	ab.analog.data = in;
+	ab.encoding.unitsize = 1;
+	ab.encoding.is_signed = FALSE;
+	ab.encoding.is_float = FALSE;
+	ab.encoding.is_bigendian = FALSE;
+	ab.encoding.scale.p = 5;
+	ab.encoding.scale.q = 64;
+	ab.encoding.offset.p = -10;
+	run_stage("analog/u8", bench_analog, &ab);
+	g_free(in);
+
+	g_free(ab.out);
+	g_slist_free(ab.meaning.channels);
+}
+
+/*--- Soft trigger ----------------------------------------------------------*/
+
+static uint64_t bench_trigger(void *data)
+{
+	struct soft_trigger_logic *stl;
+	uint8_t *buf;
+	uint64_t bytes;
+	int pre_trigger_samples;
+
+	/* D0 is always low, so the trigger never fires. */
+	buf = g_memdup(logic_chunk, BENCH_CHUNKSIZE);
+	for (bytes = 0; bytes < BENCH_CHUNKSIZE; bytes += BENCH_UNITSIZE)
+		buf[bytes] &= ~1;
+
+	stl = hooks->soft_trigger_logic_new(logic_sdi, data, 0);
+	for (bytes = 0; bytes < BENCH_TRIGGER_BYTES; bytes += BENCH_CHUNKSIZE) {
+		if (hooks->soft_trigger_logic_check(stl, buf, BENCH_CHUNKSIZE,
+				&pre_trigger_samples) != -1)
+			break;
+	}
+	hooks->soft_trigger_logic_free(stl);
+	g_free(buf);
+
+	return bytes;
+}
+
+static void trigger_stages(void)
+{
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	GSList *channels;
+
+	channels = sr_dev_inst_channels_get(logic_sdi);
+
+	trigger = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(trigger);
+	sr_trigger_match_add(stage, channels->data, SR_TRIGGER_ONE, 0);
+	run_stage("trigger/soft-level", bench_trigger, trigger);
+	sr_trigger_free(trigger);
+
+	trigger = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(trigger);
+	sr_trigger_match_add(stage, channels->next->data, SR_TRIGGER_RISING, 0);
+	sr_trigger_match_add(stage, channels->data, SR_TRIGGER_ONE, 0);
+	run_stage("trigger/soft-edge", bench_trigger, trigger);
+	sr_trigger_free(trigger);
+}
+
+/*--- SCPI transfers, from the simulated instrument -----------------------*/
+
+/* The simulator needs POSIX ptys and sockets. */
+#ifndef _WIN32
+
+static uint64_t bench_scpi_ascii(void *data)
+{
+	GArray *points;
+	uint64_t bytes;
+
+	if (hooks->scpi_get_floatv(data, ":CHAN1:DATA?", &points) != SR_OK)
+		return 0;
+	bytes = points->len * sizeof(float);
+	g_array_free(points, TRUE);
+
+	return bytes;
+}
+
+static uint64_t bench_scpi_block(void *data)
+{
+	uint8_t *buf;
+	int ret;
+
+	buf = g_malloc(BENCH_SCPI_BYTES);
+	ret = hooks->scpi_get_block(data, ":POD1:DATA?", buf, BENCH_SCPI_BYTES);
+	g_free(buf);
+
+	return ret > 0 ? (uint64_t)ret : 0;
+}
+
+static void scpi_stages(void)
+{
+	struct scpi_sim *sim;
+	struct sr_scpi_dev_inst *scpi;
+	char *script, *conn;
+
+	sim = scpi_sim_new();
+	script = g_strdup_printf("ascii :CHAN1:DATA? %d\n"
+		"block :POD1:DATA? %d\n", BENCH_SCPI_POINTS, BENCH_SCPI_BYTES);
+	scpi_sim_load(sim, script);
+	g_free(script);
+	if (scpi_sim_start(sim) != SR_OK) {
+		printf("# scpi: no simulator\n");
+		scpi_sim_free(sim);
+		return;
+	}
+
+	conn = g_strdup_printf("tcp-raw/127.0.0.1/%d", scpi_sim_port(sim));
+	scpi = hooks->scpi_dev_inst_new(NULL, conn, NULL);
+	g_free(conn);
+	if (scpi && hooks->scpi_open(scpi) == SR_OK) {
+		run_stage("scpi/tcp-ascii", bench_scpi_ascii, scpi);
+		run_stage("scpi/tcp-block", bench_scpi_block, scpi);
+		hooks->scpi_close(scpi);
+	}
+	if (scpi)
+		hooks->scpi_free(scpi);
+
+	/* Binary blocks don't survive the serial transport's '\n' handling. */
+	scpi = NULL;
+	if (scpi_sim_pty(sim))
+		scpi = hooks->scpi_dev_inst_new(NULL, scpi_sim_pty(sim),
+			"115200/8n1");
+	if (scpi && hooks->scpi_open(scpi) == SR_OK) {
+		run_stage("scpi/serial-ascii", bench_scpi_ascii, scpi);
+		hooks->scpi_close(scpi);
+	}
+	if (scpi)
+		hooks->scpi_free(scpi);
+
+	scpi_sim_free(sim);
+}
+
+#else
+
+static void scpi_stages(void)
+{
+	printf("# scpi: no simulator\n");
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+	char name[16];
+	int i;
+
+	(void)argc;
+
+	filters = argv + 1;
+	hooks = sr_test_hooks_get();
+
+	if (sr_init(&ctx) != SR_OK) {
+		fprintf(stderr, "Failed to initialize libsigrok.\n");
+		return EXIT_FAILURE;
+	}
+
+	logic_chunk = g_malloc(BENCH_CHUNKSIZE);
+	fill_random(logic_chunk, BENCH_CHUNKSIZE);
+	logic_sdi = sr_dev_inst_user_new("sigrok", "Benchmark", NULL);
+	for (i = 0; i < BENCH_CHANNELS; i++) {
+		snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(logic_sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+
+	printf("# libsigrok %s\n", sr_lib_version_string_get());
+	printf("# stage\tbytes\tseconds\tMB/s\tallocations\n");
+
+	session_stages();
+	output_stages();
+	input_stages();
+	analog_stages();
+	trigger_stages();
+	scpi_stages();
+
+	hooks->dev_inst_free(logic_sdi);
+	g_free(logic_chunk);
+	sr_exit(ctx);
+
+	return EXIT_SUCCESS;
+}
@@ -49,10 +49,16 @@ Suite *suite_input_binary(void);
 Suite *suite_output_all(void);
 Suite *suite_transform_all(void);
 Suite *suite_session(void);
+Suite *suite_session_driver(void);
+Suite *suite_scan(void);
 Suite *suite_strutil(void);
 Suite *suite_version(void);
 Suite *suite_device(void);
 Suite *suite_trigger(void);
 Suite *suite_analog(void);
+Suite *suite_logic(void);
+Suite *suite_scpi(void);
+Suite *suite_serial(void);
+Suite *suite_usb(void);
 
 #endif
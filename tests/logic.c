@@ -0,0 +1,138 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/*
+ * Check every edge of a stream against a sample-by-sample comparison,
+ * feeding it in packets of varying size.
+ */
+static void check_edges(uint16_t unitsize, const uint8_t *data,
+		uint64_t num_samples)
+{
+	struct sr_logic_edges *edges;
+	struct sr_datafeed_logic logic;
+	const struct sr_logic_edge *result;
+	const uint8_t *cur, *prev;
+	size_t num_edges, i;
+	uint64_t pos, len, expect, total, num_changes;
+	unsigned int j;
+
+	edges = sr_logic_edges_new();
+	fail_unless(edges != NULL);
+
+	expect = total = 0;
+	for (pos = 0; pos < num_samples; pos += len) {
+		len = MIN(1 + pos % 37, num_samples - pos);
+		logic.length = len * unitsize;
+		logic.unitsize = unitsize;
+		logic.data = (void *)(data + pos * unitsize);
+		fail_unless(sr_logic_edges_find(edges, &logic, &result,
+			&num_edges) == SR_OK);
+		for (i = 0; i < num_edges; i++) {
+			/* Skip over the samples that didn't change. */
+			while (expect > 0 && expect < num_samples && !memcmp(
+					data + expect * unitsize,
+					data + (expect - 1) * unitsize, unitsize))
+				expect++;
+			fail_unless(result[i].sample == expect,
+				"Expected edge at %" PRIu64 ", got %" PRIu64 ".",
+				expect, result[i].sample);
+			cur = data + expect * unitsize;
+			prev = expect ? cur - unitsize : NULL;
+			fail_unless(!memcmp(result[i].value, cur, unitsize));
+			for (j = 0; j < unitsize; j++) {
+				fail_unless(result[i].changed[j] ==
+					(prev ? (cur[j] ^ prev[j]) : 0xff));
+			}
+			expect++;
+		}
+		total += num_edges;
+	}
+
+	/* None may be missing, the first sample counts as one. */
+	num_changes = 1;
+	for (pos = 1; pos < num_samples; pos++) {
+		if (memcmp(data + pos * unitsize, data + (pos - 1) * unitsize,
+				unitsize))
+			num_changes++;
+	}
+	fail_unless(total == num_changes, "Found %" PRIu64 " edges instead "
+		"of %" PRIu64 ".", total, num_changes);
+
+	sr_logic_edges_free(edges);
+}
+
+/* Check sr_logic_edges_find() for all the unit sizes it treats differently. */
+START_TEST(test_logic_edges)
+{
+	static const uint16_t unitsizes[] = { 1, 2, 3, 4, 8, 9 };
+	uint8_t *data;
+	unsigned int i, u;
+	const unsigned int num_samples = 2000;
+
+	data = g_malloc(num_samples * 9);
+	for (u = 0; u < G_N_ELEMENTS(unitsizes); u++) {
+		for (i = 0; i < num_samples * unitsizes[u]; i++)
+			data[i] = (i / unitsizes[u]) % 13 ? 0x5a : (uint8_t)rand();
+		/* An edge on the very last sample. */
+		memset(data + (num_samples - 1) * unitsizes[u], 0xa5,
+			unitsizes[u]);
+		check_edges(unitsizes[u], data, num_samples);
+	}
+	g_free(data);
+}
+END_TEST
+
+START_TEST(test_logic_edges_null)
+{
+	struct sr_logic_edges *edges;
+	struct sr_datafeed_logic logic = { 0, 0, NULL };
+	const struct sr_logic_edge *result;
+	size_t num_edges;
+
+	edges = sr_logic_edges_new();
+	fail_unless(sr_logic_edges_find(NULL, &logic, &result, &num_edges) == SR_ERR_ARG);
+	fail_unless(sr_logic_edges_find(edges, NULL, &result, &num_edges) == SR_ERR_ARG);
+	fail_unless(sr_logic_edges_find(edges, &logic, &result, &num_edges) == SR_ERR_ARG);
+	sr_logic_edges_free(edges);
+	sr_logic_edges_free(NULL);
+}
+END_TEST
+
+Suite *suite_logic(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("logic");
+
+	tc = tcase_create("edges");
+	tcase_add_test(tc, test_logic_edges);
+	tcase_add_test(tc, test_logic_edges_null);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -41,11 +41,23 @@ int main(void)
 	srunner_add_suite(srunner, suite_output_all());
 	srunner_add_suite(srunner, suite_transform_all());
 	srunner_add_suite(srunner, suite_session());
+	srunner_add_suite(srunner, suite_session_driver());
+	srunner_add_suite(srunner, suite_scan());
 	srunner_add_suite(srunner, suite_strutil());
 	srunner_add_suite(srunner, suite_version());
 	srunner_add_suite(srunner, suite_device());
 	srunner_add_suite(srunner, suite_trigger());
 	srunner_add_suite(srunner, suite_analog());
+	srunner_add_suite(srunner, suite_logic());
+#ifndef _WIN32
+	srunner_add_suite(srunner, suite_scpi());
+#endif
+#ifdef HAVE_LIBSERIALPORT
+	srunner_add_suite(srunner, suite_serial());
+#endif
+#ifdef HAVE_LIBUSB_1_0
+	srunner_add_suite(srunner, suite_usb());
+#endif
 
 	srunner_run_all(srunner, CK_VERBOSE);
 	ret = srunner_ntests_failed(srunner);
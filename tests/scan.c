@@ -0,0 +1,400 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define NUM_PORTS 4
+
+/*
+ * A serial driver like the SCPI ones: without SR_CONF_CONN it finds a
+ * device on a port of its own accord (fake1), otherwise it finds one on
+ * every port it's given. Lower ports answer later, so the probes finish
+ * in the reverse order of the ports.
+ */
+
+static const uint32_t fake_scanopts[] = {
+	SR_CONF_CONN,
+	SR_CONF_SERIALCOMM,
+};
+
+static const struct sr_test_hooks *hooks;
+static int fake_probes[NUM_PORTS];
+
+static GSList *fake_scan(struct sr_dev_driver *di, GSList *options)
+{
+	struct drv_context *drvc;
+	struct sr_dev_inst *sdi;
+	struct sr_config *src;
+	const char *conn;
+	GSList *l;
+	int port;
+
+	conn = NULL;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_CONN)
+			conn = g_variant_get_string(src->data, NULL);
+	}
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INACTIVE;
+	sdi->inst_type = SR_INST_SCPI;
+	sdi->vendor = g_strdup("Fake");
+	sdi->driver = di;
+	if (conn) {
+		port = conn[strlen(conn) - 1] - '0';
+		g_atomic_int_inc(&fake_probes[port]);
+		/* Waiting for an answer, other probes may run meanwhile. */
+		hooks->scan_io_begin();
+		g_usleep((NUM_PORTS - port) * 20000);
+		hooks->scan_io_end();
+		sdi->model = g_strdup(conn);
+		sdi->connection_id = g_strdup(conn);
+	} else {
+		sdi->model = g_strdup("enumerated");
+		sdi->connection_id = g_strdup("/dev/fake1:9600/8n1");
+	}
+
+	drvc = di->context;
+	drvc->instances = g_slist_append(drvc->instances, sdi);
+
+	return g_slist_append(NULL, sdi);
+}
+
+static int fake_init(struct sr_dev_driver *di, struct sr_context *sr_ctx)
+{
+	return hooks->std_init(di, sr_ctx);
+}
+
+static int fake_cleanup(const struct sr_dev_driver *di)
+{
+	return hooks->std_cleanup(di);
+}
+
+static GSList *fake_dev_list(const struct sr_dev_driver *di)
+{
+	return hooks->std_dev_list(di);
+}
+
+static int fake_dev_clear(const struct sr_dev_driver *di)
+{
+	return hooks->std_dev_clear(di, NULL);
+}
+
+static int fake_config_list(uint32_t key, GVariant **data,
+		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	(void)sdi;
+	(void)cg;
+
+	if (key != SR_CONF_SCAN_OPTIONS)
+		return SR_ERR_NA;
+
+	*data = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32,
+		fake_scanopts, ARRAY_SIZE(fake_scanopts), sizeof(uint32_t));
+
+	return SR_OK;
+}
+
+static struct sr_dev_driver fake_driver = {
+	.name = "fake-serial",
+	.longname = "Fake serial driver",
+	.api_version = 1,
+	.init = fake_init,
+	.cleanup = fake_cleanup,
+	.scan = fake_scan,
+	.dev_list = fake_dev_list,
+	.dev_clear = fake_dev_clear,
+	.config_list = fake_config_list,
+	.context = NULL,
+};
+
+/*
+ * A driver that doesn't take SR_CONF_CONN, but whose devices have a
+ * connection the scan cache could record.
+ */
+
+static int enum_scans;
+static gboolean enum_conn;
+
+static GSList *enum_scan(struct sr_dev_driver *di, GSList *options)
+{
+	struct drv_context *drvc;
+	struct sr_dev_inst *sdi;
+	GSList *l;
+
+	enum_scans++;
+	for (l = options; l; l = l->next) {
+		if (((struct sr_config *)l->data)->key == SR_CONF_CONN)
+			enum_conn = TRUE;
+	}
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INACTIVE;
+	sdi->inst_type = SR_INST_SCPI;
+	sdi->vendor = g_strdup("Fake");
+	sdi->model = g_strdup("enumerated");
+	sdi->connection_id = g_strdup("/dev/fake3");
+	sdi->driver = di;
+
+	drvc = di->context;
+	drvc->instances = g_slist_append(drvc->instances, sdi);
+
+	return g_slist_append(NULL, sdi);
+}
+
+static int enum_config_list(uint32_t key, GVariant **data,
+		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	(void)sdi;
+	(void)cg;
+
+	if (key != SR_CONF_SCAN_OPTIONS)
+		return SR_ERR_NA;
+
+	*data = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32,
+		NULL, 0, sizeof(uint32_t));
+
+	return SR_OK;
+}
+
+static struct sr_dev_driver enum_driver = {
+	.name = "fake-enum",
+	.longname = "Fake enumerating driver",
+	.api_version = 1,
+	.init = fake_init,
+	.cleanup = fake_cleanup,
+	.scan = enum_scan,
+	.dev_list = fake_dev_list,
+	.dev_clear = fake_dev_clear,
+	.config_list = enum_config_list,
+	.context = NULL,
+};
+
+static char *cache_file;
+
+static void setup(void)
+{
+	hooks = sr_test_hooks_get();
+	srtest_setup();
+	fail_unless(sr_driver_init(srtest_ctx, &fake_driver) == SR_OK);
+	srtest_driver_init(srtest_ctx, srtest_driver_get("demo"));
+	memset(fake_probes, 0, sizeof(fake_probes));
+}
+
+static void teardown(void)
+{
+	fake_driver.cleanup(&fake_driver);
+	fake_driver.context = NULL;
+	srtest_teardown();
+}
+
+static void cache_setup(void)
+{
+	int fd;
+
+	setup();
+	fail_unless(sr_driver_init(srtest_ctx, &enum_driver) == SR_OK);
+	enum_scans = 0;
+	enum_conn = FALSE;
+
+	fd = g_file_open_tmp("sigrok-scan-XXXXXX", &cache_file, NULL);
+	fail_unless(fd >= 0);
+	close(fd);
+	g_unlink(cache_file);
+	fail_unless(sr_scan_cache_set_file(srtest_ctx, cache_file) == SR_OK);
+}
+
+static void cache_teardown(void)
+{
+	sr_scan_cache_set_file(srtest_ctx, NULL);
+	g_unlink(cache_file);
+	g_free(cache_file);
+	enum_driver.cleanup(&enum_driver);
+	enum_driver.context = NULL;
+	teardown();
+}
+
+static const int max_threads[] = { 0, 1, 2 };
+
+/*
+ * The devices come in the order of the drivers, and of the ports, no
+ * matter which probe finishes first. A port a driver found a device on
+ * by itself isn't probed again.
+ */
+START_TEST(test_scan_ports_order)
+{
+	struct sr_dev_driver *drivers[3];
+	struct sr_dev_inst *sdi;
+	GSList *ports, *devices, *l;
+	static const char *expected[] = {
+		"enumerated", "/dev/fake0", "/dev/fake2", "/dev/fake3", NULL,
+	};
+	char name[16];
+	unsigned int i;
+
+	drivers[0] = &fake_driver;
+	drivers[1] = srtest_driver_get("demo");
+	drivers[2] = NULL;
+
+	ports = NULL;
+	for (i = 0; i < NUM_PORTS; i++) {
+		snprintf(name, sizeof(name), "/dev/fake%u", i);
+		ports = g_slist_append(ports, g_strdup(name));
+	}
+
+	devices = hooks->driver_scan_ports(drivers, NULL, ports,
+			max_threads[_i], 5000);
+	fail_unless(g_slist_length(devices) == ARRAY_SIZE(expected),
+		"Found %u devices.", g_slist_length(devices));
+	l = devices;
+	for (i = 0; l && i < ARRAY_SIZE(expected); i++, l = l->next) {
+		sdi = l->data;
+		if (expected[i]) {
+			fail_unless(sdi->driver == &fake_driver);
+			fail_unless(!strcmp(sdi->model, expected[i]),
+				"Device %u is %s, expected %s.", i,
+				sdi->model, expected[i]);
+		} else {
+			fail_unless(sdi->driver == drivers[1],
+				"Device %u is not the demo device.", i);
+		}
+	}
+	fail_unless(fake_probes[1] == 0, "The claimed port was probed.");
+	fail_unless(fake_probes[0] == 1 && fake_probes[2] == 1
+		&& fake_probes[3] == 1);
+
+	g_slist_free(devices);
+	g_slist_free_full(ports, g_free);
+}
+END_TEST
+
+/* With SR_CONF_CONN, only that connection is probed. */
+START_TEST(test_scan_ports_conn)
+{
+	struct sr_dev_driver *drivers[2];
+	struct sr_dev_inst *sdi;
+	struct sr_config src;
+	GSList *ports, *devices, *options;
+
+	drivers[0] = &fake_driver;
+	drivers[1] = NULL;
+
+	ports = g_slist_append(NULL, "/dev/fake0");
+	src.key = SR_CONF_CONN;
+	src.data = g_variant_new_string("/dev/fake2");
+	options = g_slist_append(NULL, &src);
+
+	devices = hooks->driver_scan_ports(drivers, options, ports, 0, 5000);
+	fail_unless(g_slist_length(devices) == 1);
+	sdi = devices->data;
+	fail_unless(!strcmp(sdi->model, "/dev/fake2"));
+	fail_unless(fake_probes[0] == 0 && fake_probes[2] == 1);
+
+	g_slist_free(devices);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	g_slist_free(ports);
+}
+END_TEST
+
+/* A cached device is probed on its connection, with its parameters. */
+START_TEST(test_scan_cache_conn)
+{
+	struct sr_dev_inst *sdi;
+	GSList *devices;
+	GKeyFile *keyfile;
+
+	devices = sr_driver_scan(&fake_driver, NULL);
+	fail_unless(g_slist_length(devices) == 1);
+	g_slist_free(devices);
+	fail_unless(fake_probes[1] == 0);
+
+	devices = sr_driver_scan(&fake_driver, NULL);
+	fail_unless(g_slist_length(devices) == 1);
+	sdi = devices->data;
+	fail_unless(!strcmp(sdi->model, "/dev/fake1"),
+		"Found %s instead of the cached device.", sdi->model);
+	fail_unless(fake_probes[1] == 1);
+	g_slist_free(devices);
+
+	keyfile = g_key_file_new();
+	fail_unless(g_key_file_load_from_file(keyfile, cache_file,
+		G_KEY_FILE_NONE, NULL));
+	fail_unless(g_key_file_has_key(keyfile, "fake-serial", "/dev/fake1",
+		NULL));
+	g_key_file_free(keyfile);
+}
+END_TEST
+
+/* Drivers that don't take SR_CONF_CONN always do a full scan. */
+START_TEST(test_scan_cache_no_conn)
+{
+	GSList *devices;
+	GKeyFile *keyfile;
+	unsigned int i;
+
+	for (i = 0; i < 2; i++) {
+		devices = sr_driver_scan(&enum_driver, NULL);
+		fail_unless(g_slist_length(devices) == 1);
+		g_slist_free(devices);
+	}
+	fail_unless(enum_scans == 2);
+	fail_unless(!enum_conn, "The driver was passed SR_CONF_CONN.");
+
+	keyfile = g_key_file_new();
+	if (g_key_file_load_from_file(keyfile, cache_file, G_KEY_FILE_NONE,
+			NULL))
+		fail_unless(!g_key_file_has_group(keyfile, "fake-enum"));
+	g_key_file_free(keyfile);
+}
+END_TEST
+
+Suite *suite_scan(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("scan");
+
+	tc = tcase_create("parallel");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_loop_test(tc, test_scan_ports_order, 0,
+		ARRAY_SIZE(max_threads));
+	tcase_add_test(tc, test_scan_ports_conn);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("cache");
+	tcase_add_checked_fixture(tc, cache_setup, cache_teardown);
+	tcase_add_test(tc, test_scan_cache_conn);
+	tcase_add_test(tc, test_scan_cache_no_conn);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
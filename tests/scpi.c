@@ -0,0 +1,217 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+#include "scpi_sim.h"
+
+#ifndef _WIN32
+
+/* A 4 channel HAMEG scope, with channel 1 enabled. */
+static const char hmo2024_script[] =
+	"*IDN? HAMEG,HMO2024,012345678,05.886\n"
+	":CHAN1:STAT? 1\n"
+	":CHAN2:STAT? 0\n"
+	":CHAN3:STAT? 0\n"
+	":CHAN4:STAT? 0\n"
+	":CHAN1:SCAL? 1.000E-01\n"
+	":CHAN2:SCAL? 1.000E-01\n"
+	":CHAN3:SCAL? 1.000E-01\n"
+	":CHAN4:SCAL? 1.000E-01\n"
+	":CHAN1:POS? 0.000E+00\n"
+	":CHAN2:POS? 0.000E+00\n"
+	":CHAN3:POS? 0.000E+00\n"
+	":CHAN4:POS? 0.000E+00\n"
+	":CHAN1:COUP? DC\n"
+	":CHAN2:COUP? DC\n"
+	":CHAN3:COUP? DC\n"
+	":CHAN4:COUP? DC\n"
+	":LOG0:STAT? 0\n"
+	":LOG1:STAT? 0\n"
+	":LOG2:STAT? 0\n"
+	":LOG3:STAT? 0\n"
+	":LOG4:STAT? 0\n"
+	":LOG5:STAT? 0\n"
+	":LOG6:STAT? 0\n"
+	":LOG7:STAT? 0\n"
+	":POD1:STAT? 0\n"
+	":TIM:SCAL? 1.000E-03\n"
+	":TIM:POS? 0.000E+00\n"
+	":TRIG:A:SOUR? CH2\n"
+	":TRIG:A:EDGE:SLOP? POS\n"
+	":ACQ:SRAT? 1.000E+09\n"
+	":CHAN1:DATA:POINTS? 6000\n"
+	"ascii :CHAN1:DATA? 6000\n";
+
+static struct scpi_sim *sim;
+static struct sr_dev_driver *driver;
+static struct sr_dev_inst *sdi;
+
+/* Open the simulated scope with the hameg-hmo driver, if it's built. */
+static void setup(void)
+{
+	struct sr_dev_driver **drivers;
+	struct sr_config src;
+	GSList *devices, *options;
+	char *conn;
+	int i, ret;
+
+	srtest_setup();
+
+	drivers = sr_driver_list(srtest_ctx);
+	for (i = 0; drivers[i]; i++) {
+		if (!strcmp(drivers[i]->name, "hameg-hmo"))
+			driver = drivers[i];
+	}
+	if (!driver)
+		return;
+
+	sim = scpi_sim_new();
+	fail_unless(scpi_sim_load(sim, hmo2024_script) == SR_OK);
+	fail_unless(scpi_sim_start(sim) == SR_OK,
+		"Failed to start the SCPI simulator.");
+
+	ret = sr_driver_init(srtest_ctx, driver);
+	fail_unless(ret == SR_OK, "Failed to init driver: %d.", ret);
+
+	conn = g_strdup_printf("tcp-raw/127.0.0.1/%d", scpi_sim_port(sim));
+	src.key = SR_CONF_CONN;
+	src.data = g_variant_new_string(conn);
+	options = g_slist_append(NULL, &src);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	g_free(conn);
+
+	fail_unless(g_slist_length(devices) == 1,
+		"The simulated scope wasn't found.");
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	ret = sr_dev_open(sdi);
+	fail_unless(ret == SR_OK, "Failed to open the device: %d.", ret);
+}
+
+static void teardown(void)
+{
+	if (sdi)
+		sr_dev_close(sdi);
+	sdi = NULL;
+	driver = NULL;
+	srtest_teardown();
+	scpi_sim_free(sim);
+	sim = NULL;
+}
+
+static void check_timebase(uint64_t p, uint64_t q)
+{
+	GVariant *data;
+	uint64_t tb_p, tb_q;
+	int ret;
+
+	ret = sr_config_get(driver, sdi, NULL, SR_CONF_TIMEBASE, &data);
+	fail_unless(ret == SR_OK, "Failed to get the timebase: %d.", ret);
+	g_variant_get(data, "(tt)", &tb_p, &tb_q);
+	g_variant_unref(data);
+	fail_unless(tb_p == p && tb_q == q, "Wrong timebase %" PRIu64
+		"/%" PRIu64 ", expected %" PRIu64 "/%" PRIu64 ".",
+		tb_p, tb_q, p, q);
+}
+
+/* Check whether the scope's identity and settings are read on open. */
+START_TEST(test_hmo_open)
+{
+	GVariant *data;
+	int ret;
+
+	if (!driver)
+		return;
+
+	fail_unless(!strcmp(sr_dev_inst_vendor_get(sdi), "HAMEG"));
+	fail_unless(!strcmp(sr_dev_inst_model_get(sdi), "HMO2024"));
+
+	check_timebase(1, 1000);
+
+	ret = sr_config_get(driver, sdi, NULL, SR_CONF_TRIGGER_SOURCE, &data);
+	fail_unless(ret == SR_OK, "Failed to get the trigger source: %d.", ret);
+	fail_unless(!strcmp(g_variant_get_string(data, NULL), "CH2"));
+	g_variant_unref(data);
+}
+END_TEST
+
+/* Check whether polling the settings is answered from the cache. */
+START_TEST(test_hmo_poll)
+{
+	unsigned int queries;
+	int i;
+
+	if (!driver)
+		return;
+
+	queries = scpi_sim_num_queries(sim);
+	for (i = 0; i < 100; i++)
+		check_timebase(1, 1000);
+	fail_unless(scpi_sim_num_queries(sim) == queries,
+		"Polling caused %u queries.", scpi_sim_num_queries(sim) - queries);
+}
+END_TEST
+
+/* Check whether a changed setting is read back from the device. */
+START_TEST(test_hmo_set)
+{
+	unsigned int queries;
+	int ret;
+
+	if (!driver)
+		return;
+
+	ret = sr_config_set(sdi, NULL, SR_CONF_TIMEBASE,
+		g_variant_new("(tt)", (uint64_t)10, (uint64_t)1000));
+	fail_unless(ret == SR_OK, "Failed to set the timebase: %d.", ret);
+
+	queries = scpi_sim_num_queries(sim);
+	check_timebase(10, 1000);
+	fail_unless(scpi_sim_num_queries(sim) > queries,
+		"The timebase wasn't read back.");
+}
+END_TEST
+
+Suite *suite_scpi(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("scpi");
+
+	tc = tcase_create("hameg-hmo");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_hmo_open);
+	tcase_add_test(tc, test_hmo_poll);
+	tcase_add_test(tc, test_hmo_set);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+#endif
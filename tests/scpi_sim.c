@@ -0,0 +1,505 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/* Uses POSIX ptys and sockets, there's no simulator on Windows. */
+#ifndef _WIN32
+
+/* posix_openpt() and friends. */
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "scpi_sim.h"
+
+/* Period of the simulated waveforms, in samples. */
+#define WAVE_PERIOD 100
+
+enum {
+	RESPONSE_TEXT,
+	RESPONSE_ASCII,
+	RESPONSE_BLOCK,
+};
+
+struct sim_response {
+	int type;
+	char *text;
+	unsigned long size;
+};
+
+struct sim_port {
+	int fd;
+	gboolean is_socket;
+	GString *input;
+};
+
+struct scpi_sim {
+	/* Upper case query -> struct sim_response. */
+	GHashTable *responses;
+	unsigned int latency_ms;
+	int listen_fd;
+	int port;
+	struct sim_port client;
+	struct sim_port pty;
+	int pty_slave_fd;
+	char *pty_path;
+	int wakeup[2];
+	GThread *thread;
+	gint num_queries;
+};
+
+static void response_free(struct sim_response *response)
+{
+	g_free(response->text);
+	g_free(response);
+}
+
+static void response_set(struct scpi_sim *sim, const char *query, int type,
+		const char *text, unsigned long size)
+{
+	struct sim_response *response;
+
+	response = g_malloc0(sizeof(struct sim_response));
+	response->type = type;
+	response->text = g_strdup(text);
+	response->size = size;
+	g_hash_table_replace(sim->responses, g_ascii_strup(query, -1), response);
+}
+
+struct scpi_sim *scpi_sim_new(void)
+{
+	struct scpi_sim *sim;
+
+	sim = g_malloc0(sizeof(struct scpi_sim));
+	sim->responses = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)response_free);
+	sim->listen_fd = -1;
+	sim->client.fd = -1;
+	sim->client.is_socket = TRUE;
+	sim->client.input = g_string_new(NULL);
+	sim->pty.fd = -1;
+	sim->pty.input = g_string_new(NULL);
+	sim->pty_slave_fd = -1;
+	sim->wakeup[0] = sim->wakeup[1] = -1;
+
+	/* Drivers wait for this after most commands. */
+	response_set(sim, "*OPC?", RESPONSE_TEXT, "1", 0);
+
+	return sim;
+}
+
+static int load_line(struct scpi_sim *sim, char *line)
+{
+	char **tokens;
+	int ret;
+
+	line = g_strstrip(line);
+	if (!line[0] || line[0] == '#')
+		return SR_OK;
+
+	ret = SR_OK;
+	tokens = g_strsplit_set(line, " \t", 2);
+	if (!tokens[1]) {
+		ret = SR_ERR_ARG;
+	} else if (!strcmp(tokens[0], "latency")) {
+		sim->latency_ms = strtoul(tokens[1], NULL, 10);
+	} else if (!strcmp(tokens[0], "ascii") || !strcmp(tokens[0], "block")) {
+		g_strfreev(tokens);
+		tokens = g_strsplit_set(line, " \t", 3);
+		if (!tokens[1] || !tokens[2])
+			ret = SR_ERR_ARG;
+		else
+			response_set(sim, tokens[1],
+				tokens[0][0] == 'a' ? RESPONSE_ASCII : RESPONSE_BLOCK,
+				NULL, strtoul(tokens[2], NULL, 10));
+	} else if (g_str_has_suffix(tokens[0], "?")) {
+		response_set(sim, tokens[0], RESPONSE_TEXT,
+			g_strstrip(tokens[1]), 0);
+	} else {
+		ret = SR_ERR_ARG;
+	}
+	g_strfreev(tokens);
+
+	if (ret != SR_OK)
+		fprintf(stderr, "scpi-sim: Invalid script line '%s'.\n", line);
+
+	return ret;
+}
+
+/* Load a script, see scpi_sim.h. Must be done before scpi_sim_start(). */
+int scpi_sim_load(struct scpi_sim *sim, const char *script)
+{
+	char **lines;
+	int i, ret;
+
+	ret = SR_OK;
+	lines = g_strsplit(script, "\n", 0);
+	for (i = 0; lines[i] && ret == SR_OK; i++)
+		ret = load_line(sim, lines[i]);
+	g_strfreev(lines);
+
+	return ret;
+}
+
+int scpi_sim_load_file(struct scpi_sim *sim, const char *filename)
+{
+	char *script;
+	GError *error;
+	int ret;
+
+	error = NULL;
+	if (!g_file_get_contents(filename, &script, NULL, &error)) {
+		fprintf(stderr, "scpi-sim: %s\n", error->message);
+		g_error_free(error);
+		return SR_ERR_IO;
+	}
+	ret = scpi_sim_load(sim, script);
+	g_free(script);
+
+	return ret;
+}
+
+static int triangle(unsigned long i)
+{
+	i %= WAVE_PERIOD;
+
+	return i < WAVE_PERIOD / 2 ? i : WAVE_PERIOD - i;
+}
+
+static void response_append(GByteArray *out, const struct sim_response *response)
+{
+	char header[16], value[G_ASCII_DTOSTR_BUF_SIZE];
+	unsigned long i;
+	uint8_t sample;
+
+	switch (response->type) {
+	case RESPONSE_TEXT:
+		g_byte_array_append(out, (const guint8 *)response->text,
+			strlen(response->text));
+		break;
+	case RESPONSE_ASCII:
+		/* Volts, from -1 to 1. */
+		for (i = 0; i < response->size; i++) {
+			if (i > 0)
+				g_byte_array_append(out, (const guint8 *)",", 1);
+			g_ascii_formatd(value, sizeof(value), "%.4E",
+				triangle(i) * 4.0 / WAVE_PERIOD - 1.0);
+			g_byte_array_append(out, (const guint8 *)value,
+				strlen(value));
+		}
+		break;
+	case RESPONSE_BLOCK:
+		g_snprintf(header, sizeof(header), "#9%09lu", response->size);
+		g_byte_array_append(out, (const guint8 *)header, strlen(header));
+		for (i = 0; i < response->size; i++) {
+			sample = 28 + 4 * triangle(i);
+			g_byte_array_append(out, &sample, 1);
+		}
+		break;
+	}
+}
+
+/* Handle one program message, which may be a compound command. */
+static void handle_message(struct scpi_sim *sim, struct sim_port *port,
+		const char *message)
+{
+	struct sim_response *response;
+	GByteArray *out;
+	char **commands, *command, *args, *key;
+	gboolean answered;
+	int i, ret;
+
+	out = g_byte_array_new();
+	answered = FALSE;
+
+	commands = g_strsplit(message, ";", 0);
+	for (i = 0; commands[i]; i++) {
+		command = g_strstrip(commands[i]);
+		if (!command[0])
+			continue;
+		if ((args = strpbrk(command, " \t")))
+			*args++ = '\0';
+		if (g_str_has_suffix(command, "?")) {
+			key = g_ascii_strup(command, -1);
+			response = g_hash_table_lookup(sim->responses, key);
+			g_free(key);
+			if (!response) {
+				fprintf(stderr, "scpi-sim: Unknown query '%s'.\n",
+					command);
+				continue;
+			}
+			g_atomic_int_inc(&sim->num_queries);
+			if (answered)
+				g_byte_array_append(out, (const guint8 *)";", 1);
+			response_append(out, response);
+			answered = TRUE;
+		} else if (args) {
+			/* A setting, which its query reports from now on. */
+			key = g_strconcat(command, "?", NULL);
+			response_set(sim, key, RESPONSE_TEXT, g_strstrip(args), 0);
+			g_free(key);
+		}
+	}
+	g_strfreev(commands);
+
+	if (answered) {
+		g_byte_array_append(out, (const guint8 *)"\n", 1);
+		if (sim->latency_ms)
+			g_usleep(sim->latency_ms * 1000);
+		for (i = 0; (unsigned int)i < out->len; i += ret) {
+			if (port->is_socket)
+				ret = send(port->fd, out->data + i, out->len - i,
+					MSG_NOSIGNAL);
+			else
+				ret = write(port->fd, out->data + i, out->len - i);
+			if (ret < 0 && errno == EINTR) {
+				ret = 0;
+			} else if (ret < 0) {
+				fprintf(stderr, "scpi-sim: Write error: %s\n",
+					g_strerror(errno));
+				break;
+			}
+		}
+	}
+
+	g_byte_array_free(out, TRUE);
+}
+
+/* Read what's there, and handle all messages which are complete. */
+static gboolean port_read(struct scpi_sim *sim, struct sim_port *port)
+{
+	char buf[4096], *start, *end;
+	ssize_t len;
+
+	if ((len = read(port->fd, buf, sizeof(buf))) <= 0)
+		return FALSE;
+	g_string_append_len(port->input, buf, len);
+
+	start = port->input->str;
+	while ((end = memchr(start, '\n', port->input->str
+			+ port->input->len - start))) {
+		*end = '\0';
+		if (end > start && end[-1] == '\r')
+			end[-1] = '\0';
+		handle_message(sim, port, start);
+		start = end + 1;
+	}
+	g_string_erase(port->input, 0, start - port->input->str);
+
+	return TRUE;
+}
+
+static gpointer sim_thread(gpointer data)
+{
+	struct scpi_sim *sim;
+	struct pollfd fds[4];
+	int num_fds, fd;
+
+	sim = data;
+
+	while (TRUE) {
+		num_fds = 0;
+		fds[num_fds].fd = sim->wakeup[0];
+		fds[num_fds++].events = POLLIN;
+		fds[num_fds].fd = sim->listen_fd;
+		fds[num_fds++].events = POLLIN;
+		fds[num_fds].fd = sim->pty.fd;
+		fds[num_fds++].events = POLLIN;
+		fds[num_fds].fd = sim->client.fd;
+		fds[num_fds++].events = POLLIN;
+
+		if (poll(fds, num_fds, -1) < 0 && errno != EINTR)
+			break;
+
+		if (fds[0].revents)
+			break;
+
+		if (fds[1].revents & POLLIN) {
+			if ((fd = accept(sim->listen_fd, NULL, NULL)) >= 0) {
+				/* One client at a time, like most instruments. */
+				if (sim->client.fd >= 0)
+					close(sim->client.fd);
+				sim->client.fd = fd;
+				g_string_truncate(sim->client.input, 0);
+			}
+		}
+
+		if (fds[2].revents & POLLIN)
+			port_read(sim, &sim->pty);
+
+		if (sim->client.fd >= 0 && fds[3].revents
+				&& !port_read(sim, &sim->client)) {
+			close(sim->client.fd);
+			sim->client.fd = -1;
+		}
+	}
+
+	return NULL;
+}
+
+static int listen_tcp(struct scpi_sim *sim)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+
+	if ((sim->listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return SR_ERR;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	addrlen = sizeof(addr);
+	if (bind(sim->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(sim->listen_fd, 1) < 0
+			|| getsockname(sim->listen_fd, (struct sockaddr *)&addr,
+				&addrlen) < 0) {
+		fprintf(stderr, "scpi-sim: Can't listen: %s\n", g_strerror(errno));
+		return SR_ERR;
+	}
+	sim->port = ntohs(addr.sin_port);
+
+	return SR_OK;
+}
+
+static int open_pty(struct scpi_sim *sim)
+{
+	struct termios tio;
+	const char *path;
+
+	if ((sim->pty.fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0
+			|| grantpt(sim->pty.fd) < 0 || unlockpt(sim->pty.fd) < 0
+			|| !(path = ptsname(sim->pty.fd))) {
+		fprintf(stderr, "scpi-sim: Can't open pty: %s\n",
+			g_strerror(errno));
+		return SR_ERR;
+	}
+	sim->pty_path = g_strdup(path);
+
+	/*
+	 * Keep the slave open, so the pty stays usable between clients, and
+	 * make it raw, so nothing is echoed or translated before they set it
+	 * up themselves.
+	 */
+	if ((sim->pty_slave_fd = open(path, O_RDWR | O_NOCTTY)) < 0
+			|| tcgetattr(sim->pty_slave_fd, &tio) < 0)
+		return SR_ERR;
+	tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR
+			| ICRNL | IXON);
+	tio.c_oflag &= ~OPOST;
+	tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	tio.c_cflag &= ~(CSIZE | PARENB);
+	tio.c_cflag |= CS8;
+	if (tcsetattr(sim->pty_slave_fd, TCSANOW, &tio) < 0)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+/* Start answering on a TCP port and a pty, in a thread of its own. */
+int scpi_sim_start(struct scpi_sim *sim)
+{
+	GError *error;
+
+	if (pipe(sim->wakeup) < 0)
+		return SR_ERR;
+
+	if (listen_tcp(sim) != SR_OK)
+		return SR_ERR;
+
+	/* The simulator is still useful over TCP without a pty. */
+	if (open_pty(sim) != SR_OK) {
+		g_free(sim->pty_path);
+		sim->pty_path = NULL;
+	}
+
+	error = NULL;
+	if (!(sim->thread = g_thread_try_new("scpi-sim", sim_thread, sim,
+			&error))) {
+		fprintf(stderr, "scpi-sim: %s\n", error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+int scpi_sim_port(const struct scpi_sim *sim)
+{
+	return sim->port;
+}
+
+/* The path of the pty, or NULL if there is none. */
+const char *scpi_sim_pty(const struct scpi_sim *sim)
+{
+	return sim->pty_path;
+}
+
+/* The number of queries answered so far. */
+unsigned int scpi_sim_num_queries(struct scpi_sim *sim)
+{
+	return g_atomic_int_get(&sim->num_queries);
+}
+
+static void close_fd(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+void scpi_sim_free(struct scpi_sim *sim)
+{
+	if (!sim)
+		return;
+
+	if (sim->thread) {
+		if (write(sim->wakeup[1], "", 1) < 0)
+			fprintf(stderr, "scpi-sim: Can't stop: %s\n",
+				g_strerror(errno));
+		g_thread_join(sim->thread);
+	}
+
+	close_fd(sim->wakeup[0]);
+	close_fd(sim->wakeup[1]);
+	close_fd(sim->listen_fd);
+	close_fd(sim->client.fd);
+	close_fd(sim->pty.fd);
+	close_fd(sim->pty_slave_fd);
+	g_string_free(sim->client.input, TRUE);
+	g_string_free(sim->pty.input, TRUE);
+	g_free(sim->pty_path);
+	g_hash_table_destroy(sim->responses);
+	g_free(sim);
+}
+
+#endif
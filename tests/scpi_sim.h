@@ -0,0 +1,55 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LIBSIGROK_TESTS_SCPI_SIM_H
+#define LIBSIGROK_TESTS_SCPI_SIM_H
+
+/*
+ * A simulated SCPI instrument, for testing and benchmarking SCPI drivers
+ * without the hardware. It listens on a local TCP port (connect with
+ * "tcp-raw/127.0.0.1/<port>") and on a pty (connect with its path as a
+ * serial port), and answers queries from a script.
+ *
+ * A script has one directive per line, '#' starts a comment:
+ *
+ *   <query>? <response>     Answer the query with the response.
+ *   ascii <query>? <n>      Answer with n comma separated floats.
+ *   block <query>? <n>      Answer with a definite length block of n bytes.
+ *   latency <ms>            Wait this long before each response.
+ *
+ * Waveforms are a triangle wave. Queries are matched without regard to case.
+ * A command without a '?' sets the response of the matching query, so
+ * ":CHAN1:STAT 0" makes ":CHAN1:STAT?" answer "0" from then on. Compound
+ * commands (":A?;:B?") are answered with the responses joined by ';'.
+ * Unknown queries aren't answered, as with a real instrument.
+ */
+
+struct scpi_sim;
+
+struct scpi_sim *scpi_sim_new(void);
+int scpi_sim_load(struct scpi_sim *sim, const char *script);
+int scpi_sim_load_file(struct scpi_sim *sim, const char *filename);
+int scpi_sim_start(struct scpi_sim *sim);
+int scpi_sim_port(const struct scpi_sim *sim);
+const char *scpi_sim_pty(const struct scpi_sim *sim);
+unsigned int scpi_sim_num_queries(struct scpi_sim *sim);
+void scpi_sim_free(struct scpi_sim *sim);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Run the SCPI simulator with a script, for use with sigrok-cli or any
+ * other frontend, e.g.:
+ *
+ *   $ tests/scpi-sim rigol-ds1054z.txt
+ *   tcp-raw/127.0.0.1/41235
+ *   /dev/pts/7
+ *   $ sigrok-cli -d rigol-ds:conn=tcp-raw/127.0.0.1/41235 --frames 10
+ *
+ * It runs until it is killed.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "scpi_sim.h"
+
+int main(int argc, char **argv)
+{
+	struct scpi_sim *sim;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <script>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	sim = scpi_sim_new();
+	if (scpi_sim_load_file(sim, argv[1]) != SR_OK
+			|| scpi_sim_start(sim) != SR_OK) {
+		scpi_sim_free(sim);
+		return EXIT_FAILURE;
+	}
+
+	printf("tcp-raw/127.0.0.1/%d\n", scpi_sim_port(sim));
+	if (scpi_sim_pty(sim))
+		printf("%s\n", scpi_sim_pty(sim));
+	fflush(stdout);
+
+	while (TRUE)
+		g_usleep(G_USEC_PER_SEC);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#ifdef HAVE_LIBSERIALPORT
+
+/*
+ * A made up protocol: a 0xaa header, two data bytes, their sum and an LF.
+ * The LF is the scanner's sync byte, but may also be a data byte.
+ */
+#define PACKET_SIZE 5
+
+static gboolean packet_valid(const uint8_t *buf)
+{
+	return buf[0] == 0xaa && buf[3] == (uint8_t)(buf[1] + buf[2])
+		&& buf[4] == '\n';
+}
+
+#define PACKET(a, b) "\xaa" a b
+
+static const char *packets[] = {
+	PACKET("\x01", "\x02") "\x03\n",
+	/* The sync byte as data. */
+	PACKET("\n", "\n") "\x14\n",
+	PACKET("\xff", "\x01") "\x00\n",
+	PACKET("\x10", "\x20") "\x30\n",
+};
+
+static const struct sr_test_hooks *hooks;
+static struct serial_packet_scanner scanner;
+static GString *found;
+static unsigned int num_found, stop_after;
+
+static gboolean packet_found(const uint8_t *buf, void *cb_data)
+{
+	(void)cb_data;
+
+	g_string_append_len(found, (const char *)buf, PACKET_SIZE);
+	num_found++;
+
+	return num_found != stop_after;
+}
+
+static void setup(void)
+{
+	hooks = sr_test_hooks_get();
+	fail_unless(hooks->serial_packet_scanner_init(&scanner, PACKET_SIZE,
+		packet_valid, PACKET_SIZE - 1, '\n') == SR_OK);
+	found = g_string_new(NULL);
+	num_found = stop_after = 0;
+}
+
+static void teardown(void)
+{
+	g_string_free(found, TRUE);
+}
+
+/* Feed the data in pieces of the given size. */
+static int feed(const GString *data, size_t piece)
+{
+	size_t offset, len;
+	int ret, total;
+
+	total = 0;
+	for (offset = 0; offset < data->len; offset += len) {
+		len = MIN(piece, data->len - offset);
+		ret = hooks->serial_packet_scanner_feed(&scanner,
+			(const uint8_t *)data->str + offset, len,
+			packet_found, NULL);
+		fail_unless(ret >= 0, "Feeding the scanner failed: %d.", ret);
+		total += ret;
+	}
+
+	return total;
+}
+
+/* The packets, with garbage before, in between and after them. */
+static GString *stream_new(void)
+{
+	GString *s;
+	unsigned int i;
+
+	s = g_string_new(NULL);
+	for (i = 0; i < ARRAY_SIZE(packets); i++) {
+		/* Looks like a packet, with a bad checksum. */
+		g_string_append_len(s, PACKET("\x01", "\x02") "\x04\n", 5);
+		g_string_append_len(s, "\n\n\xaa", 3);
+		g_string_append_len(s, packets[i], PACKET_SIZE);
+	}
+	g_string_append_len(s, "\xaa\x01\n", 3);
+
+	return s;
+}
+
+static void check_found(unsigned int first, unsigned int count)
+{
+	unsigned int i;
+
+	fail_unless(num_found == count, "Found %u packets, expected %u.",
+		num_found, count);
+	for (i = 0; i < count; i++)
+		fail_unless(!memcmp(found->str + i * PACKET_SIZE,
+			packets[first + i], PACKET_SIZE),
+			"Packet %u is wrong.", i);
+}
+
+/* Only the valid packets are found in garbage. */
+START_TEST(test_scanner_garbage)
+{
+	GString *s;
+
+	s = stream_new();
+	fail_unless(feed(s, s->len) == ARRAY_SIZE(packets));
+	check_found(0, ARRAY_SIZE(packets));
+	/* The start of a packet is kept for the next call. */
+	fail_unless(scanner.buflen < PACKET_SIZE);
+	g_string_free(s, TRUE);
+}
+END_TEST
+
+/* Packets are found however the data is split up. */
+START_TEST(test_scanner_split)
+{
+	GString *s;
+
+	s = stream_new();
+	/* Pieces of 1 to 2 packets, and more. */
+	fail_unless(feed(s, 1 + _i) == ARRAY_SIZE(packets),
+		"Wrong packets with pieces of %d bytes.", 1 + _i);
+	check_found(0, ARRAY_SIZE(packets));
+	g_string_free(s, TRUE);
+}
+END_TEST
+
+/*
+ * A sync byte in the wrong place makes the scanner look at the wrong
+ * offset; the packet still has to be found where it really is.
+ */
+START_TEST(test_scanner_misplaced_sync)
+{
+	GString *s;
+
+	s = g_string_new(NULL);
+	/* A partial packet that ends in the sync byte. */
+	g_string_append_len(s, "\xaa\x01\n", 3);
+	g_string_append_len(s, packets[1], PACKET_SIZE);
+	/* Sync bytes where the header should be. */
+	g_string_append_len(s, "\n\n\n\n", 4);
+	g_string_append_len(s, packets[2], PACKET_SIZE);
+	fail_unless(feed(s, s->len) == 2);
+	check_found(1, 2);
+	g_string_free(s, TRUE);
+}
+END_TEST
+
+/* More data than the scanner's buffer can hold at once. */
+START_TEST(test_scanner_large)
+{
+	GString *s, *expected;
+	unsigned int i, count;
+
+	count = 3 * SERIAL_SCANNER_BUFSIZE / PACKET_SIZE;
+	s = g_string_new("\n\xaa");
+	expected = g_string_new(NULL);
+	for (i = 0; i < count; i++) {
+		g_string_append_len(s, packets[i % ARRAY_SIZE(packets)],
+			PACKET_SIZE);
+		g_string_append_len(expected, packets[i % ARRAY_SIZE(packets)],
+			PACKET_SIZE);
+	}
+	fail_unless(feed(s, s->len) == (int)count);
+	fail_unless(found->len == expected->len
+		&& !memcmp(found->str, expected->str, found->len));
+	g_string_free(s, TRUE);
+	g_string_free(expected, TRUE);
+}
+END_TEST
+
+/* When the callback stops the scan, the rest is kept for later. */
+START_TEST(test_scanner_stop)
+{
+	GString *s;
+
+	s = stream_new();
+	stop_after = 1;
+	fail_unless(feed(s, s->len) == 1);
+	check_found(0, 1);
+	fail_unless(hooks->serial_packet_scanner_feed(&scanner, NULL, 0,
+		packet_found, NULL) == ARRAY_SIZE(packets) - 1);
+	check_found(0, ARRAY_SIZE(packets));
+	g_string_free(s, TRUE);
+}
+END_TEST
+
+/* Without a sync byte, every offset is tried. */
+START_TEST(test_scanner_no_sync)
+{
+	GString *s;
+
+	fail_unless(hooks->serial_packet_scanner_init(&scanner, PACKET_SIZE,
+		packet_valid, -1, 0) == SR_OK);
+	s = stream_new();
+	fail_unless(feed(s, 1 + _i) == ARRAY_SIZE(packets));
+	check_found(0, ARRAY_SIZE(packets));
+	g_string_free(s, TRUE);
+}
+END_TEST
+
+Suite *suite_serial(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("serial");
+
+	tc = tcase_create("scanner");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_scanner_garbage);
+	tcase_add_loop_test(tc, test_scanner_split, 0, 2 * PACKET_SIZE + 3);
+	tcase_add_test(tc, test_scanner_misplaced_sync);
+	tcase_add_test(tc, test_scanner_large);
+	tcase_add_test(tc, test_scanner_stop);
+	tcase_add_loop_test(tc, test_scanner_no_sync, 0, PACKET_SIZE);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+#endif
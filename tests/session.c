@@ -20,6 +20,9 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -186,6 +189,324 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+/*
+ * Check whether sr_session_record_start() refuses bogus parameters.
+ * If it returns SR_OK (or segfaults) this test will fail.
+ */
+START_TEST(test_session_record_start_bogus)
+{
+	int ret;
+	struct sr_session *sess;
+
+	ret = sr_session_record_start(NULL, "foo.bin", 0);
+	fail_unless(ret != SR_OK, "sr_session_record_start(NULL) worked.");
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_record_start(sess, NULL, 0);
+	fail_unless(ret != SR_OK, "sr_session_record_start() with NULL "
+		"filename worked.");
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/*
+ * Check whether sr_session_record_stop() refuses sessions that aren't
+ * being recorded.
+ */
+START_TEST(test_session_record_stop_bogus)
+{
+	int ret;
+	struct sr_session *sess;
+
+	ret = sr_session_record_stop(NULL);
+	fail_unless(ret != SR_OK, "sr_session_record_stop(NULL) worked.");
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_record_stop(sess);
+	fail_unless(ret != SR_OK, "sr_session_record_stop() without "
+		"recorder worked.");
+	sr_session_destroy(sess);
+}
+END_TEST
+
+static char *record_file;
+static uint64_t record_feed_bytes;
+static int record_feed_ends;
+
+static void record_setup(void)
+{
+	int fd;
+
+	srtest_setup();
+
+	fd = g_file_open_tmp("sigrok-test-XXXXXX.bin", &record_file, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	close(fd);
+}
+
+static void record_teardown(void)
+{
+	char *metafile;
+
+	metafile = g_strconcat(record_file, ".metadata", NULL);
+	g_unlink(metafile);
+	g_free(metafile);
+	g_unlink(record_file);
+	g_free(record_file);
+	record_file = NULL;
+
+	srtest_teardown();
+}
+
+/* A demo device with 8 logic channels counting up, and no analog ones. */
+static struct sr_dev_inst *record_demo_new(void)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_channel_group *cg;
+	struct sr_config *src;
+	GSList *devices, *options;
+	int ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+
+	src = g_malloc(sizeof(struct sr_config));
+	src->key = SR_CONF_NUM_ANALOG_CHANNELS;
+	src->data = g_variant_new_int32(0);
+	options = g_slist_append(NULL, src);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free_full(options, g_free);
+	fail_unless(devices != NULL, "No demo device found.");
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	ret = sr_dev_open(sdi);
+	fail_unless(ret == SR_OK, "Failed to open the demo device: %d.", ret);
+	cg = sr_dev_inst_channel_groups_get(sdi)->data;
+	ret = sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+		g_variant_new_string("incremental"));
+	fail_unless(ret == SR_OK, "Failed to set the pattern: %d.", ret);
+	sr_config_set(sdi, NULL, SR_CONF_MAX_THROUGHPUT,
+		g_variant_new_boolean(TRUE));
+
+	return sdi;
+}
+
+static void record_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		record_feed_bytes += logic->length;
+	} else if (packet->type == SR_DF_END) {
+		record_feed_ends++;
+	}
+}
+
+/* Run one acquisition, the logic data reaching the session is counted. */
+static void record_run(struct sr_session *sess)
+{
+	int ret;
+
+	record_feed_bytes = 0;
+	record_feed_ends = 0;
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "Failed to start the session: %d.", ret);
+	ret = sr_session_run(sess);
+	fail_unless(ret == SR_OK, "Failed to run the session: %d.", ret);
+	fail_unless(record_feed_ends == 1, "Expected one SR_DF_END, got %d.",
+		record_feed_ends);
+}
+
+/*
+ * Check the recorded file against the demo's incrementing pattern, with
+ * sample 'first' at its start.
+ */
+static void record_check_file(uint64_t first, uint64_t num_samples)
+{
+	gchar *data;
+	gsize len, i;
+
+	fail_unless(g_file_get_contents(record_file, &data, &len, NULL));
+	fail_unless(len == num_samples, "Recorded %" G_GSIZE_FORMAT
+		" samples instead of %" PRIu64 ".", len, num_samples);
+	for (i = 0; i < len; i++) {
+		if ((uint8_t)data[i] != (uint8_t)(first + i))
+			break;
+	}
+	fail_unless(i == len, "Sample %" G_GSIZE_FORMAT " is 0x%02x.",
+		i, (uint8_t)data[MIN(i, len - 1)]);
+	g_free(data);
+}
+
+/* Check the metadata written next to the samples. */
+static void record_check_metadata(const struct sr_dev_inst *sdi,
+		uint64_t num_samples, const uint64_t *triggers,
+		gsize num_triggers)
+{
+	GKeyFile *meta;
+	GVariant *gvar;
+	char *metafile, *s, *rate, **list;
+	gsize len, i;
+
+	meta = g_key_file_new();
+	metafile = g_strconcat(record_file, ".metadata", NULL);
+	fail_unless(g_key_file_load_from_file(meta, metafile, 0, NULL),
+		"Failed to load '%s'.", metafile);
+	g_free(metafile);
+
+	s = g_key_file_get_string(meta, "device 1", "capturefile", NULL);
+	fail_unless(s && !strcmp(s, "logic-1"), "Wrong capture file.");
+	g_free(s);
+	fail_unless(g_key_file_get_integer(meta, "device 1", "unitsize", NULL) == 1);
+	fail_unless(g_key_file_get_integer(meta, "device 1", "total probes", NULL) == 8);
+	fail_unless(g_key_file_get_integer(meta, "device 1", "total analog", NULL) == 0);
+	s = g_key_file_get_string(meta, "device 1", "probe1", NULL);
+	fail_unless(s && !strcmp(s, "D0"), "Wrong name for the first channel.");
+	g_free(s);
+
+	fail_unless(sr_config_get(sr_dev_inst_driver_get(sdi), sdi, NULL,
+		SR_CONF_SAMPLERATE, &gvar) == SR_OK);
+	rate = sr_samplerate_string(g_variant_get_uint64(gvar));
+	g_variant_unref(gvar);
+	s = g_key_file_get_string(meta, "device 1", "samplerate", NULL);
+	fail_unless(s && !strcmp(s, rate), "Samplerate '%s' instead of '%s'.",
+		s, rate);
+	g_free(s);
+	g_free(rate);
+
+	fail_unless(g_key_file_get_uint64(meta, "record", "samples", NULL)
+		== num_samples, "Wrong number of samples in the metadata.");
+	list = g_key_file_get_string_list(meta, "record", "triggers", &len, NULL);
+	if (!list)
+		len = 0;
+	fail_unless(len == num_triggers, "%" G_GSIZE_FORMAT " triggers "
+		"instead of %" G_GSIZE_FORMAT ".", len, num_triggers);
+	for (i = 0; i < MIN(len, num_triggers); i++)
+		fail_unless(g_ascii_strtoull(list[i], NULL, 10) == triggers[i],
+			"Trigger %" G_GSIZE_FORMAT " at sample %s.", i, list[i]);
+	g_strfreev(list);
+
+	g_key_file_free(meta);
+}
+
+/*
+ * Record a continuous acquisition: it must stop at the recorder's limit,
+ * which falls in the middle of a packet, and no logic data may reach the
+ * session.
+ */
+START_TEST(test_session_record_limit)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	int ret;
+
+	sdi = record_demo_new();
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, record_datafeed, NULL);
+
+	ret = sr_session_record_start(sess, record_file, 100003);
+	fail_unless(ret == SR_OK, "Failed to start recording: %d.", ret);
+	record_run(sess);
+	fail_unless(record_feed_bytes == 0, "Recorded logic data reached "
+		"the session.");
+	ret = sr_session_record_stop(sess);
+	fail_unless(ret == SR_OK, "Failed to stop recording: %d.", ret);
+
+	record_check_file(0, 100003);
+	record_check_metadata(sdi, 100003, NULL, 0);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/*
+ * Record an acquisition with a soft trigger on D7 rising, which happens
+ * at sample 128. The 10% of the samples before it come first.
+ */
+START_TEST(test_session_record_trigger)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	struct sr_channel *ch;
+	const uint64_t trigger_pos = 100;
+	int ret;
+
+	sdi = record_demo_new();
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(1000));
+	ret = sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+		g_variant_new_uint64(10));
+	fail_unless(ret == SR_OK, "Failed to set the capture ratio: %d.", ret);
+
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, record_datafeed, NULL);
+	trigger = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(trigger);
+	ch = g_slist_nth_data(sr_dev_inst_channels_get(sdi), 7);
+	sr_trigger_match_add(stage, ch, SR_TRIGGER_RISING, 0);
+	sr_session_trigger_set(sess, trigger);
+
+	ret = sr_session_record_start(sess, record_file, 0);
+	fail_unless(ret == SR_OK, "Failed to start recording: %d.", ret);
+	record_run(sess);
+	ret = sr_session_record_stop(sess);
+	fail_unless(ret == SR_OK, "Failed to stop recording: %d.", ret);
+
+	record_check_file(128 - trigger_pos, 1000);
+	record_check_metadata(sdi, 1000, &trigger_pos, 1);
+
+	sr_session_destroy(sess);
+	sr_trigger_free(trigger);
+}
+END_TEST
+
+/*
+ * Once the recorded acquisition has ended, the next one must reach the
+ * session as usual, and leave the file alone.
+ */
+START_TEST(test_session_record_once)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	int ret;
+
+	sdi = record_demo_new();
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(5000));
+
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, record_datafeed, NULL);
+
+	ret = sr_session_record_start(sess, record_file, 0);
+	fail_unless(ret == SR_OK, "Failed to start recording: %d.", ret);
+	record_run(sess);
+	fail_unless(record_feed_bytes == 0, "Recorded logic data reached "
+		"the session.");
+	record_run(sess);
+	fail_unless(record_feed_bytes == 5000, "%" PRIu64 " bytes of logic "
+		"data reached the session after recording.", record_feed_bytes);
+	ret = sr_session_record_stop(sess);
+	fail_unless(ret == SR_OK, "Failed to stop recording: %d.", ret);
+
+	record_check_file(0, 5000);
+	record_check_metadata(sdi, 5000, NULL, 0);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -210,5 +531,18 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("record");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_record_start_bogus);
+	tcase_add_test(tc, test_session_record_stop_bogus);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("record_demo");
+	tcase_add_checked_fixture(tc, record_setup, record_teardown);
+	tcase_add_test(tc, test_session_record_limit);
+	tcase_add_test(tc, test_session_record_trigger);
+	tcase_add_test(tc, test_session_record_once);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
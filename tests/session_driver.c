@@ -0,0 +1,681 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Round trips through session files: a capture is written with the
+ * 'srzip' output module, replayed by the session driver, and the samples
+ * that come out are compared with the ones that went in.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <zip.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define SAMPLERATE SR_MHZ(1)
+#define MAX_ANALOG 12
+
+/* Samples per block in which the session driver interleaves its tracks. */
+#define REPLAY_BLOCK (512 * 1024 / sizeof(float))
+
+/* A capture, as written to a session file. */
+struct capture {
+	unsigned int unitsize;
+	uint64_t num_samples;
+	uint8_t *logic;
+	unsigned int num_analog;
+	uint64_t num_analog_samples;
+	float *analog[MAX_ANALOG];
+};
+
+static char *filename;
+
+/* What came out of the replay. */
+static GByteArray *replay_logic;
+static GArray *replay_analog[MAX_ANALOG];
+static unsigned int replay_num_logic;
+static int replay_ends;
+static gboolean replay_interleaved;
+
+static int num_errors;
+
+static void setup(void)
+{
+	int fd;
+
+	srtest_setup();
+
+	fd = g_file_open_tmp("sigrok-test-XXXXXX.sr", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	close(fd);
+}
+
+static void teardown(void)
+{
+	g_unlink(filename);
+	g_free(filename);
+	filename = NULL;
+
+	sr_log_callback_set_default();
+	srtest_teardown();
+}
+
+static struct capture *capture_new(unsigned int unitsize,
+		uint64_t num_samples, unsigned int num_analog,
+		uint64_t num_analog_samples)
+{
+	struct capture *cap;
+	uint64_t i;
+	unsigned int c;
+
+	fail_unless(num_analog <= MAX_ANALOG);
+
+	cap = g_malloc0(sizeof(struct capture));
+	cap->unitsize = unitsize;
+	cap->num_samples = num_samples;
+	cap->logic = g_malloc(num_samples * unitsize);
+	for (i = 0; i < num_samples * unitsize; i++)
+		cap->logic[i] = (i * 2654435761u) >> 24;
+
+	cap->num_analog = num_analog;
+	cap->num_analog_samples = num_analog_samples;
+	for (c = 0; c < num_analog; c++) {
+		cap->analog[c] = g_malloc(num_analog_samples * sizeof(float));
+		for (i = 0; i < num_analog_samples; i++)
+			cap->analog[c][i] = (i % 65536) + c * 0.25;
+	}
+
+	return cap;
+}
+
+static void capture_free(struct capture *cap)
+{
+	unsigned int c;
+
+	for (c = 0; c < cap->num_analog; c++)
+		g_free(cap->analog[c]);
+	g_free(cap->logic);
+	g_free(cap);
+}
+
+static void output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	GString *out;
+	int ret;
+
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "Failed to write packet type %d: %d.",
+		packet->type, ret);
+	if (out)
+		g_string_free(out, TRUE);
+}
+
+/*
+ * Write the capture with the 'srzip' output, one chunk per packet of
+ * 'chunk_samples' samples, logic and analog channels taking turns.
+ */
+static void capture_write(const struct capture *cap, uint64_t chunk_samples)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_config src;
+	struct sr_channel *analog_channels[MAX_ANALOG];
+	uint64_t pos, n;
+	unsigned int i;
+	char name[16];
+
+	sdi = sr_dev_inst_user_new("sigrok", "Test", NULL);
+	for (i = 0; i < cap->unitsize * 8; i++) {
+		snprintf(name, sizeof(name), "D%u", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	for (i = 0; i < cap->num_analog; i++) {
+		snprintf(name, sizeof(name), "A%u", i);
+		sr_dev_inst_channel_add(sdi, cap->unitsize * 8 + i,
+			SR_CHANNEL_ANALOG, name);
+		analog_channels[i] = g_slist_nth_data(
+			sr_dev_inst_channels_get(sdi), cap->unitsize * 8 + i);
+	}
+
+	o = sr_output_new(sr_output_find("srzip"), NULL, sdi, filename);
+	fail_unless(o != NULL, "Failed to create the srzip output.");
+
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	header.feed_version = 1;
+	gettimeofday(&header.starttime, NULL);
+	output_send(o, &packet);
+
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_new_uint64(SAMPLERATE);
+	meta.config = g_slist_append(NULL, &src);
+	output_send(o, &packet);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	memset(&encoding, 0, sizeof(encoding));
+	encoding.unitsize = sizeof(float);
+	encoding.is_signed = TRUE;
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	memset(&meaning, 0, sizeof(meaning));
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	memset(&spec, 0, sizeof(spec));
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+
+	for (pos = 0; pos < MAX(cap->num_samples, cap->num_analog_samples);
+			pos += chunk_samples) {
+		if (pos < cap->num_samples) {
+			n = MIN(chunk_samples, cap->num_samples - pos);
+			packet.type = SR_DF_LOGIC;
+			packet.payload = &logic;
+			logic.unitsize = cap->unitsize;
+			logic.length = n * cap->unitsize;
+			logic.data = cap->logic + pos * cap->unitsize;
+			output_send(o, &packet);
+		}
+		if (pos >= cap->num_analog_samples)
+			continue;
+		n = MIN(chunk_samples, cap->num_analog_samples - pos);
+		for (i = 0; i < cap->num_analog; i++) {
+			packet.type = SR_DF_ANALOG;
+			packet.payload = &analog;
+			meaning.channels = g_slist_append(NULL, analog_channels[i]);
+			analog.num_samples = n;
+			analog.data = cap->analog[i] + pos;
+			output_send(o, &packet);
+			g_slist_free(meaning.channels);
+		}
+	}
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	output_send(o, &packet);
+
+	sr_output_free(o);
+}
+
+/*
+ * While replaying a whole capture, no track may get more than a block
+ * ahead of any other track that still has samples left.
+ */
+static void check_interleaved(const struct capture *cap)
+{
+	uint64_t pos, lo, hi;
+	unsigned int c;
+
+	pos = replay_logic->len / cap->unitsize;
+	lo = pos < cap->num_samples ? pos : G_MAXUINT64;
+	hi = pos;
+	for (c = 0; c < cap->num_analog; c++) {
+		pos = replay_analog[c]->len;
+		if (pos < cap->num_analog_samples)
+			lo = MIN(lo, pos);
+		hi = MAX(hi, pos);
+	}
+	if (lo != G_MAXUINT64)
+		fail_unless(hi - lo <= REPLAY_BLOCK,
+			"Tracks at samples %" PRIu64 " and %" PRIu64 ".", lo, hi);
+}
+
+static void datafeed_replay(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_channel *ch;
+	unsigned int c;
+	float *fbuf;
+
+	(void)sdi;
+
+	if (replay_ends)
+		fail("Packet of type %d after SR_DF_END.", packet->type);
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		g_byte_array_append(replay_logic, logic->data, logic->length);
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		fail_unless(g_slist_length(analog->meaning->channels) == 1,
+			"Analog packet for more than one channel.");
+		ch = analog->meaning->channels->data;
+		c = ch->index - replay_num_logic;
+		fail_unless(c < MAX_ANALOG, "Unexpected channel %d.", ch->index);
+		fbuf = g_malloc(analog->num_samples * sizeof(float));
+		fail_unless(sr_analog_to_float(analog, fbuf) == SR_OK);
+		g_array_append_vals(replay_analog[c], fbuf, analog->num_samples);
+		g_free(fbuf);
+		break;
+	case SR_DF_END:
+		replay_ends++;
+		break;
+	default:
+		break;
+	}
+
+	if (replay_interleaved)
+		check_interleaved(cb_data);
+}
+
+/*
+ * Replay the session file, after setting 'key' to 'range' if 'key'
+ * isn't 0. The result is kept in replay_logic and replay_analog.
+ */
+static void replay(const struct capture *cap, uint32_t key, GVariant *range)
+{
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	GSList *devlist;
+	unsigned int c;
+	int ret;
+
+	ret = sr_session_load(srtest_ctx, filename, &session);
+	fail_unless(ret == SR_OK, "Failed to load the session file: %d.", ret);
+	devlist = NULL;
+	sr_session_dev_list(session, &devlist);
+	fail_unless(g_slist_length(devlist) == 1);
+	sdi = devlist->data;
+	g_slist_free(devlist);
+
+	if (key) {
+		ret = sr_config_set(sdi, NULL, key, range);
+		fail_unless(ret == SR_OK, "Failed to set the replay range: %d.", ret);
+	}
+
+	replay_logic = g_byte_array_new();
+	for (c = 0; c < MAX_ANALOG; c++)
+		replay_analog[c] = g_array_new(FALSE, FALSE, sizeof(float));
+	replay_num_logic = cap->unitsize * 8;
+	replay_ends = 0;
+	replay_interleaved = !key;
+
+	sr_session_datafeed_callback_add(session, datafeed_replay,
+		(void *)cap);
+	ret = sr_session_start(session);
+	fail_unless(ret == SR_OK, "Failed to start the replay: %d.", ret);
+	ret = sr_session_run(session);
+	fail_unless(ret == SR_OK, "Failed to run the replay: %d.", ret);
+	fail_unless(replay_ends == 1, "Expected one SR_DF_END, got %d.",
+		replay_ends);
+
+	sr_session_destroy(session);
+}
+
+static void replay_free(void)
+{
+	unsigned int c;
+
+	g_byte_array_free(replay_logic, TRUE);
+	for (c = 0; c < MAX_ANALOG; c++)
+		g_array_free(replay_analog[c], TRUE);
+}
+
+/* Check that samples [start, stop) of every channel came out, in order. */
+static void check_replay(const struct capture *cap, uint64_t start,
+		uint64_t stop)
+{
+	uint64_t first, last;
+	unsigned int c;
+
+	first = MIN(start, cap->num_samples);
+	last = MIN(stop, cap->num_samples);
+	fail_unless(replay_logic->len == (last - first) * cap->unitsize,
+		"Expected %" PRIu64 " logic samples, got %u.", last - first,
+		replay_logic->len / cap->unitsize);
+	if (replay_logic->len > 0 &&
+			replay_logic->len == (last - first) * cap->unitsize)
+		fail_unless(!memcmp(replay_logic->data,
+			cap->logic + first * cap->unitsize, replay_logic->len),
+			"The logic samples differ.");
+
+	first = MIN(start, cap->num_analog_samples);
+	last = MIN(stop, cap->num_analog_samples);
+	for (c = 0; c < cap->num_analog; c++) {
+		fail_unless(replay_analog[c]->len == last - first,
+			"Expected %" PRIu64 " samples on analog channel %u, "
+			"got %u.", last - first, c, replay_analog[c]->len);
+		if (replay_analog[c]->len > 0 &&
+				replay_analog[c]->len == last - first)
+			fail_unless(!memcmp(replay_analog[c]->data,
+				cap->analog[c] + first,
+				(last - first) * sizeof(float)),
+				"The samples on analog channel %u differ.", c);
+	}
+}
+
+/*
+ * Check a replay of many chunks, which the session driver reads ahead
+ * while the previous ones are being sent.
+ */
+START_TEST(test_replay_chunks)
+{
+	struct capture *cap;
+
+	cap = capture_new(2, 1000000, 2, 1000000);
+	capture_write(cap, 65536);
+
+	replay(cap, 0, NULL);
+	check_replay(cap, 0, G_MAXUINT64);
+	replay_free();
+
+	capture_free(cap);
+}
+END_TEST
+
+/* Check a capture that was written as a single packet. */
+START_TEST(test_replay_single_chunk)
+{
+	struct capture *cap;
+
+	cap = capture_new(1, 3000000, 0, 0);
+	capture_write(cap, cap->num_samples);
+
+	replay(cap, 0, NULL);
+	check_replay(cap, 0, G_MAXUINT64);
+	replay_free();
+
+	capture_free(cap);
+}
+END_TEST
+
+static int count_errors(void *cb_data, int loglevel, const char *format,
+		va_list args)
+{
+	(void)cb_data;
+	(void)format;
+	(void)args;
+
+	if (loglevel == SR_LOG_ERR)
+		num_errors++;
+
+	return SR_OK;
+}
+
+/* Cut an entry in the session file short, keeping its first 'size' bytes. */
+static void archive_truncate(const char *name, uint64_t size)
+{
+	struct zip *archive;
+	struct zip_source *src;
+	struct zip_file *zf;
+	zip_int64_t idx;
+	uint8_t *buf;
+
+	archive = zip_open(filename, 0, NULL);
+	fail_unless(archive != NULL, "Failed to open the session file.");
+	idx = zip_name_locate(archive, name, 0);
+	fail_unless(idx >= 0, "No entry '%s' in the session file.", name);
+	buf = g_malloc(size);
+	zf = zip_fopen_index(archive, idx, 0);
+	fail_unless(zf != NULL);
+	fail_unless(zip_fread(zf, buf, size) == (zip_int64_t)size);
+	zip_fclose(zf);
+	src = zip_source_buffer(archive, buf, size, 0);
+	fail_unless(zip_replace(archive, idx, src) == 0);
+	fail_unless(zip_close(archive) == 0);
+	g_free(buf);
+}
+
+/* Remove an entry from the session file. */
+static void archive_delete(const char *name)
+{
+	struct zip *archive;
+	zip_int64_t idx;
+
+	archive = zip_open(filename, 0, NULL);
+	fail_unless(archive != NULL, "Failed to open the session file.");
+	idx = zip_name_locate(archive, name, 0);
+	fail_unless(idx >= 0, "No entry '%s' in the session file.", name);
+	fail_unless(zip_delete(archive, idx) == 0);
+	fail_unless(zip_close(archive) == 0);
+}
+
+static const uint64_t replay_ranges[][2] = {
+	{ 0, 0 },
+	{ 0, 1 },
+	{ 5000, 5001 },
+	{ 9999, 10001 },
+	{ 123456, 234567 },
+	{ 190000, 0 },
+	{ 250000, 260000 },
+	{ 299999, 0 },
+	{ 400000, 0 },
+};
+
+/*
+ * Replay part of a capture whose analog track is shorter than the logic
+ * one, with and without the chunk index.
+ */
+START_TEST(test_replay_samples)
+{
+	struct capture *cap;
+	uint64_t start, stop;
+	int pass;
+
+	start = replay_ranges[_i][0];
+	stop = replay_ranges[_i][1];
+
+	cap = capture_new(1, 300000, 1, 200000);
+	capture_write(cap, 10000);
+
+	for (pass = 0; pass < 2; pass++) {
+		if (pass == 1)
+			archive_delete("index");
+		replay(cap, SR_CONF_REPLAY_SAMPLES,
+			g_variant_new("(tt)", start, stop));
+		check_replay(cap, start, stop ? stop : G_MAXUINT64);
+		replay_free();
+	}
+
+	capture_free(cap);
+}
+END_TEST
+
+/* Times are binary fractions, so that they convert exactly to samples. */
+static const struct {
+	double start_time, stop_time;
+	uint64_t start, stop;
+} replay_times[] = {
+	{ 0, 0.015625, 0, 15625 },
+	{ 0.0078125, 0.015625, 7812, 15625 },
+	{ 0.1953125, 0, 195312, G_MAXUINT64 },
+	{ 1, 0, 1000000, G_MAXUINT64 },
+};
+
+START_TEST(test_replay_time)
+{
+	struct capture *cap;
+
+	cap = capture_new(1, 300000, 1, 200000);
+	capture_write(cap, 10000);
+
+	replay(cap, SR_CONF_REPLAY_TIME, g_variant_new("(dd)",
+		replay_times[_i].start_time, replay_times[_i].stop_time));
+	check_replay(cap, replay_times[_i].start, replay_times[_i].stop);
+	replay_free();
+
+	capture_free(cap);
+}
+END_TEST
+
+/* Check that empty and negative ranges are rejected. */
+START_TEST(test_replay_bad_range)
+{
+	struct capture *cap;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	GSList *devlist;
+	GVariant *range;
+	int ret;
+
+	cap = capture_new(1, 1000, 0, 0);
+	capture_write(cap, 1000);
+
+	ret = sr_session_load(srtest_ctx, filename, &session);
+	fail_unless(ret == SR_OK, "Failed to load the session file: %d.", ret);
+	devlist = NULL;
+	sr_session_dev_list(session, &devlist);
+	sdi = devlist->data;
+	g_slist_free(devlist);
+
+	range = g_variant_ref_sink(g_variant_new("(tt)", 100, 100));
+	ret = sr_config_set(sdi, NULL, SR_CONF_REPLAY_SAMPLES, range);
+	fail_unless(ret != SR_OK, "Accepted an empty range of samples.");
+	g_variant_unref(range);
+	range = g_variant_ref_sink(g_variant_new("(tt)", 200, 100));
+	ret = sr_config_set(sdi, NULL, SR_CONF_REPLAY_SAMPLES, range);
+	fail_unless(ret != SR_OK, "Accepted a negative range of samples.");
+	g_variant_unref(range);
+	range = g_variant_ref_sink(g_variant_new("(dd)", -1.0, 0.0));
+	ret = sr_config_set(sdi, NULL, SR_CONF_REPLAY_TIME, range);
+	fail_unless(ret != SR_OK, "Accepted a negative start time.");
+	g_variant_unref(range);
+
+	sr_session_destroy(session);
+	capture_free(cap);
+}
+END_TEST
+
+/*
+ * Check that chunks inflated in parallel come out in order, also when
+ * the chunks don't end on a block boundary.
+ */
+START_TEST(test_replay_many_chunks)
+{
+	struct capture *cap;
+
+	cap = capture_new(1, 200000, 1, 200000);
+	capture_write(cap, 997);
+
+	replay(cap, 0, NULL);
+	check_replay(cap, 0, G_MAXUINT64);
+	replay_free();
+
+	capture_free(cap);
+}
+END_TEST
+
+/*
+ * A chunk that is shorter than the index says must stop the replay with
+ * an error, rather than shift the samples after it.
+ */
+START_TEST(test_replay_truncated)
+{
+	struct capture *cap;
+	unsigned int len;
+
+	cap = capture_new(1, 100000, 1, 100000);
+	capture_write(cap, 10000);
+	archive_truncate("logic-1-3", 5000);
+
+	num_errors = 0;
+	sr_log_callback_set(count_errors, NULL);
+	replay(cap, 0, NULL);
+	fail_unless(num_errors > 0, "No error for a truncated chunk.");
+
+	fail_unless(replay_logic->len == 25000,
+		"Expected 25000 logic samples, got %u.", replay_logic->len);
+	fail_unless(!memcmp(replay_logic->data, cap->logic, replay_logic->len),
+		"The logic samples differ.");
+	len = replay_analog[0]->len;
+	fail_unless(len < cap->num_analog_samples, "Replayed all analog samples.");
+	fail_unless(!memcmp(replay_analog[0]->data, cap->analog[0],
+		len * sizeof(float)), "The analog samples differ.");
+	replay_free();
+
+	capture_free(cap);
+}
+END_TEST
+
+/*
+ * Check a capture with more analog channels than MAX_WORKERS, each of
+ * which still gets a worker, and all of which are replayed side by side.
+ */
+START_TEST(test_replay_many_channels)
+{
+	struct capture *cap;
+
+	cap = capture_new(1, 600000, 10, 600000);
+	capture_write(cap, 65536);
+
+	replay(cap, 0, NULL);
+	check_replay(cap, 0, G_MAXUINT64);
+	replay_free();
+
+	capture_free(cap);
+}
+END_TEST
+
+Suite *suite_session_driver(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("session-driver");
+
+	tc = tcase_create("replay");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_set_timeout(tc, 0);
+	tcase_add_test(tc, test_replay_chunks);
+	tcase_add_test(tc, test_replay_single_chunk);
+	tcase_add_test(tc, test_replay_many_chunks);
+	tcase_add_test(tc, test_replay_truncated);
+	tcase_add_test(tc, test_replay_many_channels);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("range");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_set_timeout(tc, 0);
+	tcase_add_loop_test(tc, test_replay_samples, 0, G_N_ELEMENTS(replay_ranges));
+	tcase_add_loop_test(tc, test_replay_time, 0, G_N_ELEMENTS(replay_times));
+	tcase_add_test(tc, test_replay_bad_range);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
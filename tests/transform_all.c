@@ -19,11 +19,268 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
 #include "lib.h"
 
+/* Amount of data pushed through the session per benchmark run. */
+#define BENCH_SIZE (16 * 1024 * 1024)
+#define BENCH_RUNS 4
+
+static uint64_t bench_bytes, bench_packets;
+/* Value of every logic byte, or -1 to accept anything. */
+static int bench_logic_expect;
+/* If set, collects the logic data of the last run. */
+static GByteArray *bench_logic_out;
+static const struct sr_rational *bench_scale_expect;
+/* If set, the session runs the transforms one by one. */
+static gboolean bench_unfused;
+
+static void datafeed_bench(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const uint8_t *data;
+	uint64_t i;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		data = logic->data;
+		for (i = 0; bench_logic_expect >= 0 && i < logic->length; i++) {
+			if (data[i] != bench_logic_expect)
+				fail("Unexpected logic byte 0x%02x.", data[i]);
+		}
+		if (bench_logic_out)
+			g_byte_array_append(bench_logic_out, data, logic->length);
+		bench_bytes += logic->length;
+		bench_packets++;
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		if (bench_scale_expect)
+			fail_unless(analog->encoding->scale.p == bench_scale_expect->p
+				&& analog->encoding->scale.q == bench_scale_expect->q,
+				"Unexpected analog scale %" PRId64 "/%" PRIu64 ".",
+				analog->encoding->scale.p, analog->encoding->scale.q);
+		bench_bytes += analog->num_samples * analog->encoding->unitsize;
+		bench_packets++;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Push 'buf' through an input module and a chain of 'num_transforms'
+ * instances of the given transform. Returns the best time in
+ * microseconds over a few runs.
+ */
+static gint64 bench_run(const char *input_id, GHashTable *input_opts,
+		const char *transform_id, GHashTable *transform_opts,
+		int num_transforms, const uint8_t *buf, gsize size)
+{
+	const struct sr_input_module *imod;
+	const struct sr_transform_module *tmod;
+	const struct sr_transform *t[8];
+	struct sr_session *session;
+	struct sr_input *in;
+	struct sr_dev_inst *sdi;
+	GString *gbuf;
+	gint64 start, elapsed, best;
+	int run, ret, i;
+
+	fail_unless(num_transforms <= (int)ARRAY_SIZE(t));
+
+	imod = sr_input_find((char *)input_id);
+	fail_unless(imod != NULL, "Failed to find input module '%s'.", input_id);
+
+	best = G_MAXINT64;
+	for (run = 0; run < BENCH_RUNS; run++) {
+		in = sr_input_new(imod, input_opts);
+		fail_unless(in != NULL, "Failed to create input instance.");
+
+		/* The first buffer is only stored, and makes the sdi ready. */
+		gbuf = g_string_new_len((const gchar *)buf, size);
+		ret = sr_input_send(in, gbuf);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+		g_string_free(gbuf, TRUE);
+		sdi = sr_input_dev_inst_get(in);
+		fail_unless(sdi != NULL, "The input has no device instance.");
+
+		sr_session_new(srtest_ctx, &session);
+		if (bench_unfused)
+			sr_test_hooks_get()->session_fuse_transforms_set(
+				session, FALSE);
+		sr_session_datafeed_callback_add(session, datafeed_bench, NULL);
+		sr_session_dev_add(session, sdi);
+
+		for (i = 0; i < num_transforms; i++) {
+			tmod = sr_transform_find(transform_id);
+			fail_unless(tmod != NULL, "Failed to find transform '%s'.",
+				transform_id);
+			t[i] = sr_transform_new(tmod, transform_opts, sdi);
+			fail_unless(t[i] != NULL, "Failed to create transform.");
+		}
+
+		bench_bytes = bench_packets = 0;
+		if (bench_logic_out)
+			g_byte_array_set_size(bench_logic_out, 0);
+		start = g_get_monotonic_time();
+		ret = sr_input_end(in);
+		elapsed = g_get_monotonic_time() - start;
+		fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+		fail_unless(bench_bytes == size, "Expected %zu bytes, got %"
+			PRIu64 ".", size, bench_bytes);
+		best = MIN(best, elapsed);
+
+		for (i = 0; i < num_transforms; i++)
+			sr_transform_free(t[i]);
+		sr_input_free(in);
+		sr_session_destroy(session);
+	}
+
+	return best;
+}
+
+/* What came out of the session in decimate_run(). */
+static GByteArray *out_logic;
+static GArray *out_analog;
+static uint64_t out_samplerate;
+static int out_ends;
+
+static void datafeed_collect(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_config *src;
+	float *fbuf;
+	GSList *l;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (out_ends)
+		fail("Packet of type %d after SR_DF_END.", packet->type);
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				out_samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		g_byte_array_append(out_logic, logic->data, logic->length);
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		fbuf = g_malloc(analog->num_samples * sizeof(float));
+		fail_unless(sr_analog_to_float(analog, fbuf) == SR_OK);
+		g_array_append_vals(out_analog, fbuf, analog->num_samples);
+		g_free(fbuf);
+		break;
+	case SR_DF_END:
+		out_ends++;
+		break;
+	default:
+		break;
+	}
+}
+
+static GHashTable *options_new(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+}
+
+static void options_add(GHashTable *opts, const char *id, GVariant *value)
+{
+	g_hash_table_insert(opts, g_strdup(id), g_variant_ref_sink(value));
+}
+
+/*
+ * Push 'buf' through an input module and a 'decimate' transform, and
+ * collect the result in out_logic, out_analog and out_samplerate.
+ */
+static void decimate_run(const char *input_id, GHashTable *input_opts,
+		uint64_t factor, const char *logic_mode, const char *analog_mode,
+		const uint8_t *buf, gsize size)
+{
+	const struct sr_input_module *imod;
+	const struct sr_transform *t;
+	struct sr_session *session;
+	struct sr_input *in;
+	struct sr_dev_inst *sdi;
+	GHashTable *opts;
+	GString *gbuf;
+	int ret;
+
+	opts = options_new();
+	options_add(opts, "factor", g_variant_new_uint64(factor));
+	options_add(opts, "logic", g_variant_new_string(logic_mode));
+	options_add(opts, "analog", g_variant_new_string(analog_mode));
+
+	imod = sr_input_find((char *)input_id);
+	fail_unless(imod != NULL, "Failed to find input module '%s'.", input_id);
+	in = sr_input_new(imod, input_opts);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	/* The first buffer only makes the device instance ready. */
+	gbuf = g_string_new_len((const gchar *)buf, size);
+	ret = sr_input_send(in, gbuf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	g_string_free(gbuf, TRUE);
+	sdi = sr_input_dev_inst_get(in);
+	fail_unless(sdi != NULL, "The input has no device instance.");
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_collect, NULL);
+	sr_session_dev_add(session, sdi);
+	t = sr_transform_new(sr_transform_find("decimate"), opts, sdi);
+	fail_unless(t != NULL, "Failed to create transform.");
+
+	out_logic = g_byte_array_new();
+	out_analog = g_array_new(FALSE, FALSE, sizeof(float));
+	out_samplerate = 0;
+	out_ends = 0;
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	fail_unless(out_ends == 1, "Expected one SR_DF_END, got %d.", out_ends);
+
+	sr_transform_free(t);
+	sr_input_free(in);
+	sr_session_destroy(session);
+	g_hash_table_destroy(opts);
+}
+
+static void decimate_done(void)
+{
+	g_byte_array_free(out_logic, TRUE);
+	g_array_free(out_analog, TRUE);
+}
+
+static void bench_report(const char *name, gint64 base, gint64 with)
+{
+	g_debug("%s: %.1f MB/s baseline, %.1f MB/s measured, "
+		"%.3f us extra per packet.", name,
+		BENCH_SIZE / (double)MAX(base, 1), BENCH_SIZE / (double)MAX(with, 1),
+		(with - base) / (double)MAX(bench_packets, 1));
+}
+
 /* Check whether at least one transform module is available. */
 START_TEST(test_transform_available)
 {
@@ -97,6 +354,300 @@ START_TEST(test_transform_options)
 }
 END_TEST
 
+/* Check whether the 'decimate' transform module offers its options. */
+START_TEST(test_transform_decimate_options)
+{
+	const struct sr_option **opt;
+	int i;
+
+	opt = sr_transform_options_get(sr_transform_find("decimate"));
+	fail_unless(opt != NULL, "Transform module 'decimate' has no options.");
+	for (i = 0; opt[i]; i++)
+		fail_unless(opt[i]->def != NULL, "Option '%s' has no default.",
+			opt[i]->id);
+	fail_unless(i == 3, "Unexpected number of 'decimate' options.");
+	sr_transform_options_free(opt);
+}
+END_TEST
+
+/* Two full windows of four samples, and a partial one. */
+static const uint8_t decimate_pattern[] = {
+	0x00, 0x01, 0x00, 0x00,
+	0x02, 0x02, 0x00, 0x02,
+	0x05, 0x01,
+};
+
+static void check_decimate_logic(const char *mode, const uint8_t *expect,
+		gsize expect_len)
+{
+	GHashTable *opts;
+	gsize i;
+
+	opts = options_new();
+	options_add(opts, "numchannels", g_variant_new_int32(8));
+	options_add(opts, "samplerate", g_variant_new_uint64(SR_KHZ(1)));
+
+	decimate_run("binary", opts, 4, mode, "sample",
+		decimate_pattern, sizeof(decimate_pattern));
+	fail_unless(out_logic->len == expect_len, "Mode '%s': expected %zu "
+		"samples, got %u.", mode, expect_len, out_logic->len);
+	for (i = 0; i < MIN(expect_len, out_logic->len); i++)
+		fail_unless(out_logic->data[i] == expect[i], "Mode '%s': sample "
+			"%zu is 0x%02x, expected 0x%02x.", mode, i,
+			out_logic->data[i], expect[i]);
+	fail_unless(out_samplerate == 250, "Mode '%s': samplerate %" PRIu64
+		", expected 250.", mode, out_samplerate);
+
+	decimate_done();
+	g_hash_table_destroy(opts);
+}
+
+/*
+ * Check the logic modes on a known pattern. 'sample' keeps the first
+ * sample of each window, 'or' and 'and' combine the window and flush the
+ * partial window at the end of the stream.
+ */
+START_TEST(test_transform_decimate_logic)
+{
+	const uint8_t sample[] = { 0x00, 0x02, 0x05 };
+	const uint8_t or[] = { 0x01, 0x02, 0x05 };
+	const uint8_t and[] = { 0x00, 0x00, 0x01 };
+
+	check_decimate_logic("sample", sample, sizeof(sample));
+	check_decimate_logic("or", or, sizeof(or));
+	check_decimate_logic("and", and, sizeof(and));
+}
+END_TEST
+
+/* Check that a factor of 1 passes everything on unmodified. */
+START_TEST(test_transform_decimate_passthrough)
+{
+	GHashTable *opts;
+
+	opts = options_new();
+	options_add(opts, "numchannels", g_variant_new_int32(8));
+	options_add(opts, "samplerate", g_variant_new_uint64(SR_KHZ(1)));
+
+	decimate_run("binary", opts, 1, "or", "sample",
+		decimate_pattern, sizeof(decimate_pattern));
+	fail_unless(out_logic->len == sizeof(decimate_pattern));
+	fail_unless(!memcmp(out_logic->data, decimate_pattern,
+		sizeof(decimate_pattern)));
+	fail_unless(out_samplerate == SR_KHZ(1));
+
+	decimate_done();
+	g_hash_table_destroy(opts);
+}
+END_TEST
+
+/*
+ * Check the anti-alias filter: DC passes with unity gain, a tone at the
+ * old Nyquist frequency (which aliases to DC) is suppressed.
+ */
+START_TEST(test_transform_decimate_fir)
+{
+	GHashTable *opts;
+	float buf[256], v;
+	unsigned int i;
+
+	opts = options_new();
+	options_add(opts, "samplerate", g_variant_new_uint64(SR_KHZ(1)));
+	options_add(opts, "format", g_variant_new_string("FLOAT_LE"));
+
+	for (i = 0; i < ARRAY_SIZE(buf); i++)
+		buf[i] = 1.0;
+	decimate_run("raw_analog", opts, 4, "sample", "fir",
+		(const uint8_t *)buf, sizeof(buf));
+	fail_unless(out_analog->len == ARRAY_SIZE(buf) / 4,
+		"Expected %zu samples, got %u.", ARRAY_SIZE(buf) / 4,
+		out_analog->len);
+	fail_unless(out_samplerate == 250);
+	/* Skip the samples that still see the filter's initial zeros. */
+	for (i = 8; i < out_analog->len; i++) {
+		v = g_array_index(out_analog, float, i);
+		fail_unless(fabs(v - 1.0) < 0.001, "DC sample %u is %f.", i, v);
+	}
+	decimate_done();
+
+	for (i = 0; i < ARRAY_SIZE(buf); i++)
+		buf[i] = i & 1 ? -1.0 : 1.0;
+	decimate_run("raw_analog", opts, 4, "sample", "fir",
+		(const uint8_t *)buf, sizeof(buf));
+	for (i = 8; i < out_analog->len; i++) {
+		v = g_array_index(out_analog, float, i);
+		fail_unless(fabs(v) < 0.01, "Nyquist sample %u is %f.", i, v);
+	}
+	decimate_done();
+
+	g_hash_table_destroy(opts);
+}
+END_TEST
+
+/*
+ * Check that the partial window at the end of the stream isn't lost,
+ * with a sample count that isn't a multiple of the factor.
+ */
+START_TEST(test_transform_decimate_analog_end)
+{
+	GHashTable *opts;
+	const float buf[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 10 };
+	const float mean[] = { 2.5, 6.5, 10.5, 12 };
+	const float min[] = { 1, 5, 9, 10 };
+	const float max[] = { 4, 8, 12, 14 };
+	const struct {
+		const char *mode;
+		const float *expect;
+	} modes[] = {
+		{ "mean", mean },
+		{ "min", min },
+		{ "max", max },
+	};
+	unsigned int i, j;
+	float v;
+
+	opts = options_new();
+	options_add(opts, "samplerate", g_variant_new_uint64(SR_KHZ(1)));
+	options_add(opts, "format", g_variant_new_string("FLOAT_LE"));
+
+	for (i = 0; i < ARRAY_SIZE(modes); i++) {
+		decimate_run("raw_analog", opts, 4, "sample", modes[i].mode,
+			(const uint8_t *)buf, sizeof(buf));
+		fail_unless(out_analog->len == ARRAY_SIZE(mean),
+			"Mode '%s': expected %zu samples, got %u.", modes[i].mode,
+			ARRAY_SIZE(mean), out_analog->len);
+		for (j = 0; j < out_analog->len; j++) {
+			v = g_array_index(out_analog, float, j);
+			fail_unless(fabs(v - modes[i].expect[j]) < 0.001,
+				"Mode '%s': sample %u is %f, expected %f.",
+				modes[i].mode, j, v, modes[i].expect[j]);
+		}
+		decimate_done();
+	}
+
+	g_hash_table_destroy(opts);
+}
+END_TEST
+
+/* Check the 'invert' transform on logic data, and what it costs. */
+START_TEST(test_transform_invert_logic_bench)
+{
+	uint8_t *buf;
+	gint64 base, with;
+
+	buf = g_malloc0(BENCH_SIZE);
+
+	bench_logic_expect = 0x00;
+	base = bench_run("binary", NULL, NULL, NULL, 0, buf, BENCH_SIZE);
+	bench_logic_expect = 0xff;
+	with = bench_run("binary", NULL, "invert", NULL, 1, buf, BENCH_SIZE);
+	bench_report("invert/logic", base, with);
+
+	g_free(buf);
+}
+END_TEST
+
+/*
+ * Check that fusing a chain of four 'invert' transforms gives the same
+ * output as running them one by one, and what it saves.
+ */
+START_TEST(test_transform_invert_fused_bench)
+{
+	GByteArray *unfused_out;
+	uint8_t *buf;
+	gint64 unfused, fused;
+	gsize i;
+
+	buf = g_malloc(BENCH_SIZE);
+	for (i = 0; i < BENCH_SIZE; i++)
+		buf[i] = (i * 2654435761u) >> 24;
+
+	bench_logic_expect = -1;
+	bench_logic_out = g_byte_array_new();
+	bench_unfused = TRUE;
+	unfused = bench_run("binary", NULL, "invert", NULL, 4, buf, BENCH_SIZE);
+	bench_unfused = FALSE;
+	unfused_out = bench_logic_out;
+
+	bench_logic_out = g_byte_array_new();
+	fused = bench_run("binary", NULL, "invert", NULL, 4, buf, BENCH_SIZE);
+	bench_report("invert/logic x4 (fused)", unfused, fused);
+
+	fail_unless(bench_logic_out->len == unfused_out->len);
+	fail_unless(!memcmp(bench_logic_out->data, unfused_out->data,
+		unfused_out->len), "Fused output differs from unfused output.");
+	fail_unless(!memcmp(bench_logic_out->data, buf, BENCH_SIZE),
+		"Four inversions didn't restore the input.");
+
+	g_byte_array_free(unfused_out, TRUE);
+	g_byte_array_free(bench_logic_out, TRUE);
+	bench_logic_out = NULL;
+	g_free(buf);
+}
+END_TEST
+
+/* Check that 'scale' only touches the encoding, for every packet. */
+START_TEST(test_transform_scale_analog_bench)
+{
+	GHashTable *in_opts, *t_opts;
+	uint8_t *buf;
+	gint64 base, with;
+	int64_t p;
+	uint64_t q;
+	const struct sr_rational expect = { 1, 16384 };
+
+	buf = g_malloc0(BENCH_SIZE);
+
+	in_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(in_opts, g_strdup("format"),
+			g_variant_ref_sink(g_variant_new_string("S16_LE")));
+	t_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	p = 2;
+	q = 1;
+	g_hash_table_insert(t_opts, g_strdup("factor"),
+			g_variant_ref_sink(g_variant_new("(xt)", p, q)));
+
+	bench_scale_expect = NULL;
+	base = bench_run("raw_analog", in_opts, NULL, NULL, 0, buf, BENCH_SIZE);
+	bench_scale_expect = &expect;
+	with = bench_run("raw_analog", in_opts, "scale", t_opts, 1, buf, BENCH_SIZE);
+	bench_scale_expect = NULL;
+	bench_report("scale/analog", base, with);
+
+	g_hash_table_destroy(t_opts);
+	g_hash_table_destroy(in_opts);
+	g_free(buf);
+}
+END_TEST
+
+/* Check that 'deglitch' removes single-sample pulses, and what it costs. */
+START_TEST(test_transform_deglitch_bench)
+{
+	GHashTable *opts;
+	uint8_t *buf;
+	gint64 base, with;
+	gsize i;
+
+	buf = g_malloc0(BENCH_SIZE);
+
+	opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(opts, g_strdup("width"),
+			g_variant_ref_sink(g_variant_new_uint64(2)));
+
+	bench_logic_expect = 0x00;
+	base = bench_run("binary", NULL, NULL, NULL, 0, buf, BENCH_SIZE);
+	for (i = 1; i < BENCH_SIZE; i += 64)
+		buf[i] = 0xff;
+	with = bench_run("binary", NULL, "deglitch", opts, 1, buf, BENCH_SIZE);
+	bench_report("deglitch/logic", base, with);
+
+	g_hash_table_destroy(opts);
+	g_free(buf);
+}
+END_TEST
+
 Suite *suite_transform_all(void)
 {
 	Suite *s;
@@ -111,6 +662,24 @@ Suite *suite_transform_all(void)
 	tcase_add_test(tc, test_transform_desc);
 	tcase_add_test(tc, test_transform_find);
 	tcase_add_test(tc, test_transform_options);
+	tcase_add_test(tc, test_transform_decimate_options);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("decimate");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_decimate_logic);
+	tcase_add_test(tc, test_transform_decimate_passthrough);
+	tcase_add_test(tc, test_transform_decimate_fir);
+	tcase_add_test(tc, test_transform_decimate_analog_end);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("benchmark");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_set_timeout(tc, 0);
+	tcase_add_test(tc, test_transform_invert_logic_bench);
+	tcase_add_test(tc, test_transform_invert_fused_bench);
+	tcase_add_test(tc, test_transform_scale_analog_bench);
+	tcase_add_test(tc, test_transform_deglitch_bench);
 	suite_add_tcase(s, tc);
 
 	return s;
@@ -0,0 +1,436 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2016 The sigrok project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#ifdef HAVE_LIBUSB_1_0
+
+/* Record types of the USB recording format, see usb.c. */
+enum {
+	REC_TRANSFER = 1,
+	REC_CONTROL,
+	REC_BULK,
+	REC_CONTROL_TRANSFER,
+};
+
+struct record {
+	uint8_t type;
+	uint8_t endpoint;
+	uint8_t request;
+	uint16_t value;
+	uint16_t index;
+	int32_t status;
+	uint32_t length;
+	uint64_t time_us;
+	/* Only kept for IN transfers that succeeded. */
+	const char *data;
+};
+
+#define EP_IN  0x82
+#define EP_OUT 0x01
+
+/*
+ * Synchronous and asynchronous transfers are interleaved, like a driver
+ * polling its device while streaming. The completions are 50ms apart.
+ */
+static const struct record recording[] = {
+	{ REC_CONTROL, 0xc0, 0xb0, 0x0102, 3, 4, 4, 100, "\x01\x02\x03\x04" },
+	{ REC_TRANSFER, EP_IN, 0, 0, 0, LIBUSB_TRANSFER_COMPLETED, 8, 1000,
+		"abcdefgh" },
+	{ REC_CONTROL, 0x40, 0xb1, 0, 0, LIBUSB_ERROR_PIPE, 0, 2000, NULL },
+	{ REC_TRANSFER, EP_IN, 0, 0, 0, LIBUSB_TRANSFER_COMPLETED, 5, 51000,
+		"ijklm" },
+	{ REC_BULK, EP_OUT, 0, 0, 0, 0, 3, 52000, NULL },
+	{ REC_TRANSFER, EP_IN, 0, 0, 0, LIBUSB_TRANSFER_STALL, 0, 101000,
+		NULL },
+};
+
+/* The asynchronous transfers, in the recorded order. */
+static const struct record *completions[] = {
+	&recording[1], &recording[3], &recording[5],
+};
+
+/* Asynchronous control transfers, IN and OUT, and a bulk transfer. */
+static const struct record control_recording[] = {
+	{ REC_CONTROL_TRANSFER, 0xc0, 0xb2, 0x0001, 0,
+		LIBUSB_TRANSFER_COMPLETED, 3, 100, "xyz" },
+	{ REC_TRANSFER, EP_IN, 0, 0, 0, LIBUSB_TRANSFER_COMPLETED, 4, 200,
+		"bulk" },
+	{ REC_CONTROL_TRANSFER, 0x40, 0xb3, 0, 0, LIBUSB_TRANSFER_COMPLETED,
+		2, 300, NULL },
+};
+
+static const struct sr_test_hooks *hooks;
+static char *replay_file;
+static unsigned int num_done;
+static int done_status[8];
+static char done_data[8][16];
+static int64_t done_us[8];
+static struct libusb_transfer *done_transfers[8];
+
+static void write_recording(const char *filename, const struct record *recs,
+		unsigned int num_recs)
+{
+	const struct record *rec;
+	uint8_t hdr[32];
+	unsigned int i;
+	FILE *f;
+
+	fail_unless((f = g_fopen(filename, "wb")) != NULL);
+	fwrite("SRUSBREC", 8, 1, f);
+	WL32(hdr, 1);
+	fwrite(hdr, 4, 1, f);
+	for (i = 0; i < num_recs; i++) {
+		rec = &recs[i];
+		memset(hdr, 0, sizeof(hdr));
+		W8(hdr, rec->type);
+		W8(hdr + 1, rec->endpoint);
+		W8(hdr + 2, rec->request);
+		WL16(hdr + 4, rec->value);
+		WL16(hdr + 6, rec->index);
+		WL32(hdr + 8, rec->status);
+		WL32(hdr + 12, rec->length);
+		WL32(hdr + 16, rec->time_us);
+		WL32(hdr + 20, rec->time_us >> 32);
+		fwrite(hdr, sizeof(hdr), 1, f);
+		if (rec->data)
+			fwrite(rec->data, rec->length, 1, f);
+	}
+	fail_unless(fclose(f) == 0);
+}
+
+/* Start replaying the recording at the given speed. */
+static void replay_start(const struct record *recs, unsigned int num_recs,
+		const char *speed)
+{
+	write_recording(replay_file, recs, num_recs);
+	g_setenv("SIGROK_USB_REPLAY", replay_file, TRUE);
+	g_setenv("SIGROK_USB_REPLAY_SPEED", speed, TRUE);
+	srtest_setup();
+}
+
+static void setup(void)
+{
+	int fd;
+
+	hooks = sr_test_hooks_get();
+	fd = g_file_open_tmp("sigrok-usb-XXXXXX", &replay_file, NULL);
+	fail_unless(fd >= 0);
+	close(fd);
+	num_done = 0;
+}
+
+static void teardown(void)
+{
+	srtest_teardown();
+	g_unsetenv("SIGROK_USB_REPLAY");
+	g_unsetenv("SIGROK_USB_REPLAY_SPEED");
+	g_unlink(replay_file);
+	g_free(replay_file);
+}
+
+/* Keeps the transfer going, like drivers do, until it fails. */
+static void LIBUSB_CALL transfer_done(struct libusb_transfer *transfer)
+{
+	fail_unless(num_done < ARRAY_SIZE(done_status));
+	done_status[num_done] = transfer->status;
+	memset(done_data[num_done], 0, sizeof(done_data[num_done]));
+	memcpy(done_data[num_done], transfer->buffer, transfer->actual_length);
+	done_us[num_done] = g_get_monotonic_time();
+	num_done++;
+
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+		fail_unless(hooks->usb_submit_transfer(transfer)
+			== LIBUSB_SUCCESS);
+}
+
+static void LIBUSB_CALL transfer_finished(struct libusb_transfer *transfer)
+{
+	fail_unless(num_done < ARRAY_SIZE(done_transfers));
+	done_transfers[num_done++] = transfer;
+}
+
+static struct libusb_transfer *transfer_new(unsigned char *buf, int len)
+{
+	struct libusb_transfer *transfer;
+
+	transfer = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(transfer, NULL, EP_IN, buf, len,
+			transfer_done, NULL, 1000);
+
+	return transfer;
+}
+
+static void handle_events(void)
+{
+	struct timeval tv;
+
+	tv.tv_sec = tv.tv_usec = 0;
+	fail_unless(hooks->usb_handle_events(srtest_ctx->libusb_ctx, &tv,
+			NULL) == LIBUSB_SUCCESS);
+}
+
+static void check_completions(unsigned int first)
+{
+	const struct record *rec;
+	unsigned int i;
+
+	fail_unless(num_done >= first + ARRAY_SIZE(completions));
+	for (i = 0; i < ARRAY_SIZE(completions); i++) {
+		rec = completions[i];
+		fail_unless(done_status[first + i] == rec->status,
+			"Completion %u has status %d, expected %d.", i,
+			done_status[first + i], rec->status);
+		fail_unless(!strcmp(done_data[first + i],
+			rec->data ? rec->data : ""),
+			"Completion %u has the wrong data.", i);
+	}
+}
+
+/* Synchronous transfers return the recorded results, in order. */
+START_TEST(test_replay_sync)
+{
+	unsigned char data[16];
+	int ret, transferred;
+
+	replay_start(ARRAY_AND_SIZE(recording), "0");
+
+	memset(data, 0, sizeof(data));
+	ret = hooks->usb_control_transfer(NULL, 0xc0, 0xb0, 0x0102, 3, data,
+			sizeof(data), 100);
+	fail_unless(ret == 4, "Control transfer returned %d.", ret);
+	fail_unless(!memcmp(data, "\x01\x02\x03\x04", 4));
+
+	ret = hooks->usb_control_transfer(NULL, 0x40, 0xb1, 0, 0, NULL, 0, 100);
+	fail_unless(ret == LIBUSB_ERROR_PIPE, "Control transfer returned %d.",
+			ret);
+
+	transferred = 0;
+	ret = hooks->usb_bulk_transfer(NULL, EP_OUT, data, 3, &transferred,
+			100);
+	fail_unless(ret == 0 && transferred == 3);
+
+	/* The device is gone once the recording runs out. */
+	ret = hooks->usb_bulk_transfer(NULL, EP_OUT, data, 3, &transferred,
+			100);
+	fail_unless(ret == LIBUSB_ERROR_NO_DEVICE);
+}
+END_TEST
+
+/* Asynchronous transfers complete in order when events are handled. */
+START_TEST(test_replay_async)
+{
+	struct libusb_transfer *transfer;
+	unsigned char buf[16];
+	unsigned int i;
+
+	replay_start(ARRAY_AND_SIZE(recording), "0");
+
+	transfer = transfer_new(buf, sizeof(buf));
+	fail_unless(hooks->usb_submit_transfer(transfer) == LIBUSB_SUCCESS);
+	for (i = 0; i < 10 && num_done < ARRAY_SIZE(completions); i++)
+		handle_events();
+	fail_unless(num_done == ARRAY_SIZE(completions),
+		"%u transfers completed.", num_done);
+	check_completions(0);
+
+	/* Nothing is left in the recording. */
+	fail_unless(hooks->usb_submit_transfer(transfer) == LIBUSB_SUCCESS);
+	handle_events();
+	fail_unless(num_done == ARRAY_SIZE(completions) + 1);
+	fail_unless(done_status[num_done - 1] == LIBUSB_TRANSFER_NO_DEVICE);
+
+	libusb_free_transfer(transfer);
+}
+END_TEST
+
+/* A cancelled transfer doesn't use up a recorded completion. */
+START_TEST(test_replay_cancel)
+{
+	struct libusb_transfer *transfer;
+	unsigned char buf[16];
+	unsigned int i;
+
+	replay_start(ARRAY_AND_SIZE(recording), "0");
+
+	transfer = transfer_new(buf, sizeof(buf));
+	fail_unless(hooks->usb_submit_transfer(transfer) == LIBUSB_SUCCESS);
+	fail_unless(hooks->usb_cancel_transfer(transfer) == LIBUSB_SUCCESS);
+	fail_unless(hooks->usb_cancel_transfer(transfer)
+		== LIBUSB_ERROR_NOT_FOUND);
+	fail_unless(num_done == 0);
+	handle_events();
+	fail_unless(num_done == 1);
+	fail_unless(done_status[0] == LIBUSB_TRANSFER_CANCELLED);
+
+	fail_unless(hooks->usb_submit_transfer(transfer) == LIBUSB_SUCCESS);
+	for (i = 0; i < 10 && num_done < ARRAY_SIZE(completions) + 1; i++)
+		handle_events();
+	check_completions(1);
+
+	libusb_free_transfer(transfer);
+}
+END_TEST
+
+/*
+ * Control transfers all go to endpoint 0: the recorded ones complete the
+ * transfers with the same request, and their data follows the setup
+ * packet.
+ */
+START_TEST(test_replay_control)
+{
+	struct libusb_transfer *ctrl_in, *ctrl_out, *bulk;
+	struct libusb_control_setup *setup;
+	unsigned char in_buf[LIBUSB_CONTROL_SETUP_SIZE + 8];
+	unsigned char out_buf[LIBUSB_CONTROL_SETUP_SIZE + 2];
+	unsigned char bulk_buf[16];
+	unsigned int i;
+
+	replay_start(ARRAY_AND_SIZE(control_recording), "0");
+
+	ctrl_out = libusb_alloc_transfer(0);
+	libusb_fill_control_setup(out_buf, 0x40, 0xb3, 0, 0, 2);
+	memcpy(out_buf + LIBUSB_CONTROL_SETUP_SIZE, "ab", 2);
+	libusb_fill_control_transfer(ctrl_out, NULL, out_buf,
+			transfer_finished, NULL, 1000);
+	bulk = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(bulk, NULL, EP_IN, bulk_buf,
+			sizeof(bulk_buf), transfer_finished, NULL, 1000);
+	ctrl_in = libusb_alloc_transfer(0);
+	memset(in_buf, 0, sizeof(in_buf));
+	libusb_fill_control_setup(in_buf, 0xc0, 0xb2, 0x0001, 0, 8);
+	libusb_fill_control_transfer(ctrl_in, NULL, in_buf,
+			transfer_finished, NULL, 1000);
+
+	/* Submitted in another order than they complete in. */
+	fail_unless(hooks->usb_submit_transfer(ctrl_out) == LIBUSB_SUCCESS);
+	fail_unless(hooks->usb_submit_transfer(bulk) == LIBUSB_SUCCESS);
+	fail_unless(hooks->usb_submit_transfer(ctrl_in) == LIBUSB_SUCCESS);
+	for (i = 0; i < 10 && num_done < ARRAY_SIZE(control_recording); i++)
+		handle_events();
+	fail_unless(num_done == ARRAY_SIZE(control_recording),
+		"%u transfers completed.", num_done);
+
+	fail_unless(done_transfers[0] == ctrl_in);
+	fail_unless(ctrl_in->status == LIBUSB_TRANSFER_COMPLETED);
+	fail_unless(ctrl_in->actual_length == 3);
+	fail_unless(!memcmp(libusb_control_transfer_get_data(ctrl_in),
+		"xyz", 3));
+	setup = libusb_control_transfer_get_setup(ctrl_in);
+	fail_unless(setup->bmRequestType == 0xc0 && setup->bRequest == 0xb2
+		&& libusb_le16_to_cpu(setup->wLength) == 8,
+		"The setup packet was overwritten.");
+
+	fail_unless(done_transfers[1] == bulk);
+	fail_unless(bulk->actual_length == 4 && !memcmp(bulk_buf, "bulk", 4));
+
+	fail_unless(done_transfers[2] == ctrl_out);
+	fail_unless(ctrl_out->actual_length == 2);
+	fail_unless(!memcmp(out_buf + LIBUSB_CONTROL_SETUP_SIZE, "ab", 2));
+
+	libusb_free_transfer(ctrl_in);
+	libusb_free_transfer(ctrl_out);
+	libusb_free_transfer(bulk);
+}
+END_TEST
+
+static int usb_receive_data(int fd, int revents, void *cb_data)
+{
+	(void)fd;
+	(void)revents;
+	(void)cb_data;
+
+	handle_events();
+
+	return G_SOURCE_CONTINUE;
+}
+
+/*
+ * The USB event source wakes up when a replayed transfer is due, even
+ * though nothing happens on the file descriptors and the driver asked
+ * for a much longer timeout.
+ */
+START_TEST(test_replay_source)
+{
+	struct sr_session *session;
+	struct libusb_transfer *transfer;
+	unsigned char buf[16];
+	int64_t start_us, elapsed_us;
+	unsigned int i;
+
+	replay_start(ARRAY_AND_SIZE(recording), "1");
+
+	fail_unless(sr_session_new(srtest_ctx, &session) == SR_OK);
+	session->main_context = g_main_context_new();
+	fail_unless(hooks->usb_source_add(session, srtest_ctx, 10000,
+			usb_receive_data, NULL) == SR_OK);
+
+	transfer = transfer_new(buf, sizeof(buf));
+	fail_unless(hooks->usb_submit_transfer(transfer) == LIBUSB_SUCCESS);
+	start_us = g_get_monotonic_time();
+	for (i = 0; i < 20 && num_done < ARRAY_SIZE(completions); i++)
+		g_main_context_iteration(session->main_context, TRUE);
+	elapsed_us = g_get_monotonic_time() - start_us;
+	check_completions(0);
+
+	/* Replayed at the recorded pace, without waiting for the timeout. */
+	fail_unless(done_us[2] - done_us[0] >= 100000,
+		"Replayed too fast: %" PRIi64 "us.", done_us[2] - done_us[0]);
+	fail_unless(elapsed_us < 2000000,
+		"Replayed too slowly: %" PRIi64 "us.", elapsed_us);
+
+	fail_unless(hooks->usb_source_remove(session, srtest_ctx) == SR_OK);
+	g_main_context_unref(session->main_context);
+	session->main_context = NULL;
+	fail_unless(sr_session_destroy(session) == SR_OK);
+	libusb_free_transfer(transfer);
+}
+END_TEST
+
+Suite *suite_usb(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("usb");
+
+	tc = tcase_create("replay");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_replay_sync);
+	tcase_add_test(tc, test_replay_async);
+	tcase_add_test(tc, test_replay_cancel);
+	tcase_add_test(tc, test_replay_control);
+	tcase_add_test(tc, test_replay_source);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+#endif